@@ -0,0 +1,248 @@
+/**
+ * @file Capture.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Capture of the inbound frames of the server, in a binary file.
+ */
+
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include "WhatsApp.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def CAPTURE_MAGIC "WACAPT01"
+ * @brief A Macro that sets the magic which starts a capture file.
+ */
+#define CAPTURE_MAGIC "WACAPT01"
+
+/**
+ * @def CAPTURE_MAGIC_LENGTH 8
+ * @brief A Macro that sets the length of the magic of a capture file.
+ */
+#define CAPTURE_MAGIC_LENGTH 8
+
+/**
+ * @def NO_CAPTURE_CONNECTION 0
+ * @brief A Macro that sets the connection of a record of the whole server.
+ */
+#define NO_CAPTURE_CONNECTION 0
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief The kinds of the records of a capture. A hot restart starts a new
+ *        server whose handles are unrelated to those of the old server, so
+ *        the old server records the name of every client it hands off, the
+ *        new server records the start of its capture, and then the new handle
+ *        of every client it takes over.
+ */
+enum CaptureKind : uint8_t
+{
+    FRAME_RECORD,
+    CLOSE_RECORD,
+    HANDOFF_RECORD,
+    START_RECORD,
+    TAKEOVER_RECORD
+};
+
+/**
+ * @brief A single record of a capture. A connection is identified by its
+ *        handle (the socket with the generation of its slot), since sockets
+ *        are reused. The data is the frame of a frame record, and the client
+ *        name of a handoff or a takeover.
+ */
+struct CaptureRecord
+{
+    uint64_t time;
+    uint64_t connection;
+    CaptureKind kind;
+    message_t data;
+};
+
+
+/*-----=  Capture Writer  =-----*/
+
+
+/**
+ * @brief A writer of a capture file. Every record is the time of the record
+ *        in microseconds of the monotonic clock and the handle of its
+ *        connection (8 bytes each), its kind (1 byte) and the length of its
+ *        data (4 bytes), in the byte order of the host, followed by the data.
+ *        The file is appended to, so a server which is hot restarted keeps on
+ *        writing the same capture, and the records are buffered and written
+ *        in large blocks.
+ */
+class CaptureWriter
+{
+public:
+
+    /**
+     * @brief Opens a capture file for appending, starts it with the magic if
+     *        it is a new file, and records the start of the capture.
+     * @param path The path of the file.
+     * @return 0 on success, -1 on failure.
+     */
+    int open(const std::string &path)
+    {
+        _file.open(path, std::ios::binary | std::ios::app | std::ios::ate);
+        if (_file && _file.tellp() == 0)
+        {
+            _file.write(CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH);
+        }
+        _record(START_RECORD, NO_CAPTURE_CONNECTION, EMPTY_MSG);
+        return _file ? SUCCESS_STATE : FAILURE_STATE;
+    }
+
+    /**
+     * @brief Gets whether the capture is open.
+     * @return true if records are captured, false otherwise.
+     */
+    bool capturing() const
+    {
+        return _file.is_open();
+    }
+
+    /**
+     * @brief Records a frame of a connection.
+     * @param connection The handle of the connection.
+     * @param frame The frame, without its terminator.
+     */
+    void frame(const uint64_t connection, const message_t &frame)
+    {
+        _record(FRAME_RECORD, connection, frame);
+    }
+
+    /**
+     * @brief Records the end of a connection.
+     * @param connection The handle of the connection.
+     */
+    void close(const uint64_t connection)
+    {
+        _record(CLOSE_RECORD, connection, EMPTY_MSG);
+    }
+
+    /**
+     * @brief Records a client which is handed off to a new server.
+     * @param connection The handle of the connection of the client.
+     * @param clientName The name of the client.
+     */
+    void handoff(const uint64_t connection, const clientName_t &clientName)
+    {
+        _record(HANDOFF_RECORD, connection, clientName);
+    }
+
+    /**
+     * @brief Records a client which was taken over from an old server.
+     * @param connection The new handle of the connection of the client.
+     * @param clientName The name of the client.
+     */
+    void takeover(const uint64_t connection, const clientName_t &clientName)
+    {
+        _record(TAKEOVER_RECORD, connection, clientName);
+    }
+
+    /**
+     * @brief Writes the buffered records to the file.
+     */
+    void flush()
+    {
+        _file.flush();
+    }
+
+private:
+
+    std::ofstream _file;
+
+    /**
+     * @brief Writes a record.
+     * @param kind The kind of the record.
+     * @param connection The handle of the connection.
+     * @param data The data of the record.
+     */
+    void _record(const CaptureKind kind, const uint64_t connection,
+                 const message_t &data)
+    {
+        auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+        uint64_t time = (uint64_t) std::chrono::duration_cast<
+                std::chrono::microseconds>(elapsed).count();
+        uint32_t length = (uint32_t) data.length();
+        _file.write((const char *) &time, sizeof(time));
+        _file.write((const char *) &connection, sizeof(connection));
+        _file.write((const char *) &kind, sizeof(kind));
+        _file.write((const char *) &length, sizeof(length));
+        _file.write(data.data(), (std::streamsize) length);
+    }
+};
+
+
+/*-----=  Capture Reader  =-----*/
+
+
+/**
+ * @brief A reader of a capture file, which reads its records in order. A
+ *        record which was cut by the end of the file (a server that crashed
+ *        while writing it) ends the capture.
+ */
+class CaptureReader
+{
+public:
+
+    /**
+     * @brief Opens a capture file, and checks its magic.
+     * @param path The path of the file.
+     * @return 0 on success, -1 on failure.
+     */
+    int open(const std::string &path)
+    {
+        char magic[CAPTURE_MAGIC_LENGTH];
+        _file.open(path, std::ios::binary);
+        _file.read(magic, CAPTURE_MAGIC_LENGTH);
+        if (!_file || memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH))
+        {
+            return FAILURE_STATE;
+        }
+        return SUCCESS_STATE;
+    }
+
+    /**
+     * @brief Reads the next record.
+     * @param record The record to fill.
+     * @return true if a record was read, false at the end of the capture.
+     */
+    bool next(CaptureRecord &record)
+    {
+        uint32_t length = 0;
+        _file.read((char *) &record.time, sizeof(record.time));
+        _file.read((char *) &record.connection, sizeof(record.connection));
+        _file.read((char *) &record.kind, sizeof(record.kind));
+        _file.read((char *) &length, sizeof(length));
+        if (!_file)
+        {
+            return false;
+        }
+        record.data.resize(length);
+        _file.read(&record.data[0], (std::streamsize) length);
+        return (bool) _file;
+    }
+
+private:
+
+    std::ifstream _file;
+};
+
+#endif
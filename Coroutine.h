@@ -0,0 +1,335 @@
+/**
+ * @file Coroutine.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief Coroutines of the connections of an event loop, with pooled frames.
+ */
+
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <vector>
+#include <utility>
+#include <exception>
+#include <coroutine>
+#include "WhatsApp.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def FRAME_ALIGNMENT 64
+ * @brief A Macro that sets the granularity of the sizes of pooled frames.
+ */
+#define FRAME_ALIGNMENT 64
+
+/**
+ * @def POOLED_FRAME_CLASSES 16
+ * @brief A Macro that sets the number of pooled frame sizes, so frames of up
+ *        to POOLED_FRAME_CLASSES * FRAME_ALIGNMENT bytes are pooled.
+ */
+#define POOLED_FRAME_CLASSES 16
+
+
+/*-----=  Frame Pool  =-----*/
+
+
+/**
+ * @brief A pool of the frames of coroutines. The frames are kept in a free
+ *        list for each size class, so a coroutine of the loop allocates its
+ *        frame from the heap only until the pool holds as many frames as the
+ *        coroutines which ever lived together, and a released frame is pushed
+ *        into its list in place without any allocation. The pool belongs to
+ *        the thread of its loop and is not synchronized.
+ */
+class FramePool
+{
+public:
+
+    /**
+     * @brief Allocates a frame.
+     * @param size The size of the frame in bytes.
+     * @return The frame.
+     */
+    static void *allocate(const size_t size)
+    {
+        size_t sizeClass = _sizeClass(size);
+        if (sizeClass >= POOLED_FRAME_CLASSES)
+        {
+            return ::operator new(size);
+        }
+        _FreeFrame *frame = _freeFrames[sizeClass];
+        if (frame == nullptr)
+        {
+            return ::operator new((sizeClass + 1) * FRAME_ALIGNMENT);
+        }
+        _freeFrames[sizeClass] = frame->next;
+        return frame;
+    }
+
+    /**
+     * @brief Releases a frame into the pool.
+     * @param frame The frame to release.
+     * @param size The size of the frame in bytes, as it was allocated.
+     */
+    static void release(void *frame, const size_t size)
+    {
+        size_t sizeClass = _sizeClass(size);
+        if (sizeClass >= POOLED_FRAME_CLASSES)
+        {
+            ::operator delete(frame);
+            return;
+        }
+        _FreeFrame *freeFrame = static_cast<_FreeFrame *>(frame);
+        freeFrame->next = _freeFrames[sizeClass];
+        _freeFrames[sizeClass] = freeFrame;
+    }
+
+private:
+
+    /**
+     * @brief A released frame, which links the next frame of its list.
+     */
+    struct _FreeFrame
+    {
+        _FreeFrame *next;
+    };
+
+    static inline _FreeFrame *_freeFrames[POOLED_FRAME_CLASSES] = {};
+
+    /**
+     * @brief Gets the size class of a frame.
+     * @param size The size of the frame in bytes.
+     * @return The size class.
+     */
+    static size_t _sizeClass(const size_t size)
+    {
+        return size == 0 ? 0 : (size - 1) / FRAME_ALIGNMENT;
+    }
+};
+
+
+/*-----=  Connection Task  =-----*/
+
+
+/**
+ * @brief A coroutine which runs the protocol of a single connection as
+ *        straight-line code over the event loop. The coroutine runs as soon as
+ *        it is created until it waits for its first frame, and it is resumed
+ *        by the loop whenever its connection has new input. The task owns the
+ *        frame of its coroutine, and destroys it with the task.
+ */
+class ConnectionTask
+{
+public:
+
+    /**
+     * @brief The promise of the coroutine of a task.
+     */
+    struct promise_type
+    {
+        ConnectionTask get_return_object()
+        {
+            return ConnectionTask(
+                    std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        // The task destroys the frame, so the coroutine stops at its end.
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+
+        static void *operator new(const size_t size)
+        {
+            return FramePool::allocate(size);
+        }
+
+        static void operator delete(void *frame, const size_t size)
+        {
+            FramePool::release(frame, size);
+        }
+    };
+
+    /**
+     * @brief Constructs a new task without a coroutine.
+     */
+    ConnectionTask() : _handle(nullptr)
+    {
+    }
+
+    /**
+     * @brief Moves a task, which leaves the other task without a coroutine.
+     * @param other The task to move.
+     */
+    ConnectionTask(ConnectionTask &&other) noexcept
+            : _handle(std::exchange(other._handle, nullptr))
+    {
+    }
+
+    /**
+     * @brief Moves a task in place of this task, whose coroutine is destroyed.
+     * @param other The task to move.
+     * @return This task.
+     */
+    ConnectionTask &operator=(ConnectionTask &&other) noexcept
+    {
+        if (this != &other)
+        {
+            _destroy();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Destroys the task and its coroutine.
+     */
+    ~ConnectionTask()
+    {
+        _destroy();
+    }
+
+    /**
+     * @brief Gets whether the task has a coroutine.
+     * @return true if the coroutine was started, false otherwise.
+     */
+    bool started() const
+    {
+        return (bool) _handle;
+    }
+
+    /**
+     * @brief Gets whether the coroutine of the task has ended.
+     * @return true if the coroutine ended or was never started, false
+     *         otherwise.
+     */
+    bool done() const
+    {
+        return !_handle || _handle.done();
+    }
+
+    /**
+     * @brief Resumes the coroutine of the task, if it did not end.
+     */
+    void resume()
+    {
+        if (!done())
+        {
+            _handle.resume();
+        }
+    }
+
+private:
+
+    std::coroutine_handle<promise_type> _handle;
+
+    /**
+     * @brief Constructs a new task of a coroutine.
+     * @param handle The handle of the coroutine.
+     */
+    explicit ConnectionTask(std::coroutine_handle<promise_type> handle)
+            : _handle(handle)
+    {
+    }
+
+    /**
+     * @brief Destroys the coroutine of the task.
+     */
+    void _destroy()
+    {
+        if (_handle)
+        {
+            _handle.destroy();
+            _handle = nullptr;
+        }
+    }
+
+    ConnectionTask(const ConnectionTask &) = delete;
+    ConnectionTask &operator=(const ConnectionTask &) = delete;
+};
+
+
+/*-----=  Frame Awaiter  =-----*/
+
+
+/**
+ * @brief An awaiter of the next frame of a connection, which is a message
+ *        ended with the message terminator. The coroutine does not suspend if
+ *        the frame was already read. The input buffer is given by its table
+ *        and socket, since the table may grow while the coroutine waits.
+ *        A coroutine which is resumed while its frame is incomplete wakes up
+ *        without a frame, which is how the loop tells it that the connection
+ *        should be closed.
+ */
+class FrameAwaiter
+{
+public:
+
+    /**
+     * @brief Constructs a new awaiter of the next frame of a connection.
+     * @param buffers The input buffers of the connections.
+     * @param socket The socket of the connection.
+     * @param frame The frame to fill once it arrives.
+     */
+    FrameAwaiter(std::vector<message_t> &buffers, const int socket,
+                 message_t &frame)
+            : _buffers(buffers), _socket(socket), _frame(frame)
+    {
+    }
+
+    bool await_ready() const
+    {
+        return _buffers[_socket].find(MSG_TERMINATOR) != std::string::npos;
+    }
+
+    void await_suspend(std::coroutine_handle<>) const
+    {
+    }
+
+    /**
+     * @brief Takes the frame from the input buffer.
+     * @return true if the frame arrived, false if the connection should be
+     *         closed.
+     */
+    bool await_resume()
+    {
+        message_t &buffer = _buffers[_socket];
+        auto frameEnd = buffer.find(MSG_TERMINATOR);
+        if (frameEnd == std::string::npos)
+        {
+            return false;
+        }
+        _frame = buffer.substr(MSG_BEGIN_INDEX, frameEnd);
+        buffer.erase(MSG_BEGIN_INDEX, frameEnd + 1);
+        return true;
+    }
+
+private:
+
+    std::vector<message_t> &_buffers;
+    int _socket;
+    message_t &_frame;
+};
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * @file DedupWindow.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Deduplication Window of the recent message IDs of a single sender.
+ */
+
+
+#ifndef DEDUP_WINDOW_H
+#define DEDUP_WINDOW_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <vector>
+#include <cstdint>
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def DEDUP_WINDOW_CAPACITY 64
+ * @brief A Macro that sets the maximal number of IDs kept in a single window.
+ */
+#define DEDUP_WINDOW_CAPACITY 64
+
+
+/*-----=  Deduplication Window  =-----*/
+
+
+/**
+ * @brief A deduplication window of the IDs of the recent messages of a single
+ *        sender. The window is a ring of the hashes of the IDs with the time
+ *        they were seen, so it is bounded both in time and in size: an ID is
+ *        forgotten once its time has passed or once the ring has wrapped
+ *        around it. The ring grows only up to its capacity, so a sender which
+ *        rarely sends keeps only a few entries, and a lookup is a scan of at
+ *        most DEDUP_WINDOW_CAPACITY entries which are contiguous in memory.
+ */
+class DedupWindow
+{
+public:
+
+    /**
+     * @brief Constructs a new empty window.
+     */
+    DedupWindow() : _next(0)
+    {
+    }
+
+    /**
+     * @brief Checks if the given ID was seen within the window.
+     * @param idHash The hash of the ID.
+     * @param now The current time in milliseconds.
+     * @param windowLength The length of the window in milliseconds.
+     * @return true if the ID was seen, false otherwise.
+     */
+    bool contains(const uint64_t idHash, const uint64_t now,
+                  const uint64_t windowLength) const
+    {
+        for (const _Entry &entry : _entries)
+        {
+            if (entry.idHash == idHash && entry.time + windowLength > now)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Adds an ID to the window, in place of the oldest ID if the window
+     *        is full.
+     * @param idHash The hash of the ID.
+     * @param now The current time in milliseconds.
+     */
+    void insert(const uint64_t idHash, const uint64_t now)
+    {
+        if (_entries.size() < DEDUP_WINDOW_CAPACITY)
+        {
+            _entries.push_back({idHash, now});
+            return;
+        }
+        _entries[_next] = {idHash, now};
+        _next = (_next + 1) % DEDUP_WINDOW_CAPACITY;
+    }
+
+    /**
+     * @brief Gets the number of IDs in the window, from the oldest.
+     * @return The number of IDs.
+     */
+    size_t size() const
+    {
+        return _entries.size();
+    }
+
+    /**
+     * @brief Gets the memory held by the window.
+     * @return The number of bytes of the entries of the window.
+     */
+    size_t bytes() const
+    {
+        return _entries.capacity() * sizeof(_Entry);
+    }
+
+    /**
+     * @brief Gets the ID in the given position, where 0 is the oldest.
+     * @param position The position of the ID.
+     * @param idHash The hash of the ID.
+     * @param time The time the ID was seen.
+     */
+    void at(const size_t position, uint64_t &idHash, uint64_t &time) const
+    {
+        const _Entry &entry = _entries[(_next + position) % _entries.size()];
+        idHash = entry.idHash;
+        time = entry.time;
+    }
+
+private:
+
+    /**
+     * @brief A single ID in the window.
+     */
+    struct _Entry
+    {
+        uint64_t idHash;
+        uint64_t time;
+    };
+
+    std::vector<_Entry> _entries;
+    size_t _next;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file HashRing.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Consistent Hash Ring for the ownership of names between servers.
+ */
+
+
+#ifndef HASH_RING_H
+#define HASH_RING_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <map>
+#include <string>
+#include <cstdint>
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def VIRTUAL_NODES 64
+ * @brief A Macro that sets the number of points of a single node in the ring.
+ */
+#define VIRTUAL_NODES 64
+
+/**
+ * @def VIRTUAL_NODE_SEP "#"
+ * @brief A Macro that sets the separator between a node and its point index.
+ */
+#define VIRTUAL_NODE_SEP "#"
+
+/**
+ * @def FNV_OFFSET_BASIS 14695981039346656037ULL
+ * @brief A Macro that sets the offset basis of the 64 bit FNV-1a hash.
+ */
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+
+/**
+ * @def FNV_PRIME 1099511628211ULL
+ * @brief A Macro that sets the prime of the 64 bit FNV-1a hash.
+ */
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * @def FMIX_SHIFT 33
+ * @brief A Macro that sets the shift of the final mix of a hash.
+ */
+#define FMIX_SHIFT 33
+
+/**
+ * @def FMIX_FIRST_MULTIPLIER 0xff51afd7ed558ccdULL
+ * @brief A Macro that sets the first multiplier of the final mix of a hash.
+ */
+#define FMIX_FIRST_MULTIPLIER 0xff51afd7ed558ccdULL
+
+/**
+ * @def FMIX_SECOND_MULTIPLIER 0xc4ceb9fe1a85ec53ULL
+ * @brief A Macro that sets the second multiplier of the final mix of a hash.
+ */
+#define FMIX_SECOND_MULTIPLIER 0xc4ceb9fe1a85ec53ULL
+
+/**
+ * @def NO_NODE -1
+ * @brief A Macro that sets the node of an empty ring.
+ */
+#define NO_NODE -1
+
+
+/*-----=  Hash Ring  =-----*/
+
+
+/**
+ * @brief A consistent hash ring. Every node is placed in several points of
+ *        the ring, and a name is owned by the node of the first point that
+ *        follows the hash of the name. All the servers build the same ring
+ *        from the same node IDs, so they all agree on the owner of a name,
+ *        and adding a node moves only the names of its own points.
+ */
+class HashRing
+{
+public:
+
+    /**
+     * @brief Adds a node to the ring.
+     * @param nodeID The ID of the node (the same in all the servers).
+     * @param node The local index of the node, returned as the owner.
+     */
+    void addNode(const std::string &nodeID, const int node)
+    {
+        for (int i = 0; i < VIRTUAL_NODES; ++i)
+        {
+            _points[hash(nodeID + VIRTUAL_NODE_SEP + std::to_string(i))] = node;
+        }
+    }
+
+    /**
+     * @brief Gets the owner node of the given name.
+     * @param name The name to look up.
+     * @return The index of the owner node, or NO_NODE if the ring is empty.
+     */
+    int ownerOf(const std::string &name) const
+    {
+        if (_points.empty())
+        {
+            return NO_NODE;
+        }
+        auto i = _points.lower_bound(hash(name));
+        if (i == _points.end())
+        {
+            // The ring wraps around to its first point.
+            i = _points.begin();
+        }
+        return i->second;
+    }
+
+    /**
+     * @brief Hashes the given string with the 64 bit FNV-1a hash, followed by
+     *        a final mix so similar strings are spread over the entire ring.
+     * @param data The string to hash.
+     * @return The hash of the string.
+     */
+    static uint64_t hash(const std::string &data)
+    {
+        uint64_t result = FNV_OFFSET_BASIS;
+        for (unsigned char c : data)
+        {
+            result ^= c;
+            result *= FNV_PRIME;
+        }
+        result ^= result >> FMIX_SHIFT;
+        result *= FMIX_FIRST_MULTIPLIER;
+        result ^= result >> FMIX_SHIFT;
+        result *= FMIX_SECOND_MULTIPLIER;
+        result ^= result >> FMIX_SHIFT;
+        return result;
+    }
+
+private:
+
+    std::map<uint64_t, int> _points;
+};
+
+#endif
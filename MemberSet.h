@@ -0,0 +1,676 @@
+/**
+ * @file MemberSet.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Set of the members of a group, as a compressed bitmap when large.
+ */
+
+
+#ifndef MEMBER_SET_H
+#define MEMBER_SET_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def SMALL_SET_CAPACITY 16
+ * @brief A Macro that sets the number of members kept in the inline array of
+ *        a small set.
+ */
+#define SMALL_SET_CAPACITY 16
+
+/**
+ * @def CONTAINER_BITS 16
+ * @brief A Macro that sets the number of low bits of a member ID which are
+ *        kept in its container, while the high bits are the container key.
+ */
+#define CONTAINER_BITS 16
+
+/**
+ * @def CONTAINER_MASK 0xFFFF
+ * @brief A Macro that sets the mask of the low bits of a member ID.
+ */
+#define CONTAINER_MASK 0xFFFF
+
+/**
+ * @def ARRAY_CONTAINER_CAPACITY 4096
+ * @brief A Macro that sets the maximal number of members of an array
+ *        container, above which the array takes more memory than a bitmap.
+ */
+#define ARRAY_CONTAINER_CAPACITY 4096
+
+/**
+ * @def WORD_BITS 64
+ * @brief A Macro that sets the number of bits in a word of a bitmap.
+ */
+#define WORD_BITS 64
+
+/**
+ * @def BITMAP_WORDS 1024
+ * @brief A Macro that sets the number of words of a bitmap container.
+ */
+#define BITMAP_WORDS 1024
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief Type Definition for the ID of a member, which should be dense (like
+ *        the index of a connection table) for the bitmaps to be compact.
+ */
+typedef uint32_t memberID_t;
+
+
+/*-----=  Member Set  =-----*/
+
+
+/**
+ * @brief A set of member IDs. A small set is a sorted inline array, and once
+ *        it outgrows the array it turns into a compressed bitmap in the
+ *        manner of roaring bitmaps: the IDs are split by their high bits into
+ *        containers, each of them a sorted array of the low bits while it is
+ *        sparse or a bitmap of all the low bits once it is dense. Membership
+ *        is a binary search or a single bit test, and the members are iterated
+ *        in ascending order. A large set turns back into an inline array once
+ *        it shrinks to half of the array. Two large sets are intersected
+ *        container by container, so the containers of one set whose keys the
+ *        other set does not have are skipped at once, and two bitmaps are
+ *        intersected a word at a time. A change of the set invalidates its
+ *        iterators.
+ */
+class MemberSet
+{
+public:
+
+    /**
+     * @brief An iterator over the members of a set, in ascending order.
+     */
+    class Iterator
+    {
+    public:
+
+        memberID_t operator*() const
+        {
+            return _member;
+        }
+
+        Iterator &operator++()
+        {
+            ++_position;
+            _settle();
+            return *this;
+        }
+
+        bool operator==(const Iterator &other) const
+        {
+            return _container == other._container
+                   && _position == other._position;
+        }
+
+        bool operator!=(const Iterator &other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+
+        friend class MemberSet;
+
+        const MemberSet *_set;
+        size_t _container;
+        size_t _position;
+        memberID_t _member;
+
+        /**
+         * @brief Constructs a new iterator.
+         * @param set The set to iterate.
+         * @param container The index of the container.
+         * @param position The position inside the container, which is a bit
+         *        of a bitmap container, or an index of an array.
+         */
+        Iterator(const MemberSet *set, const size_t container,
+                 const size_t position)
+                : _set(set), _container(container), _position(position),
+                  _member(0)
+        {
+            _settle();
+        }
+
+        /**
+         * @brief Moves the iterator from its position to the first member at
+         *        or after it, or to the end of the set.
+         */
+        void _settle()
+        {
+            if (!_set->_large)
+            {
+                if (_position < _set->_size)
+                {
+                    _member = _set->_small[_position];
+                }
+                return;
+            }
+            for (; _container < _set->_containers.size(); ++_container)
+            {
+                const _Container &container = _set->_containers[_container];
+                if (container.bitmap.empty()
+                    && _position < container.array.size())
+                {
+                    _member = container.member(container.array[_position]);
+                    return;
+                }
+                if (!container.bitmap.empty()
+                    && _set->_nextBit(container, _position))
+                {
+                    _member = container.member((uint16_t) _position);
+                    return;
+                }
+                _position = 0;
+            }
+        }
+    };
+
+    /**
+     * @brief Constructs a new empty set.
+     */
+    MemberSet() : _large(false), _size(0)
+    {
+    }
+
+    /**
+     * @brief Gets the number of members.
+     * @return The number of members.
+     */
+    size_t size() const
+    {
+        return _size;
+    }
+
+    /**
+     * @brief Gets whether the set is empty.
+     * @return true if the set has no members, false otherwise.
+     */
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    /**
+     * @brief Determine if a member is in the set.
+     * @param member The member ID.
+     * @return true if the member is in the set, false otherwise.
+     */
+    bool contains(const memberID_t member) const
+    {
+        if (!_large)
+        {
+            return std::binary_search(_small, _small + _size, member);
+        }
+        uint16_t key = _key(member);
+        size_t index = _findContainer(key);
+        if (index == _containers.size() || _containers[index].key != key)
+        {
+            return false;
+        }
+        return _containerContains(_containers[index],
+                                  (uint16_t) (member & CONTAINER_MASK));
+    }
+
+    /**
+     * @brief Adds a member to the set.
+     * @param member The member ID.
+     * @return true if the member was added, false if it was in the set.
+     */
+    bool insert(const memberID_t member)
+    {
+        if (!_large)
+        {
+            memberID_t *position = std::lower_bound(_small, _small + _size,
+                                                    member);
+            if (position != _small + _size && *position == member)
+            {
+                return false;
+            }
+            if (_size < SMALL_SET_CAPACITY)
+            {
+                std::copy_backward(position, _small + _size,
+                                   _small + _size + 1);
+                *position = member;
+                ++_size;
+                return true;
+            }
+            _growLarge();
+        }
+        if (!_insertLarge(member))
+        {
+            return false;
+        }
+        ++_size;
+        return true;
+    }
+
+    /**
+     * @brief Removes a member from the set.
+     * @param member The member ID.
+     * @return true if the member was removed, false if it was not in the set.
+     */
+    bool erase(const memberID_t member)
+    {
+        if (!_large)
+        {
+            memberID_t *position = std::lower_bound(_small, _small + _size,
+                                                    member);
+            if (position == _small + _size || *position != member)
+            {
+                return false;
+            }
+            std::copy(position + 1, _small + _size, position);
+            --_size;
+            return true;
+        }
+        if (!_eraseLarge(member))
+        {
+            return false;
+        }
+        if (--_size <= SMALL_SET_CAPACITY / 2)
+        {
+            _shrinkSmall();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Adds all the members of another set to the set.
+     * @param other The other set.
+     */
+    void unite(const MemberSet &other)
+    {
+        for (memberID_t member : other)
+        {
+            insert(member);
+        }
+    }
+
+    /**
+     * @brief Gets the members which are in both the set and another set.
+     * @param other The other set.
+     * @return The set of the common members.
+     */
+    MemberSet intersection(const MemberSet &other) const
+    {
+        MemberSet common;
+        if (!_large || !other._large)
+        {
+            // The members of the small set are looked up in the other one.
+            const MemberSet &small = _large ? other : *this;
+            const MemberSet &large = _large ? *this : other;
+            for (memberID_t member : small)
+            {
+                if (large.contains(member))
+                {
+                    common._small[common._size++] = member;
+                }
+            }
+            return common;
+        }
+
+        common._large = true;
+        size_t j = 0;
+        for (const _Container &container : _containers)
+        {
+            while (j < other._containers.size()
+                   && other._containers[j].key < container.key)
+            {
+                ++j;
+            }
+            if (j == other._containers.size())
+            {
+                break;
+            }
+            if (other._containers[j].key != container.key)
+            {
+                continue;
+            }
+            _Container both = _intersectContainers(container,
+                                                   other._containers[j]);
+            if (both.cardinality > 0)
+            {
+                common._size += both.cardinality;
+                common._containers.push_back(std::move(both));
+            }
+        }
+        if (common._size <= SMALL_SET_CAPACITY)
+        {
+            common._shrinkSmall();
+        }
+        return common;
+    }
+
+    /**
+     * @brief Removes all the members.
+     */
+    void clear()
+    {
+        std::vector<_Container>().swap(_containers);
+        _large = false;
+        _size = 0;
+    }
+
+    /**
+     * @brief Gets an iterator to the smallest member.
+     * @return The iterator.
+     */
+    Iterator begin() const
+    {
+        return Iterator(this, 0, 0);
+    }
+
+    /**
+     * @brief Gets an iterator past the largest member.
+     * @return The iterator.
+     */
+    Iterator end() const
+    {
+        if (!_large)
+        {
+            return Iterator(this, 0, _size);
+        }
+        return Iterator(this, _containers.size(), 0);
+    }
+
+private:
+
+    /**
+     * @brief A container of the members which share the high bits of their
+     *        IDs. The low bits are kept in a sorted array, or in a bitmap if
+     *        the bitmap is not empty.
+     */
+    struct _Container
+    {
+        uint16_t key;
+        size_t cardinality;
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bitmap;
+
+        memberID_t member(const uint16_t low) const
+        {
+            return ((memberID_t) key << CONTAINER_BITS) | low;
+        }
+    };
+
+    bool _large;
+    size_t _size;
+    memberID_t _small[SMALL_SET_CAPACITY];
+    std::vector<_Container> _containers;
+
+    /**
+     * @brief Gets the container key of a member.
+     * @param member The member ID.
+     * @return The container key.
+     */
+    static uint16_t _key(const memberID_t member)
+    {
+        return (uint16_t) (member >> CONTAINER_BITS);
+    }
+
+    /**
+     * @brief Finds the first container whose key is not smaller than a key.
+     * @param key The container key.
+     * @return The index of the container, or the number of containers.
+     */
+    size_t _findContainer(const uint16_t key) const
+    {
+        size_t low = 0;
+        size_t high = _containers.size();
+        while (low < high)
+        {
+            size_t middle = (low + high) / 2;
+            if (_containers[middle].key < key)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    /**
+     * @brief Finds the first set bit of a bitmap container at or after a bit.
+     * @param container The bitmap container.
+     * @param bit The bit to start from, which is set to the found bit.
+     * @return true if a set bit was found, false otherwise.
+     */
+    static bool _nextBit(const _Container &container, size_t &bit)
+    {
+        size_t word = bit / WORD_BITS;
+        if (word >= BITMAP_WORDS)
+        {
+            return false;
+        }
+        uint64_t bits = container.bitmap[word] & (~0ULL << (bit % WORD_BITS));
+        while (bits == 0)
+        {
+            if (++word == BITMAP_WORDS)
+            {
+                return false;
+            }
+            bits = container.bitmap[word];
+        }
+        bit = word * WORD_BITS + (size_t) __builtin_ctzll(bits);
+        return true;
+    }
+
+    /**
+     * @brief Determine if the low bits of a member are in a container.
+     * @param container The container.
+     * @param low The low bits of the member ID.
+     * @return true if the member is in the container, false otherwise.
+     */
+    static bool _containerContains(const _Container &container,
+                                   const uint16_t low)
+    {
+        if (container.bitmap.empty())
+        {
+            return std::binary_search(container.array.begin(),
+                                      container.array.end(), low);
+        }
+        return (container.bitmap[low / WORD_BITS] >> (low % WORD_BITS)) & 1;
+    }
+
+    /**
+     * @brief Intersects two containers of the same key. The common members of
+     *        an array are at most as many as its members, so they are an
+     *        array, and the common members of two bitmaps are a bitmap unless
+     *        they are few enough for an array.
+     * @param first The first container.
+     * @param second The second container.
+     * @return The container of the common members.
+     */
+    static _Container _intersectContainers(const _Container &first,
+                                           const _Container &second)
+    {
+        _Container both;
+        both.key = first.key;
+        both.cardinality = 0;
+        if (first.bitmap.empty() || second.bitmap.empty())
+        {
+            const _Container &array = first.bitmap.empty() ? first : second;
+            const _Container &other = first.bitmap.empty() ? second : first;
+            for (uint16_t low : array.array)
+            {
+                if (_containerContains(other, low))
+                {
+                    both.array.push_back(low);
+                }
+            }
+            both.cardinality = both.array.size();
+            return both;
+        }
+
+        both.bitmap.assign(BITMAP_WORDS, 0);
+        for (size_t word = 0; word < BITMAP_WORDS; ++word)
+        {
+            both.bitmap[word] = first.bitmap[word] & second.bitmap[word];
+            both.cardinality += (size_t) __builtin_popcountll(
+                    both.bitmap[word]);
+        }
+        if (both.cardinality <= ARRAY_CONTAINER_CAPACITY)
+        {
+            // A sparse container takes less memory as an array.
+            for (size_t value = 0; _nextBit(both, value); ++value)
+            {
+                both.array.push_back((uint16_t) value);
+            }
+            std::vector<uint64_t>().swap(both.bitmap);
+        }
+        return both;
+    }
+
+    /**
+     * @brief Adds a member to the containers.
+     * @param member The member ID.
+     * @return true if the member was added, false if it was in the set.
+     */
+    bool _insertLarge(const memberID_t member)
+    {
+        uint16_t key = _key(member);
+        uint16_t low = (uint16_t) (member & CONTAINER_MASK);
+        size_t index = _findContainer(key);
+        if (index == _containers.size() || _containers[index].key != key)
+        {
+            _Container container;
+            container.key = key;
+            container.cardinality = 0;
+            _containers.insert(_containers.begin() + index, container);
+        }
+        _Container &container = _containers[index];
+
+        if (!container.bitmap.empty())
+        {
+            uint64_t &word = container.bitmap[low / WORD_BITS];
+            uint64_t bit = 1ULL << (low % WORD_BITS);
+            if (word & bit)
+            {
+                return false;
+            }
+            word |= bit;
+            ++container.cardinality;
+            return true;
+        }
+
+        auto position = std::lower_bound(container.array.begin(),
+                                         container.array.end(), low);
+        if (position != container.array.end() && *position == low)
+        {
+            return false;
+        }
+        container.array.insert(position, low);
+        if (++container.cardinality > ARRAY_CONTAINER_CAPACITY)
+        {
+            // A dense container takes less memory as a bitmap.
+            container.bitmap.assign(BITMAP_WORDS, 0);
+            for (uint16_t value : container.array)
+            {
+                container.bitmap[value / WORD_BITS] |= 1ULL
+                                                       << (value % WORD_BITS);
+            }
+            std::vector<uint16_t>().swap(container.array);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Removes a member from the containers.
+     * @param member The member ID.
+     * @return true if the member was removed, false if it was not in the set.
+     */
+    bool _eraseLarge(const memberID_t member)
+    {
+        uint16_t key = _key(member);
+        uint16_t low = (uint16_t) (member & CONTAINER_MASK);
+        size_t index = _findContainer(key);
+        if (index == _containers.size() || _containers[index].key != key)
+        {
+            return false;
+        }
+        _Container &container = _containers[index];
+
+        if (container.bitmap.empty())
+        {
+            auto position = std::lower_bound(container.array.begin(),
+                                             container.array.end(), low);
+            if (position == container.array.end() || *position != low)
+            {
+                return false;
+            }
+            container.array.erase(position);
+        }
+        else
+        {
+            uint64_t &word = container.bitmap[low / WORD_BITS];
+            uint64_t bit = 1ULL << (low % WORD_BITS);
+            if (!(word & bit))
+            {
+                return false;
+            }
+            word &= ~bit;
+            if (container.cardinality - 1 == ARRAY_CONTAINER_CAPACITY)
+            {
+                // A sparse container takes less memory as an array.
+                for (size_t value = 0; _nextBit(container, value); ++value)
+                {
+                    container.array.push_back((uint16_t) value);
+                }
+                std::vector<uint64_t>().swap(container.bitmap);
+            }
+        }
+
+        if (--container.cardinality == 0)
+        {
+            _containers.erase(_containers.begin() + index);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Turns the full inline array into containers.
+     */
+    void _growLarge()
+    {
+        _large = true;
+        for (size_t i = 0; i < _size; ++i)
+        {
+            _insertLarge(_small[i]);
+        }
+    }
+
+    /**
+     * @brief Turns the containers into an inline array.
+     */
+    void _shrinkSmall()
+    {
+        size_t size = 0;
+        for (memberID_t member : *this)
+        {
+            _small[size++] = member;
+        }
+        std::vector<_Container>().swap(_containers);
+        _large = false;
+    }
+};
+
+#endif
@@ -0,0 +1,451 @@
+/**
+ * @file SharedChannel.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Shared Memory Channel between the server and a co-located client.
+ */
+
+
+#ifndef SHARED_CHANNEL_H
+#define SHARED_CHANNEL_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <atomic>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "WhatsApp.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def SHARED_RING_SIZE 65536
+ * @brief A Macro that sets the bytes of a single ring (a power of two).
+ */
+#define SHARED_RING_SIZE 65536
+
+/**
+ * @def CACHE_LINE_SIZE 64
+ * @brief A Macro that sets the size of a cache line, which separates the
+ *        indices of the producer and the consumer of a ring.
+ */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @def SHARED_MEMORY_NAME "whatsapp"
+ * @brief A Macro that sets the name of the memory of a channel.
+ */
+#define SHARED_MEMORY_NAME "whatsapp"
+
+/**
+ * @def SHARED_CHANNEL_DESCRIPTORS 3
+ * @brief A Macro that sets the number of descriptors passed to a client: the
+ *        memory, the doorbell of the client and the doorbell of the server.
+ */
+#define SHARED_CHANNEL_DESCRIPTORS 3
+
+/**
+ * @def NO_DESCRIPTOR -1
+ * @brief A Macro that sets the descriptor of a channel which is not open.
+ */
+#define NO_DESCRIPTOR -1
+
+/**
+ * @def DOORBELL_RING 1
+ * @brief A Macro that sets the value written to a doorbell to wake its owner.
+ */
+#define DOORBELL_RING 1
+
+
+/*-----=  Shared Ring  =-----*/
+
+
+/**
+ * @brief A single producer single consumer ring of bytes in shared memory.
+ *        The producer and the consumer each own one index, which only grows
+ *        (and wraps around), so the ring needs no lock.
+ *        A consumer which emptied the ring goes to sleep on its doorbell, and
+ *        the producer rings it only when the ring was empty before its data
+ *        was published. A producer which found the ring full marks that it
+ *        waits, and the consumer rings it once it frees space. Both sides
+ *        publish their index before they check the index of the other side,
+ *        with a full fence between them, so a wakeup is never lost.
+ *        A new shared memory is filled with zeros, which is an empty ring.
+ *        The indices are in memory the other side may write anything into, so
+ *        each side loads them once per step and copies only after it checked
+ *        that the ring holds at most its size.
+ *        A consumer reads a bounded chunk at a time, so a producer which keeps
+ *        writing can not hold it, and it learns whether data is left behind
+ *        (which the producer will not ring for).
+ */
+class SharedRing
+{
+public:
+
+    /**
+     * @brief Writes as much as possible of the given data into the ring.
+     * @param data The data to write.
+     * @param length The length of the data.
+     * @param wakeConsumer Set to true if the consumer should be woken.
+     * @return The number of bytes written, or -1 if the indices are corrupt.
+     */
+    ssize_t push(const char *data, const size_t length, bool &wakeConsumer)
+    {
+        size_t written = 0;
+        wakeConsumer = false;
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        while (written < length)
+        {
+            uint32_t head = _head.load(std::memory_order_acquire);
+            if (tail - head > SHARED_RING_SIZE)
+            {
+                return FAILURE_STATE;
+            }
+            uint32_t space = SHARED_RING_SIZE - (tail - head);
+            if (space == 0)
+            {
+                // Wait for the consumer, unless it freed space meanwhile.
+                _producerWaiting.store(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (_head.load(std::memory_order_relaxed) == head)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            uint32_t count = (uint32_t) std::min((size_t) space,
+                                                 length - written);
+            _copyIn(tail, data + written, count);
+            _tail.store(tail + count, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_head.load(std::memory_order_relaxed) == tail)
+            {
+                // The consumer has read everything before this data.
+                wakeConsumer = true;
+            }
+            tail += count;
+            written += count;
+        }
+        return (ssize_t) written;
+    }
+
+    /**
+     * @brief Reads the data of the ring, up to the given limit.
+     * @param buffer The buffer to append the data into.
+     * @param limit The maximal number of bytes to read.
+     * @param wakeProducer Set to true if the producer should be woken.
+     * @param pending Set to true if the ring was left with data.
+     * @return The number of bytes read, or -1 if the indices are corrupt.
+     */
+    ssize_t pop(std::string &buffer, const size_t limit, bool &wakeProducer,
+                bool &pending)
+    {
+        wakeProducer = false;
+        pending = false;
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        if (tail - head > SHARED_RING_SIZE)
+        {
+            return FAILURE_STATE;
+        }
+        uint32_t count = (uint32_t) std::min((size_t) (tail - head), limit);
+        if (count == 0)
+        {
+            return 0;
+        }
+        _copyOut(head, count, buffer);
+        head += count;
+        _head.store(head, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Data published after the load of the tail did not ring either.
+        pending = _tail.load(std::memory_order_relaxed) != head;
+        wakeProducer = _producerWaiting.exchange(0) != 0;
+        return (ssize_t) count;
+    }
+
+private:
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> _head;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> _tail;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> _producerWaiting;
+    alignas(CACHE_LINE_SIZE) char _data[SHARED_RING_SIZE];
+
+    /**
+     * @brief Copies data into the ring from the given index, around its end.
+     * @param index The index to copy into.
+     * @param data The data to copy.
+     * @param count The number of bytes to copy.
+     */
+    void _copyIn(const uint32_t index, const char *data, const uint32_t count)
+    {
+        uint32_t offset = index % SHARED_RING_SIZE;
+        uint32_t first = std::min(count, SHARED_RING_SIZE - offset);
+        memcpy(_data + offset, data, first);
+        memcpy(_data, data + first, count - first);
+    }
+
+    /**
+     * @brief Copies data out of the ring from the given index, around its end.
+     * @param index The index to copy from.
+     * @param count The number of bytes to copy.
+     * @param buffer The buffer to append the data into.
+     */
+    void _copyOut(const uint32_t index, const uint32_t count,
+                  std::string &buffer) const
+    {
+        uint32_t offset = index % SHARED_RING_SIZE;
+        uint32_t first = std::min(count, SHARED_RING_SIZE - offset);
+        buffer.append(_data + offset, first);
+        buffer.append(_data, count - first);
+    }
+};
+
+/**
+ * @brief The shared memory of a channel: a ring for each direction, and a
+ *        mark of a side which has closed the channel.
+ */
+struct SharedRegion
+{
+    SharedRing toServer;
+    SharedRing toClient;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> closed;
+};
+
+
+/*-----=  Shared Channel  =-----*/
+
+
+/**
+ * @brief One side of a shared memory channel. Every side reads from one ring
+ *        and writes to the other, and has a doorbell (an eventfd) it waits on,
+ *        which the other side rings only when a ring leaves its empty (or
+ *        full) state. The server creates the channel and passes its
+ *        descriptors to the client over their Unix socket.
+ *        A channel is a plain handle, so it may be copied, and it is released
+ *        explicitly by the side which owns it.
+ */
+class SharedChannel
+{
+public:
+
+    /**
+     * @brief Constructs a channel which is not open.
+     */
+    SharedChannel() : _region(nullptr), _incoming(nullptr), _outgoing(nullptr),
+                      _memory(NO_DESCRIPTOR), _doorbell(NO_DESCRIPTOR),
+                      _peerDoorbell(NO_DESCRIPTOR)
+    {
+    }
+
+    /**
+     * @brief Creates a new channel, as its server side.
+     * @return 0 upon success, -1 on failure.
+     */
+    int create()
+    {
+        int memory = memfd_create(SHARED_MEMORY_NAME, MFD_CLOEXEC);
+        if (memory < 0)
+        {
+            systemCallError(MEMFD_CREATE_NAME, errno);
+            return FAILURE_STATE;
+        }
+        if (ftruncate(memory, sizeof(SharedRegion)))
+        {
+            systemCallError(FTRUNCATE_NAME, errno);
+            close(memory);
+            return FAILURE_STATE;
+        }
+        int doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        int peerDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (doorbell < 0 || peerDoorbell < 0)
+        {
+            systemCallError(EVENTFD_NAME, errno);
+            close(memory);
+            close(doorbell);
+            close(peerDoorbell);
+            return FAILURE_STATE;
+        }
+        return attach(memory, doorbell, peerDoorbell, true);
+    }
+
+    /**
+     * @brief Attaches to an existing channel.
+     * @param memory The descriptor of the shared memory.
+     * @param doorbell The doorbell this side waits on.
+     * @param peerDoorbell The doorbell of the other side.
+     * @param server Whether this is the server side.
+     * @return 0 upon success, -1 on failure (the descriptors are closed).
+     */
+    int attach(const int memory, const int doorbell, const int peerDoorbell,
+               const bool server)
+    {
+        void *region = mmap(nullptr, sizeof(SharedRegion),
+                            PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+        if (region == MAP_FAILED)
+        {
+            systemCallError(MMAP_NAME, errno);
+            close(memory);
+            close(doorbell);
+            close(peerDoorbell);
+            return FAILURE_STATE;
+        }
+        _region = (SharedRegion *) region;
+        _incoming = server ? &_region->toServer : &_region->toClient;
+        _outgoing = server ? &_region->toClient : &_region->toServer;
+        _memory = memory;
+        _doorbell = doorbell;
+        _peerDoorbell = peerDoorbell;
+        return SUCCESS_STATE;
+    }
+
+    /**
+     * @brief Gets whether the channel is open.
+     * @return true if the channel is open, false otherwise.
+     */
+    bool open() const
+    {
+        return _region != nullptr;
+    }
+
+    /**
+     * @brief Gets the doorbell this side waits on, which is readable when the
+     *        other side rings it.
+     * @return The descriptor of the doorbell.
+     */
+    int doorbell() const
+    {
+        return _doorbell;
+    }
+
+    /**
+     * @brief Gets the descriptors to pass to the client side, in the order of
+     *        attach: the memory, the doorbell of the client and the doorbell
+     *        of the server.
+     * @param descriptors The vector to append the descriptors into.
+     */
+    void clientDescriptors(std::vector<int> &descriptors) const
+    {
+        descriptors.push_back(_memory);
+        descriptors.push_back(_peerDoorbell);
+        descriptors.push_back(_doorbell);
+    }
+
+    /**
+     * @brief Gets the descriptors of this side, in the order of attach.
+     * @param descriptors The vector to append the descriptors into.
+     */
+    void serverDescriptors(std::vector<int> &descriptors) const
+    {
+        descriptors.push_back(_memory);
+        descriptors.push_back(_doorbell);
+        descriptors.push_back(_peerDoorbell);
+    }
+
+    /**
+     * @brief Writes as much as possible of the given data to the other side.
+     * @param data The data to write.
+     * @param length The length of the data.
+     * @return The number of bytes written, or -1 if the other side corrupted
+     *         the ring.
+     */
+    ssize_t write(const char *data, const size_t length)
+    {
+        bool wake = false;
+        ssize_t written = _outgoing->push(data, length, wake);
+        if (wake)
+        {
+            _ring(_peerDoorbell);
+        }
+        return written;
+    }
+
+    /**
+     * @brief Reads the data the other side has written, up to the given
+     *        limit, and resets the doorbell of this side. The doorbell is
+     *        rung again if data is left, so the rest is read on its next
+     *        wakeup.
+     * @param buffer The buffer to append the data into.
+     * @param limit The maximal number of bytes to read.
+     * @return The number of bytes read, or -1 if the other side corrupted the
+     *         ring.
+     */
+    ssize_t read(std::string &buffer, const size_t limit = SHARED_RING_SIZE)
+    {
+        uint64_t rings;
+        while (::read(_doorbell, &rings, sizeof(uint64_t)) < 0
+               && errno == EINTR)
+        {
+        }
+        bool wake = false;
+        bool pending = false;
+        ssize_t count = _incoming->pop(buffer, limit, wake, pending);
+        if (wake)
+        {
+            _ring(_peerDoorbell);
+        }
+        if (pending)
+        {
+            _ring(_doorbell);
+        }
+        return count;
+    }
+
+    /**
+     * @brief Gets whether any side has closed the channel.
+     * @return true if the channel was closed, false otherwise.
+     */
+    bool closed() const
+    {
+        return _region->closed.load(std::memory_order_acquire) != 0;
+    }
+
+    /**
+     * @brief Closes the channel for both sides and wakes the other side, and
+     *        releases this side of it. The data written so far may still be
+     *        read by the other side.
+     */
+    void release()
+    {
+        if (!open())
+        {
+            return;
+        }
+        _region->closed.store(1, std::memory_order_release);
+        _ring(_peerDoorbell);
+        munmap(_region, sizeof(SharedRegion));
+        close(_memory);
+        close(_doorbell);
+        close(_peerDoorbell);
+        *this = SharedChannel();
+    }
+
+private:
+
+    SharedRegion *_region;
+    SharedRing *_incoming;
+    SharedRing *_outgoing;
+    int _memory;
+    int _doorbell;
+    int _peerDoorbell;
+
+    /**
+     * @brief Rings the given doorbell.
+     * @param doorbell The descriptor of the doorbell.
+     */
+    static void _ring(const int doorbell)
+    {
+        uint64_t ring = DOORBELL_RING;
+        while (::write(doorbell, &ring, sizeof(uint64_t)) < 0
+               && errno == EINTR)
+        {
+        }
+    }
+};
+
+#endif
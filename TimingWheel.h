@@ -0,0 +1,309 @@
+/**
+ * @file TimingWheel.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Hashed Timing Wheel for the timers of the WhatsApp Server.
+ */
+
+
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def NO_TIMER 0
+ * @brief A Macro that sets the ID which never refers to a scheduled timer.
+ */
+#define NO_TIMER 0
+
+/**
+ * @def NO_TIMER_INDEX -1
+ * @brief A Macro that sets the index of a timer that does not exist.
+ */
+#define NO_TIMER_INDEX -1
+
+/**
+ * @def GENERATION_SHIFT 32
+ * @brief A Macro that sets the shift of the generation inside a timer ID.
+ */
+#define GENERATION_SHIFT 32
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief Type Definition for a timer ID. The ID holds the timer index in the
+ *        wheel and its generation, so an ID of a timer that has expired or has
+ *        been cancelled never refers to a newer timer in the same index.
+ */
+typedef uint64_t timerID_t;
+
+/**
+ * @brief Type Definition for a time in milliseconds.
+ */
+typedef uint64_t milliseconds_t;
+
+
+/*-----=  Timing Wheel  =-----*/
+
+
+/**
+ * @brief A hashed timing wheel. Every timer is hashed by its expiry tick
+ *        into one of the slots of the wheel, where the timers of a slot are
+ *        kept in an intrusive doubly linked list. Scheduling and cancelling
+ *        are O(1), and advancing the wheel visits only the slots of the ticks
+ *        that passed, where a timer expires if its tick has been reached and
+ *        otherwise waits for one of the next rounds of the wheel.
+ */
+class TimingWheel
+{
+public:
+
+    /**
+     * @brief Constructs a new timing wheel.
+     * @param slotsCount The number of slots in the wheel.
+     * @param tickLength The length of a single tick in milliseconds.
+     * @param now The current time.
+     */
+    TimingWheel(const size_t slotsCount, const milliseconds_t tickLength,
+                const milliseconds_t now) :
+            _slots(slotsCount, NO_TIMER_INDEX), _tickLength(tickLength),
+            _currentTick(now / tickLength), _freeList(NO_TIMER_INDEX),
+            _count(0)
+    {
+    }
+
+    /**
+     * @brief Schedule a new timer.
+     * @param now The current time.
+     * @param delay The delay until the timer expires in milliseconds.
+     * @param key The key to return when the timer expires.
+     * @return The ID of the new timer.
+     */
+    timerID_t schedule(const milliseconds_t now, const milliseconds_t delay,
+                       const int key)
+    {
+        int index = _allocate();
+        _Timer &timer = _timers[index];
+        // Round the expiry up so a timer never expires before its time.
+        timer.expiryTick = (now + delay + _tickLength - 1) / _tickLength;
+        if (timer.expiryTick <= _currentTick)
+        {
+            timer.expiryTick = _currentTick + 1;
+        }
+        timer.key = key;
+        timer.slot = (int) (timer.expiryTick % _slots.size());
+        _link(index);
+        _count++;
+        return _makeID(index, timer.generation);
+    }
+
+    /**
+     * @brief Cancel the given timer.
+     * @param timerID The timer to cancel.
+     * @return true if the timer was cancelled, false if it no longer exists.
+     */
+    bool cancel(const timerID_t timerID)
+    {
+        int index = _findTimer(timerID);
+        if (index == NO_TIMER_INDEX)
+        {
+            return false;
+        }
+        _unlink(index);
+        _release(index);
+        _count--;
+        return true;
+    }
+
+    /**
+     * @brief Advance the wheel to the given time, and collect the keys of the
+     *        timers which expired on the way.
+     * @param now The current time.
+     * @param expired The vector to append the expired keys into.
+     */
+    void advance(const milliseconds_t now, std::vector<int> &expired)
+    {
+        uint64_t targetTick = now / _tickLength;
+        // After a long pause there is no reason to visit a slot twice.
+        if (targetTick - _currentTick > _slots.size())
+        {
+            _currentTick = targetTick - _slots.size();
+        }
+
+        while (_currentTick < targetTick)
+        {
+            _currentTick++;
+            int index = _slots[_currentTick % _slots.size()];
+            while (index != NO_TIMER_INDEX)
+            {
+                int next = _timers[index].next;
+                if (_timers[index].expiryTick <= targetTick)
+                {
+                    expired.push_back(_timers[index].key);
+                    _unlink(index);
+                    _release(index);
+                    _count--;
+                }
+                index = next;
+            }
+        }
+    }
+
+    /**
+     * @brief Gets the time until the wheel should be advanced again, which is
+     *        the expiry of the earliest timer, so a wheel of distant timers
+     *        does not wake its owner on every tick. The slots of the next
+     *        revolution are scanned in order, and the first timer which
+     *        expires in its slot on this revolution is the earliest. If all
+     *        the timers are for later revolutions, the wheel is advanced once
+     *        a revolution.
+     * @param now The current time.
+     * @return The delay in milliseconds until the earliest expiry, or -1 if
+     *         there are no timers in the wheel.
+     */
+    long nextTimeout(const milliseconds_t now) const
+    {
+        if (_count == 0)
+        {
+            return -1;
+        }
+        uint64_t tick = _currentTick + 1;
+        for (; tick <= _currentTick + _slots.size(); ++tick)
+        {
+            int index = _slots[tick % _slots.size()];
+            while (index != NO_TIMER_INDEX
+                   && _timers[index].expiryTick != tick)
+            {
+                index = _timers[index].next;
+            }
+            if (index != NO_TIMER_INDEX)
+            {
+                break;
+            }
+        }
+        milliseconds_t expiry = std::min(tick, _currentTick + _slots.size())
+                                * _tickLength;
+        return expiry > now ? (long) (expiry - now) : 0;
+    }
+
+    /**
+     * @brief Gets the number of scheduled timers.
+     * @return The number of scheduled timers.
+     */
+    size_t size() const
+    {
+        return _count;
+    }
+
+private:
+
+    /**
+     * @brief A single timer in the wheel.
+     */
+    struct _Timer
+    {
+        uint64_t expiryTick;
+        int key;
+        int slot;
+        int prev;
+        int next;
+        uint32_t generation;
+    };
+
+    std::vector<int> _slots;
+    std::vector<_Timer> _timers;
+    milliseconds_t _tickLength;
+    uint64_t _currentTick;
+    int _freeList;
+    size_t _count;
+
+    static timerID_t _makeID(const int index, const uint32_t generation)
+    {
+        // The generation is never zero, so a valid ID is never NO_TIMER.
+        return ((timerID_t) generation << GENERATION_SHIFT) | (uint32_t) index;
+    }
+
+    int _findTimer(const timerID_t timerID) const
+    {
+        int index = (int) (timerID & UINT32_MAX);
+        uint32_t generation = (uint32_t) (timerID >> GENERATION_SHIFT);
+        if (timerID == NO_TIMER || (size_t) index >= _timers.size()
+            || _timers[index].generation != generation
+            || _timers[index].slot == NO_TIMER_INDEX)
+        {
+            return NO_TIMER_INDEX;
+        }
+        return index;
+    }
+
+    int _allocate()
+    {
+        if (_freeList == NO_TIMER_INDEX)
+        {
+            _Timer timer = _Timer();
+            timer.slot = NO_TIMER_INDEX;
+            _timers.push_back(timer);
+            return (int) _timers.size() - 1;
+        }
+        int index = _freeList;
+        _freeList = _timers[index].next;
+        return index;
+    }
+
+    void _release(const int index)
+    {
+        _Timer &timer = _timers[index];
+        timer.slot = NO_TIMER_INDEX;
+        timer.generation++;
+        timer.next = _freeList;
+        _freeList = index;
+    }
+
+    void _link(const int index)
+    {
+        _Timer &timer = _timers[index];
+        if (++timer.generation == 0)
+        {
+            timer.generation++;
+        }
+        timer.prev = NO_TIMER_INDEX;
+        timer.next = _slots[timer.slot];
+        if (timer.next != NO_TIMER_INDEX)
+        {
+            _timers[timer.next].prev = index;
+        }
+        _slots[timer.slot] = index;
+    }
+
+    void _unlink(const int index)
+    {
+        _Timer &timer = _timers[index];
+        if (timer.prev != NO_TIMER_INDEX)
+        {
+            _timers[timer.prev].next = timer.next;
+        }
+        else
+        {
+            _slots[timer.slot] = timer.next;
+        }
+        if (timer.next != NO_TIMER_INDEX)
+        {
+            _timers[timer.next].prev = timer.prev;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,204 @@
+/**
+ * @file TopicTrie.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Trie of the topic subscriptions of the clients.
+ */
+
+
+#ifndef TOPIC_TRIE_H
+#define TOPIC_TRIE_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "WhatsApp.h"
+#include "MemberSet.h"
+
+
+/*-----=  Topic Trie  =-----*/
+
+
+/**
+ * @brief A trie of topic filters, with a node for every segment. The members
+ *        subscribed to a filter are kept in the node of its last segment, so
+ *        a topic is matched by walking the exact segment, the single segment
+ *        wildcard and the multi segment wildcard at every level, and the cost
+ *        of a match depends on the length of the topic and on the matching
+ *        subscriptions, never on the number of all the subscriptions. A node
+ *        is removed with its last subscriber, so the trie does not keep the
+ *        filters nobody is subscribed to.
+ */
+class TopicTrie
+{
+public:
+
+    /**
+     * @brief Constructs a new empty trie.
+     */
+    TopicTrie() : _size(0)
+    {
+    }
+
+    /**
+     * @brief Gets the number of subscriptions.
+     * @return The number of subscriptions.
+     */
+    size_t size() const
+    {
+        return _size;
+    }
+
+    /**
+     * @brief Subscribes a member to a filter.
+     * @param filter The filter, which must be valid.
+     * @param member The member ID.
+     * @return true if the member was subscribed, false if it already was.
+     */
+    bool subscribe(const std::string &filter, const memberID_t member)
+    {
+        _Node *node = &_root;
+        for (const std::string &segment : _split(filter))
+        {
+            std::unique_ptr<_Node> &child = node->children[segment];
+            if (!child)
+            {
+                child.reset(new _Node());
+            }
+            node = child.get();
+        }
+        if (!node->subscribers.insert(member))
+        {
+            return false;
+        }
+        ++_size;
+        return true;
+    }
+
+    /**
+     * @brief Unsubscribes a member from a filter, and removes the nodes which
+     *        are left without subscribers and children.
+     * @param filter The filter.
+     * @param member The member ID.
+     * @return true if the member was unsubscribed, false if it was not
+     *         subscribed to the filter.
+     */
+    bool unsubscribe(const std::string &filter, const memberID_t member)
+    {
+        std::vector<std::string> segments = _split(filter);
+        std::vector<_Node *> path(1, &_root);
+        for (const std::string &segment : segments)
+        {
+            auto child = path.back()->children.find(segment);
+            if (child == path.back()->children.end())
+            {
+                return false;
+            }
+            path.push_back(child->second.get());
+        }
+        if (!path.back()->subscribers.erase(member))
+        {
+            return false;
+        }
+        --_size;
+
+        // The root is never removed.
+        for (size_t i = segments.size(); i > 0; --i)
+        {
+            if (!path[i]->subscribers.empty() || !path[i]->children.empty())
+            {
+                break;
+            }
+            path[i - 1]->children.erase(segments[i - 1]);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Adds the members subscribed to a filter which matches a topic to
+     *        the given recipients, so a member subscribed to several matching
+     *        filters is added once.
+     * @param topic The topic, which must be valid.
+     * @param recipients The set to add the members into.
+     */
+    void match(const std::string &topic, MemberSet &recipients) const
+    {
+        _match(_root, _split(topic), 0, recipients);
+    }
+
+private:
+
+    /**
+     * @brief A node of the trie, for a single segment of the filters.
+     */
+    struct _Node
+    {
+        std::unordered_map<std::string, std::unique_ptr<_Node>> children;
+        MemberSet subscribers;
+    };
+
+    _Node _root;
+    size_t _size;
+
+    /**
+     * @brief Splits a topic or a filter into its segments.
+     * @param topic The topic.
+     * @return The segments.
+     */
+    static std::vector<std::string> _split(const std::string &topic)
+    {
+        std::vector<std::string> segments;
+        size_t begin = MSG_BEGIN_INDEX;
+        while (true)
+        {
+            size_t end = topic.find(TOPIC_SEP, begin);
+            segments.push_back(topic.substr(begin, end - begin));
+            if (end == std::string::npos)
+            {
+                return segments;
+            }
+            begin = end + 1;
+        }
+    }
+
+    /**
+     * @brief Matches the rest of a topic from a node of the trie.
+     * @param node The node of the segments which were matched.
+     * @param segments The segments of the topic.
+     * @param index The index of the next segment to match.
+     * @param recipients The set to add the members into.
+     */
+    static void _match(const _Node &node,
+                       const std::vector<std::string> &segments,
+                       const size_t index, MemberSet &recipients)
+    {
+        // The multi segment wildcard matches the rest, even if it is empty.
+        auto rest = node.children.find(TOPIC_MULTI_WILDCARD);
+        if (rest != node.children.end())
+        {
+            recipients.unite(rest->second->subscribers);
+        }
+        if (index == segments.size())
+        {
+            recipients.unite(node.subscribers);
+            return;
+        }
+
+        auto exact = node.children.find(segments[index]);
+        if (exact != node.children.end())
+        {
+            _match(*exact->second, segments, index + 1, recipients);
+        }
+        auto any = node.children.find(TOPIC_SINGLE_WILDCARD);
+        if (any != node.children.end())
+        {
+            _match(*any->second, segments, index + 1, recipients);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,214 @@
+/**
+ * @file Tracer.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Tracer of the stages of the server, exported as Chrome trace events.
+ */
+
+
+#ifndef TRACER_H
+#define TRACER_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <vector>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def TRACE_CAPACITY 16384
+ * @brief A Macro that sets the maximal number of spans kept by a tracer.
+ */
+#define TRACE_CAPACITY 16384
+
+/**
+ * @def NO_SAMPLING 0
+ * @brief A Macro that sets the sampling period of a disabled tracer.
+ */
+#define NO_SAMPLING 0
+
+
+/*-----=  Tracer  =-----*/
+
+
+/**
+ * @brief A tracer of the stages of the rounds of an event loop. The loop is
+ *        sampled in whole rounds, one of every sampling period, and every
+ *        span of a sampled round is recorded, so a sampled request keeps its
+ *        entire timeline from its read to the writes of its output.
+ *        The spans are kept in a ring which overwrites the oldest span once
+ *        it is full, so the tracer holds the recent history of the loop in a
+ *        bounded memory, and a span of a round which is not sampled costs a
+ *        single check. The tracer belongs to the thread of its loop and is
+ *        not synchronized.
+ */
+class Tracer
+{
+public:
+
+    /**
+     * @brief Constructs a new disabled tracer.
+     */
+    Tracer() : _period(NO_SAMPLING), _rounds(0), _sampling(false), _next(0)
+    {
+    }
+
+    /**
+     * @brief Sets the sampling period of the tracer.
+     * @param period The number of rounds per sampled round, or NO_SAMPLING to
+     *        disable the tracer.
+     */
+    void setPeriod(const unsigned long period)
+    {
+        _period = period;
+        _sampling = false;
+    }
+
+    /**
+     * @brief Starts a new round of the loop, and decides if it is sampled.
+     */
+    void beginRound()
+    {
+        _sampling = _period != NO_SAMPLING && ++_rounds % _period == 0;
+    }
+
+    /**
+     * @brief Gets whether the current round is sampled.
+     * @return true if the round is sampled, false otherwise.
+     */
+    bool sampling() const
+    {
+        return _sampling;
+    }
+
+    /**
+     * @brief Gets the current time of the tracer.
+     * @return The current time in microseconds.
+     */
+    static uint64_t now()
+    {
+        auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>
+                (elapsed).count();
+    }
+
+    /**
+     * @brief Records a span, in place of the oldest span if the tracer is full.
+     * @param name The name of the span, which must outlive the tracer.
+     * @param socket The socket the span handled.
+     * @param start The start time of the span in microseconds.
+     * @param end The end time of the span in microseconds.
+     */
+    void record(const char *name, const int socket, const uint64_t start,
+                const uint64_t end)
+    {
+        _Span span = {name, socket, start, end - start};
+        if (_spans.size() < TRACE_CAPACITY)
+        {
+            _spans.push_back(span);
+            return;
+        }
+        _spans[_next] = span;
+        _next = (_next + 1) % TRACE_CAPACITY;
+    }
+
+    /**
+     * @brief Gets the number of recorded spans.
+     * @return The number of spans.
+     */
+    size_t size() const
+    {
+        return _spans.size();
+    }
+
+    /**
+     * @brief Writes the recorded spans, from the oldest, as a JSON document of
+     *        complete events in the Chrome trace event format.
+     * @param out The stream to write to.
+     * @param processID The process ID of the events.
+     */
+    void dump(std::ostream &out, const long processID) const
+    {
+        out << "{\"traceEvents\":[";
+        for (size_t i = 0; i < _spans.size(); ++i)
+        {
+            const _Span &span = _spans[(_next + i) % _spans.size()];
+            out << (i ? ",\n" : "\n") << "{\"name\":\"" << span.name
+                << "\",\"ph\":\"X\",\"ts\":" << span.start << ",\"dur\":"
+                << span.duration << ",\"pid\":" << processID << ",\"tid\":"
+                << processID << ",\"args\":{\"socket\":" << span.socket
+                << "}}";
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+private:
+
+    /**
+     * @brief A single recorded span.
+     */
+    struct _Span
+    {
+        const char *name;
+        int socket;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    unsigned long _period;
+    unsigned long _rounds;
+    bool _sampling;
+    std::vector<_Span> _spans;
+    size_t _next;
+};
+
+/**
+ * @brief A span of a tracer which covers its own scope. The span is recorded
+ *        when it goes out of scope, if its round is sampled.
+ */
+class TraceSpan
+{
+public:
+
+    /**
+     * @brief Starts a new span.
+     * @param tracer The tracer of the span.
+     * @param name The name of the span, which must outlive the tracer.
+     * @param socket The socket the span handles.
+     */
+    TraceSpan(Tracer &tracer, const char *name, const int socket)
+            : _tracer(tracer), _name(name), _socket(socket),
+              _start(tracer.sampling() ? Tracer::now() : 0)
+    {
+    }
+
+    /**
+     * @brief Ends the span.
+     */
+    ~TraceSpan()
+    {
+        if (_tracer.sampling())
+        {
+            _tracer.record(_name, _socket, _start, Tracer::now());
+        }
+    }
+
+private:
+
+    Tracer &_tracer;
+    const char *_name;
+    int _socket;
+    uint64_t _start;
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+#endif
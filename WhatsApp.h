@@ -15,12 +15,19 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <vector>
+#include <algorithm>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <errno.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <termio.h>
 
 
@@ -117,12 +124,103 @@
  */
 #define CLIENT_SEND_SUCCESS_MSG "Sent successfully."
 
+/**
+ * @def MULTI_SEND_FAIL_MSG "ERROR: failed to send to "
+ * @brief A Macro that sets the message prefix of the receivers a multi send
+ *        failed to send to.
+ */
+#define MULTI_SEND_FAIL_MSG "ERROR: failed to send to "
+
+/**
+ * @def BROADCAST_FAIL_MSG "ERROR: failed to broadcast."
+ * @brief A Macro that sets the message upon a broadcast failure.
+ */
+#define BROADCAST_FAIL_MSG "ERROR: failed to broadcast."
+
 /**
  * @def GROUP_FAIL_MSG "ERROR: failed to create group "
  * @brief A Macro that sets the message upon group failure in the client side.
  */
 #define GROUP_FAIL_MSG "ERROR: failed to create group "
 
+/**
+ * @def ADD_TO_GROUP_SUCCESS_MSG "Added clients to group "
+ * @brief A Macro that sets the message upon success in adding group members.
+ */
+#define ADD_TO_GROUP_SUCCESS_MSG "Added clients to group "
+
+/**
+ * @def ADD_TO_GROUP_FAIL_MSG "ERROR: failed to add clients to group "
+ * @brief A Macro that sets the message upon failure in adding group members.
+ */
+#define ADD_TO_GROUP_FAIL_MSG "ERROR: failed to add clients to group "
+
+/**
+ * @def REMOVE_FROM_GROUP_SUCCESS_MSG "Removed clients from group "
+ * @brief A Macro that sets the message upon success in removing group members.
+ */
+#define REMOVE_FROM_GROUP_SUCCESS_MSG "Removed clients from group "
+
+/**
+ * @def REMOVE_FROM_GROUP_FAIL_MSG "ERROR: failed to remove clients from group "
+ * @brief A Macro that sets the message upon failure in removing group members.
+ */
+#define REMOVE_FROM_GROUP_FAIL_MSG "ERROR: failed to remove clients from group "
+
+/**
+ * @def LEAVE_GROUP_SUCCESS_MSG "Left group "
+ * @brief A Macro that sets the message upon success in leaving a group.
+ */
+#define LEAVE_GROUP_SUCCESS_MSG "Left group "
+
+/**
+ * @def LEAVE_GROUP_FAIL_MSG "ERROR: failed to leave group "
+ * @brief A Macro that sets the message upon failure in leaving a group.
+ */
+#define LEAVE_GROUP_FAIL_MSG "ERROR: failed to leave group "
+
+/**
+ * @def TYPING_FAIL_MSG "ERROR: failed to signal typing in group "
+ * @brief A Macro that sets the message upon failure in a typing signal.
+ */
+#define TYPING_FAIL_MSG "ERROR: failed to signal typing in group "
+
+/**
+ * @def SUBSCRIBE_SUCCESS_MSG "Subscribed to topic "
+ * @brief A Macro that sets the message upon success in subscribing to topics.
+ */
+#define SUBSCRIBE_SUCCESS_MSG "Subscribed to topic "
+
+/**
+ * @def SUBSCRIBE_FAIL_MSG "ERROR: failed to subscribe to topic "
+ * @brief A Macro that sets the message upon failure in subscribing to topics.
+ */
+#define SUBSCRIBE_FAIL_MSG "ERROR: failed to subscribe to topic "
+
+/**
+ * @def UNSUBSCRIBE_SUCCESS_MSG "Unsubscribed from topic "
+ * @brief A Macro that sets the message upon success in unsubscribing.
+ */
+#define UNSUBSCRIBE_SUCCESS_MSG "Unsubscribed from topic "
+
+/**
+ * @def UNSUBSCRIBE_FAIL_MSG "ERROR: failed to unsubscribe from topic "
+ * @brief A Macro that sets the message upon failure in unsubscribing.
+ */
+#define UNSUBSCRIBE_FAIL_MSG "ERROR: failed to unsubscribe from topic "
+
+/**
+ * @def PUBLISH_SUCCESS_MSG "Published to topic "
+ * @brief A Macro that sets the message upon success in publishing to a topic.
+ */
+#define PUBLISH_SUCCESS_MSG "Published to topic "
+
+/**
+ * @def PUBLISH_FAIL_MSG "ERROR: failed to publish to topic "
+ * @brief A Macro that sets the message upon failure in publishing to a topic.
+ */
+#define PUBLISH_FAIL_MSG "ERROR: failed to publish to topic "
+
 /**
  * @def EXIT_COMMAND "exit"
  * @brief A Macro that sets the command exit.
@@ -141,12 +239,77 @@
  */
 #define CREATE_GROUP_COMMAND "create_group"
 
+/**
+ * @def ADD_TO_GROUP_COMMAND "add_to_group"
+ * @brief A Macro that sets the command add to group.
+ */
+#define ADD_TO_GROUP_COMMAND "add_to_group"
+
+/**
+ * @def REMOVE_FROM_GROUP_COMMAND "remove_from_group"
+ * @brief A Macro that sets the command remove from group.
+ */
+#define REMOVE_FROM_GROUP_COMMAND "remove_from_group"
+
+/**
+ * @def LEAVE_GROUP_COMMAND "leave_group"
+ * @brief A Macro that sets the command leave group.
+ */
+#define LEAVE_GROUP_COMMAND "leave_group"
+
+/**
+ * @def TYPING_COMMAND "typing"
+ * @brief A Macro that sets the command which signals typing in a group.
+ */
+#define TYPING_COMMAND "typing"
+
 /**
  * @def SEND_COMMAND "send"
  * @brief A Macro that sets the command send.
  */
 #define SEND_COMMAND "send"
 
+/**
+ * @def MULTI_SEND_COMMAND "multi_send"
+ * @brief A Macro that sets the command which sends a message to several
+ *        clients at once.
+ */
+#define MULTI_SEND_COMMAND "multi_send"
+
+/**
+ * @def BROADCAST_COMMAND "broadcast"
+ * @brief A Macro that sets the command which sends a message to all the
+ *        clients, which only an admin may use.
+ */
+#define BROADCAST_COMMAND "broadcast"
+
+/**
+ * @def PING_COMMAND "ping"
+ * @brief A Macro that sets the command which measures the latency to the
+ *        server.
+ */
+#define PING_COMMAND "ping"
+
+/**
+ * @def SUBSCRIBE_COMMAND "subscribe"
+ * @brief A Macro that sets the command which subscribes to the topics which
+ *        match a filter.
+ */
+#define SUBSCRIBE_COMMAND "subscribe"
+
+/**
+ * @def UNSUBSCRIBE_COMMAND "unsubscribe"
+ * @brief A Macro that sets the command unsubscribe.
+ */
+#define UNSUBSCRIBE_COMMAND "unsubscribe"
+
+/**
+ * @def PUBLISH_COMMAND "publish"
+ * @brief A Macro that sets the command which sends a message to the
+ *        subscribers of a topic.
+ */
+#define PUBLISH_COMMAND "publish"
+
 /**
  * @def MSG_BEGIN_INDEX 0
  * @brief A Macro that sets the value of the message begin index.
@@ -171,6 +334,20 @@
  */
 #define CONNECTION_IN_USE_STATE '2'
 
+/**
+ * @def CONNECTION_REDIRECT_STATE '3'
+ * @brief A Macro that sets the value of connection redirect state, which is
+ *        followed by the address of the server node that owns the client name.
+ */
+#define CONNECTION_REDIRECT_STATE '3'
+
+/**
+ * @def CONNECTION_RESUMED_STATE '4'
+ * @brief A Macro that sets the value of connection success state of a client
+ *        which resumed its previous session.
+ */
+#define CONNECTION_RESUMED_STATE '4'
+
 /**
  * @def LOGOUT_SUCCESS_STATE '1'
  * @brief A Macro that sets the value of logout success state.
@@ -183,12 +360,72 @@
  */
 #define MSG_TERMINATOR '\n'
 
+/**
+ * @def MESSAGE_ID_PREFIX '#'
+ * @brief A Macro that sets the prefix of the optional ID of a send request,
+ *        which can not start a client or a group name.
+ */
+#define MESSAGE_ID_PREFIX '#'
+
+/**
+ * @def SHARED_MEMORY_REQUEST "#shm"
+ * @brief A Macro that sets the first line of a client over a Unix socket which
+ *        requests a shared memory channel, which can not be a client name.
+ */
+#define SHARED_MEMORY_REQUEST "#shm"
+
+/**
+ * @def TOPIC_SEP '.'
+ * @brief A Macro that sets the separator of the segments of a topic, which
+ *        are alphanumeric names.
+ */
+#define TOPIC_SEP '.'
+
+/**
+ * @def TOPIC_SINGLE_WILDCARD "*"
+ * @brief A Macro that sets the segment of a filter which matches any single
+ *        segment of a topic.
+ */
+#define TOPIC_SINGLE_WILDCARD "*"
+
+/**
+ * @def TOPIC_MULTI_WILDCARD "#"
+ * @brief A Macro that sets the last segment of a filter which matches the
+ *        rest of a topic, even if it is empty.
+ */
+#define TOPIC_MULTI_WILDCARD "#"
+
+/**
+ * @def SUBSCRIBE_MARK '+'
+ * @brief A Macro that sets the mark of the filter of a subscription request.
+ */
+#define SUBSCRIBE_MARK '+'
+
+/**
+ * @def UNSUBSCRIBE_MARK '-'
+ * @brief A Macro that sets the mark of the filter of an unsubscribe request.
+ */
+#define UNSUBSCRIBE_MARK '-'
+
+/**
+ * @def TOPIC_SENDER_DELIM '@'
+ * @brief A Macro that sets the delimiter between the sender and the topic of
+ *        a published message, as its receivers get it.
+ */
+#define TOPIC_SENDER_DELIM '@'
+
 /**
  * @def TAG_CHAR_BASE '0'
  * @brief A Macro that sets the base value of calculating tag characters.
  */
 #define TAG_CHAR_BASE '0'
 
+/**
+ * @def MAX_SIGNAL_SIZE 512
+ * @brief A Macro that sets the maximal size of a datagram of the signals.
+ */
+#define MAX_SIGNAL_SIZE 512
+
 /**
  * @def SOCKET_ID_BOUND 0
  * @brief A Macro that sets the lower bound of socket ID value.
@@ -220,6 +457,44 @@
 #define INITIAL_WRITE_COUNT 0
 
 
+/**
+ * @def MAX_DESCRIPTORS_PER_MESSAGE 250
+ * @brief A Macro that sets the maximal descriptors passed in a single message.
+ */
+#define MAX_DESCRIPTORS_PER_MESSAGE 250
+
+/**
+ * @def DESCRIPTORS_MSG_MARK 'F'
+ * @brief A Macro that sets the data byte which carries passed descriptors.
+ */
+#define DESCRIPTORS_MSG_MARK 'F'
+
+/**
+ * @def UNIX_PATH_SEPARATOR '/'
+ * @brief A Macro that sets the character which marks a Unix socket path.
+ */
+#define UNIX_PATH_SEPARATOR '/'
+
+/**
+ * @def NODE_PORT_DELIM ':'
+ * @brief A Macro that sets the delimiter between the host and the port of a
+ *        server node address.
+ */
+#define NODE_PORT_DELIM ':'
+
+/**
+ * @def IPV6_HOST_OPEN '['
+ * @brief A Macro that sets the character which opens an IPv6 host in a node.
+ */
+#define IPV6_HOST_OPEN '['
+
+/**
+ * @def IPV6_HOST_CLOSE ']'
+ * @brief A Macro that sets the character which closes an IPv6 host in a node.
+ */
+#define IPV6_HOST_CLOSE ']'
+
+
 /*-----=  System Calls Name Definitions  =-----*/
 
 
@@ -235,6 +510,18 @@
  */
 #define GETHOSTBYNAME_NAME "gethostbyname"
 
+/**
+ * @def GETADDRINFO_NAME "getaddrinfo"
+ * @brief A Macro that sets function name for getaddrinfo.
+ */
+#define GETADDRINFO_NAME "getaddrinfo"
+
+/**
+ * @def SETSOCKOPT_NAME "setsockopt"
+ * @brief A Macro that sets function name for setsockopt.
+ */
+#define SETSOCKOPT_NAME "setsockopt"
+
 /**
  * @def SOCKET_NAME "socket"
  * @brief A Macro that sets function name for socket.
@@ -283,12 +570,84 @@
  */
 #define WRITE_NAME "write"
 
+/**
+ * @def FCNTL_NAME "fcntl"
+ * @brief A Macro that sets function name for fcntl.
+ */
+#define FCNTL_NAME "fcntl"
+
+/**
+ * @def SENDMSG_NAME "sendmsg"
+ * @brief A Macro that sets function name for sendmsg.
+ */
+#define SENDMSG_NAME "sendmsg"
+
+/**
+ * @def RECVMSG_NAME "recvmsg"
+ * @brief A Macro that sets function name for recvmsg.
+ */
+#define RECVMSG_NAME "recvmsg"
+
 /**
  * @def SELECT_NAME "select"
  * @brief A Macro that sets function name for select.
  */
 #define SELECT_NAME "select"
 
+/**
+ * @def EPOLL_CREATE_NAME "epoll_create1"
+ * @brief A Macro that sets function name for epoll_create1.
+ */
+#define EPOLL_CREATE_NAME "epoll_create1"
+
+/**
+ * @def EPOLL_CTL_NAME "epoll_ctl"
+ * @brief A Macro that sets function name for epoll_ctl.
+ */
+#define EPOLL_CTL_NAME "epoll_ctl"
+
+/**
+ * @def EPOLL_WAIT_NAME "epoll_wait"
+ * @brief A Macro that sets function name for epoll_wait.
+ */
+#define EPOLL_WAIT_NAME "epoll_wait"
+
+/**
+ * @def MEMFD_CREATE_NAME "memfd_create"
+ * @brief A Macro that sets function name for memfd_create.
+ */
+#define MEMFD_CREATE_NAME "memfd_create"
+
+/**
+ * @def FTRUNCATE_NAME "ftruncate"
+ * @brief A Macro that sets function name for ftruncate.
+ */
+#define FTRUNCATE_NAME "ftruncate"
+
+/**
+ * @def MMAP_NAME "mmap"
+ * @brief A Macro that sets function name for mmap.
+ */
+#define MMAP_NAME "mmap"
+
+/**
+ * @def EVENTFD_NAME "eventfd"
+ * @brief A Macro that sets function name for eventfd.
+ */
+#define EVENTFD_NAME "eventfd"
+
+/**
+ * @def SENDTO_NAME "sendto"
+ * @brief A Macro that sets function name for sendto.
+ */
+#define SENDTO_NAME "sendto"
+
+/**
+ * @def RECVFROM_NAME "recvfrom"
+ * @brief A Macro that sets function name for recvfrom.
+ */
+#define RECVFROM_NAME "recvfrom"
+
 
 /*-----=  Type Definitions & Enums  =-----*/
 
@@ -315,8 +674,24 @@ typedef std::string message_t;
 
 /**
  * @brief Enum for the types of messages types that the server can receive.
+ *        A PING is answered with the times the server received it and sent
+ *        its response. A TIMESTAMP from a client asks the server to precede
+ *        every frame it sends in the handling of a frame (a response or a
+ *        routed message) with a TIMESTAMP of the same two times.
+ *        A SUBSCRIBE both subscribes and unsubscribes, by the mark of its
+ *        filter, since a tag past '@' would be a capital letter, which may
+ *        start the name of the sender of a message.
  */
-enum MessageTag { CREATE_GROUP, SEND, WHO, CLIENT_EXIT, SERVER_EXIT };
+enum MessageTag { CREATE_GROUP, SEND, WHO, CLIENT_EXIT, SERVER_EXIT,
+                  HEARTBEAT, RESUME_TOKEN, ADD_TO_GROUP, REMOVE_FROM_GROUP,
+                  LEAVE_GROUP, SIGNAL_TOKEN, MULTI_SEND, BROADCAST, PING,
+                  TIMESTAMP, SUBSCRIBE, PUBLISH };
+
+/**
+ * @brief Enum for the types of the signals of the UDP side channel, which are
+ *        never retransmitted.
+ */
+enum SignalTag { TYPING_SIGNAL, PRESENCE_SIGNAL };
 
 
 /*-----=  Server/Client Functions  =-----*/
@@ -328,19 +703,49 @@ enum MessageTag { CREATE_GROUP, SEND, WHO, CLIENT_EXIT, SERVER_EXIT };
  * @param callName The system call name.
  * @param errorNumber The error number.
  */
-void systemCallError(const std::string callName, const int errorNumber)
+static inline void systemCallError(const std::string callName,
+                                    const int errorNumber)
 {
     std::cerr << SYSTEM_CALL_ERROR_MSG_PREFIX << WHITE_SPACE_SEPARATOR
               << callName << WHITE_SPACE_SEPARATOR
               << errorNumber << MSG_SUFFIX << std::endl;
 }
 
+/**
+ * @brief A function that handles the failure of getaddrinfo, whose return
+ *        value is not an errno (unless it is EAI_SYSTEM), and print out an
+ *        informative message.
+ * @param error The return value of getaddrinfo.
+ */
+static inline void addressInfoError(const int error)
+{
+    if (error == EAI_SYSTEM)
+    {
+        systemCallError(GETADDRINFO_NAME, errno);
+        return;
+    }
+    std::cerr << SYSTEM_CALL_ERROR_MSG_PREFIX << WHITE_SPACE_SEPARATOR
+              << GETADDRINFO_NAME << WHITE_SPACE_SEPARATOR
+              << gai_strerror(error) << MSG_SUFFIX << std::endl;
+}
+
+/**
+ * @brief Gets the tag of a message of the given type. A tag is a single
+ *        character even when it is past the digits.
+ * @param tag The type of the message.
+ * @return The tag.
+ */
+static inline message_t messageTag(const MessageTag tag)
+{
+    return message_t(1, (char) (TAG_CHAR_BASE + tag));
+}
+
 /**
  * @brief Validates the given port number.
  * @param portNumber The port number to validate.
  * @return 0 if the port number is a valid number, -1 otherwise.
  */
-static int validatePortNumber(std::string const portNumber)
+static inline int validatePortNumber(std::string const portNumber)
 {
     for (unsigned int i = 0; i < portNumber.length(); ++i)
     {
@@ -352,13 +757,254 @@ static int validatePortNumber(std::string const portNumber)
     return SUCCESS_STATE;
 }
 
+/**
+ * @brief Validates a topic, which is alphanumeric segments separated by
+ *        single dots, or a filter of topics, whose segments may also be the
+ *        single segment wildcard, and whose last segment may be the multi
+ *        segment wildcard.
+ * @param topic The topic to validate.
+ * @param filter Whether the topic is a filter.
+ * @return 0 if the topic is valid, -1 otherwise.
+ */
+static inline int validateTopic(std::string const topic, const bool filter)
+{
+    size_t begin = MSG_BEGIN_INDEX;
+    while (true)
+    {
+        size_t end = std::min(topic.find(TOPIC_SEP, begin), topic.length());
+        std::string segment = topic.substr(begin, end - begin);
+        bool wildcard = filter
+                        && (segment.compare(TOPIC_SINGLE_WILDCARD)
+                            == EQUAL_COMPARISON
+                            || (segment.compare(TOPIC_MULTI_WILDCARD)
+                                == EQUAL_COMPARISON && end == topic.length()));
+        for (unsigned int i = 0; i < segment.length() && !wildcard; ++i)
+        {
+            if (!isalnum(segment[i]))
+            {
+                return FAILURE_STATE;
+            }
+        }
+        if (segment.empty())
+        {
+            return FAILURE_STATE;
+        }
+        if (end == topic.length())
+        {
+            return SUCCESS_STATE;
+        }
+        begin = end + 1;
+    }
+}
+
+/**
+ * @brief Splits the address of a server node, in the form host:port (where an
+ *        IPv6 host may be enclosed in brackets), into its host and port.
+ * @param address The node address to split.
+ * @param host The string to store the host in.
+ * @param port The string to store the port in.
+ * @return 0 upon success, -1 if the address is invalid.
+ */
+static inline int splitNodeAddress(std::string const address, std::string &host,
+                                   std::string &port)
+{
+    size_t delimiter = address.rfind(NODE_PORT_DELIM);
+    if (delimiter == std::string::npos || delimiter == 0)
+    {
+        return FAILURE_STATE;
+    }
+    host = address.substr(0, delimiter);
+    port = address.substr(delimiter + 1);
+    if (host.length() > 2 && host.front() == IPV6_HOST_OPEN
+        && host.back() == IPV6_HOST_CLOSE)
+    {
+        host = host.substr(1, host.length() - 2);
+    }
+    if (port.empty() || validatePortNumber(port))
+    {
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Determine if the given address is a path of a Unix domain socket.
+ * @param address The address to check.
+ * @return true if the address is a Unix socket path, false otherwise.
+ */
+static inline bool isUnixSocketPath(std::string const address)
+{
+    return address.find(UNIX_PATH_SEPARATOR) != std::string::npos;
+}
+
+/**
+ * @brief Fills a Unix domain socket address with the given path.
+ * @param path The path of the socket.
+ * @param address The address to fill.
+ * @return 0 upon success, -1 if the path is too long.
+ */
+static inline int setUnixSocketAddress(std::string const path,
+                                       sockaddr_un &address)
+{
+    memset(&address, 0, sizeof(sockaddr_un));
+    if (path.length() >= sizeof(address.sun_path))
+    {
+        return FAILURE_STATE;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.length());
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Disables Nagle's algorithm on the given socket, so the small
+ *        messages of the protocol are sent without delay. Sockets that are
+ *        not TCP sockets (e.g. Unix sockets) are left as is.
+ * @param socketID The socket to set.
+ */
+static inline void setNoDelay(const int socketID)
+{
+    int enable = 1;
+    setsockopt(socketID, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(int));
+}
+
+/**
+ * @brief Sets the given socket to non-blocking mode.
+ * @param socketID The socket to set.
+ * @return 0 upon success, -1 on failure.
+ */
+static inline int setNonBlocking(const int socketID)
+{
+    int flags = fcntl(socketID, F_GETFL, 0);
+    if (flags < 0 || fcntl(socketID, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        systemCallError(FCNTL_NAME, errno);
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Determine if the last failed I/O call would have blocked.
+ * @return true if the call should be retried later, false otherwise.
+ */
+static inline bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+/**
+ * @brief Passes the given descriptors over the given Unix socket using
+ *        SCM_RIGHTS messages, each one carrying a single data byte and up to
+ *        MAX_DESCRIPTORS_PER_MESSAGE descriptors.
+ * @param socketID The Unix socket to pass the descriptors over.
+ * @param descriptors The descriptors to pass.
+ * @return 0 upon success, -1 on failure.
+ */
+static inline int sendDescriptors(const int socketID,
+                                  const std::vector<int> &descriptors)
+{
+    size_t sent = 0;
+    while (sent < descriptors.size())
+    {
+        size_t count = std::min(descriptors.size() - sent,
+                                (size_t) MAX_DESCRIPTORS_PER_MESSAGE);
+        char mark = DESCRIPTORS_MSG_MARK;
+        iovec data = {&mark, sizeof(char)};
+        std::vector<char> control(CMSG_SPACE(count * sizeof(int)));
+
+        msghdr message;
+        memset(&message, 0, sizeof(msghdr));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(header), descriptors.data() + sent,
+               count * sizeof(int));
+
+        if (sendmsg(socketID, &message, 0) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            systemCallError(SENDMSG_NAME, errno);
+            return FAILURE_STATE;
+        }
+        sent += count;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Receives descriptors passed over the given Unix socket by
+ *        sendDescriptors. Every message is read separately so the
+ *        descriptors of different messages are never merged.
+ * @param socketID The Unix socket to receive the descriptors from.
+ * @param count The number of descriptors to receive.
+ * @param descriptors The vector to append the descriptors into.
+ * @return 0 upon success, -1 on failure.
+ */
+static inline int receiveDescriptors(const int socketID, const size_t count,
+                                     std::vector<int> &descriptors)
+{
+    size_t received = 0;
+    while (received < count)
+    {
+        char mark;
+        iovec data = {&mark, sizeof(char)};
+        std::vector<char> control(CMSG_SPACE(MAX_DESCRIPTORS_PER_MESSAGE
+                                             * sizeof(int)));
+
+        msghdr message;
+        memset(&message, 0, sizeof(msghdr));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        ssize_t result = recvmsg(socketID, &message, 0);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0 || mark != DESCRIPTORS_MSG_MARK)
+        {
+            systemCallError(RECVMSG_NAME, result < 0 ? errno : EPROTO);
+            return FAILURE_STATE;
+        }
+
+        for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+             header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level != SOL_SOCKET
+                || header->cmsg_type != SCM_RIGHTS)
+            {
+                continue;
+            }
+            size_t headerCount = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            std::vector<int> current(headerCount);
+            memcpy(current.data(), CMSG_DATA(header), headerCount * sizeof(int));
+            descriptors.insert(descriptors.end(), current.begin(),
+                               current.end());
+            received += headerCount;
+        }
+    }
+    return SUCCESS_STATE;
+}
+
 /**
  * @brief Reads data from the given socket into the given buffer.
  * @param socketID The socket to read from.
  * @param buffer The buffer to read into.
  * @return The number of bytes read or -1 in case of failure.
  */
-static int readData(const int socketID, message_t &buffer)
+static inline int readData(const int socketID, message_t &buffer)
 {
     int totalCount = INITIAL_READ_COUNT;
     while (true)
@@ -390,7 +1036,7 @@ static int readData(const int socketID, message_t &buffer)
  * @param buffer The buffer to write from.
  * @return The number of bytes written or -1 in case of failure.
  */
-static int writeData(const int socketID, const message_t &buffer)
+static inline int writeData(const int socketID, const message_t &buffer)
 {
     // Add to the message the NEW_LINE which indicates the end of the message.
     message_t modified = buffer + (char) MSG_TERMINATOR;
@@ -0,0 +1,1227 @@
+/**
+ * @file WhatsAppSession.cpp
+ * @author Itai Tagar <itagar>
+ *
+ * @brief An implementation of the WhatsApp Client Library.
+ */
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <chrono>
+#include "WhatsAppSession.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def MESSAGE_ID_SEP '.'
+ * @brief A Macro that sets the separator between the prefix of the message IDs
+ *        of a session and the number of a message.
+ */
+#define MESSAGE_ID_SEP '.'
+
+/**
+ * @def READ_BUFFER_SIZE 65536
+ * @brief A Macro that sets the maximal bytes read from a descriptor at once.
+ */
+#define READ_BUFFER_SIZE 65536
+
+/**
+ * @def CHANNEL_POLL_EVENTS 2
+ * @brief A Macro that sets the number of descriptors a session with a shared
+ *        memory channel waits for (its socket and its doorbell).
+ */
+#define CHANNEL_POLL_EVENTS 2
+
+
+/*-----=  Connection Functions  =-----*/
+
+
+/**
+ * @brief Gets the current time of the monotonic clock, which is the clock of
+ *        the timestamps of the server.
+ * @return The current time in microseconds.
+ */
+static uint64_t monotonicTime()
+{
+    auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint64_t) std::chrono::duration_cast<
+            std::chrono::microseconds>(elapsed).count();
+}
+
+/**
+ * @brief Checks if the given name is a valid client or group name.
+ * @param name The name to check.
+ * @return true if the name is a non empty alphanumeric name, false otherwise.
+ */
+static bool isValidName(const std::string &name)
+{
+    if (name.empty())
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < name.length(); ++i)
+    {
+        if (!isalnum(name[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Attempt to start a connection of a new non-blocking socket to the
+ *        given address. The connection completes when the socket is writable.
+ * @param family The address family of the socket.
+ * @param address The address to connect to.
+ * @param addressLength The length of the given address.
+ * @return The connecting socket upon success, -1 otherwise.
+ */
+static int connectSocket(const int family, const sockaddr *address,
+                         const socklen_t addressLength)
+{
+    // Create Socket.
+    int socketID = socket(family, SOCK_STREAM, 0);
+    if (socketID < SOCKET_ID_BOUND)
+    {
+        systemCallError(SOCKET_NAME, errno);
+        return FAILURE_STATE;
+    }
+    if (setNonBlocking(socketID)
+        || (connect(socketID, address, addressLength) && errno != EINPROGRESS))
+    {
+        int connectError = errno;
+        if (close(socketID))
+        {
+            systemCallError(CLOSE_NAME, errno);
+        }
+        errno = connectError;
+        return FAILURE_STATE;
+    }
+    return socketID;
+}
+
+/**
+ * @brief Attempt to connect a socket to the server provided by host and port.
+ *        A host which is a path is connected as a Unix socket, otherwise
+ *        every address of the host is tried in turn until a connection
+ *        starts.
+ * @param hostName The host name of the server.
+ * @param portNumber The port number of the server.
+ * @return The connecting socket upon success, -1 otherwise.
+ */
+static int connectServer(const char *hostName, const portNumber_t portNumber)
+{
+    if (isUnixSocketPath(hostName))
+    {
+        sockaddr_un sa;
+        if (setUnixSocketAddress(hostName, sa))
+        {
+            systemCallError(CONNECT_NAME, ENAMETOOLONG);
+            return FAILURE_STATE;
+        }
+        int socketID = connectSocket(AF_UNIX, (sockaddr *) &sa,
+                                     sizeof(sockaddr_un));
+        if (socketID < SOCKET_ID_BOUND)
+        {
+            systemCallError(CONNECT_NAME, errno);
+        }
+        return socketID;
+    }
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    std::string port = std::to_string(portNumber);
+    int error = getaddrinfo(hostName, port.c_str(), &hints, &addresses);
+    if (error)
+    {
+        addressInfoError(error);
+        return FAILURE_STATE;
+    }
+
+    int socketID = FAILURE_STATE;
+    for (addrinfo *i = addresses; i != nullptr; i = i->ai_next)
+    {
+        socketID = connectSocket(i->ai_family, i->ai_addr, i->ai_addrlen);
+        if (socketID >= SOCKET_ID_BOUND)
+        {
+            break;
+        }
+    }
+    if (socketID < SOCKET_ID_BOUND)
+    {
+        systemCallError(CONNECT_NAME, errno);
+    }
+    else
+    {
+        setNoDelay(socketID);
+    }
+    freeaddrinfo(addresses);
+
+    return socketID;
+}
+
+
+/*-----=  WhatsApp Session  =-----*/
+
+
+WhatsAppSession::WhatsAppSession(const clientName_t &name) :
+        _name(name), _messageCount(0), _port(0), _socket(FAILURE_STATE),
+        _sharedMemory(false), _negotiating(false), _poller(FAILURE_STATE),
+        _signals(false), _timestamps(false), _stamps(),
+        _signalSocket(FAILURE_STATE),
+        _state(CLOSED_SESSION), _connection(0), _redirects(0), _reconnects(0),
+        _reconnecting(false), _notifiedWrite(false)
+{
+    // A random prefix keeps the IDs unique after the client is restarted.
+    std::stringstream prefix;
+    prefix << MESSAGE_ID_PREFIX << std::hex << std::random_device()()
+           << std::random_device()() << MESSAGE_ID_SEP;
+    _messageIDPrefix = prefix.str();
+}
+
+WhatsAppSession::~WhatsAppSession()
+{
+    _channel.release();
+    if (_poller >= SOCKET_ID_BOUND && close(_poller))
+    {
+        systemCallError(CLOSE_NAME, errno);
+    }
+    if (_signalSocket >= SOCKET_ID_BOUND && close(_signalSocket))
+    {
+        systemCallError(CLOSE_NAME, errno);
+    }
+    if (_socket >= SOCKET_ID_BOUND && close(_socket))
+    {
+        systemCallError(CLOSE_NAME, errno);
+    }
+}
+
+int WhatsAppSession::connect(const char *hostName,
+                             const portNumber_t portNumber,
+                             connectCallback_t onConnect)
+{
+    if (_state != CLOSED_SESSION || !isValidName(_name))
+    {
+        return FAILURE_STATE;
+    }
+    _redirects = 0;
+    _reconnecting = false;
+    _token.clear();
+    _topics.clear();
+    _onConnect = onConnect;
+    return _openConnection(hostName, portNumber);
+}
+
+int WhatsAppSession::createGroup(const groupName_t &groupName,
+                                 const std::vector<clientName_t> &members,
+                                 responseCallback_t onResponse)
+{
+    // A repeated group creation would fail, so it is not sent again.
+    return _groupRequest(CREATE_GROUP, groupName, members, onResponse, false);
+}
+
+int WhatsAppSession::addToGroup(const groupName_t &groupName,
+                                const std::vector<clientName_t> &members,
+                                responseCallback_t onResponse)
+{
+    // Adding a member again leaves it as is, so it is safe to repeat.
+    return _groupRequest(ADD_TO_GROUP, groupName, members, onResponse, true);
+}
+
+int WhatsAppSession::removeFromGroup(const groupName_t &groupName,
+                                     const std::vector<clientName_t> &members,
+                                     responseCallback_t onResponse)
+{
+    return _groupRequest(REMOVE_FROM_GROUP, groupName, members, onResponse,
+                         false);
+}
+
+int WhatsAppSession::leaveGroup(const groupName_t &groupName,
+                                responseCallback_t onResponse)
+{
+    if (!isValidName(groupName))
+    {
+        return FAILURE_STATE;
+    }
+    return _request(std::to_string(LEAVE_GROUP) + groupName, onResponse,
+                    false);
+}
+
+int WhatsAppSession::send(const std::string &receiver, const message_t &message,
+                          responseCallback_t onResponse)
+{
+    // A client can not send a message to itself.
+    if (!isValidName(receiver) || receiver.compare(_name) == EQUAL_COMPARISON
+        || message.find(MSG_TERMINATOR) != std::string::npos)
+    {
+        return FAILURE_STATE;
+    }
+
+    // Add the message tag representing send and the message ID.
+    return _request(std::to_string(SEND) + _messageIDPrefix
+                    + std::to_string(++_messageCount) + WHITE_SPACE_SEPARATOR
+                    + receiver + WHITE_SPACE_SEPARATOR + message, onResponse,
+                    true);
+}
+
+int WhatsAppSession::multiSend(const std::vector<clientName_t> &receivers,
+                               const message_t &message,
+                               responseCallback_t onResponse)
+{
+    if (receivers.empty() || message.find(MSG_TERMINATOR) != std::string::npos)
+    {
+        return FAILURE_STATE;
+    }
+
+    // Add the message tag representing multi send and the message ID.
+    message_t request = messageTag(MULTI_SEND) + _messageIDPrefix
+                        + std::to_string(++_messageCount)
+                        + WHITE_SPACE_SEPARATOR;
+    for (auto i = receivers.begin(); i != receivers.end(); ++i)
+    {
+        if (!isValidName(*i))
+        {
+            return FAILURE_STATE;
+        }
+        if (i != receivers.begin())
+        {
+            request += GROUP_CLIENTS_DELIM;
+        }
+        request += *i;
+    }
+    return _request(request + WHITE_SPACE_SEPARATOR + message, onResponse,
+                    true);
+}
+
+int WhatsAppSession::broadcast(const message_t &message,
+                               responseCallback_t onResponse)
+{
+    if (message.find(MSG_TERMINATOR) != std::string::npos)
+    {
+        return FAILURE_STATE;
+    }
+
+    // Add the message tag representing broadcast and the message ID.
+    return _request(messageTag(BROADCAST) + _messageIDPrefix
+                    + std::to_string(++_messageCount) + WHITE_SPACE_SEPARATOR
+                    + message, onResponse, true);
+}
+
+int WhatsAppSession::subscribeTopic(const std::string &filter,
+                                    responseCallback_t onResponse)
+{
+    if (validateTopic(filter, true)
+        || _request(messageTag(SUBSCRIBE) + SUBSCRIBE_MARK + filter,
+                    onResponse, true))
+    {
+        return FAILURE_STATE;
+    }
+    _topics.insert(filter);
+    return SUCCESS_STATE;
+}
+
+int WhatsAppSession::unsubscribeTopic(const std::string &filter,
+                                      responseCallback_t onResponse)
+{
+    // The subscription is dropped anyway if the connection is lost.
+    if (_topics.find(filter) == _topics.end()
+        || _request(messageTag(SUBSCRIBE) + UNSUBSCRIBE_MARK + filter,
+                    onResponse, false))
+    {
+        return FAILURE_STATE;
+    }
+    _topics.erase(filter);
+    return SUCCESS_STATE;
+}
+
+int WhatsAppSession::publish(const std::string &topic,
+                             const message_t &message,
+                             responseCallback_t onResponse)
+{
+    if (validateTopic(topic, false)
+        || message.find(MSG_TERMINATOR) != std::string::npos)
+    {
+        return FAILURE_STATE;
+    }
+
+    // Add the message tag representing publish and the message ID.
+    return _request(messageTag(PUBLISH) + _messageIDPrefix
+                    + std::to_string(++_messageCount) + WHITE_SPACE_SEPARATOR
+                    + topic + WHITE_SPACE_SEPARATOR + message, onResponse,
+                    true);
+}
+
+int WhatsAppSession::who(responseCallback_t onResponse)
+{
+    return _request(std::to_string(WHO), onResponse, true);
+}
+
+int WhatsAppSession::ping(pingCallback_t onPong)
+{
+    uint64_t sent = monotonicTime();
+    return _request(messageTag(PING), [sent, onPong](const message_t &response)
+    {
+        FrameTimestamps times = {sent, 0, 0, monotonicTime()};
+        std::istringstream fields(response);
+        fields >> times.received >> times.dispatched;
+        if (onPong)
+        {
+            onPong(times);
+        }
+    }, false);
+}
+
+int WhatsAppSession::typing(const groupName_t &groupName)
+{
+    if (_state != CONNECTED_SESSION || _signalSocket < SOCKET_ID_BOUND
+        || !isValidName(groupName))
+    {
+        return FAILURE_STATE;
+    }
+    _signal(TYPING_SIGNAL, groupName);
+    return SUCCESS_STATE;
+}
+
+int WhatsAppSession::logout()
+{
+    if (_state != CONNECTED_SESSION)
+    {
+        return FAILURE_STATE;
+    }
+    // The response of the server is the last byte it sends before it closes.
+    _queue(std::to_string(CLIENT_EXIT));
+    _state = LOGOUT_SESSION;
+    return SUCCESS_STATE;
+}
+
+void WhatsAppSession::subscribe(messageCallback_t onMessage)
+{
+    _onMessage = onMessage;
+}
+
+void WhatsAppSession::onSignal(signalCallback_t onSignal)
+{
+    _onSignal = onSignal;
+}
+
+void WhatsAppSession::onClose(closeCallback_t onClose)
+{
+    _onClose = onClose;
+}
+
+void WhatsAppSession::onReconnect(connectCallback_t onReconnect)
+{
+    _onReconnect = onReconnect;
+}
+
+void WhatsAppSession::onInterest(interestCallback_t onInterest)
+{
+    _onInterest = onInterest;
+}
+
+int WhatsAppSession::handleEvents(const bool readable, const bool writable)
+{
+    if (_state == CLOSED_SESSION)
+    {
+        return FAILURE_STATE;
+    }
+    if (_state == CONNECTING_SESSION && (readable || writable)
+        && _completeConnection())
+    {
+        return FAILURE_STATE;
+    }
+
+    if (readable && _negotiating)
+    {
+        if (_openChannel())
+        {
+            return _failHandshake(CONNECTION_FAIL_STATE);
+        }
+    }
+    else if (readable)
+    {
+        unsigned int connection = _connection;
+        int state = _receive();
+        if (_process())
+        {
+            return FAILURE_STATE;
+        }
+        // A redirected session does not care about the end of the old socket.
+        if (state && connection == _connection)
+        {
+            // After a logout the server closes right after the logout state.
+            message_t logoutState(1, LOGOUT_SUCCESS_STATE);
+            bool loggedOut = _state == LOGOUT_SESSION
+                             && _input.compare(logoutState) == EQUAL_COMPARISON;
+            if (_state == HANDSHAKE_SESSION)
+            {
+                return _failHandshake(CONNECTION_FAIL_STATE);
+            }
+            if (_state == CONNECTED_SESSION && !_token.empty())
+            {
+                // The server keeps the session for a while, so resume it.
+                _reconnects = 0;
+                _reconnecting = true;
+                return _reconnect();
+            }
+            _disconnect();
+            closeCallback_t onClose = _onClose;
+            if (onClose)
+            {
+                onClose(loggedOut ? LOGOUT_CLOSE : CONNECTION_LOST_CLOSE);
+            }
+            return FAILURE_STATE;
+        }
+    }
+
+    if (writable || !_output.empty())
+    {
+        _flush();
+    }
+    _notifyInterest(false);
+    return SUCCESS_STATE;
+}
+
+void WhatsAppSession::handleSignals()
+{
+    char datagram[MAX_SIGNAL_SIZE];
+    while (_signalSocket >= SOCKET_ID_BOUND)
+    {
+        ssize_t length = recv(_signalSocket, datagram, MAX_SIGNAL_SIZE, 0);
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (length <= 0)
+        {
+            // A lost or refused signal is not an error of the session.
+            return;
+        }
+
+        // A signal is in the form "<tag>sender [group]".
+        clientName_t sender;
+        groupName_t groupName;
+        std::istringstream fields(std::string(datagram + 1, length - 1));
+        fields >> sender >> groupName;
+        int tag = datagram[MSG_BEGIN_INDEX] - TAG_CHAR_BASE;
+        if ((tag == TYPING_SIGNAL || tag == PRESENCE_SIGNAL) && _onSignal
+            && !sender.empty())
+        {
+            _onSignal((SignalTag) tag, sender, groupName);
+        }
+    }
+}
+
+/**
+ * @brief Open a connection to the server provided by host and port, and queue
+ *        the client name, which is the first request of the handshake. On a
+ *        Unix socket the session may first ask for a shared memory channel,
+ *        and the name is sent over the channel.
+ * @param hostName The host name of the server (or a Unix socket path).
+ * @param portNumber The port number of the server.
+ * @return 0 upon success, -1 otherwise.
+ */
+int WhatsAppSession::_openConnection(const char *hostName,
+                                     const portNumber_t portNumber)
+{
+    std::string host = hostName;
+    _socket = connectServer(hostName, portNumber);
+    if (_socket < SOCKET_ID_BOUND)
+    {
+        return FAILURE_STATE;
+    }
+
+    // Keep the address of the node that owns the name to reconnect to it.
+    _host = host;
+    _port = portNumber;
+    _connection++;
+    _state = CONNECTING_SESSION;
+    _input.clear();
+    _negotiating = _sharedMemory && isUnixSocketPath(hostName);
+    if (_negotiating)
+    {
+        _output = SHARED_MEMORY_REQUEST;
+        _output += (char) MSG_TERMINATOR;
+    }
+    else
+    {
+        _queueName();
+    }
+    _notifyInterest(true);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Queue the client name, followed by the resume token when the session
+ *        reconnects.
+ */
+void WhatsAppSession::_queueName()
+{
+    _output = _name;
+    if (_reconnecting)
+    {
+        _output += WHITE_SPACE_SEPARATOR + _token;
+    }
+    _output += (char) MSG_TERMINATOR;
+}
+
+/**
+ * @brief Complete the connection of the socket once it is ready, after which
+ *        the queued client name is written.
+ * @return 0 upon success, -1 if the connection failed and the session was
+ *         closed.
+ */
+int WhatsAppSession::_completeConnection()
+{
+    int error = SUCCESS_STATE;
+    socklen_t errorLength = sizeof(int);
+    if (getsockopt(_socket, SOL_SOCKET, SO_ERROR, &error, &errorLength))
+    {
+        error = errno;
+    }
+    if (error == SUCCESS_STATE)
+    {
+        _state = HANDSHAKE_SESSION;
+        return SUCCESS_STATE;
+    }
+
+    systemCallError(CONNECT_NAME, error);
+    return _failHandshake(CONNECTION_FAIL_STATE);
+}
+
+/**
+ * @brief Attach the shared memory channel the server passed in response to the
+ *        request of the session, and queue the client name over it. From now
+ *        on the session waits on an epoll descriptor of its socket and of its
+ *        doorbell.
+ * @return 0 upon success, -1 if the server did not pass a channel.
+ */
+int WhatsAppSession::_openChannel()
+{
+    std::vector<int> descriptors;
+    if (receiveDescriptors(_socket, SHARED_CHANNEL_DESCRIPTORS, descriptors))
+    {
+        return FAILURE_STATE;
+    }
+    if (descriptors.size() != SHARED_CHANNEL_DESCRIPTORS)
+    {
+        for (int descriptor : descriptors)
+        {
+            close(descriptor);
+        }
+        return FAILURE_STATE;
+    }
+    if (_channel.attach(descriptors[0], descriptors[1], descriptors[2], false))
+    {
+        return FAILURE_STATE;
+    }
+
+    _poller = epoll_create1(EPOLL_CLOEXEC);
+    if (_poller < SOCKET_ID_BOUND)
+    {
+        systemCallError(EPOLL_CREATE_NAME, errno);
+        return FAILURE_STATE;
+    }
+    int watched[CHANNEL_POLL_EVENTS] = {_socket, _channel.doorbell()};
+    for (int descriptor : watched)
+    {
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN;
+        event.data.fd = descriptor;
+        if (epoll_ctl(_poller, EPOLL_CTL_ADD, descriptor, &event))
+        {
+            systemCallError(EPOLL_CTL_NAME, errno);
+            return FAILURE_STATE;
+        }
+    }
+
+    _negotiating = false;
+    _queueName();
+    _notifyInterest(true);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Queue a request which expects a response.
+ * @param request The request.
+ * @param onResponse The callback of the response.
+ * @param repeatable Whether the request may be sent again after a resume.
+ * @return 0 upon success, -1 if the session is not connected.
+ */
+int WhatsAppSession::_request(const message_t &request,
+                              responseCallback_t onResponse,
+                              const bool repeatable)
+{
+    if (_state != CONNECTED_SESSION)
+    {
+        return FAILURE_STATE;
+    }
+    _queue(request);
+    _requests.push_back({request, onResponse, repeatable});
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Queue a request of a group with the given members.
+ * @param tag The tag of the request.
+ * @param groupName The group name.
+ * @param members The names of the members.
+ * @param onResponse The callback of the response.
+ * @param repeatable Whether the request may be sent again after a resume.
+ * @return 0 upon success, -1 if the session is not connected or the names
+ *         are not valid.
+ */
+int WhatsAppSession::_groupRequest(const MessageTag tag,
+                                   const groupName_t &groupName,
+                                   const std::vector<clientName_t> &members,
+                                   responseCallback_t onResponse,
+                                   const bool repeatable)
+{
+    if (!isValidName(groupName) || members.empty())
+    {
+        return FAILURE_STATE;
+    }
+
+    // Add the message tag and the group name.
+    message_t request = std::to_string(tag) + groupName;
+    // Add the group members.
+    for (auto i = members.begin(); i != members.end(); ++i)
+    {
+        if (!isValidName(*i))
+        {
+            return FAILURE_STATE;
+        }
+        request += WHITE_SPACE_SEPARATOR + *i;
+    }
+    return _request(request, onResponse, repeatable);
+}
+
+/**
+ * @brief Send again the requests which were not answered before the
+ *        connection was lost, in their order. The requests which can not be
+ *        repeated are dropped, since they may have been done already.
+ */
+void WhatsAppSession::_resendRequests()
+{
+    std::deque<_Request> requests;
+    requests.swap(_requests);
+    for (auto i = requests.begin(); i != requests.end(); ++i)
+    {
+        if (i->repeatable)
+        {
+            _queue(i->request);
+            _requests.push_back(*i);
+        }
+    }
+}
+
+/**
+ * @brief Queue a request to the server. The request is written when the
+ *        socket accepts it, so the session never blocks on a busy server, and
+ *        right away over a shared memory channel.
+ * @param request The request to queue.
+ */
+void WhatsAppSession::_queue(const message_t &request)
+{
+    _output += request;
+    _output += (char) MSG_TERMINATOR;
+    if (_channel.open())
+    {
+        // The channel never blocks, so there is no reason to wait for it.
+        _flush();
+    }
+    _notifyInterest(false);
+}
+
+/**
+ * @brief Write as much as possible of the queued requests without blocking.
+ *        A failure is not final here, the read side reports the lost
+ *        connection.
+ * @return 0 upon success, -1 if the socket failed.
+ */
+int WhatsAppSession::_flush()
+{
+    if (_channel.open())
+    {
+        ssize_t written = _channel.write(_output.data(), _output.length());
+        if (written < 0)
+        {
+            _output.clear();
+            return FAILURE_STATE;
+        }
+        _output.erase(MSG_BEGIN_INDEX, written);
+        return SUCCESS_STATE;
+    }
+
+    size_t written = INITIAL_WRITE_COUNT;
+    while (written < _output.length())
+    {
+        ssize_t currentCount = ::send(_socket, _output.data() + written,
+                                      _output.length() - written, MSG_NOSIGNAL);
+        if (currentCount < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (wouldBlock())
+            {
+                break;
+            }
+            systemCallError(WRITE_NAME, errno);
+            _output.clear();
+            return FAILURE_STATE;
+        }
+        written += currentCount;
+    }
+    _output.erase(MSG_BEGIN_INDEX, written);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Reads all the data currently available from the server without
+ *        blocking.
+ * @return 0 upon success, -1 if the server closed the connection or failed.
+ */
+int WhatsAppSession::_receive()
+{
+    if (_channel.open())
+    {
+        // Checked first, so the data the server wrote before it closed is read.
+        bool closed = _channel.closed();
+        if (_channel.read(_input) < 0)
+        {
+            return FAILURE_STATE;
+        }
+        char discarded;
+        ssize_t result = read(_socket, &discarded, sizeof(char));
+        return (closed || result == 0 || (result < 0 && !wouldBlock())) ?
+               FAILURE_STATE : SUCCESS_STATE;
+    }
+
+    char currentChunk[READ_BUFFER_SIZE];
+    while (true)
+    {
+        ssize_t currentCount = read(_socket, currentChunk, READ_BUFFER_SIZE);
+        if (currentCount < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (wouldBlock())
+            {
+                return SUCCESS_STATE;
+            }
+            systemCallError(READ_NAME, errno);
+            return FAILURE_STATE;
+        }
+        if (currentCount == 0)
+        {
+            return FAILURE_STATE;
+        }
+        _input.append(currentChunk, (size_t) currentCount);
+        if (currentCount < READ_BUFFER_SIZE)
+        {
+            return SUCCESS_STATE;
+        }
+    }
+}
+
+/**
+ * @brief Parse the data received from the server. The data is parsed
+ *        incrementally: every complete message is processed, and a partial
+ *        message is kept until the rest of it arrives.
+ * @return 0 upon success, -1 if the session was closed.
+ */
+int WhatsAppSession::_process()
+{
+    if (_state == HANDSHAKE_SESSION)
+    {
+        if (_handleHandshake())
+        {
+            return FAILURE_STATE;
+        }
+        if (_state == HANDSHAKE_SESSION)
+        {
+            return SUCCESS_STATE;
+        }
+    }
+
+    size_t position = MSG_BEGIN_INDEX;
+    auto messageEnd = _input.find(MSG_TERMINATOR);
+    while (messageEnd != std::string::npos)
+    {
+        message_t message = _input.substr(position, messageEnd - position);
+        position = messageEnd + 1;
+        if (!message.empty() && _processMessage(message))
+        {
+            return FAILURE_STATE;
+        }
+        messageEnd = _input.find(MSG_TERMINATOR, position);
+    }
+    _input.erase(MSG_BEGIN_INDEX, position);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Handle the response of the server to the client name, which is a
+ *        single state character (followed by an address on a redirect).
+ * @return 0 upon success or if the response is not complete yet, -1 if the
+ *         session was closed.
+ */
+int WhatsAppSession::_handleHandshake()
+{
+    if (_input.empty())
+    {
+        return SUCCESS_STATE;
+    }
+
+    char connectionState = _input.front();
+    if (connectionState == CONNECTION_REDIRECT_STATE)
+    {
+        // If another server node owns the name, it sends its address.
+        auto addressEnd = _input.find(MSG_TERMINATOR);
+        if (addressEnd == std::string::npos)
+        {
+            return SUCCESS_STATE;
+        }
+        return _redirect(_input.substr(1, addressEnd - 1));
+    }
+
+    if (connectionState == CONNECTION_SUCCESS_STATE
+        || connectionState == CONNECTION_RESUMED_STATE)
+    {
+        connectCallback_t onConnect = _reconnecting ? _onReconnect
+                                                    : _onConnect;
+        _input.erase(MSG_BEGIN_INDEX, 1);
+        _state = CONNECTED_SESSION;
+        if (_timestamps)
+        {
+            // Every connection starts without timestamps.
+            _queue(messageTag(TIMESTAMP));
+        }
+        if (_reconnecting && connectionState == CONNECTION_RESUMED_STATE)
+        {
+            _resendRequests();
+        }
+        else
+        {
+            // A new session does not know the requests of the lost one.
+            _requests.clear();
+        }
+        for (auto i = _topics.begin(); i != _topics.end() && _reconnecting;
+             ++i)
+        {
+            // The server dropped the subscriptions with the lost connection.
+            _request(messageTag(SUBSCRIBE) + SUBSCRIBE_MARK + *i, nullptr,
+                     true);
+        }
+        _reconnecting = false;
+        if (onConnect)
+        {
+            onConnect(connectionState);
+        }
+        return SUCCESS_STATE;
+    }
+
+    // The name is already taken or any other failure.
+    return _failHandshake(connectionState == CONNECTION_IN_USE_STATE ?
+                          CONNECTION_IN_USE_STATE : CONNECTION_FAIL_STATE);
+}
+
+/**
+ * @brief Close the session after a failed handshake, unless the session is
+ *        reconnecting and may still try again.
+ * @param connectionState The state of the failure.
+ * @return 0 if the session tries to reconnect again, -1 if it was closed.
+ */
+int WhatsAppSession::_failHandshake(const char connectionState)
+{
+    if (_reconnecting)
+    {
+        return _reconnect();
+    }
+    _disconnect();
+    connectCallback_t onConnect = _onConnect;
+    if (onConnect)
+    {
+        onConnect(connectionState);
+    }
+    return FAILURE_STATE;
+}
+
+/**
+ * @brief Connect to the server node which owns the client name.
+ * @param address The address of the node, in the form host:port.
+ * @return 0 upon success, -1 if the session was closed.
+ */
+int WhatsAppSession::_redirect(const message_t &address)
+{
+    _disconnect();
+    std::string host;
+    std::string port;
+    if (++_redirects > MAX_REDIRECTS || splitNodeAddress(address, host, port)
+        || _openConnection(host.c_str(), (portNumber_t) std::stoi(port)))
+    {
+        return _failHandshake(CONNECTION_FAIL_STATE);
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Reconnect to the server after the connection was lost, and resume
+ *        the session with its resume token. The requests which were not
+ *        answered are kept until the session is resumed.
+ * @return 0 if the session is reconnecting, -1 if it ran out of attempts and
+ *         was closed.
+ */
+int WhatsAppSession::_reconnect()
+{
+    std::deque<_Request> requests;
+    requests.swap(_requests);
+    _disconnect();
+    _requests.swap(requests);
+    _redirects = 0;
+    while (_reconnects < MAX_RECONNECTS)
+    {
+        if (_reconnects > 0)
+        {
+            usleep(RECONNECT_DELAY * _reconnects);
+        }
+        _reconnects++;
+        if (_openConnection(_host.c_str(), _port) == SUCCESS_STATE)
+        {
+            return SUCCESS_STATE;
+        }
+    }
+    _reconnecting = false;
+    _requests.clear();
+    closeCallback_t onClose = _onClose;
+    if (onClose)
+    {
+        onClose(CONNECTION_LOST_CLOSE);
+    }
+    return FAILURE_STATE;
+}
+
+/**
+ * @brief Process a message received from the server.
+ * @param message The message to process.
+ * @return 0 upon success, -1 if the session was closed.
+ */
+int WhatsAppSession::_processMessage(const message_t &message)
+{
+    int tagChar = message.front() - TAG_CHAR_BASE;
+
+    switch (tagChar)
+    {
+        case CREATE_GROUP:
+        case SEND:
+        case MULTI_SEND:
+        case BROADCAST:
+        case WHO:
+        case ADD_TO_GROUP:
+        case REMOVE_FROM_GROUP:
+        case LEAVE_GROUP:
+        case PING:
+        case SUBSCRIBE:
+        case PUBLISH:
+        {
+            if (_requests.empty())
+            {
+                return SUCCESS_STATE;
+            }
+            responseCallback_t onResponse = _requests.front().onResponse;
+            _requests.pop_front();
+            if (onResponse)
+            {
+                onResponse(message.substr(1));  // Trim the message tag.
+            }
+            _stamps = FrameTimestamps();
+            return SUCCESS_STATE;
+        }
+
+        case TIMESTAMP:
+        {
+            // The times of the frame which follows.
+            std::istringstream fields(message.substr(1));
+            _stamps = FrameTimestamps();
+            fields >> _stamps.received >> _stamps.dispatched;
+            _stamps.arrived = monotonicTime();
+            return SUCCESS_STATE;
+        }
+
+        case SERVER_EXIT:
+        {
+            _disconnect();
+            closeCallback_t onClose = _onClose;
+            if (onClose)
+            {
+                onClose(SERVER_EXIT_CLOSE);
+            }
+            return FAILURE_STATE;
+        }
+
+        case HEARTBEAT:
+            // Answer the heartbeat, so the server knows this client is alive.
+            _queue(std::to_string(HEARTBEAT));
+            _signal(PRESENCE_SIGNAL, EMPTY_MSG);
+            return SUCCESS_STATE;
+
+        case SIGNAL_TOKEN:
+            // The server offers a side channel, which is used if wanted.
+            if (_signals)
+            {
+                _openSignals(message.substr(1));
+            }
+            return SUCCESS_STATE;
+
+        case RESUME_TOKEN:
+            // Keep the token to resume the session if the connection is lost.
+            _token = message.substr(1);
+            return SUCCESS_STATE;
+
+        default:
+            if (_onMessage)
+            {
+                _onMessage(message);
+            }
+            _stamps = FrameTimestamps();
+            return SUCCESS_STATE;
+    }
+}
+
+/**
+ * @brief Open the UDP side channel to the signal port of the server, at the
+ *        address of the server this session is connected to, and announce the
+ *        presence of the session on it.
+ * @param token The signal port and the signal token, separated by a space.
+ * @return 0 upon success, -1 if the side channel could not be opened.
+ */
+int WhatsAppSession::_openSignals(const message_t &token)
+{
+    unsigned long port = 0;
+    std::istringstream fields(token);
+    fields >> port >> _signalToken;
+
+    sockaddr_storage address;
+    socklen_t addressLength = sizeof(sockaddr_storage);
+    if (getpeername(_socket, (sockaddr *) &address, &addressLength))
+    {
+        return FAILURE_STATE;
+    }
+    // A Unix socket has no side channel.
+    if (address.ss_family == AF_INET)
+    {
+        ((sockaddr_in *) &address)->sin_port = htons((uint16_t) port);
+    }
+    else if (address.ss_family == AF_INET6)
+    {
+        ((sockaddr_in6 *) &address)->sin6_port = htons((uint16_t) port);
+    }
+    else
+    {
+        return FAILURE_STATE;
+    }
+
+    if (_signalSocket >= SOCKET_ID_BOUND)
+    {
+        close(_signalSocket);
+    }
+    // A connected socket receives the datagrams of the server only.
+    _signalSocket = socket(address.ss_family, SOCK_DGRAM, 0);
+    if (_signalSocket < SOCKET_ID_BOUND)
+    {
+        systemCallError(SOCKET_NAME, errno);
+        return FAILURE_STATE;
+    }
+    if (setNonBlocking(_signalSocket)
+        || ::connect(_signalSocket, (sockaddr *) &address, addressLength))
+    {
+        systemCallError(CONNECT_NAME, errno);
+        close(_signalSocket);
+        _signalSocket = FAILURE_STATE;
+        return FAILURE_STATE;
+    }
+    _signal(PRESENCE_SIGNAL, EMPTY_MSG);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Send a signal over the side channel, if the session has one. The
+ *        signal is in the form "<tag>name token [group]", and it is dropped
+ *        if the socket can not take it right away.
+ * @param tag The tag of the signal.
+ * @param groupName The group of the signal, or empty if it has none.
+ */
+void WhatsAppSession::_signal(const SignalTag tag, const groupName_t &groupName)
+{
+    if (_signalSocket < SOCKET_ID_BOUND)
+    {
+        return;
+    }
+    message_t datagram(1, (char) (TAG_CHAR_BASE + tag));
+    datagram += _name + WHITE_SPACE_DELIM + _signalToken;
+    if (!groupName.empty())
+    {
+        datagram += WHITE_SPACE_DELIM + groupName;
+    }
+    ::send(_signalSocket, datagram.data(), datagram.length(), MSG_DONTWAIT);
+}
+
+/**
+ * @brief Notify the interest callback on a change of the write interest.
+ * @param force Whether to notify even if the interest did not change.
+ */
+void WhatsAppSession::_notifyInterest(const bool force)
+{
+    bool writing = wantsWrite();
+    if (_socket < SOCKET_ID_BOUND || (!force && writing == _notifiedWrite))
+    {
+        return;
+    }
+    _notifiedWrite = writing;
+    if (_onInterest)
+    {
+        _onInterest(fileDescriptor(), writing);
+    }
+}
+
+/**
+ * @brief Close the connection of the session.
+ */
+void WhatsAppSession::_disconnect()
+{
+    _channel.release();
+    if (_poller >= SOCKET_ID_BOUND && close(_poller))
+    {
+        systemCallError(CLOSE_NAME, errno);
+    }
+    _poller = FAILURE_STATE;
+    _negotiating = false;
+    if (_signalSocket >= SOCKET_ID_BOUND && close(_signalSocket))
+    {
+        systemCallError(CLOSE_NAME, errno);
+    }
+    _signalSocket = FAILURE_STATE;
+    _signalToken.clear();
+    if (_socket >= SOCKET_ID_BOUND && close(_socket))
+    {
+        systemCallError(CLOSE_NAME, errno);
+    }
+    _socket = FAILURE_STATE;
+    _state = CLOSED_SESSION;
+    _output.clear();
+    _requests.clear();
+}
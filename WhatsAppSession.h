@@ -0,0 +1,570 @@
+/**
+ * @file WhatsAppSession.h
+ * @author Itai Tagar <itagar>
+ *
+ * @brief The WhatsApp Client Library (libwhatsapp), a single client session
+ *        which can be embedded in any event loop.
+ */
+
+
+#ifndef WHATSAPP_SESSION_H
+#define WHATSAPP_SESSION_H
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <set>
+#include <deque>
+#include <random>
+#include <functional>
+#include <sys/epoll.h>
+#include "WhatsApp.h"
+#include "SharedChannel.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def MAX_REDIRECTS 3
+ * @brief A Macro that sets the maximal number of redirects between servers.
+ */
+#define MAX_REDIRECTS 3
+
+/**
+ * @def MAX_RECONNECTS 6
+ * @brief A Macro that sets the maximal number of attempts to resume a session
+ *        which lost its connection.
+ */
+#define MAX_RECONNECTS 6
+
+/**
+ * @def RECONNECT_DELAY 200000
+ * @brief A Macro that sets the microseconds to wait before another attempt to
+ *        resume a session, times the number of the attempts so far. The wait
+ *        gives a replica of the server the time to take over.
+ */
+#define RECONNECT_DELAY 200000
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief The states of a session.
+ */
+enum SessionState
+{
+    CLOSED_SESSION,
+    CONNECTING_SESSION,
+    HANDSHAKE_SESSION,
+    CONNECTED_SESSION,
+    LOGOUT_SESSION
+};
+
+/**
+ * @brief The reasons for the end of a connected session.
+ */
+enum CloseReason
+{
+    LOGOUT_CLOSE,
+    SERVER_EXIT_CLOSE,
+    CONNECTION_LOST_CLOSE
+};
+
+/**
+ * @brief Type Definition for the callback of the handshake result, which gets
+ *        the connection state of the server (success, name in use or failure).
+ */
+typedef std::function<void(const char connectionState)> connectCallback_t;
+
+/**
+ * @brief Type Definition for the callback of the response to a request.
+ */
+typedef std::function<void(const message_t &response)> responseCallback_t;
+
+/**
+ * @brief Type Definition for the callback of a message of another client.
+ */
+typedef std::function<void(const message_t &message)> messageCallback_t;
+
+/**
+ * @brief Type Definition for the callback of the end of a connected session.
+ */
+typedef std::function<void(const CloseReason reason)> closeCallback_t;
+
+/**
+ * @brief Type Definition for the callback of a change in the events a session
+ *        waits for, which gets the descriptor and whether it waits to write.
+ */
+typedef std::function<void(const int socketID, const bool writing)>
+        interestCallback_t;
+
+/**
+ * @brief Type Definition for the callback of a signal of another client, which
+ *        gets the group of a typing signal (empty for a presence signal).
+ */
+typedef std::function<void(const SignalTag tag, const clientName_t &sender,
+                           const groupName_t &groupName)> signalCallback_t;
+
+/**
+ * @brief The times of a frame of the server in microseconds of the monotonic
+ *        clock: when the session sent its request (0 if it did not), when the
+ *        server received the frame it handled, when the server dispatched its
+ *        own frame, and when the session read it. The times of the server are
+ *        of its clock, so on another host only their difference (the time the
+ *        frame spent in the server) is meaningful.
+ */
+struct FrameTimestamps
+{
+    uint64_t sent;
+    uint64_t received;
+    uint64_t dispatched;
+    uint64_t arrived;
+};
+
+/**
+ * @brief Type Definition for the callback of the answer to a ping.
+ */
+typedef std::function<void(const FrameTimestamps &times)> pingCallback_t;
+
+
+/*-----=  WhatsApp Session  =-----*/
+
+
+/**
+ * @brief A single client session of a WhatsApp server. The session never
+ *        blocks after it is connected: requests are queued and written when
+ *        the socket accepts them, and every response is delivered to the
+ *        callback of its request, in the order of the requests.
+ *        The session does not run an event loop of its own. The embedding
+ *        program waits for the descriptor of the session (for reading, and
+ *        for writing while wantsWrite() is true) in its own loop, and calls
+ *        handleEvents() when it is ready. The interest callback notifies on
+ *        every change of the descriptor or of the write interest, which is
+ *        what an epoll based loop needs.
+ *        A session which loses its connection reconnects by itself and resumes
+ *        its identity with the resume token the server issued, after which
+ *        the server replays the messages the session missed. Every send
+ *        carries a message ID, so the requests which were not answered before
+ *        the connection was lost are sent again after the session resumes,
+ *        and the server acknowledges a send it already delivered without
+ *        delivering it twice.
+ *        A session on a Unix socket may use a shared memory channel with the
+ *        server instead of the socket, which is then kept only to notice the
+ *        end of the connection. The descriptor of such a session is an epoll
+ *        descriptor which is readable on the events of both.
+ *        A session on a server with a UDP side channel may send and receive
+ *        signals (typing and presence) over it, which are never retransmitted
+ *        and never wait behind the messages. The embedding program waits for
+ *        the signal descriptor too, and calls handleSignals() when it is
+ *        readable. A presence signal is sent when the session connects and
+ *        on every heartbeat of the server.
+ *        A session which uses timestamps asks the server to stamp every frame
+ *        it sends in the handling of a frame (the responses and the messages
+ *        of other clients) with the times the server received and dispatched
+ *        it, which the callback of the frame reads with timestamps().
+ *        A session may be destroyed inside its close callback, or inside its
+ *        connect callback on a failure, but not inside any other callback.
+ */
+class WhatsAppSession
+{
+public:
+
+    /**
+     * @brief Constructs a new session.
+     * @param name The client name of the session.
+     */
+    explicit WhatsAppSession(const clientName_t &name);
+
+    /**
+     * @brief Destroys the session and closes its connection.
+     */
+    ~WhatsAppSession();
+
+    /**
+     * @brief Start to connect to the server provided by host and port, which
+     *        is followed by the handshake. Neither of them blocks, and a
+     *        redirect to another server node is followed by the session
+     *        itself.
+     * @param hostName The host name of the server (or a Unix socket path).
+     * @param portNumber The port number of the server.
+     * @param onConnect The callback of the handshake result. The session is
+     *        closed after any result other than a success.
+     * @return 0 upon success, -1 if the connection could not be started.
+     */
+    int connect(const char *hostName, const portNumber_t portNumber,
+                connectCallback_t onConnect);
+
+    /**
+     * @brief Request to create a group.
+     * @param groupName The group name.
+     * @param members The names of the group members.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the names
+     *         are not valid.
+     */
+    int createGroup(const groupName_t &groupName,
+                    const std::vector<clientName_t> &members,
+                    responseCallback_t onResponse);
+
+    /**
+     * @brief Request to add clients to a group the session is a member of. The
+     *        request is sent again if the session resumes before it was
+     *        answered.
+     * @param groupName The group name.
+     * @param members The names of the clients to add.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the names
+     *         are not valid.
+     */
+    int addToGroup(const groupName_t &groupName,
+                   const std::vector<clientName_t> &members,
+                   responseCallback_t onResponse);
+
+    /**
+     * @brief Request to remove members from a group the session is a member
+     *        of. A group which is left without members is removed.
+     * @param groupName The group name.
+     * @param members The names of the members to remove.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the names
+     *         are not valid.
+     */
+    int removeFromGroup(const groupName_t &groupName,
+                        const std::vector<clientName_t> &members,
+                        responseCallback_t onResponse);
+
+    /**
+     * @brief Request to leave a group. A group which is left without members
+     *        is removed.
+     * @param groupName The group name.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the name
+     *         is not valid.
+     */
+    int leaveGroup(const groupName_t &groupName, responseCallback_t onResponse);
+
+    /**
+     * @brief Request to send a message to a client or a group. The request is
+     *        sent again if the session resumes before it was answered.
+     * @param receiver The name of the client or the group.
+     * @param message The message to send.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the
+     *         request is not valid.
+     */
+    int send(const std::string &receiver, const message_t &message,
+             responseCallback_t onResponse);
+
+    /**
+     * @brief Request to send a single message to several clients. The server
+     *        answers once, with the receivers it failed to send to. The
+     *        request is sent again if the session resumes before it was
+     *        answered.
+     * @param receivers The names of the clients.
+     * @param message The message to send.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the
+     *         request is not valid.
+     */
+    int multiSend(const std::vector<clientName_t> &receivers,
+                  const message_t &message, responseCallback_t onResponse);
+
+    /**
+     * @brief Request to send a message to all the clients, which the server
+     *        only allows to its admins. The request is sent again if the
+     *        session resumes before it was answered.
+     * @param message The message to send.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the
+     *         request is not valid.
+     */
+    int broadcast(const message_t &message, responseCallback_t onResponse);
+
+    /**
+     * @brief Request to subscribe to the topics which match a filter, whose
+     *        segments may be '*' for any single segment, and whose last
+     *        segment may be '#' for the rest of the topic. The subscriptions
+     *        are requested again whenever the session reconnects, since the
+     *        server drops them with the connection.
+     * @param filter The topic filter.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the
+     *         filter is not valid.
+     */
+    int subscribeTopic(const std::string &filter,
+                       responseCallback_t onResponse);
+
+    /**
+     * @brief Request to unsubscribe from a topic filter.
+     * @param filter The topic filter.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or is not
+     *         subscribed to the filter.
+     */
+    int unsubscribeTopic(const std::string &filter,
+                         responseCallback_t onResponse);
+
+    /**
+     * @brief Request to send a message to the subscribers of a topic. The
+     *        request is sent again if the session resumes before it was
+     *        answered.
+     * @param topic The topic.
+     * @param message The message to send.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected or the
+     *         request is not valid.
+     */
+    int publish(const std::string &topic, const message_t &message,
+                responseCallback_t onResponse);
+
+    /**
+     * @brief Request the names of the connected clients. The request is sent
+     *        again if the session resumes before it was answered.
+     * @param onResponse The callback of the response.
+     * @return 0 upon success, -1 if the session is not connected.
+     */
+    int who(responseCallback_t onResponse);
+
+    /**
+     * @brief Ping the server, which answers with the times it received the
+     *        ping and dispatched the answer. A ping which is lost with the
+     *        connection is never answered.
+     * @param onPong The callback of the answer.
+     * @return 0 upon success, -1 if the session is not connected.
+     */
+    int ping(pingCallback_t onPong);
+
+    /**
+     * @brief Signal the members of a group the session is a member of that its
+     *        user is typing. The signal is dropped if it is lost.
+     * @param groupName The group name.
+     * @return 0 upon success, -1 if the session has no side channel or the
+     *         name is not valid.
+     */
+    int typing(const groupName_t &groupName);
+
+    /**
+     * @brief Log out from the server. The session is closed with LOGOUT_CLOSE
+     *        once the server confirms.
+     * @return 0 upon success, -1 if the session is not connected.
+     */
+    int logout();
+
+    /**
+     * @brief Sets the callback of the messages of other clients.
+     * @param onMessage The callback.
+     */
+    void subscribe(messageCallback_t onMessage);
+
+    /**
+     * @brief Sets the callback of the end of the session.
+     * @param onClose The callback.
+     */
+    void onClose(closeCallback_t onClose);
+
+    /**
+     * @brief Sets the callback of the handshake result of a session which
+     *        reconnected after it lost its connection. The session is closed
+     *        with CONNECTION_LOST_CLOSE if it fails to reconnect.
+     * @param onReconnect The callback, which gets the resumed state, or the
+     *        success state if the server started a new session instead.
+     */
+    void onReconnect(connectCallback_t onReconnect);
+
+    /**
+     * @brief Sets whether the session uses a shared memory channel when it
+     *        connects to a server over a Unix socket.
+     * @param sharedMemory Whether to use a shared memory channel.
+     */
+    void useSharedMemory(const bool sharedMemory)
+    {
+        _sharedMemory = sharedMemory;
+    }
+
+    /**
+     * @brief Sets whether the session uses the UDP side channel of a server
+     *        which offers it.
+     * @param signals Whether to use the side channel.
+     */
+    void useSignals(const bool signals)
+    {
+        _signals = signals;
+    }
+
+    /**
+     * @brief Sets whether the session asks the server for the timestamps of
+     *        the frames it sends.
+     * @param timestamps Whether to use timestamps.
+     */
+    void useTimestamps(const bool timestamps)
+    {
+        _timestamps = timestamps;
+    }
+
+    /**
+     * @brief Gets the timestamps of the frame whose callback runs now.
+     * @return The timestamps, all zero if the server did not stamp the frame.
+     */
+    const FrameTimestamps &timestamps() const
+    {
+        return _stamps;
+    }
+
+    /**
+     * @brief Sets the callback of the signals of other clients.
+     * @param onSignal The callback.
+     */
+    void onSignal(signalCallback_t onSignal);
+
+    /**
+     * @brief Sets the callback of a change in the events the session waits for.
+     * @param onInterest The callback.
+     */
+    void onInterest(interestCallback_t onInterest);
+
+    /**
+     * @brief Handle the events of the descriptor of the session.
+     * @param readable Whether the descriptor is ready for reading.
+     * @param writable Whether the descriptor is ready for writing.
+     * @return 0 if the session is still open, -1 if it was closed.
+     */
+    int handleEvents(const bool readable, const bool writable);
+
+    /**
+     * @brief Handle the signals which arrived over the side channel.
+     */
+    void handleSignals();
+
+    /**
+     * @brief Gets the descriptor of the side channel of the session.
+     * @return The descriptor, or -1 if the session has no side channel.
+     */
+    int signalDescriptor() const
+    {
+        return _signalSocket;
+    }
+
+    /**
+     * @brief Gets the descriptor of the session.
+     * @return The descriptor, or -1 if the session is closed.
+     */
+    int fileDescriptor() const
+    {
+        return _channel.open() ? _poller : _socket;
+    }
+
+    /**
+     * @brief Gets whether the session waits to write queued requests. A shared
+     *        memory channel is written again when the server reads it, which
+     *        makes the descriptor readable.
+     * @return true if there are queued requests, false otherwise.
+     */
+    bool wantsWrite() const
+    {
+        return !_output.empty() && !_channel.open();
+    }
+
+    /**
+     * @brief Gets the state of the session.
+     * @return The state of the session.
+     */
+    SessionState state() const
+    {
+        return _state;
+    }
+
+    /**
+     * @brief Gets the number of requests which were not answered yet.
+     * @return The number of pending requests.
+     */
+    size_t pendingResponses() const
+    {
+        return _requests.size();
+    }
+
+    /**
+     * @brief Gets the client name of the session.
+     * @return The client name.
+     */
+    const clientName_t &name() const
+    {
+        return _name;
+    }
+
+private:
+
+    /**
+     * @brief A request which waits for its response.
+     */
+    struct _Request
+    {
+        message_t request;
+        responseCallback_t onResponse;
+        bool repeatable;
+    };
+
+    clientName_t _name;
+    std::string _messageIDPrefix;
+    unsigned long _messageCount;
+    std::string _host;
+    portNumber_t _port;
+    std::string _token;
+    int _socket;
+    bool _sharedMemory;
+    bool _negotiating;
+    SharedChannel _channel;
+    int _poller;
+    bool _signals;
+    bool _timestamps;
+    FrameTimestamps _stamps;
+    std::string _signalToken;
+    int _signalSocket;
+    SessionState _state;
+    unsigned int _connection;
+    int _redirects;
+    int _reconnects;
+    bool _reconnecting;
+    message_t _input;
+    message_t _output;
+    bool _notifiedWrite;
+    std::deque<_Request> _requests;
+    std::set<std::string> _topics;
+    connectCallback_t _onConnect;
+    connectCallback_t _onReconnect;
+    messageCallback_t _onMessage;
+    signalCallback_t _onSignal;
+    closeCallback_t _onClose;
+    interestCallback_t _onInterest;
+
+    WhatsAppSession(const WhatsAppSession &) = delete;
+    WhatsAppSession &operator=(const WhatsAppSession &) = delete;
+
+    int _openConnection(const char *hostName, const portNumber_t portNumber);
+    int _completeConnection();
+    int _openChannel();
+    void _queueName();
+    int _request(const message_t &request, responseCallback_t onResponse,
+                 const bool repeatable);
+    int _groupRequest(const MessageTag tag, const groupName_t &groupName,
+                      const std::vector<clientName_t> &members,
+                      responseCallback_t onResponse, const bool repeatable);
+    void _resendRequests();
+    void _queue(const message_t &request);
+    int _flush();
+    int _receive();
+    int _process();
+    int _handleHandshake();
+    int _failHandshake(const char connectionState);
+    int _redirect(const message_t &address);
+    int _reconnect();
+    int _processMessage(const message_t &message);
+    int _openSignals(const message_t &token);
+    void _signal(const SignalTag tag, const groupName_t &groupName);
+    void _notifyInterest(const bool force);
+    void _disconnect();
+};
+
+#endif
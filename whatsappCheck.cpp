@@ -0,0 +1,744 @@
+/**
+ * @file whatsappCheck.cpp
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Check of the containers of the WhatsApp Server against the
+ *        containers of the standard library.
+ */
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <set>
+#include <map>
+#include <iterator>
+#include <random>
+#include <iostream>
+#include "WhatsApp.h"
+#include "MemberSet.h"
+#include "TopicTrie.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def CHECK_SEED 5
+ * @brief A Macro that sets the seed of the random operations, so a failure
+ *        can be reproduced.
+ */
+#define CHECK_SEED 5
+
+/**
+ * @def CHECK_CONTAINERS 3
+ * @brief A Macro that sets the number of containers the random members of a
+ *        set are drawn from.
+ */
+#define CHECK_CONTAINERS 3
+
+/**
+ * @def BOUNDARY_CROSSINGS 64
+ * @brief A Macro that sets the number of times a container is moved across
+ *        the array capacity in each direction.
+ */
+#define BOUNDARY_CROSSINGS 64
+
+/**
+ * @def RANDOM_OPERATIONS 200000
+ * @brief A Macro that sets the number of random operations on a set.
+ */
+#define RANDOM_OPERATIONS 200000
+
+/**
+ * @def RANDOM_COMPARE_INTERVAL 997
+ * @brief A Macro that sets the number of random operations between two full
+ *        comparisons of the sets.
+ */
+#define RANDOM_COMPARE_INTERVAL 997
+
+/**
+ * @def INTERSECTION_ROUNDS 8
+ * @brief A Macro that sets the number of random pairs of sets intersected for
+ *        every pair of sizes.
+ */
+#define INTERSECTION_ROUNDS 8
+
+/**
+ * @def MAX_CHECK_SEGMENTS 4
+ * @brief A Macro that sets the maximal number of segments of a random topic
+ *        or filter.
+ */
+#define MAX_CHECK_SEGMENTS 4
+
+/**
+ * @def CHECK_SUBSCRIBERS 48
+ * @brief A Macro that sets the number of members which subscribe to the
+ *        random filters, more than the inline array of a member set.
+ */
+#define CHECK_SUBSCRIBERS 48
+
+/**
+ * @def MAX_CHECK_SUBSCRIPTIONS 3000
+ * @brief A Macro that sets the number of subscriptions at which the random
+ *        operations turn to unsubscribe, until none are left.
+ */
+#define MAX_CHECK_SUBSCRIPTIONS 3000
+
+/**
+ * @def TOPIC_OPERATIONS 100000
+ * @brief A Macro that sets the number of random operations on a trie.
+ */
+#define TOPIC_OPERATIONS 100000
+
+/**
+ * @def TOPIC_MATCH_INTERVAL 50
+ * @brief A Macro that sets the number of random operations on a trie between
+ *        two matches of a random topic.
+ */
+#define TOPIC_MATCH_INTERVAL 50
+
+/**
+ * @def CHECK_FAIL_MSG "Check failed: "
+ * @brief A Macro that sets the prefix of the message of a failed check.
+ */
+#define CHECK_FAIL_MSG "Check failed: "
+
+/**
+ * @def CHECK_PASS_MSG "Containers checked."
+ * @brief A Macro that sets the message of the passed checks.
+ */
+#define CHECK_PASS_MSG "Containers checked."
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief Type Definition for the set the member sets are compared with.
+ */
+typedef std::set<memberID_t> memberSet_t;
+
+/**
+ * @brief Type Definition for the subscriptions the trie is compared with, as
+ *        a map from a filter to the members subscribed to it.
+ */
+typedef std::map<std::string, memberSet_t> filterToMembersMap;
+
+
+/*-----=  Check Data  =-----*/
+
+
+/**
+ * @brief The generator of the random operations.
+ */
+static std::mt19937 generator(CHECK_SEED);
+
+/**
+ * @brief The segments of the random topics and filters, which are few so the
+ *        filters overlap and match the topics often.
+ */
+static const std::vector<std::string> checkSegments = {"a", "b", "c"};
+
+
+/*-----=  Check Functions  =-----*/
+
+
+/**
+ * @brief Prints the message of a failed check.
+ * @param check The name of the check.
+ * @param what The description of the difference.
+ * @return -1, so it can be returned by the failed check.
+ */
+static int checkFailed(const std::string &check, const std::string &what)
+{
+    std::cerr << CHECK_FAIL_MSG << check << ": " << what << std::endl;
+    return FAILURE_STATE;
+}
+
+/**
+ * @brief Compares a member set with the expected set: its size, its members
+ *        in ascending order, and its membership of each member and of the
+ *        IDs next to them.
+ * @param check The name of the check.
+ * @param members The member set.
+ * @param expected The expected set.
+ * @return 0 if the sets are equal, -1 otherwise.
+ */
+static int compareSets(const std::string &check, const MemberSet &members,
+                       const memberSet_t &expected)
+{
+    if (members.size() != expected.size()
+        || members.empty() != expected.empty())
+    {
+        return checkFailed(check, "size " + std::to_string(members.size())
+                                  + " instead of "
+                                  + std::to_string(expected.size()));
+    }
+    auto next = expected.begin();
+    for (memberID_t member : members)
+    {
+        if (next == expected.end() || member != *next)
+        {
+            return checkFailed(check, "iterated " + std::to_string(member)
+                                      + " out of order");
+        }
+        ++next;
+    }
+    if (next != expected.end())
+    {
+        return checkFailed(check, "iteration ended before "
+                                  + std::to_string(*next));
+    }
+    for (memberID_t member : expected)
+    {
+        if (!members.contains(member)
+            || members.contains(member + 1)
+               != (expected.count(member + 1) == 1))
+        {
+            return checkFailed(check, "membership around "
+                                      + std::to_string(member));
+        }
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Inserts a member to a member set and to the expected set, and
+ *        compares the results of the insertions.
+ * @param check The name of the check.
+ * @param members The member set.
+ * @param expected The expected set.
+ * @param member The member ID.
+ * @return 0 if the results are equal, -1 otherwise.
+ */
+static int checkInsert(const std::string &check, MemberSet &members,
+                       memberSet_t &expected, const memberID_t member)
+{
+    if (members.insert(member) != expected.insert(member).second)
+    {
+        return checkFailed(check, "insert " + std::to_string(member));
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Erases a member from a member set and from the expected set, and
+ *        compares the results of the removals.
+ * @param check The name of the check.
+ * @param members The member set.
+ * @param expected The expected set.
+ * @param member The member ID.
+ * @return 0 if the results are equal, -1 otherwise.
+ */
+static int checkErase(const std::string &check, MemberSet &members,
+                      memberSet_t &expected, const memberID_t member)
+{
+    if (members.erase(member) != (expected.erase(member) == 1))
+    {
+        return checkFailed(check, "erase " + std::to_string(member));
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Draws a random member ID from the first containers.
+ * @return The member ID.
+ */
+static memberID_t randomMember()
+{
+    std::uniform_int_distribution<memberID_t> distribution(
+            0, (CHECK_CONTAINERS << CONTAINER_BITS) - 1);
+    return distribution(generator);
+}
+
+/**
+ * @brief Draws a random member ID from a single container.
+ * @param key The container key.
+ * @return The member ID.
+ */
+static memberID_t randomContainerMember(const memberID_t key)
+{
+    std::uniform_int_distribution<memberID_t> distribution(0,
+                                                           CONTAINER_MASK);
+    return (key << CONTAINER_BITS) | distribution(generator);
+}
+
+/**
+ * @brief Checks a set which grows past the inline array and shrinks back,
+ *        comparing it after every operation: it turns into containers once it
+ *        has more members than the array, and back into the array once it has
+ *        half of the array.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int checkSmallSet()
+{
+    const std::string check = "small set";
+    MemberSet members;
+    memberSet_t expected;
+    for (int round = 0; round < BOUNDARY_CROSSINGS; ++round)
+    {
+        // The members are spread over several containers once it is large.
+        while (expected.size() <= SMALL_SET_CAPACITY)
+        {
+            if (checkInsert(check, members, expected, randomMember())
+                || compareSets(check, members, expected))
+            {
+                return FAILURE_STATE;
+            }
+        }
+        while (expected.size()
+               > (size_t) (SMALL_SET_CAPACITY / 2 - round % 2))
+        {
+            auto member = expected.begin();
+            std::advance(member, generator() % expected.size());
+            if (checkErase(check, members, expected, *member)
+                || compareSets(check, members, expected))
+            {
+                return FAILURE_STATE;
+            }
+        }
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Checks a container which is moved back and forth across the array
+ *        capacity: it turns into a bitmap once it has more members than the
+ *        capacity, and back into an array once it has the capacity. The set
+ *        has members in the containers around it too, the container always
+ *        has its first and last IDs, and it is compared on both sides of the
+ *        capacity after every crossing.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int checkDenseContainer()
+{
+    const std::string check = "dense container";
+    const memberID_t key = 1;
+    const memberID_t first = key << CONTAINER_BITS;
+    const memberID_t last = first | CONTAINER_MASK;
+    MemberSet members;
+    memberSet_t expected;
+    for (memberID_t neighbour = 0; neighbour < SMALL_SET_CAPACITY; ++neighbour)
+    {
+        if (checkInsert(check, members, expected, neighbour)
+            || checkInsert(check, members, expected,
+                           ((key + 1) << CONTAINER_BITS) + neighbour))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    size_t outside = expected.size();
+    if (checkInsert(check, members, expected, first)
+        || checkInsert(check, members, expected, last))
+    {
+        return FAILURE_STATE;
+    }
+
+    for (int round = 0; round < BOUNDARY_CROSSINGS; ++round)
+    {
+        while (expected.size() - outside <= ARRAY_CONTAINER_CAPACITY)
+        {
+            bool boundary = expected.size() - outside
+                            >= ARRAY_CONTAINER_CAPACITY;
+            if (checkInsert(check, members, expected,
+                            randomContainerMember(key))
+                || (boundary && compareSets(check, members, expected)))
+            {
+                return FAILURE_STATE;
+            }
+        }
+        // Erasing a missing member must not turn the bitmap into an array.
+        memberID_t missing = randomContainerMember(key);
+        while (expected.count(missing))
+        {
+            missing = randomContainerMember(key);
+        }
+        if (checkErase(check, members, expected, missing)
+            || compareSets(check, members, expected))
+        {
+            return FAILURE_STATE;
+        }
+
+        size_t target = ARRAY_CONTAINER_CAPACITY - round % 2;
+        while (expected.size() - outside > target)
+        {
+            auto member = expected.lower_bound(randomContainerMember(key));
+            if (*member == first || *member >= last)
+            {
+                member = expected.upper_bound(first);
+            }
+            if (checkErase(check, members, expected, *member)
+                || compareSets(check, members, expected))
+            {
+                return FAILURE_STATE;
+            }
+        }
+    }
+
+    // The last member of a container removes the container.
+    while (expected.size() > outside)
+    {
+        if (checkErase(check, members, expected,
+                       *expected.lower_bound(first)))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    return compareSets(check, members, expected);
+}
+
+/**
+ * @brief Checks random insertions and removals of members from a few
+ *        containers. The insertions are more likely while the set is small,
+ *        so the set crosses every threshold several times.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int checkRandomSet()
+{
+    const std::string check = "random set";
+    const size_t highWater = ARRAY_CONTAINER_CAPACITY * CHECK_CONTAINERS * 2;
+    MemberSet members;
+    memberSet_t expected;
+    bool growing = true;
+    for (int operation = 0; operation < RANDOM_OPERATIONS; ++operation)
+    {
+        if (expected.size() >= highWater)
+        {
+            growing = false;
+        }
+        else if (expected.empty())
+        {
+            growing = true;
+        }
+
+        int result = SUCCESS_STATE;
+        if ((generator() % 4 != 0) == growing)
+        {
+            result = checkInsert(check, members, expected, randomMember());
+        }
+        else if (!expected.empty() && generator() % 2)
+        {
+            auto member = expected.lower_bound(randomMember());
+            if (member == expected.end())
+            {
+                member = expected.begin();
+            }
+            result = checkErase(check, members, expected, *member);
+        }
+        else
+        {
+            result = checkErase(check, members, expected, randomMember());
+        }
+        if (result || ((operation % RANDOM_COMPARE_INTERVAL == 0
+                        || expected.size() <= SMALL_SET_CAPACITY)
+                       && compareSets(check, members, expected)))
+        {
+            return FAILURE_STATE;
+        }
+    }
+
+    members.clear();
+    expected.clear();
+    return compareSets(check, members, expected);
+}
+
+/**
+ * @brief Fills a member set and the expected set with random members below
+ *        the given bound.
+ * @param members The member set.
+ * @param expected The expected set.
+ * @param size The number of members.
+ * @param bound The bound of the member IDs, which is larger than the size.
+ */
+static void randomSet(MemberSet &members, memberSet_t &expected,
+                      const size_t size, const memberID_t bound)
+{
+    std::uniform_int_distribution<memberID_t> distribution(0, bound - 1);
+    while (expected.size() < size)
+    {
+        memberID_t member = distribution(generator);
+        members.insert(member);
+        expected.insert(member);
+    }
+}
+
+/**
+ * @brief Checks the intersections of random sets of every pair of sizes: the
+ *        inline array, the sets of a few array containers, and the sets of
+ *        dense bitmap containers whose common members are either few enough
+ *        for an array or still a bitmap.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int checkIntersection()
+{
+    const std::string check = "intersection";
+    const size_t sizes[] = {0, SMALL_SET_CAPACITY / 2, SMALL_SET_CAPACITY,
+                            SMALL_SET_CAPACITY + 1, ARRAY_CONTAINER_CAPACITY,
+                            ARRAY_CONTAINER_CAPACITY * 2};
+    // A single container makes the dense sets bitmaps, and a narrow bound
+    // makes them share most of their members.
+    const memberID_t bounds[] = {CHECK_CONTAINERS << CONTAINER_BITS,
+                                 1 << CONTAINER_BITS,
+                                 ARRAY_CONTAINER_CAPACITY * 3};
+    for (size_t firstSize : sizes)
+    {
+        for (size_t secondSize : sizes)
+        {
+            for (int round = 0; round < INTERSECTION_ROUNDS; ++round)
+            {
+                memberID_t bound = bounds[round % 3];
+                MemberSet first;
+                MemberSet second;
+                memberSet_t firstExpected;
+                memberSet_t secondExpected;
+                randomSet(first, firstExpected, firstSize, bound);
+                randomSet(second, secondExpected, secondSize, bound);
+                memberSet_t expected;
+                std::set_intersection(firstExpected.begin(),
+                                      firstExpected.end(),
+                                      secondExpected.begin(),
+                                      secondExpected.end(),
+                                      std::inserter(expected, expected.end()));
+                MemberSet common = first.intersection(second);
+                if (compareSets(check, common, expected)
+                    || compareSets(check, second.intersection(first),
+                                   expected))
+                {
+                    return FAILURE_STATE;
+                }
+                // The common members are a set like any other.
+                for (memberID_t member : firstExpected)
+                {
+                    if (checkInsert(check, common, expected, member))
+                    {
+                        return FAILURE_STATE;
+                    }
+                }
+                if (compareSets(check, common, expected))
+                {
+                    return FAILURE_STATE;
+                }
+            }
+        }
+    }
+    return SUCCESS_STATE;
+}
+
+
+/*-----=  Topic Functions  =-----*/
+
+
+/**
+ * @brief Splits a topic or a filter into its segments.
+ * @param topic The topic.
+ * @return The segments.
+ */
+static std::vector<std::string> splitTopic(const std::string &topic)
+{
+    std::vector<std::string> segments;
+    size_t begin = MSG_BEGIN_INDEX;
+    size_t end = 0;
+    do
+    {
+        end = std::min(topic.find(TOPIC_SEP, begin), topic.length());
+        segments.push_back(topic.substr(begin, end - begin));
+        begin = end + 1;
+    } while (end < topic.length());
+    return segments;
+}
+
+/**
+ * @brief Determine if a filter matches a topic by comparing their segments
+ *        one by one, as the trie should.
+ * @param filter The filter.
+ * @param topic The topic.
+ * @return true if the filter matches the topic, false otherwise.
+ */
+static bool filterMatches(const std::string &filter, const std::string &topic)
+{
+    std::vector<std::string> filterSegments = splitTopic(filter);
+    std::vector<std::string> topicSegments = splitTopic(topic);
+    for (size_t i = 0; i < filterSegments.size(); ++i)
+    {
+        if (filterSegments[i] == TOPIC_MULTI_WILDCARD)
+        {
+            return true;
+        }
+        if (i == topicSegments.size()
+            || (filterSegments[i] != TOPIC_SINGLE_WILDCARD
+                && filterSegments[i] != topicSegments[i]))
+        {
+            return false;
+        }
+    }
+    return filterSegments.size() == topicSegments.size();
+}
+
+/**
+ * @brief Draws a random topic, or a random filter whose segments may be
+ *        wildcards (and which ends at a multi segment wildcard).
+ * @param filter true to draw a filter, false to draw a topic.
+ * @return The topic.
+ */
+static std::string randomTopic(const bool filter)
+{
+    size_t choices = checkSegments.size() + (filter ? 2 : 0);
+    size_t length = generator() % MAX_CHECK_SEGMENTS + 1;
+    std::string topic;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (i > 0)
+        {
+            topic += TOPIC_SEP;
+        }
+        size_t choice = generator() % choices;
+        if (choice == checkSegments.size())
+        {
+            topic += TOPIC_SINGLE_WILDCARD;
+        }
+        else if (choice > checkSegments.size())
+        {
+            topic += TOPIC_MULTI_WILDCARD;
+            break;
+        }
+        else
+        {
+            topic += checkSegments[choice];
+        }
+    }
+    return topic;
+}
+
+/**
+ * @brief Matches a random topic in a trie and in the expected subscriptions,
+ *        and compares the members of the matching filters.
+ * @param trie The trie.
+ * @param expected The expected subscriptions.
+ * @return 0 if the members are equal, -1 otherwise.
+ */
+static int checkMatch(const TopicTrie &trie,
+                      const filterToMembersMap &expected)
+{
+    std::string topic = randomTopic(false);
+    if (validateTopic(topic, false))
+    {
+        return checkFailed("topic trie", "invalid topic " + topic);
+    }
+    MemberSet recipients;
+    trie.match(topic, recipients);
+    memberSet_t matching;
+    for (const auto &subscription : expected)
+    {
+        if (filterMatches(subscription.first, topic))
+        {
+            matching.insert(subscription.second.begin(),
+                            subscription.second.end());
+        }
+    }
+    return compareSets("topic trie match of " + topic, recipients, matching);
+}
+
+/**
+ * @brief Checks random subscriptions and unsubscriptions of a trie, and the
+ *        members it matches for random topics, against the subscriptions
+ *        matched one by one. The subscriptions grow until there are enough of
+ *        them and then are all removed again, so the nodes of the trie are
+ *        created and removed several times.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int checkTopicTrie()
+{
+    const std::string check = "topic trie";
+    TopicTrie trie;
+    filterToMembersMap expected;
+    size_t subscriptions = 0;
+    bool growing = true;
+    for (int operation = 0; operation < TOPIC_OPERATIONS; ++operation)
+    {
+        if (subscriptions >= MAX_CHECK_SUBSCRIPTIONS)
+        {
+            growing = false;
+        }
+        else if (subscriptions == 0)
+        {
+            growing = true;
+        }
+
+        std::string filter = randomTopic(true);
+        memberID_t member = generator() % CHECK_SUBSCRIBERS;
+        if (!growing && generator() % 4 != 0)
+        {
+            // Mostly unsubscribe an existing subscription.
+            auto subscription = expected.begin();
+            std::advance(subscription, generator() % expected.size());
+            filter = subscription->first;
+            auto subscriber = subscription->second.begin();
+            std::advance(subscriber,
+                         generator() % subscription->second.size());
+            member = *subscriber;
+        }
+        if (validateTopic(filter, true))
+        {
+            return checkFailed(check, "invalid filter " + filter);
+        }
+
+        if (growing == (generator() % 4 != 0))
+        {
+            bool subscribed = expected[filter].insert(member).second;
+            if (trie.subscribe(filter, member) != subscribed)
+            {
+                return checkFailed(check, "subscribe " + filter);
+            }
+            subscriptions += subscribed;
+        }
+        else
+        {
+            auto subscription = expected.find(filter);
+            bool unsubscribed = subscription != expected.end()
+                                && subscription->second.erase(member);
+            if (unsubscribed && subscription->second.empty())
+            {
+                expected.erase(subscription);
+            }
+            if (trie.unsubscribe(filter, member) != unsubscribed)
+            {
+                return checkFailed(check, "unsubscribe " + filter);
+            }
+            subscriptions -= unsubscribed;
+        }
+        if (trie.size() != subscriptions)
+        {
+            return checkFailed(check, "size "
+                                      + std::to_string(trie.size()));
+        }
+        if (operation % TOPIC_MATCH_INTERVAL == 0
+            && checkMatch(trie, expected))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    return SUCCESS_STATE;
+}
+
+
+/*-----=  Main  =-----*/
+
+
+/**
+ * @brief The main function that runs the checks. Every check runs a sequence
+ *        of operations on a container of the server and on a container of the
+ *        standard library with the same behaviour, and compares their results
+ *        and their contents.
+ * @return 0 upon success, -1 otherwise.
+ */
+int main()
+{
+    if (checkSmallSet() || checkDenseContainer() || checkRandomSet()
+        || checkIntersection() || checkTopicTrie())
+    {
+        return FAILURE_STATE;
+    }
+    std::cout << CHECK_PASS_MSG << std::endl;
+    return SUCCESS_STATE;
+}
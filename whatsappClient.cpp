@@ -10,10 +10,14 @@
 
 
 #include <cstring>
-#include <regex>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <stdlib.h>
-#include <cassert>
-#include "WhatsApp.h"
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include "WhatsAppSession.h"
 
 
 /*-----=  Definitions  =-----*/
@@ -25,6 +29,109 @@
  */
 #define VALID_ARGUMENTS_COUNT 4
 
+/**
+ * @def SCRIPT_ARGUMENTS_COUNT 6
+ * @brief A Macro that sets the number for valid arguments count with a script.
+ */
+#define SCRIPT_ARGUMENTS_COUNT 6
+
+/**
+ * @def SCRIPT_OPTION_INDEX 4
+ * @brief A Macro that sets the index of the script option to this program.
+ */
+#define SCRIPT_OPTION_INDEX 4
+
+/**
+ * @def SCRIPT_ARGUMENT_INDEX 5
+ * @brief A Macro that sets the index of the script file to this program.
+ */
+#define SCRIPT_ARGUMENT_INDEX 5
+
+/**
+ * @def SCRIPT_OPTION "--script"
+ * @brief A Macro that sets the option of a file of commands to run as a batch.
+ */
+#define SCRIPT_OPTION "--script"
+
+/**
+ * @def SCRIPT_STDIN "-"
+ * @brief A Macro that sets the script file which stands for the standard input.
+ */
+#define SCRIPT_STDIN "-"
+
+/**
+ * @def SCRIPT_OPEN_FAIL_MSG "ERROR: failed to open the script file."
+ * @brief A Macro that sets the message when the script file can not be read.
+ */
+#define SCRIPT_OPEN_FAIL_MSG "ERROR: failed to open the script file."
+
+/**
+ * @def SESSIONS_ARGUMENTS_COUNT 5
+ * @brief A Macro that sets the number for valid arguments count with sessions.
+ */
+#define SESSIONS_ARGUMENTS_COUNT 5
+
+/**
+ * @def SESSIONS_OPTION_INDEX 1
+ * @brief A Macro that sets the index of the sessions option to this program.
+ */
+#define SESSIONS_OPTION_INDEX 1
+
+/**
+ * @def SESSIONS_ARGUMENT_INDEX 2
+ * @brief A Macro that sets the index of the sessions file to this program.
+ */
+#define SESSIONS_ARGUMENT_INDEX 2
+
+/**
+ * @def SESSIONS_SERVER_ARGUMENT_INDEX 3
+ * @brief A Macro that sets the index of server address argument with sessions.
+ */
+#define SESSIONS_SERVER_ARGUMENT_INDEX 3
+
+/**
+ * @def SESSIONS_PORT_ARGUMENT_INDEX 4
+ * @brief A Macro that sets the index of the port argument with sessions.
+ */
+#define SESSIONS_PORT_ARGUMENT_INDEX 4
+
+/**
+ * @def SESSIONS_OPTION "--sessions"
+ * @brief A Macro that sets the option of a file of client names to run as
+ *        sessions of a single process.
+ */
+#define SESSIONS_OPTION "--sessions"
+
+/**
+ * @def SESSIONS_OPEN_FAIL_MSG "ERROR: failed to open the sessions file."
+ * @brief A Macro that sets the message when the sessions file can not be read.
+ */
+#define SESSIONS_OPEN_FAIL_MSG "ERROR: failed to open the sessions file."
+
+/**
+ * @def SESSION_UNKNOWN_MSG "ERROR: unknown session."
+ * @brief A Macro that sets the message on a command to an unknown session.
+ */
+#define SESSION_UNKNOWN_MSG "ERROR: unknown session."
+
+/**
+ * @def SESSION_OUTPUT_SEP "> "
+ * @brief A Macro that sets the separator between a session name and its output.
+ */
+#define SESSION_OUTPUT_SEP "> "
+
+/**
+ * @def MAX_EPOLL_EVENTS 1024
+ * @brief A Macro that sets the maximal number of events of a single wait.
+ */
+#define MAX_EPOLL_EVENTS 1024
+
+/**
+ * @def INPUT_EVENT_KEY UINT64_MAX
+ * @brief A Macro that sets the key of the user input events in the epoll set.
+ */
+#define INPUT_EVENT_KEY UINT64_MAX
+
 /**
  * @def PORT_ARGUMENT_INDEX 1
  * @brief A Macro that sets the index of client name argument to this program.
@@ -47,7 +154,16 @@
  * @def USAGE_MSG "Usage: whatsappClient clientName serverAddress serverPort"
  * @brief A Macro that sets the error message when the usage is invalid.
  */
-#define USAGE_MSG "Usage: whatsappClient clientName serverAddress serverPort"
+#define USAGE_MSG "Usage: whatsappClient clientName serverAddress serverPort " \
+                  "[--script file]\n" \
+                  "       whatsappClient --sessions namesFile serverAddress " \
+                  "serverPort"
+
+/**
+ * @def IPV6_ADDRESS_DELIMITER ':'
+ * @brief A Macro that sets the IPv6 server address delimiter.
+ */
+#define IPV6_ADDRESS_DELIMITER ':'
 
 /**
  * @def ADDRESS_DELIMITER '.'
@@ -73,6 +189,12 @@
  */
 #define CONNECT_SUCCESS_MSG "Connected Successfully."
 
+/**
+ * @def RESUME_SUCCESS_MSG "Resumed Successfully."
+ * @brief A Macro that sets the message when a lost session is resumed.
+ */
+#define RESUME_SUCCESS_MSG "Resumed Successfully."
+
 /**
  * @def TAKEN_CLIENT_NAME_MSG "Client name is already in use."
  * @brief A Macro that sets the message when the client name is already in use.
@@ -92,30 +214,128 @@
 #define WHO_FAIL_MSG "ERROR: failed to receive list of connected clients."
 
 /**
- * @def SEND_REGEX "send ([a-zA-Z0-9]+) (.*)"
- * @brief A Macro that sets the send command regex.
+ * @def TYPING_MSG_INFIX " is typing in "
+ * @brief A Macro that sets the message of a typing signal of another client.
+ */
+#define TYPING_MSG_INFIX " is typing in "
+
+/**
+ * @def ONLINE_MSG_SUFFIX " is online."
+ * @brief A Macro that sets the message of the first presence signal of
+ *        another client.
+ */
+#define ONLINE_MSG_SUFFIX " is online."
+
+/**
+ * @def PING_FAIL_MSG "ERROR: failed to ping the server."
+ * @brief A Macro that sets the message upon ping failure in the client side.
+ */
+#define PING_FAIL_MSG "ERROR: failed to ping the server."
+
+/**
+ * @def PING_MSG "Ping: "
+ * @brief A Macro that sets the prefix of the latencies of a ping.
+ */
+#define PING_MSG "Ping: "
+
+/**
+ * @def MAX_PING_COUNT 1000
+ * @brief A Macro that sets the maximal number of pings of a single command.
+ */
+#define MAX_PING_COUNT 1000
+
+/**
+ * @def READ_BUFFER_SIZE 65536
+ * @brief A Macro that sets the maximal bytes read from a descriptor at once.
  */
-#define SEND_REGEX "send ([a-zA-Z0-9]+) (.*)"
+#define READ_BUFFER_SIZE 65536
+
+
+/*-----=  Type Definitions  =-----*/
+
 
 /**
- * @def GROUP_REGEX_1 "create_group ([a-zA-Z0-9]+) ([.]*)"
- * @brief A Macro that sets the group command regex.
+ * @brief The kinds of a parsed user input.
  */
-#define GROUP_REGEX_1 "create_group ([a-zA-Z0-9]+) (.*)"
+enum InputCommand
+{
+    EXIT_INPUT,
+    REQUEST_INPUT,
+    TYPING_INPUT,
+    INVALID_INPUT
+};
 
 /**
- * @def GROUP_REGEX_2 "create_group ([a-zA-Z0-9]+) ([a-zA-Z0-9]+[,a-zA-Z0-9]*)"
- * @brief A Macro that sets the group command regex.
+ * @brief A parsed request of the user.
  */
-#define GROUP_REGEX_2 "[a-zA-Z0-9]+[,a-zA-Z0-9]*"
+struct ClientRequest
+{
+    MessageTag tag;
+    std::string name;
+    std::vector<clientName_t> members;
+    message_t message;
+    unsigned long count;
+    bool unsubscribe;
+};
 
 
 /*-----=  Client Data  =-----*/
 
 /**
- * @brief The client name.
+ * @brief The session of the client.
+ */
+WhatsAppSession *session = nullptr;
+
+/**
+ * @brief The user input which does not form a complete line yet.
+ */
+message_t userInput;
+
+/**
+ * @brief Whether the client reads commands from the user.
+ */
+bool readingInput = true;
+
+/**
+ * @brief The script of commands to run, or nullptr in interactive mode.
+ */
+std::istream *script = nullptr;
+
+/**
+ * @brief Whether the client runs several sessions, whose output is prefixed
+ *        by the session name.
+ */
+bool multiSession = false;
+
+/**
+ * @brief All the sessions of the client in the multi session mode.
+ */
+std::vector<std::unique_ptr<WhatsAppSession>> sessions;
+
+/**
+ * @brief A map between a client name to its session in the multi session mode.
+ */
+std::unordered_map<clientName_t, WhatsAppSession *> namesToSessions;
+
+/**
+ * @brief The clients whose presence was already printed.
+ */
+std::unordered_set<clientName_t> onlineClients;
+
+/**
+ * @brief The epoll instance of the multi session mode.
+ */
+int epollFD = FAILURE_STATE;
+
+/**
+ * @brief The number of sessions which are still open.
  */
-clientName_t clientName;
+size_t openSessions = 0;
+
+/**
+ * @brief The number of sessions which did not complete their handshake yet.
+ */
+size_t pendingHandshakes = 0;
 
 
 /*-----=  Client Initialization Functions  =-----*/
@@ -139,15 +359,22 @@ static int validateClientName(clientName_t const clientName)
 }
 
 /**
- * @brief Checks if the given server address is a valid address.
+ * @brief Checks if the given server address is a valid address. The address
+ *        is either a numeric IPv4/IPv6 address or a path of a Unix socket.
  * @param serverAddress The server address to check.
  * @return 0 if the address is valid, -1 otherwise.
  */
 static int validateServerAddress(std::string const serverAddress)
 {
+    if (isUnixSocketPath(serverAddress))
+    {
+        return SUCCESS_STATE;
+    }
     for (unsigned int i = 0; i < serverAddress.length(); ++i)
     {
-        if (!isdigit(serverAddress[i]) && serverAddress[i] != ADDRESS_DELIMITER)
+        if (!isxdigit(serverAddress[i])
+            && serverAddress[i] != ADDRESS_DELIMITER
+            && serverAddress[i] != IPV6_ADDRESS_DELIMITER)
         {
             return FAILURE_STATE;
         }
@@ -165,8 +392,28 @@ static int validateServerAddress(std::string const serverAddress)
  */
 static int checkClientArguments(int const argc, char * const argv[])
 {
+    // Check the arguments of the multi session mode.
+    if (argc == SESSIONS_ARGUMENTS_COUNT)
+    {
+        if (strcmp(argv[SESSIONS_OPTION_INDEX], SESSIONS_OPTION)
+            != EQUAL_COMPARISON
+            || validateServerAddress(argv[SESSIONS_SERVER_ARGUMENT_INDEX])
+            || validatePortNumber(argv[SESSIONS_PORT_ARGUMENT_INDEX]))
+        {
+            return FAILURE_STATE;
+        }
+        return SUCCESS_STATE;
+    }
+
     // Check valid number of arguments.
-    if (argc != VALID_ARGUMENTS_COUNT)
+    if (argc != VALID_ARGUMENTS_COUNT && argc != SCRIPT_ARGUMENTS_COUNT)
+    {
+        return FAILURE_STATE;
+    }
+
+    // Check the script option.
+    if (argc == SCRIPT_ARGUMENTS_COUNT
+        && strcmp(argv[SCRIPT_OPTION_INDEX], SCRIPT_OPTION) != EQUAL_COMPARISON)
     {
         return FAILURE_STATE;
     }
@@ -192,427 +439,1033 @@ static int checkClientArguments(int const argc, char * const argv[])
     return SUCCESS_STATE;
 }
 
+
+/*-----=  Handle Server Functions  =-----*/
+
+
 /**
- * @brief Request from the server to create itself as a client.
- * @param socket The socket of the client.
- * @param clientName The client name.
- * @return 0 upon success, -1 otherwise.
+ * @brief Print an output of a session. In the multi session mode the output
+ *        is prefixed by the session name, and flushed once per iteration.
+ * @param outputSession The session.
+ * @param output The output.
  */
-static int createClientRequest(const int socket, const clientName_t clientName)
+static void printOutput(const WhatsAppSession &outputSession,
+                        const message_t &output)
 {
-    // First we write the client name in our socket so the server could read
-    // it and analyze it.
-    if (writeData(socket, clientName) < 0)
-    {
-        systemCallError(WRITE_NAME, errno);
-        exit(EXIT_FAILURE);
-    }
-
-    // Now we wait for a response from the server about our name and therefore
-    // about our connection state.
-    char connectionState;
-    if (read(socket, &connectionState, sizeof(char)) < 0)
-    {
-        systemCallError(READ_NAME, errno);
-        exit(EXIT_FAILURE);
-    }
-
-    // Check the connection state that received from the server.
-    if (connectionState == CONNECTION_SUCCESS_STATE)
+    if (multiSession)
     {
-        // If the connection is valid and the name is valid.
-        std::cout << CONNECT_SUCCESS_MSG << std::endl;
-        return SUCCESS_STATE;
-    }
-    else if (connectionState == CONNECTION_IN_USE_STATE)
-    {
-        // If the name is already taken.
-        std::cout << TAKEN_CLIENT_NAME_MSG << std::endl;
-        exit(EXIT_FAILURE);
+        std::cout << outputSession.name() << SESSION_OUTPUT_SEP << output
+                  << MSG_TERMINATOR;
+        return;
     }
-    // Any other failure during connection to the server.
-    std::cout << CONNECT_FAILURE_MSG << std::endl;
-    exit(EXIT_FAILURE);
+    std::cout << output << std::endl;
 }
 
 /**
- * @brief Attempt to connect to the server provided by host and port.
- * @param hostName The host name of the server.
- * @param portNumber The port number of the server.
- * @param clientName The client name to connect.
- * @return 0 upon success, -1 otherwise.
+ * @brief Creates the callback which prints the responses or the messages of
+ *        the given session.
+ * @param outputSession The session.
+ * @return The callback.
  */
-static int callSocket(const char *hostName, const portNumber_t portNumber,
-                      const clientName_t clientName)
+static responseCallback_t printer(const WhatsAppSession *outputSession)
 {
-    // Hostent initialization.
-    hostent *pHostent = gethostbyname(hostName);
-    if (pHostent == nullptr)
+    return [outputSession](const message_t &output)
     {
-        systemCallError(GETHOSTBYNAME_NAME, errno);
-        exit(EXIT_FAILURE);
-    }
-
-    // Socket Address initialization.
-    sockaddr_in sa;
-    memset(&sa, 0, sizeof(sockaddr_in));
-    sa.sin_family = (sa_family_t) pHostent->h_addrtype;
-    memcpy(&sa.sin_addr, pHostent->h_addr, (size_t) pHostent->h_length);
-    sa.sin_port = htons(portNumber);
+        printOutput(*outputSession, output);
+    };
+}
 
-    // Create Socket.
-    int socketID = socket(AF_INET, SOCK_STREAM, 0);
-    if (socketID < SOCKET_ID_BOUND)
+/**
+ * @brief Print a signal of another client. A presence signal is printed only
+ *        the first time, since it is repeated while the client is connected.
+ * @param tag The tag of the signal.
+ * @param sender The client which sent the signal.
+ * @param groupName The group of a typing signal.
+ */
+static void printSignal(const SignalTag tag, const clientName_t &sender,
+                        const groupName_t &groupName)
+{
+    if (tag == TYPING_SIGNAL)
     {
-        systemCallError(SOCKET_NAME, errno);
-        exit(EXIT_FAILURE);
+        printOutput(*session, sender + TYPING_MSG_INFIX + groupName
+                              + MSG_SUFFIX);
     }
-    if (connect(socketID, (sockaddr *) &sa, sizeof(sockaddr_in)))
+    else if (onlineClients.insert(sender).second)
     {
-        if (close(socketID))
-        {
-            systemCallError(CLOSE_NAME, errno);
-            exit(EXIT_FAILURE);
-        }
-        systemCallError(CONNECT_NAME, errno);
-        exit(EXIT_FAILURE);
+        printOutput(*session, sender + ONLINE_MSG_SUFFIX);
     }
+}
 
-    if (createClientRequest(socketID, clientName))
+/**
+ * @brief Handle the end of the session, which ends the client.
+ * @param reason The reason for the end of the session.
+ */
+static void handleSessionClosed(const CloseReason reason)
+{
+    if (reason == LOGOUT_CLOSE)
     {
-        return FAILURE_STATE;
+        std::cout << LOGOUT_SUCCESS_MSG << std::endl;
+        exit(EXIT_SUCCESS);
     }
-
-    return socketID;
+    exit(EXIT_FAILURE);
 }
 
 
-/*-----=  Handle Server Functions  =-----*/
+/*-----=  Handle Input Functions  =-----*/
 
 
 /**
- * @brief Handle the server EXIT command.
- * @param clientSocket The current client socket.
+ * @brief Splits the client names of a create group command.
+ * @param groupClients The client names separated by commas.
+ * @return The client names.
  */
-static int handleServerExitCommand(int const clientSocket)
+static std::vector<clientName_t> splitGroupClients(message_t const groupClients)
 {
-    if (close(clientSocket))
+    std::vector<clientName_t> clientsNames;
+    std::stringstream modifiedClients = std::stringstream(groupClients);
+
+    clientName_t currentName;
+    while (getline(modifiedClients, currentName, GROUP_CLIENTS_DELIM))
     {
-        systemCallError(CLOSE_NAME, errno);
-        exit(EXIT_FAILURE);
+        if (currentName.compare(EMPTY_MSG))
+        {
+            // If the name is not empty.
+            clientsNames.push_back(currentName);
+        }
     }
-    exit(EXIT_FAILURE);
-}
 
-/**
- * @brief Handle response from the server due to client command.
- * @param message The server response.
- */
-static void handleServerResponseMessage(const message_t &message)
-{
-    message_t response = message.substr(1);  // Trim the message tag.
-    std::cout << response << std::endl;
+    return clientsNames;
 }
 
 /**
- * @brief Handle a message from the server.
- * @param message The server response.
+ * @brief Gets the end of the alphanumeric name which starts in the given
+ *        position of the input.
+ * @param clientInput The client input.
+ * @param position The position where the name starts.
+ * @return The position right after the name.
  */
-static void handleServerMessage(const message_t &message)
+static size_t scanName(const message_t &clientInput, size_t position)
 {
-    std::cout << message << std::endl;
+    while (position < clientInput.length() && isalnum(clientInput[position]))
+    {
+        position++;
+    }
+    return position;
 }
 
 /**
- * @brief Process a message received in the given client socket.
- * @param clientSocket The current client socket.
- * @param message The message to process.
+ * @brief Parse the arguments of a command in the form "command name rest",
+ *        where the name is a non empty alphanumeric name and the rest is any
+ *        text (possibly empty).
+ * @param clientInput The client input, which starts with the command.
+ * @param command The command.
+ * @param name The string to store the name in.
+ * @param rest The string to store the rest of the input in.
+ * @return 0 if the input matches, -1 otherwise.
  */
-static void processMessage(int const clientSocket, const message_t &message)
+static int parseCommandArguments(const message_t &clientInput,
+                                 const char *command, std::string &name,
+                                 message_t &rest)
 {
-    int tagChar = message.front() - TAG_CHAR_BASE;
-
-    switch (tagChar)
+    size_t nameBegin = strlen(command) + 1;
+    if (clientInput.length() < nameBegin
+        || clientInput[nameBegin - 1] != WHITE_SPACE_DELIM)
     {
-        case CREATE_GROUP:
-            handleServerResponseMessage(message);
-            return;
-
-        case SEND:
-            handleServerResponseMessage(message);
-            return;
-
-        case WHO:
-            handleServerResponseMessage(message);
-            return;
-
-        case SERVER_EXIT:
-            handleServerExitCommand(clientSocket);
-            return;
+        return FAILURE_STATE;
+    }
 
-        default:
-            handleServerMessage(message);
-            return;
+    size_t nameEnd = scanName(clientInput, nameBegin);
+    if (nameEnd == nameBegin || nameEnd >= clientInput.length()
+        || clientInput[nameEnd] != WHITE_SPACE_DELIM)
+    {
+        return FAILURE_STATE;
     }
+
+    name = clientInput.substr(nameBegin, nameEnd - nameBegin);
+    rest = clientInput.substr(nameEnd + 1);
+    return SUCCESS_STATE;
 }
 
 /**
- * @brief Parse messages read from the recent read operation from the socket.
- * @param clientSocket The current client socket.
- * @param messages The read data which contain a message or several.
+ * @brief Checks the client names of a create group command, which are
+ *        alphanumeric names separated by single commas.
+ * @param clientsNames The client names.
+ * @return 0 if the names are valid, -1 otherwise.
  */
-static void parseMessages(int const clientSocket, const message_t &messages)
+static int validateGroupClients(message_t const &clientsNames)
 {
-    message_t currentMessage;
-    std::stringstream messageStream = std::stringstream(messages);
-    while (std::getline(messageStream, currentMessage))
+    if (clientsNames.empty() || !isalnum(clientsNames.front())
+        || clientsNames.find(BAD_COMMAS) != std::string::npos)
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned int i = 0; i < clientsNames.length(); ++i)
     {
-        processMessage(clientSocket, currentMessage);
+        if (!isalnum(clientsNames[i]) && clientsNames[i] != GROUP_CLIENTS_DELIM)
+        {
+            return FAILURE_STATE;
+        }
     }
+    return SUCCESS_STATE;
 }
 
 /**
- * @brief Handles the client procedure in case of receiving message from server.
+ * @brief Parse the argument of a command in the form "command name", where
+ *        the name is a non empty alphanumeric name which ends the input.
+ * @param clientInput The client input, which starts with the command.
+ * @param command The command.
+ * @param name The string to store the name in.
+ * @return 0 if the input matches, -1 otherwise.
  */
-static void handleServer(int const clientSocket)
+static int parseCommandName(const message_t &clientInput, const char *command,
+                            std::string &name)
 {
-    message_t serverMessage;
-    if (readData(clientSocket, serverMessage) < 0)
+    size_t nameBegin = strlen(command) + 1;
+    if (clientInput.length() <= nameBegin
+        || clientInput[nameBegin - 1] != WHITE_SPACE_DELIM
+        || scanName(clientInput, nameBegin) != clientInput.length())
     {
-        return;
+        return FAILURE_STATE;
     }
-    parseMessages(clientSocket, serverMessage);
+    name = clientInput.substr(nameBegin);
+    return SUCCESS_STATE;
 }
 
-
-/*-----=  Handle Input Functions  =-----*/
-
-
 /**
- * @brief Handle the exit command of the client.
- * @param clientSocket The current client socket.
+ * @brief Parse a group command in the form "command groupName names", where
+ *        the names are separated by single commas.
+ * @param clientInput The client input, which starts with the command.
+ * @param command The command.
+ * @param tag The tag of the request of the command.
+ * @param failMessage The message to print if the command is not valid.
+ * @param request The request to store the parsed request in.
+ * @return The kind of the input.
  */
-static void handleClientExitCommand(int const clientSocket)
+static InputCommand parseGroupCommand(const message_t &clientInput,
+                                      const char *command, const MessageTag tag,
+                                      const char *failMessage,
+                                      ClientRequest &request)
 {
-    // Notify the server on the exit.
-    message_t clientExit = std::to_string(CLIENT_EXIT);
-    if (writeData(clientSocket, clientExit) < 0)
-    {
-        systemCallError(WRITE_NAME, errno);
-        exit(EXIT_FAILURE);
-    }
-
-    // Wait for response from the server.
-    char serverResponse;
-    if (read(clientSocket, &serverResponse, sizeof(char)) < 0)
-    {
-        systemCallError(READ_NAME, errno);
-        exit(EXIT_FAILURE);
-    }
-
-    if (serverResponse == LOGOUT_SUCCESS_STATE)
+    std::string name;
+    message_t rest;
+    groupName_t groupName = EMPTY_MSG;
+    if (!parseCommandArguments(clientInput, command, name, rest))
     {
-        std::cout << LOGOUT_SUCCESS_MSG << std::endl;
-        close(clientSocket);
-        exit(EXIT_SUCCESS);
+        groupName = name;
+        // Check the client names in the group specification.
+        if (!validateGroupClients(rest))
+        {
+            request.tag = tag;
+            request.name = groupName;
+            request.members = splitGroupClients(rest);
+            return REQUEST_INPUT;
+        }
     }
 
-    close(clientSocket);
-    exit(EXIT_FAILURE);
+    // Error in the group command.
+    printOutput(*session, failMessage + std::string(QUATS) + groupName
+                          + QUATS MSG_SUFFIX);
+    return INVALID_INPUT;
 }
 
 /**
- * @brief Handles the client who command.
- * @param clientSocket The current client socket.
+ * @brief Parse a multi send command in the form "multi_send names message",
+ *        where the names are separated by single commas.
+ * @param clientInput The client input, which starts with the command.
+ * @param request The request to store the parsed request in.
+ * @return The kind of the input.
  */
-static void handleClientWhoCommand(int const clientSocket)
+static InputCommand parseMultiSendCommand(const message_t &clientInput,
+                                          ClientRequest &request)
 {
-    message_t clientWho = std::to_string(WHO);
-    if (writeData(clientSocket, clientWho) < 0)
+    size_t namesBegin = strlen(MULTI_SEND_COMMAND) + 1;
+    size_t namesEnd = clientInput.find(WHITE_SPACE_DELIM, namesBegin);
+    if (clientInput.length() > namesBegin
+        && clientInput[namesBegin - 1] == WHITE_SPACE_DELIM
+        && namesEnd != std::string::npos)
     {
-        systemCallError(WRITE_NAME, errno);
-        exit(EXIT_FAILURE);
+        message_t names = clientInput.substr(namesBegin, namesEnd - namesBegin);
+        if (!validateGroupClients(names))
+        {
+            request.tag = MULTI_SEND;
+            request.members = splitGroupClients(names);
+            request.message = clientInput.substr(namesEnd + 1);
+            return REQUEST_INPUT;
+        }
     }
 
-    // Read the server response.
-    handleServer(clientSocket);
+    printOutput(*session, CLIENT_SEND_FAIL_MSG);
+    return INVALID_INPUT;
 }
 
 /**
- * @brief Helper function for create group command which creates the client
- *        message part in the entire group message.
- * @param groupClients A message contains data of the group clients.
- * @return A modified message used by the server.
+ * @brief Parse a ping command in the form "ping [count]".
+ * @param clientInput The client input, which starts with the command.
+ * @param request The request to store the parsed request in.
+ * @return The kind of the input.
  */
-static message_t createGroupClientsMessage(message_t const groupClients)
+static InputCommand parsePingCommand(const message_t &clientInput,
+                                     ClientRequest &request)
 {
-    message_t clientsNames;
-    std::stringstream modifiedClients = std::stringstream(GROUP_CLIENTS_DELIM
-                                                          + groupClients);
-    modifiedClients << GROUP_CLIENTS_DELIM;
+    request.tag = PING;
+    request.count = 1;
+    if (clientInput.compare(PING_COMMAND) == EQUAL_COMPARISON)
+    {
+        return REQUEST_INPUT;
+    }
 
-    clientName_t currentName;
-    while (getline(modifiedClients, currentName, GROUP_CLIENTS_DELIM))
+    size_t countBegin = strlen(PING_COMMAND) + 1;
+    if (clientInput.length() > countBegin
+        && clientInput[countBegin - 1] == WHITE_SPACE_DELIM)
     {
-        if (currentName.compare(EMPTY_MSG))
+        std::istringstream count(clientInput.substr(countBegin));
+        count >> request.count;
+        if (isdigit(clientInput[countBegin]) && count && count.eof()
+            && request.count > 0 && request.count <= MAX_PING_COUNT)
         {
-            // If the name is not empty.
-            clientsNames += WHITE_SPACE_SEPARATOR;
-            clientsNames += currentName;
+            return REQUEST_INPUT;
         }
     }
 
-    return clientsNames;
+    printOutput(*session, PING_FAIL_MSG);
+    return INVALID_INPUT;
 }
 
 /**
- * @brief Handles the create group command by the client.
- * @param clientSocket The current client socket.
- * @param groupName The group name.
- * @param groupClients The group clients.
+ * @brief Parse a subscription command in the form "command filter".
+ * @param clientInput The client input, which starts with the command.
+ * @param command The command.
+ * @param unsubscribe Whether the command unsubscribes from the filter.
+ * @param request The request to store the parsed request in.
+ * @return The kind of the input.
  */
-static void handleClientGroupCommand(int const clientSocket,
-                                     groupName_t const groupName,
-                                     message_t const groupClients)
+static InputCommand parseSubscribeCommand(const message_t &clientInput,
+                                          const char *command,
+                                          const bool unsubscribe,
+                                          ClientRequest &request)
 {
-    // Add the message tag representing group creation.
-    message_t clientGroup = std::to_string(CREATE_GROUP);
-    // Add the group name.
-    clientGroup += groupName;
-    // Add the group members.
-    clientGroup += createGroupClientsMessage(groupClients);
-
-    // Send the server the group creation message.
-    if (writeData(clientSocket, clientGroup) < 0)
+    size_t filterBegin = strlen(command) + 1;
+    std::string filter = EMPTY_MSG;
+    if (clientInput.length() > filterBegin
+        && clientInput[filterBegin - 1] == WHITE_SPACE_DELIM)
     {
-        systemCallError(WRITE_NAME, errno);
-        exit(EXIT_FAILURE);
+        filter = clientInput.substr(filterBegin);
+        if (!validateTopic(filter, true))
+        {
+            request.tag = SUBSCRIBE;
+            request.name = filter;
+            request.unsubscribe = unsubscribe;
+            return REQUEST_INPUT;
+        }
     }
 
-    // Read the server response.
-    handleServer(clientSocket);
+    printOutput(*session, (unsubscribe ? UNSUBSCRIBE_FAIL_MSG
+                                       : SUBSCRIBE_FAIL_MSG)
+                          + std::string(QUATS) + filter + QUATS MSG_SUFFIX);
+    return INVALID_INPUT;
 }
 
 /**
- * @brief Handles the send command by the client.
- * @param clientSocket The current client socket.
- * @param sendTo The receiver name.
- * @param message The message to send.
+ * @brief Parse a publish command in the form "publish topic message".
+ * @param clientInput The client input, which starts with the command.
+ * @param request The request to store the parsed request in.
+ * @return The kind of the input.
  */
-static void handleClientSendCommand(int const clientSocket,
-                                    clientName_t const sendTo,
-                                    message_t const message)
+static InputCommand parsePublishCommand(const message_t &clientInput,
+                                        ClientRequest &request)
 {
-    // Add the message tag representing send.
-    message_t clientSend = std::to_string(SEND);
-    clientSend += sendTo + WHITE_SPACE_SEPARATOR + message;
-    // Send the server the group creation message.
-    if (writeData(clientSocket, clientSend) < 0)
+    size_t topicBegin = strlen(PUBLISH_COMMAND) + 1;
+    size_t topicEnd = clientInput.find(WHITE_SPACE_DELIM, topicBegin);
+    std::string topic = EMPTY_MSG;
+    if (clientInput.length() > topicBegin
+        && clientInput[topicBegin - 1] == WHITE_SPACE_DELIM
+        && topicEnd != std::string::npos)
     {
-        systemCallError(WRITE_NAME, errno);
-        exit(EXIT_FAILURE);
+        topic = clientInput.substr(topicBegin, topicEnd - topicBegin);
+        if (!validateTopic(topic, false))
+        {
+            request.tag = PUBLISH;
+            request.name = topic;
+            request.message = clientInput.substr(topicEnd + 1);
+            return REQUEST_INPUT;
+        }
     }
 
-    // Read the server response.
-    handleServer(clientSocket);
+    printOutput(*session, PUBLISH_FAIL_MSG + std::string(QUATS) + topic
+                          + QUATS MSG_SUFFIX);
+    return INVALID_INPUT;
 }
 
 /**
- * @brief Parse and analyze the user input command.
- * @param clientSocket The current client socket.
+ * @brief Parse and analyze the user input command. The parser scans the input
+ *        once, and an invalid command is reported to the user right away.
  * @param clientInput the client input command.
+ * @param request The request to store the parsed request in.
+ * @return The kind of the input.
  */
-static void parseClientInput(int const clientSocket,
-                             const message_t &clientInput)
+static InputCommand parseClientInput(const message_t &clientInput,
+                                     ClientRequest &request)
 {
-    std::regex sendRegex(SEND_REGEX);
-    std::regex groupRegex1(GROUP_REGEX_1);
-    std::regex groupRegex2(GROUP_REGEX_2);
-    std::smatch matcher;
+    std::string name;
+    message_t rest;
 
     if (clientInput.compare(EXIT_COMMAND) == EQUAL_COMPARISON)
     {
-        handleClientExitCommand(clientSocket);
-        assert(false);  // We should never reach this line.
+        return EXIT_INPUT;
     }
 
     if (clientInput.find(WHO_COMMAND) == MSG_BEGIN_INDEX)
     {
         if (clientInput.compare(WHO_COMMAND) == EQUAL_COMPARISON)
         {
-            handleClientWhoCommand(clientSocket);
-            return;
+            request.tag = WHO;
+            return REQUEST_INPUT;
         }
 
         // Error in who command.
-        std::cout << WHO_FAIL_MSG << std::endl;
-        return;
+        printOutput(*session, WHO_FAIL_MSG);
+        return INVALID_INPUT;
     }
 
-    if (clientInput.find(CREATE_GROUP_COMMAND) == MSG_BEGIN_INDEX)
+    if (clientInput.find(PING_COMMAND) == MSG_BEGIN_INDEX)
     {
-        groupName_t groupName = EMPTY_MSG;
-        if (std::regex_match(clientInput, matcher, groupRegex1))
-        {
-            groupName += matcher[1];
+        return parsePingCommand(clientInput, request);
+    }
 
-            // Check the client names in the group specification.
-            message_t clientsNames = matcher[2];
-            bool goodCommas = true;
-            if (clientsNames.find(BAD_COMMAS) != std::string::npos)
-            {
-                goodCommas = false;
+    if (clientInput.find(CREATE_GROUP_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        return parseGroupCommand(clientInput, CREATE_GROUP_COMMAND,
+                                 CREATE_GROUP, GROUP_FAIL_MSG, request);
+    }
 
-            }
-            if (std::regex_match(clientsNames, matcher, groupRegex2))
-            {
-                if (goodCommas)
-                {
-                    handleClientGroupCommand(clientSocket, groupName,
-                                             clientsNames);
-                    return;
-                }
-            }
+    if (clientInput.find(ADD_TO_GROUP_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        return parseGroupCommand(clientInput, ADD_TO_GROUP_COMMAND,
+                                 ADD_TO_GROUP, ADD_TO_GROUP_FAIL_MSG, request);
+    }
+
+    if (clientInput.find(REMOVE_FROM_GROUP_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        return parseGroupCommand(clientInput, REMOVE_FROM_GROUP_COMMAND,
+                                 REMOVE_FROM_GROUP, REMOVE_FROM_GROUP_FAIL_MSG,
+                                 request);
+    }
+
+    if (clientInput.find(LEAVE_GROUP_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        if (!parseCommandName(clientInput, LEAVE_GROUP_COMMAND, name))
+        {
+            request.tag = LEAVE_GROUP;
+            request.name = name;
+            return REQUEST_INPUT;
         }
 
-        // Error in group creation.
-        std::cout << GROUP_FAIL_MSG << QUATS << groupName << QUATS
-                  << MSG_SUFFIX << std::endl;
-        return;
+        printOutput(*session, LEAVE_GROUP_FAIL_MSG QUATS + name + QUATS
+                              MSG_SUFFIX);
+        return INVALID_INPUT;
+    }
+
+    if (clientInput.find(TYPING_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        if (!parseCommandName(clientInput, TYPING_COMMAND, name))
+        {
+            request.name = name;
+            return TYPING_INPUT;
+        }
+
+        printOutput(*session, TYPING_FAIL_MSG QUATS + name + QUATS MSG_SUFFIX);
+        return INVALID_INPUT;
+    }
+
+    if (clientInput.find(MULTI_SEND_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        return parseMultiSendCommand(clientInput, request);
+    }
+
+    if (clientInput.find(SUBSCRIBE_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        return parseSubscribeCommand(clientInput, SUBSCRIBE_COMMAND, false,
+                                     request);
+    }
+
+    if (clientInput.find(UNSUBSCRIBE_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        return parseSubscribeCommand(clientInput, UNSUBSCRIBE_COMMAND, true,
+                                     request);
+    }
+
+    if (clientInput.find(PUBLISH_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        return parsePublishCommand(clientInput, request);
+    }
+
+    if (clientInput.find(BROADCAST_COMMAND) == MSG_BEGIN_INDEX)
+    {
+        size_t messageBegin = strlen(BROADCAST_COMMAND) + 1;
+        if (clientInput.length() >= messageBegin
+            && clientInput[messageBegin - 1] == WHITE_SPACE_DELIM)
+        {
+            request.tag = BROADCAST;
+            request.message = clientInput.substr(messageBegin);
+            return REQUEST_INPUT;
+        }
+
+        printOutput(*session, BROADCAST_FAIL_MSG);
+        return INVALID_INPUT;
     }
 
     if (clientInput.find(SEND_COMMAND) == MSG_BEGIN_INDEX)
     {
-        if (std::regex_match(clientInput, matcher, sendRegex))
+        if (!parseCommandArguments(clientInput, SEND_COMMAND, name, rest)
+            && name.compare(session->name()) != EQUAL_COMPARISON)
         {
-            if (matcher[1].compare(clientName) == EQUAL_COMPARISON)
+            // A client can not send a message to itself.
+            request.tag = SEND;
+            request.name = name;
+            request.message = rest;
+            return REQUEST_INPUT;
+        }
+
+        printOutput(*session, CLIENT_SEND_FAIL_MSG);
+        return INVALID_INPUT;
+    }
+
+    // If the given command doesn't exists.
+    printOutput(*session, INVALID_INPUT_MSG);
+    return INVALID_INPUT;
+}
+
+/**
+ * @brief Summarizes latencies as "title min/avg/max a/b/cus".
+ * @param title The kind of the latencies.
+ * @param latencies The latencies in microseconds, at least one.
+ * @return The summary.
+ */
+static std::string summarizeLatencies(const char *title,
+                                      const std::vector<int64_t> &latencies)
+{
+    int64_t total = 0;
+    for (int64_t latency : latencies)
+    {
+        total += latency;
+    }
+    auto range = std::minmax_element(latencies.begin(), latencies.end());
+    return std::string(title) + " min/avg/max " + std::to_string(*range.first)
+           + "/" + std::to_string(total / (int64_t) latencies.size()) + "/"
+           + std::to_string(*range.second) + "us";
+}
+
+/**
+ * @brief Prints the latencies of the answered pings of a session: the round
+ *        trip, the time in the server, and the time on the wire, which is the
+ *        rest of the round trip and does not depend on the clock of the
+ *        server.
+ * @param pingSession The session.
+ * @param pongs The timestamps of the answers.
+ */
+static void printPings(const WhatsAppSession &pingSession,
+                       const std::vector<FrameTimestamps> &pongs)
+{
+    std::vector<int64_t> roundTrips;
+    std::vector<int64_t> residences;
+    std::vector<int64_t> wires;
+    for (const FrameTimestamps &times : pongs)
+    {
+        int64_t roundTrip = (int64_t) (times.arrived - times.sent);
+        int64_t residence = (int64_t) (times.dispatched - times.received);
+        roundTrips.push_back(roundTrip);
+        residences.push_back(residence);
+        wires.push_back(roundTrip - residence);
+    }
+    printOutput(pingSession, PING_MSG + std::to_string(pongs.size())
+                             + " answered, "
+                             + summarizeLatencies("rtt", roundTrips) + ", "
+                             + summarizeLatencies("server", residences) + ", "
+                             + summarizeLatencies("wire", wires) + MSG_SUFFIX);
+}
+
+/**
+ * @brief Pings the server of the session several times at once, and prints
+ *        the latencies once all the pings were answered.
+ * @param count The number of pings.
+ */
+static void pingServer(const unsigned long count)
+{
+    WhatsAppSession *pingSession = session;
+    auto pongs = std::make_shared<std::vector<FrameTimestamps>>();
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        session->ping([pingSession, pongs, count](const FrameTimestamps &times)
+        {
+            pongs->push_back(times);
+            if (pongs->size() == count)
             {
-                // If the client sends a message to itself.
-                std::cout << CLIENT_SEND_FAIL_MSG << std::endl;
-                return;
+                printPings(*pingSession, *pongs);
             }
+        });
+    }
+}
 
-            handleClientSendCommand(clientSocket, matcher[1], matcher[2]);
+/**
+ * @brief Send a parsed request of the user through the session. The client
+ *        does not wait for the response, which is printed when it arrives.
+ * @param request The request to send.
+ */
+static void handleClientRequest(const ClientRequest &request)
+{
+    switch (request.tag)
+    {
+        case CREATE_GROUP:
+            session->createGroup(request.name, request.members,
+                                 printer(session));
             return;
-        }
 
-        std::cout << CLIENT_SEND_FAIL_MSG << std::endl;
-        return;
+        case SEND:
+            session->send(request.name, request.message, printer(session));
+            return;
+
+        case MULTI_SEND:
+            session->multiSend(request.members, request.message,
+                               printer(session));
+            return;
+
+        case BROADCAST:
+            session->broadcast(request.message, printer(session));
+            return;
+
+        case ADD_TO_GROUP:
+            session->addToGroup(request.name, request.members,
+                                printer(session));
+            return;
+
+        case REMOVE_FROM_GROUP:
+            session->removeFromGroup(request.name, request.members,
+                                     printer(session));
+            return;
+
+        case LEAVE_GROUP:
+            session->leaveGroup(request.name, printer(session));
+            return;
+
+        case PING:
+            pingServer(request.count);
+            return;
+
+        case SUBSCRIBE:
+            if (!request.unsubscribe)
+            {
+                session->subscribeTopic(request.name, printer(session));
+            }
+            else if (session->unsubscribeTopic(request.name, printer(session)))
+            {
+                // The session is not subscribed to the filter.
+                printOutput(*session, UNSUBSCRIBE_FAIL_MSG QUATS + request.name
+                                      + QUATS MSG_SUFFIX);
+            }
+            return;
+
+        case PUBLISH:
+            session->publish(request.name, request.message, printer(session));
+            return;
+
+        default:
+            session->who(printer(session));
+            return;
     }
+}
 
-    // If the given command doesn't exists.
-    std::cout << INVALID_INPUT_MSG << std::endl;
-    return;
+/**
+ * @brief Handle a single command of the user.
+ * @param clientInput The command.
+ */
+static void handleClientCommand(const message_t &clientInput)
+{
+    ClientRequest request;
+    InputCommand command = parseClientInput(clientInput, request);
+    if (command == EXIT_INPUT)
+    {
+        session->logout();
+    }
+    else if (command == REQUEST_INPUT)
+    {
+        handleClientRequest(request);
+    }
+    else if (command == TYPING_INPUT && session->typing(request.name))
+    {
+        printOutput(*session, TYPING_FAIL_MSG QUATS + request.name + QUATS
+                              MSG_SUFFIX);
+    }
 }
 
 /**
  * @brief Handles the client procedure in case of receiving input from the user.
+ *        The input is read without blocking, and every complete line in it is
+ *        handled as a command.
  */
-static void handleClientInput(int const clientSocket)
+static void handleClientInput()
+{
+    char currentChunk[READ_BUFFER_SIZE];
+    ssize_t currentCount = read(STDIN_FILENO, currentChunk, READ_BUFFER_SIZE);
+    if (currentCount < 0)
+    {
+        if (wouldBlock())
+        {
+            return;
+        }
+        systemCallError(READ_NAME, errno);
+        exit(EXIT_FAILURE);
+    }
+    if (currentCount == 0)
+    {
+        // The input was closed, handle its last line if it is not terminated.
+        readingInput = false;
+        if (!userInput.empty())
+        {
+            userInput += (char) MSG_TERMINATOR;
+        }
+    }
+    else
+    {
+        userInput.append(currentChunk, (size_t) currentCount);
+    }
+
+    size_t position = MSG_BEGIN_INDEX;
+    auto lineEnd = userInput.find(MSG_TERMINATOR);
+    while (lineEnd != std::string::npos
+           && session->state() == CONNECTED_SESSION)
+    {
+        handleClientCommand(userInput.substr(position, lineEnd - position));
+        position = lineEnd + 1;
+        lineEnd = userInput.find(MSG_TERMINATOR, position);
+    }
+    userInput.erase(MSG_BEGIN_INDEX, position);
+}
+
+/**
+ * @brief Loads a script of commands as a single batch. All the commands are
+ *        parsed and validated, and their requests are queued to the server at
+ *        once, so they are streamed without waiting for each response. The
+ *        script ends at its end or at its first exit command, and the client
+ *        exits once all of its requests were answered.
+ * @param commands The script to load.
+ */
+static void loadScript(std::istream &commands)
 {
     message_t clientInput;
-    std::getline(std::cin, clientInput);
-    parseClientInput(clientSocket, clientInput);
+    while (std::getline(commands, clientInput))
+    {
+        ClientRequest request;
+        InputCommand command = parseClientInput(clientInput, request);
+        if (command == EXIT_INPUT)
+        {
+            break;
+        }
+        if (command == REQUEST_INPUT)
+        {
+            handleClientRequest(request);
+        }
+        else if (command == TYPING_INPUT)
+        {
+            session->typing(request.name);
+        }
+    }
+}
+
+/**
+ * @brief Handle the result of the handshake with the server.
+ * @param connectionState The connection state that received from the server.
+ */
+static void handleConnection(const char connectionState)
+{
+    if (connectionState == CONNECTION_SUCCESS_STATE)
+    {
+        // If the connection is valid and the name is valid.
+        std::cout << CONNECT_SUCCESS_MSG << std::endl;
+        if (script != nullptr)
+        {
+            loadScript(*script);
+        }
+        return;
+    }
+    if (connectionState == CONNECTION_IN_USE_STATE)
+    {
+        // If the name is already taken.
+        std::cout << TAKEN_CLIENT_NAME_MSG << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // Any other failure during connection to the server.
+    std::cout << CONNECT_FAILURE_MSG << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Gets the message of a session which reconnected after it lost its
+ *        connection.
+ * @param connectionState The connection state that received from the server.
+ * @return The message to print.
+ */
+static const char *reconnectionMessage(const char connectionState)
+{
+    // The server starts a new session if the lost session has expired.
+    return connectionState == CONNECTION_RESUMED_STATE ? RESUME_SUCCESS_MSG
+                                                       : CONNECT_SUCCESS_MSG;
+}
+
+
+/*-----=  Multi Session Functions  =-----*/
+
+
+/**
+ * @brief Watch the descriptor of a session in the epoll set. The session
+ *        index is the key of its events, so the descriptor of a session may
+ *        change (on a redirect) without any lookup.
+ * @param index The index of the session.
+ * @param socketID The descriptor of the session.
+ * @param writing Whether the session waits to write.
+ */
+static void watchSession(const size_t index, const int socketID,
+                         const bool writing)
+{
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+    event.data.u64 = index;
+    if (epoll_ctl(epollFD, EPOLL_CTL_MOD, socketID, &event)
+        && (errno != ENOENT
+            || epoll_ctl(epollFD, EPOLL_CTL_ADD, socketID, &event)))
+    {
+        systemCallError(EPOLL_CTL_NAME, errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Handle the result of the handshake of a session. A session which
+ *        failed to connect is closed, and the rest keep running.
+ * @param handshakeSession The session.
+ * @param connectionState The connection state that received from the server.
+ */
+static void handleSessionConnection(const WhatsAppSession &handshakeSession,
+                                    const char connectionState)
+{
+    pendingHandshakes--;
+    if (connectionState == CONNECTION_SUCCESS_STATE)
+    {
+        printOutput(handshakeSession, CONNECT_SUCCESS_MSG);
+        return;
+    }
+    openSessions--;
+    printOutput(handshakeSession, connectionState == CONNECTION_IN_USE_STATE ?
+                                  TAKEN_CLIENT_NAME_MSG : CONNECT_FAILURE_MSG);
+}
+
+/**
+ * @brief Handle the end of a session in the multi session mode.
+ * @param closedSession The session.
+ * @param reason The reason for the end of the session.
+ */
+static void handleMultiSessionClosed(const WhatsAppSession &closedSession,
+                                     const CloseReason reason)
+{
+    openSessions--;
+    if (reason == LOGOUT_CLOSE)
+    {
+        printOutput(closedSession, LOGOUT_SUCCESS_MSG);
+    }
+}
+
+/**
+ * @brief Opens a session for every client name in the given file, all of them
+ *        connected to the same server.
+ * @param names The file of client names, one name per line.
+ * @param hostName The host name of the server (or a Unix socket path).
+ * @param portNumber The port number of the server.
+ */
+static void openMultiSessions(std::istream &names, const char *hostName,
+                              const portNumber_t portNumber)
+{
+    clientName_t name;
+    while (std::getline(names, name))
+    {
+        if (name.empty() || namesToSessions.count(name))
+        {
+            continue;
+        }
+        size_t index = sessions.size();
+        sessions.emplace_back(new WhatsAppSession(name));
+        WhatsAppSession *newSession = sessions.back().get();
+        namesToSessions[name] = newSession;
+
+        newSession->useSharedMemory(true);
+        newSession->subscribe(printer(newSession));
+        newSession->onClose([newSession](const CloseReason reason)
+        {
+            handleMultiSessionClosed(*newSession, reason);
+        });
+        newSession->onReconnect([newSession](const char connectionState)
+        {
+            printOutput(*newSession, reconnectionMessage(connectionState));
+        });
+        newSession->onInterest([index](const int socketID, const bool writing)
+        {
+            watchSession(index, socketID, writing);
+        });
+        if (newSession->connect(hostName, portNumber,
+                                [newSession](const char connectionState)
+        {
+            handleSessionConnection(*newSession, connectionState);
+        }))
+        {
+            printOutput(*newSession, CONNECT_FAILURE_MSG);
+            continue;
+        }
+        openSessions++;
+        pendingHandshakes++;
+    }
+}
+
+/**
+ * @brief Handle a line of the user in the multi session mode, which is routed
+ *        to the session named by its first word, as in "name command".
+ * @param line The line.
+ */
+static void handleSessionLine(const message_t &line)
+{
+    size_t nameEnd = line.find(WHITE_SPACE_DELIM);
+    auto i = namesToSessions.find(line.substr(MSG_BEGIN_INDEX, nameEnd));
+    if (nameEnd == std::string::npos || i == namesToSessions.end()
+        || i->second->state() != CONNECTED_SESSION)
+    {
+        std::cout << SESSION_UNKNOWN_MSG << MSG_TERMINATOR;
+        return;
+    }
+    session = i->second;
+    handleClientCommand(line.substr(nameEnd + 1));
+}
+
+/**
+ * @brief Handles the input of the user in the multi session mode.
+ */
+static void handleMultiSessionInput()
+{
+    char currentChunk[READ_BUFFER_SIZE];
+    ssize_t currentCount = read(STDIN_FILENO, currentChunk, READ_BUFFER_SIZE);
+    if (currentCount < 0)
+    {
+        if (wouldBlock() || errno == EINTR)
+        {
+            return;
+        }
+        systemCallError(READ_NAME, errno);
+        exit(EXIT_FAILURE);
+    }
+    if (currentCount == 0)
+    {
+        // The input was closed, handle its last line if it is not terminated.
+        readingInput = false;
+        epoll_ctl(epollFD, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+        if (!userInput.empty())
+        {
+            userInput += (char) MSG_TERMINATOR;
+        }
+    }
+    else
+    {
+        userInput.append(currentChunk, (size_t) currentCount);
+    }
+
+    size_t position = MSG_BEGIN_INDEX;
+    auto lineEnd = userInput.find(MSG_TERMINATOR);
+    while (lineEnd != std::string::npos)
+    {
+        handleSessionLine(userInput.substr(position, lineEnd - position));
+        position = lineEnd + 1;
+        lineEnd = userInput.find(MSG_TERMINATOR, position);
+    }
+    userInput.erase(MSG_BEGIN_INDEX, position);
+}
+
+/**
+ * @brief Runs all the sessions of the client over a single epoll loop. The
+ *        user input is read once all the sessions completed their handshake,
+ *        and the client exits once all the sessions are closed.
+ * @param names The file of client names, one name per line.
+ * @param hostName The host name of the server (or a Unix socket path).
+ * @param portNumber The port number of the server.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int runMultiSessions(std::istream &names, const char *hostName,
+                            const portNumber_t portNumber)
+{
+    // A session is a descriptor, so allow as many as the system allows.
+    rlimit limit;
+    if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFD < SOCKET_ID_BOUND)
+    {
+        systemCallError(EPOLL_CREATE_NAME, errno);
+        return FAILURE_STATE;
+    }
+    multiSession = true;
+    openMultiSessions(names, hostName, portNumber);
+
+    // The input may be a regular file, which epoll can not watch but which
+    // is always ready.
+    bool watchingInput = false;
+    bool inputAlwaysReady = false;
+    epoll_event inputEvent;
+    memset(&inputEvent, 0, sizeof(epoll_event));
+    inputEvent.events = EPOLLIN;
+    inputEvent.data.u64 = INPUT_EVENT_KEY;
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    while (openSessions > 0)
+    {
+        if (readingInput && pendingHandshakes == 0 && !watchingInput
+            && !inputAlwaysReady)
+        {
+            inputAlwaysReady = epoll_ctl(epollFD, EPOLL_CTL_ADD, STDIN_FILENO,
+                                         &inputEvent) != SUCCESS_STATE;
+            watchingInput = !inputAlwaysReady;
+        }
+        bool inputReady = inputAlwaysReady && readingInput;
+
+        int readyCount = epoll_wait(epollFD, events, MAX_EPOLL_EVENTS,
+                                    inputReady ? 0 : -1);
+        if (readyCount < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            systemCallError(EPOLL_WAIT_NAME, errno);
+            return FAILURE_STATE;
+        }
+
+        for (int i = 0; i < readyCount; ++i)
+        {
+            if (events[i].data.u64 == INPUT_EVENT_KEY)
+            {
+                inputReady = true;
+                continue;
+            }
+            uint32_t ready = events[i].events;
+            sessions[events[i].data.u64]->handleEvents(
+                    ready & (EPOLLIN | EPOLLHUP | EPOLLERR), ready & EPOLLOUT);
+        }
+        if (inputReady && readingInput)
+        {
+            // The new requests are written once their sessions are writable.
+            handleMultiSessionInput();
+        }
+        std::cout.flush();
+    }
+    return SUCCESS_STATE;
 }
 
 
@@ -620,7 +1473,9 @@ static void handleClientInput(int const clientSocket)
 
 
 /**
- * @brief The main function that runs the client.
+ * @brief The main function that runs the client. The client is a thin shell
+ *        over a session of the client library, whose descriptor is waited for
+ *        together with the user input in a single event loop.
  */
 int main(int argc, char *argv[])
 {
@@ -631,41 +1486,110 @@ int main(int argc, char *argv[])
         return FAILURE_STATE;
     }
 
-    clientName = argv[CLIENT_ARGUMENT_INDEX];
+    // Run all the client names of the given file as sessions of this process.
+    if (argc == SESSIONS_ARGUMENTS_COUNT)
+    {
+        std::ifstream names(argv[SESSIONS_ARGUMENT_INDEX]);
+        if (!names)
+        {
+            std::cout << SESSIONS_OPEN_FAIL_MSG << std::endl;
+            return FAILURE_STATE;
+        }
+        return runMultiSessions(names, argv[SESSIONS_SERVER_ARGUMENT_INDEX],
+                                (portNumber_t) std::stoi(
+                                        argv[SESSIONS_PORT_ARGUMENT_INDEX]));
+    }
+
     const char *serverAddress = argv[SERVER_ARGUMENT_INDEX];
     portNumber_t portNum = (portNumber_t) std::stoi(argv[PORT_ARGUMENT_INDEX]);
 
+    // Open the script from the standard input or from the given file.
+    std::ifstream scriptFile;
+    if (argc == SCRIPT_ARGUMENTS_COUNT)
+    {
+        script = &std::cin;
+        if (strcmp(argv[SCRIPT_ARGUMENT_INDEX], SCRIPT_STDIN)
+            != EQUAL_COMPARISON)
+        {
+            scriptFile.open(argv[SCRIPT_ARGUMENT_INDEX]);
+            if (!scriptFile)
+            {
+                std::cout << SCRIPT_OPEN_FAIL_MSG << std::endl;
+                return FAILURE_STATE;
+            }
+            script = &scriptFile;
+        }
+        readingInput = false;
+    }
+
     // Attempt to connect to the server.
-    int clientSocket = callSocket(serverAddress, portNum, clientName);
-    if (clientSocket < SOCKET_ID_BOUND)
+    WhatsAppSession clientSession(argv[CLIENT_ARGUMENT_INDEX]);
+    session = &clientSession;
+    session->useSharedMemory(true);
+    session->useSignals(true);
+    session->onSignal(printSignal);
+    session->subscribe(printer(session));
+    session->onClose(handleSessionClosed);
+    session->onReconnect([](const char connectionState)
+    {
+        printOutput(*session, reconnectionMessage(connectionState));
+    });
+    if (session->connect(serverAddress, portNum, handleConnection))
     {
         return FAILURE_STATE;
     }
 
-    fd_set originalSet;
-    FD_ZERO(&originalSet);
-    FD_SET(STDIN_FILENO, &originalSet);
-    FD_SET(clientSocket, &originalSet);
-
     while (true)
     {
-        fd_set currentSet = originalSet;
-        int readyFD = select(clientSocket + 1, &currentSet, NULL, NULL, NULL);
+        if (script != nullptr && session->state() == CONNECTED_SESSION
+            && session->pendingResponses() == 0)
+        {
+            // All the requests of the script were answered.
+            session->logout();
+        }
+
+        int serverSocket = session->fileDescriptor();
+        fd_set readSet;
+        fd_set writeSet;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        if (readingInput && session->state() == CONNECTED_SESSION)
+        {
+            FD_SET(STDIN_FILENO, &readSet);
+        }
+        FD_SET(serverSocket, &readSet);
+        if (session->wantsWrite())
+        {
+            FD_SET(serverSocket, &writeSet);
+        }
+        int signalSocket = session->signalDescriptor();
+        if (signalSocket >= SOCKET_ID_BOUND)
+        {
+            FD_SET(signalSocket, &readSet);
+        }
 
+        int maxSocket = std::max(serverSocket, signalSocket);
+        int readyFD = select(maxSocket + 1, &readSet, &writeSet, NULL, NULL);
         if (readyFD < 0)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             systemCallError(SELECT_NAME, errno);
             exit(EXIT_FAILURE);
         }
 
-        if (FD_ISSET(STDIN_FILENO, &currentSet))
+        if (FD_ISSET(STDIN_FILENO, &readSet))
         {
-            handleClientInput(clientSocket);
+            handleClientInput();
         }
 
-        if (FD_ISSET(clientSocket, &currentSet))
+        if (signalSocket >= SOCKET_ID_BOUND && FD_ISSET(signalSocket, &readSet))
         {
-            handleServer(clientSocket);
+            session->handleSignals();
         }
+        session->handleEvents(FD_ISSET(serverSocket, &readSet),
+                              FD_ISSET(serverSocket, &writeSet));
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,899 @@
+/**
+ * @file whatsappReplay.cpp
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Replay of a capture of the WhatsApp Server against a server.
+ */
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <cmath>
+#include <deque>
+#include <chrono>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include "Capture.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def VALID_ARGUMENTS_COUNT 4
+ * @brief A Macro that sets the number for valid arguments count.
+ */
+#define VALID_ARGUMENTS_COUNT 4
+
+/**
+ * @def SPEED_ARGUMENTS_COUNT 6
+ * @brief A Macro that sets the number for valid arguments count with a speed.
+ */
+#define SPEED_ARGUMENTS_COUNT 6
+
+/**
+ * @def CAPTURE_ARGUMENT_INDEX 1
+ * @brief A Macro that sets the index of the capture file to this program.
+ */
+#define CAPTURE_ARGUMENT_INDEX 1
+
+/**
+ * @def SERVER_ARGUMENT_INDEX 2
+ * @brief A Macro that sets the index of the server address to this program.
+ */
+#define SERVER_ARGUMENT_INDEX 2
+
+/**
+ * @def PORT_ARGUMENT_INDEX 3
+ * @brief A Macro that sets the index of the server port to this program.
+ */
+#define PORT_ARGUMENT_INDEX 3
+
+/**
+ * @def SPEED_OPTION_INDEX 4
+ * @brief A Macro that sets the index of the speed option to this program.
+ */
+#define SPEED_OPTION_INDEX 4
+
+/**
+ * @def SPEED_ARGUMENT_INDEX 5
+ * @brief A Macro that sets the index of the speed to this program.
+ */
+#define SPEED_ARGUMENT_INDEX 5
+
+/**
+ * @def SPEED_OPTION "--speed"
+ * @brief A Macro that sets the option of the speed of the replay.
+ */
+#define SPEED_OPTION "--speed"
+
+/**
+ * @def MAX_SPEED "max"
+ * @brief A Macro that sets the speed which replays every frame at once.
+ */
+#define MAX_SPEED "max"
+
+/**
+ * @def MAX_SPEED_FACTOR 0
+ * @brief A Macro that sets the speed factor of the max speed.
+ */
+#define MAX_SPEED_FACTOR 0
+
+/**
+ * @def DEFAULT_SPEED_FACTOR 1
+ * @brief A Macro that sets the speed factor of the original time of the frames.
+ */
+#define DEFAULT_SPEED_FACTOR 1
+
+/**
+ * @def USAGE_MSG "Usage: whatsappReplay captureFile serverAddress serverPort"
+ * @brief A Macro that sets the error message when the usage is invalid.
+ */
+#define USAGE_MSG "Usage: whatsappReplay captureFile serverAddress " \
+                  "serverPort [--speed factor|max]\n"
+
+/**
+ * @def CAPTURE_OPEN_FAIL_MSG "ERROR: failed to open the capture."
+ * @brief A Macro that sets the error message when the capture is not valid.
+ */
+#define CAPTURE_OPEN_FAIL_MSG "ERROR: failed to open the capture."
+
+/**
+ * @def DRAIN_TIMEOUT 5000
+ * @brief A Macro that sets the time in milliseconds to wait for the responses
+ *        once all the frames were sent.
+ */
+#define DRAIN_TIMEOUT 5000
+
+/**
+ * @def MAX_EPOLL_EVENTS 256
+ * @brief A Macro that sets the maximal number of events of a single wait.
+ */
+#define MAX_EPOLL_EVENTS 256
+
+/**
+ * @def NO_SOCKET -1
+ * @brief A Macro that sets the socket of a connection which is not open.
+ */
+#define NO_SOCKET -1
+
+/**
+ * @def MICROSECONDS_PER_MILLISECOND 1000
+ * @brief A Macro that sets the number of microseconds in a millisecond.
+ */
+#define MICROSECONDS_PER_MILLISECOND 1000
+
+/**
+ * @def MICROSECONDS_PER_SECOND 1000000.0
+ * @brief A Macro that sets the number of microseconds in a second.
+ */
+#define MICROSECONDS_PER_SECOND 1000000.0
+
+/**
+ * @def MEDIAN_PERCENTILE 50
+ * @brief A Macro that sets the percentile of the median latency.
+ */
+#define MEDIAN_PERCENTILE 50
+
+/**
+ * @def TAIL_PERCENTILE 99
+ * @brief A Macro that sets the percentile of the tail latency.
+ */
+#define TAIL_PERCENTILE 99
+
+/**
+ * @def FULL_PERCENTILE 100
+ * @brief A Macro that sets the percentile of the maximal latency.
+ */
+#define FULL_PERCENTILE 100
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief Type Definition for a time in microseconds.
+ */
+typedef uint64_t microseconds_t;
+
+/**
+ * @brief A connection of the capture, which is replayed as a connection of
+ *        its own to the server. The connection asks for the timestamps of the
+ *        server, and keeps those of the next line until it arrives.
+ */
+struct ReplayConnection
+{
+    int socket;
+    bool opened;
+    bool handshaking;
+    bool redirected;
+    bool closing;
+    bool halfClosed;
+    bool stamped;
+    microseconds_t received;
+    microseconds_t dispatched;
+    microseconds_t connectTime;
+    message_t input;
+    message_t output;
+    std::deque<microseconds_t> requests;
+};
+
+/**
+ * @brief A record of the capture, on the index of its connection: a frame,
+ *        or the end of the connection.
+ */
+struct ReplayRecord
+{
+    microseconds_t time;
+    size_t connection;
+    bool closing;
+    message_t frame;
+};
+
+
+/*-----=  Replay Data  =-----*/
+
+
+/**
+ * @brief The records of the capture.
+ */
+std::vector<ReplayRecord> records;
+
+/**
+ * @brief The connections of the capture, in the order of their first frame.
+ */
+std::vector<ReplayConnection> connections;
+
+/**
+ * @brief A map between the handle of a captured connection and its index,
+ *        for the handles of the server which is captured.
+ */
+std::unordered_map<uint64_t, size_t> handlesToConnections;
+
+/**
+ * @brief A map between the name of a client which was handed off to a new
+ *        server and the index of its connection.
+ */
+std::unordered_map<clientName_t, size_t> handoffs;
+
+/**
+ * @brief The address of the server.
+ */
+sockaddr_storage serverAddress;
+
+/**
+ * @brief The length of the address of the server.
+ */
+socklen_t serverAddressLength = 0;
+
+/**
+ * @brief The epoll instance of the replay.
+ */
+int epollFD = FAILURE_STATE;
+
+/**
+ * @brief The number of frames which were sent.
+ */
+size_t sentFrames = 0;
+
+/**
+ * @brief The number of handshakes which the server refused.
+ */
+size_t failedHandshakes = 0;
+
+/**
+ * @brief The number of connections which failed to connect to the server.
+ */
+size_t failedConnections = 0;
+
+/**
+ * @brief The latencies of the handshakes, from the connection to the state.
+ */
+std::vector<microseconds_t> handshakeLatencies;
+
+/**
+ * @brief The latencies of the requests, from the request to its response.
+ */
+std::vector<microseconds_t> requestLatencies;
+
+/**
+ * @brief The times the requests spent in the server, from their receipt to
+ *        the dispatch of their responses.
+ */
+std::vector<microseconds_t> residenceLatencies;
+
+/**
+ * @brief The times the requests and their responses spent on the wire, which
+ *        is the rest of their latencies.
+ */
+std::vector<microseconds_t> wireLatencies;
+
+
+/*-----=  Replay Initialization Functions  =-----*/
+
+
+/**
+ * @brief Gets the current time.
+ * @return The current time in microseconds of the monotonic clock.
+ */
+static microseconds_t now()
+{
+    auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+    return (microseconds_t) std::chrono::duration_cast<
+            std::chrono::microseconds>(elapsed).count();
+}
+
+/**
+ * @brief Parses the speed of the replay.
+ * @param speed The speed, a positive factor or "max".
+ * @param factor The speed factor to fill, MAX_SPEED_FACTOR for max speed.
+ * @return 0 if the speed is valid, -1 otherwise.
+ */
+static int parseSpeed(std::string const speed, double &factor)
+{
+    if (speed.compare(MAX_SPEED) == EQUAL_COMPARISON)
+    {
+        factor = MAX_SPEED_FACTOR;
+        return SUCCESS_STATE;
+    }
+    std::istringstream value(speed);
+    value >> factor;
+    if (!value || !value.eof() || !std::isfinite(factor) || factor <= 0)
+    {
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Resolves the address of the server, once for all the connections.
+ * @param hostName The host name of the server, or the path of a Unix socket.
+ * @param port The port of the server.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int resolveServer(const char *hostName, std::string const port)
+{
+    memset(&serverAddress, 0, sizeof(sockaddr_storage));
+    if (isUnixSocketPath(hostName))
+    {
+        if (setUnixSocketAddress(hostName, *(sockaddr_un *) &serverAddress))
+        {
+            return FAILURE_STATE;
+        }
+        serverAddressLength = sizeof(sockaddr_un);
+        return SUCCESS_STATE;
+    }
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    int error = getaddrinfo(hostName, port.c_str(), &hints, &addresses);
+    if (error)
+    {
+        addressInfoError(error);
+        return FAILURE_STATE;
+    }
+    memcpy(&serverAddress, addresses->ai_addr, addresses->ai_addrlen);
+    serverAddressLength = addresses->ai_addrlen;
+    freeaddrinfo(addresses);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Loads the records of a capture, and indexes its connections. The
+ *        clients which were taken over on a hot restart keep the connection
+ *        they had before it, and a record of a connection which never sent a
+ *        frame is dropped.
+ * @param path The path of the capture file.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int loadCapture(std::string const path)
+{
+    CaptureReader reader;
+    if (reader.open(path))
+    {
+        return FAILURE_STATE;
+    }
+    CaptureRecord record;
+    while (reader.next(record))
+    {
+        auto connection = handlesToConnections.find(record.connection);
+        switch (record.kind)
+        {
+            case START_RECORD:
+                // The handles of the previous server are void.
+                handlesToConnections.clear();
+                continue;
+
+            case HANDOFF_RECORD:
+                if (connection != handlesToConnections.end())
+                {
+                    handoffs[record.data] = connection->second;
+                }
+                continue;
+
+            case TAKEOVER_RECORD:
+                if (handoffs.count(record.data))
+                {
+                    handlesToConnections[record.connection] =
+                            handoffs[record.data];
+                    handoffs.erase(record.data);
+                }
+                continue;
+
+            case CLOSE_RECORD:
+                if (connection != handlesToConnections.end())
+                {
+                    records.push_back(ReplayRecord{record.time,
+                                                   connection->second, true,
+                                                   EMPTY_MSG});
+                    handlesToConnections.erase(connection);
+                }
+                continue;
+
+            case FRAME_RECORD:
+                if (connection == handlesToConnections.end())
+                {
+                    connection = handlesToConnections.emplace(
+                            record.connection, connections.size()).first;
+                    connections.push_back(ReplayConnection{NO_SOCKET, false,
+                                                           false, false, false,
+                                                           false, false, 0, 0,
+                                                           0, "", "", {}});
+                }
+                records.push_back(ReplayRecord{record.time, connection->second,
+                                               false, record.data});
+                continue;
+
+            default:
+                continue;
+        }
+    }
+    return SUCCESS_STATE;
+}
+
+
+/*-----=  Replay Connection Functions  =-----*/
+
+
+/**
+ * @brief Watch the socket of a connection in the epoll set. The connection
+ *        index is the key of its events.
+ * @param index The index of the connection.
+ */
+static void watchConnection(const size_t index)
+{
+    const ReplayConnection &connection = connections[index];
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN | (connection.output.empty() ? 0 : EPOLLOUT);
+    event.data.u64 = index;
+    if (epoll_ctl(epollFD, EPOLL_CTL_MOD, connection.socket, &event)
+        && (errno != ENOENT
+            || epoll_ctl(epollFD, EPOLL_CTL_ADD, connection.socket, &event)))
+    {
+        systemCallError(EPOLL_CTL_NAME, errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Closes a connection. Its requests which were not answered are
+ *        dropped.
+ * @param index The index of the connection.
+ */
+static void closeConnection(const size_t index)
+{
+    ReplayConnection &connection = connections[index];
+    if (connection.socket != NO_SOCKET)
+    {
+        close(connection.socket);
+        connection.socket = NO_SOCKET;
+    }
+    connection.requests.clear();
+}
+
+/**
+ * @brief Writes as much of the output of a connection as the socket accepts.
+ * @param index The index of the connection.
+ * @return 0 upon success, -1 if the connection failed.
+ */
+static int writeOutput(const size_t index)
+{
+    ReplayConnection &connection = connections[index];
+    ssize_t count = write(connection.socket, connection.output.data(),
+                          connection.output.length());
+    if (count < 0 && !wouldBlock())
+    {
+        closeConnection(index);
+        return FAILURE_STATE;
+    }
+    connection.output.erase(MSG_BEGIN_INDEX, count < 0 ? 0 : (size_t) count);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Opens the connection of a captured connection to the server.
+ * @param index The index of the connection.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int openConnection(const size_t index)
+{
+    ReplayConnection &connection = connections[index];
+    connection.opened = true;
+    connection.socket = socket(serverAddress.ss_family, SOCK_STREAM, 0);
+    if (connection.socket < SOCKET_ID_BOUND)
+    {
+        systemCallError(SOCKET_NAME, errno);
+        connection.socket = NO_SOCKET;
+        return FAILURE_STATE;
+    }
+    if (connect(connection.socket, (sockaddr *) &serverAddress,
+                serverAddressLength))
+    {
+        systemCallError(CONNECT_NAME, errno);
+        closeConnection(index);
+        return FAILURE_STATE;
+    }
+    if (serverAddress.ss_family != AF_UNIX)
+    {
+        setNoDelay(connection.socket);
+    }
+    if (setNonBlocking(connection.socket))
+    {
+        closeConnection(index);
+        return FAILURE_STATE;
+    }
+    connection.handshaking = true;
+    connection.connectTime = now();
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Determine if a frame is a request which the server answers with a
+ *        response of the same tag.
+ * @param frame The frame.
+ * @return true if the frame is answered, false otherwise.
+ */
+static bool answeredFrame(const message_t &frame)
+{
+    if (frame.empty())
+    {
+        return false;
+    }
+    switch (frame.front() - TAG_CHAR_BASE)
+    {
+        case CREATE_GROUP:
+        case SEND:
+        case MULTI_SEND:
+        case BROADCAST:
+        case WHO:
+        case ADD_TO_GROUP:
+        case REMOVE_FROM_GROUP:
+        case LEAVE_GROUP:
+        case PING:
+        case SUBSCRIBE:
+        case PUBLISH:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Ends the output of a connection which the capture has closed, once
+ *        its output is written. The connection is kept open to read the
+ *        responses, until the server closes it.
+ * @param index The index of the connection.
+ */
+static void finishOutput(const size_t index)
+{
+    ReplayConnection &connection = connections[index];
+    if (connection.closing && !connection.halfClosed
+        && connection.output.empty())
+    {
+        shutdown(connection.socket, SHUT_WR);
+        connection.halfClosed = true;
+    }
+}
+
+/**
+ * @brief Replays a record on its connection. The first frame of a connection
+ *        is its handshake, so the connection is opened for it.
+ * @param record The record.
+ */
+static void replayRecord(const ReplayRecord &record)
+{
+    size_t index = record.connection;
+    ReplayConnection &connection = connections[index];
+    if (record.closing)
+    {
+        connection.closing = true;
+        if (connection.socket != NO_SOCKET)
+        {
+            finishOutput(index);
+        }
+        return;
+    }
+    bool handshake = !connection.opened;
+    if (handshake && openConnection(index))
+    {
+        failedConnections++;
+        return;
+    }
+    if (connection.socket == NO_SOCKET)
+    {
+        return;
+    }
+
+    connection.output += record.frame + (char) MSG_TERMINATOR;
+    if (handshake)
+    {
+        // The timestamps are asked for once the client is connected.
+        connection.output += messageTag(TIMESTAMP) + (char) MSG_TERMINATOR;
+    }
+    if (!handshake && answeredFrame(record.frame))
+    {
+        connection.requests.push_back(now());
+    }
+    sentFrames++;
+    // The frame is written right away, so the server gets the frames of all
+    // the connections in the order of the capture.
+    if (writeOutput(index) == SUCCESS_STATE)
+    {
+        watchConnection(index);
+    }
+}
+
+/**
+ * @brief Handles the lines the server has sent on a connection, and matches
+ *        every response with the oldest request of the connection.
+ * @param connection The connection.
+ * @param time The time the lines were read.
+ */
+static void handleLines(ReplayConnection &connection, const microseconds_t time)
+{
+    if (connection.handshaking && !connection.input.empty())
+    {
+        // The handshake is answered with a single state, without a terminator.
+        char state = connection.input.front();
+        connection.input.erase(MSG_BEGIN_INDEX, 1);
+        connection.handshaking = false;
+        connection.redirected = state == CONNECTION_REDIRECT_STATE;
+        handshakeLatencies.push_back(time - connection.connectTime);
+        if (state != CONNECTION_SUCCESS_STATE
+            && state != CONNECTION_RESUMED_STATE)
+        {
+            failedHandshakes++;
+        }
+    }
+
+    size_t lineEnd;
+    while ((lineEnd = connection.input.find(MSG_TERMINATOR))
+           != std::string::npos)
+    {
+        message_t line = connection.input.substr(MSG_BEGIN_INDEX, lineEnd);
+        connection.input.erase(MSG_BEGIN_INDEX, lineEnd + 1);
+        if (connection.redirected)
+        {
+            // The line is the node which owns the name.
+            connection.redirected = false;
+            continue;
+        }
+        if (!line.empty() && line.front() - TAG_CHAR_BASE == TIMESTAMP)
+        {
+            std::istringstream fields(line.substr(1));
+            fields >> connection.received >> connection.dispatched;
+            connection.stamped = (bool) fields;
+            continue;
+        }
+        if (answeredFrame(line) && !connection.requests.empty())
+        {
+            microseconds_t latency = time - connection.requests.front();
+            requestLatencies.push_back(latency);
+            connection.requests.pop_front();
+            if (connection.stamped)
+            {
+                microseconds_t residence = connection.dispatched
+                                           - connection.received;
+                residenceLatencies.push_back(residence);
+                wireLatencies.push_back(latency - std::min(latency,
+                                                           residence));
+            }
+        }
+        connection.stamped = false;
+    }
+}
+
+/**
+ * @brief Handles the events of a connection.
+ * @param index The index of the connection.
+ * @param events The ready events.
+ */
+static void handleConnection(const size_t index, const uint32_t events)
+{
+    ReplayConnection &connection = connections[index];
+    if (connection.socket == NO_SOCKET)
+    {
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+    {
+        char chunk[READ_CHUNK];
+        ssize_t count;
+        while ((count = read(connection.socket, chunk, READ_CHUNK)) > 0)
+        {
+            connection.input.append(chunk, (size_t) count);
+        }
+        handleLines(connection, now());
+        if (count == 0 || (count < 0 && !wouldBlock()))
+        {
+            closeConnection(index);
+            return;
+        }
+    }
+    if ((events & EPOLLOUT) && !connection.output.empty()
+        && writeOutput(index))
+    {
+        return;
+    }
+    finishOutput(index);
+    watchConnection(index);
+}
+
+/**
+ * @brief Gets the number of requests which wait for their responses.
+ * @return The number of requests.
+ */
+static size_t pendingRequests()
+{
+    size_t pending = 0;
+    for (const ReplayConnection &connection : connections)
+    {
+        pending += connection.socket == NO_SOCKET ? 0
+                                                  : connection.requests.size();
+    }
+    return pending;
+}
+
+
+/*-----=  Report Functions  =-----*/
+
+
+/**
+ * @brief Gets a percentile of the given latencies.
+ * @param latencies The latencies, which are sorted.
+ * @param level The percentile.
+ * @return The latency of the percentile, 0 if there are no latencies.
+ */
+static microseconds_t percentile(const std::vector<microseconds_t> &latencies,
+                                 const size_t level)
+{
+    if (latencies.empty())
+    {
+        return 0;
+    }
+    size_t rank = (latencies.size() * level + FULL_PERCENTILE - 1)
+                  / FULL_PERCENTILE;
+    return latencies[std::max(rank, (size_t) 1) - 1];
+}
+
+/**
+ * @brief Prints the latencies of a kind of operation.
+ * @param title The kind of operation.
+ * @param latencies The latencies.
+ */
+static void printLatencies(const char *title,
+                           std::vector<microseconds_t> &latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << title << ": " << latencies.size() << " (p50 "
+              << percentile(latencies, MEDIAN_PERCENTILE) << "us, p99 "
+              << percentile(latencies, TAIL_PERCENTILE) << "us, max "
+              << percentile(latencies, FULL_PERCENTILE) << "us)."
+              << std::endl;
+}
+
+/**
+ * @brief Prints the report of the replay.
+ * @param duration The duration of the replay in microseconds.
+ */
+static void printReport(const microseconds_t duration)
+{
+    double seconds = duration / MICROSECONDS_PER_SECOND;
+    std::cout << "Replayed " << sentFrames << " frames of "
+              << connections.size() << " connections in " << seconds
+              << "s (" << (seconds > 0 ? sentFrames / seconds : 0)
+              << " frames/s)." << std::endl;
+    printLatencies("Handshakes", handshakeLatencies);
+    printLatencies("Responses", requestLatencies);
+    printLatencies("Server residence", residenceLatencies);
+    printLatencies("Wire", wireLatencies);
+    std::cout << "Failed connections: " << failedConnections
+              << ", refused handshakes: " << failedHandshakes
+              << ", unanswered requests: " << pendingRequests() << "."
+              << std::endl;
+}
+
+
+/*-----=  Main  =-----*/
+
+
+/**
+ * @brief The main function that runs the replay. Every record is replayed at
+ *        its time in the capture divided by the speed factor, relative to the
+ *        first record, and the replay ends once all the records were replayed
+ *        and all the requests were answered (or DRAIN_TIMEOUT passed).
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return 0 upon success, -1 otherwise.
+ */
+int main(int argc, char *argv[])
+{
+    double speed = DEFAULT_SPEED_FACTOR;
+    if ((argc != VALID_ARGUMENTS_COUNT && argc != SPEED_ARGUMENTS_COUNT)
+        || validatePortNumber(argv[PORT_ARGUMENT_INDEX])
+        || (argc == SPEED_ARGUMENTS_COUNT
+            && (strcmp(argv[SPEED_OPTION_INDEX], SPEED_OPTION)
+                != EQUAL_COMPARISON
+                || parseSpeed(argv[SPEED_ARGUMENT_INDEX], speed))))
+    {
+        std::cout << USAGE_MSG;
+        return FAILURE_STATE;
+    }
+    if (loadCapture(argv[CAPTURE_ARGUMENT_INDEX]))
+    {
+        std::cout << CAPTURE_OPEN_FAIL_MSG << std::endl;
+        return FAILURE_STATE;
+    }
+    if (resolveServer(argv[SERVER_ARGUMENT_INDEX], argv[PORT_ARGUMENT_INDEX]))
+    {
+        return FAILURE_STATE;
+    }
+
+    // A connection is a descriptor, so allow as many as the system allows.
+    rlimit limit;
+    if (!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFD < SOCKET_ID_BOUND)
+    {
+        systemCallError(EPOLL_CREATE_NAME, errno);
+        return FAILURE_STATE;
+    }
+
+    microseconds_t start = now();
+    microseconds_t captureStart = records.empty() ? 0 : records.front().time;
+    microseconds_t drainDeadline = 0;
+    size_t next = 0;
+    epoll_event events[MAX_EPOLL_EVENTS];
+    while (true)
+    {
+        microseconds_t current = now();
+        for (; next < records.size(); ++next)
+        {
+            microseconds_t offset = records[next].time - captureStart;
+            if (speed != MAX_SPEED_FACTOR
+                && start + (microseconds_t) (offset / speed) > current)
+            {
+                break;
+            }
+            replayRecord(records[next]);
+        }
+
+        int timeout;
+        if (next < records.size())
+        {
+            microseconds_t offset = records[next].time - captureStart;
+            microseconds_t due = start + (microseconds_t) (offset / speed);
+            timeout = (int) ((due - std::min(due, current)
+                              + MICROSECONDS_PER_MILLISECOND - 1)
+                             / MICROSECONDS_PER_MILLISECOND);
+        }
+        else
+        {
+            if (drainDeadline == 0)
+            {
+                drainDeadline = current + DRAIN_TIMEOUT
+                                          * MICROSECONDS_PER_MILLISECOND;
+            }
+            if (pendingRequests() == 0 || current >= drainDeadline)
+            {
+                break;
+            }
+            timeout = (int) ((drainDeadline - current)
+                             / MICROSECONDS_PER_MILLISECOND);
+        }
+
+        int readyCount = epoll_wait(epollFD, events, MAX_EPOLL_EVENTS, timeout);
+        if (readyCount < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            systemCallError(EPOLL_WAIT_NAME, errno);
+            return FAILURE_STATE;
+        }
+        for (int i = 0; i < readyCount; ++i)
+        {
+            handleConnection(events[i].data.u64, events[i].events);
+        }
+    }
+
+    printReport(now() - start);
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+        closeConnection(i);
+    }
+    close(epollFD);
+    return SUCCESS_STATE;
+}
@@ -16,7 +16,29 @@
 #include <cassert>
 #include <algorithm>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <fstream>
+#include <chrono>
+#include <iomanip>
+#include <csignal>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/random.h>
+#include <sys/time.h>
 #include "WhatsApp.h"
+#include "TimingWheel.h"
+#include "HashRing.h"
+#include "DedupWindow.h"
+#include "Tracer.h"
+#include "SharedChannel.h"
+#include "Coroutine.h"
+#include "MemberSet.h"
+#include "Capture.h"
+#include "TopicTrie.h"
 
 
 /*-----=  Definitions  =-----*/
@@ -24,10 +46,16 @@
 
 /**
  * @def VALID_ARGUMENTS_COUNT 2
- * @brief A Macro that sets the number for valid arguments count.
+ * @brief A Macro that sets the minimal number for valid arguments count.
  */
 #define VALID_ARGUMENTS_COUNT 2
 
+/**
+ * @def OPTION_ARGUMENTS_COUNT 2
+ * @brief A Macro that sets the number of arguments of a single server option.
+ */
+#define OPTION_ARGUMENTS_COUNT 2
+
 /**
  * @def PORT_ARGUMENT_INDEX 1
  * @brief A Macro that sets the index of the port argument to this program.
@@ -35,874 +63,7146 @@
 #define PORT_ARGUMENT_INDEX 1
 
 /**
- * @def USAGE_MSG "Usage: whatsappServer portNum"
+ * @def USAGE_MSG "Usage: whatsappServer portNum [options]"
  * @brief A Macro that sets the error message when the usage is invalid.
  */
-#define USAGE_MSG "Usage: whatsappServer portNum"
+#define USAGE_MSG "Usage: whatsappServer portNum [--bind host]... " \
+                  "[--unix path]... [--message-rate n] [--byte-rate n] " \
+                  "[--message-budget n] [--heartbeat-interval seconds] " \
+                  "[--idle-timeout seconds] [--handshake-timeout seconds] " \
+                  "[--drain-timeout seconds] [--resume-grace seconds] " \
+                  "[--trace-sample n] [--capture file] " \
+                  "[--signal-port port] [--replicate host:port] " \
+                  "[--replica-listen host:port] " \
+                  "[--admin name]... [--secret-file path] " \
+                  "[--node host:port [--peer host:port]...]"
 
 /**
- * @def SERVER_EXIT_COMMAND "EXIT"
- * @brief A Macro that sets the exit command when exiting the server.
+ * @def SERVER_RESTART_COMMAND "RESTART"
+ * @brief A Macro that sets the command which hot restarts the server.
  */
-#define SERVER_EXIT_COMMAND "EXIT"
+#define SERVER_RESTART_COMMAND "RESTART"
 
 /**
- * @def SERVER_EXIT_MSG "EXIT command is typed: server is shutting down"
- * @brief A Macro that sets the exit message when exiting the server.
+ * @def SERVER_RESTART_MSG "RESTART command is typed: server is restarting"
+ * @brief A Macro that sets the message when the server hands over to a new one.
  */
-#define SERVER_EXIT_MSG "EXIT command is typed: server is shutting down"
+#define SERVER_RESTART_MSG "RESTART command is typed: server is restarting"
 
 /**
- * @def CONNECT_SUCCESS_MSG_SUFFIX " connected."
- * @brief A Macro that sets the message suffix on connection success.
+ * @def RESTART_FAIL_MSG "ERROR: failed to restart the server."
+ * @brief A Macro that sets the message when the hot restart fails.
  */
-#define CONNECT_SUCCESS_MSG_SUFFIX " connected."
+#define RESTART_FAIL_MSG "ERROR: failed to restart the server."
 
 /**
- * @def CONNECT_FAIL_MSG_SUFFIX " failed to connect."
- * @brief A Macro that sets the message suffix on connection failure.
+ * @def INHERIT_OPTION "--inherit"
+ * @brief A Macro that sets the internal option of a restarted server, which
+ *        gives the Unix socket to receive the state of the old server from.
  */
-#define CONNECT_FAIL_MSG_SUFFIX " failed to connect."
+#define INHERIT_OPTION "--inherit"
 
 /**
- * @def MAX_PENDING_CONNECTIONS 10
- * @brief A Macro that sets the maximal number of pending connections.
+ * @def NO_INHERITED_STATE ULONG_MAX
+ * @brief A Macro that sets the inherit socket value of a fresh server.
  */
-#define MAX_PENDING_CONNECTIONS 10
+#define NO_INHERITED_STATE ULONG_MAX
 
 /**
- * @def MIN_GROUP_SIZE 2
- * @brief A Macro that sets the minimal group size.
+ * @def SELF_EXECUTABLE "/proc/self/exe"
+ * @brief A Macro that sets the path of the binary of the running server,
+ *        which does not depend on the PATH or on the working directory.
  */
-#define MIN_GROUP_SIZE 2
+#define SELF_EXECUTABLE "/proc/self/exe"
 
+/**
+ * @def RESTART_TIMEOUT 10000
+ * @brief A Macro that sets the milliseconds the new server has to take over.
+ */
+#define RESTART_TIMEOUT 10000
 
-/*-----=  Type Definitions  =-----*/
+/**
+ * @def RESTART_ACK 'R'
+ * @brief A Macro that sets the byte the new server sends once it took over.
+ */
+#define RESTART_ACK 'R'
 
+/**
+ * @def FIELD_LENGTH_DELIM ':'
+ * @brief A Macro that sets the delimiter after the length of a state field.
+ */
+#define FIELD_LENGTH_DELIM ':'
 
 /**
- * @brief Type Definition for a vector of client sockets.
+ * @def FIELD_END ','
+ * @brief A Macro that sets the character which ends a state field.
  */
-typedef std::vector<int> clientsVector;
+#define FIELD_END ','
 
 /**
- * @brief Type Definition for a vector of groups.
+ * @def FORK_NAME "fork"
+ * @brief A Macro that sets function name for fork.
  */
-typedef std::vector<groupName_t> groupVector;
+#define FORK_NAME "fork"
 
 /**
- * @brief Type Definition for a map from socket to client name.
+ * @def EXECV_NAME "execv"
+ * @brief A Macro that sets function name for execv.
  */
-typedef std::map<int, clientName_t> socketToNameMap;
+#define EXECV_NAME "execv"
 
 /**
- * @brief Type Definition for a map from group to a clients vector.
+ * @def SOCKETPAIR_NAME "socketpair"
+ * @brief A Macro that sets function name for socketpair.
  */
-typedef std::map<groupName_t, clientsVector> groupToClient;
+#define SOCKETPAIR_NAME "socketpair"
 
+/**
+ * @def GETRANDOM_NAME "getrandom"
+ * @brief A Macro that sets function name for getrandom.
+ */
+#define GETRANDOM_NAME "getrandom"
 
-/*-----=  Server Data  =-----*/
+/**
+ * @def DRAIN_TIMEOUT_OPTION "--drain-timeout"
+ * @brief A Macro that sets the option of the time to drain on shutdown.
+ */
+#define DRAIN_TIMEOUT_OPTION "--drain-timeout"
 
+/**
+ * @def DEFAULT_DRAIN_TIMEOUT 5
+ * @brief A Macro that sets the default seconds to drain the clients on exit.
+ */
+#define DEFAULT_DRAIN_TIMEOUT 5
 
 /**
- * @brief The vector of the connected clients.
+ * @def RESUME_GRACE_OPTION "--resume-grace"
+ * @brief A Macro that sets the option of the time a lost session is kept.
  */
-clientsVector clients = clientsVector();
+#define RESUME_GRACE_OPTION "--resume-grace"
 
 /**
- * @brief The vector of the open groups.
+ * @def DEFAULT_RESUME_GRACE 30
+ * @brief A Macro that sets the default seconds a lost session may be resumed.
  */
-groupVector groups = groupVector();
+#define DEFAULT_RESUME_GRACE 30
 
 /**
- * @brief The map from the connected client sockets into their names.
+ * @def RESUME_TIMER_KEY INT_MIN
+ * @brief A Macro that sets the timer key of the expiry of lost sessions.
  */
-socketToNameMap socketsToNames = socketToNameMap();
+#define RESUME_TIMER_KEY INT_MIN
 
 /**
- * @brief The map from the open groups to the vector of their clients.
+ * @def TOKEN_BYTES 16
+ * @brief A Macro that sets the number of random bytes of a token.
  */
-groupToClient groupsToClients = groupToClient();
+#define TOKEN_BYTES 16
 
 /**
- * @brief The FD Set for the server to read from.
+ * @def TOKEN_BYTE_DIGITS 2
+ * @brief A Macro that sets the number of hex digits of a byte of a token.
  */
-fd_set readFDs;
+#define TOKEN_BYTE_DIGITS 2
 
+/**
+ * @def RESUME_SWEEP_INTERVAL 1000
+ * @brief A Macro that sets the milliseconds between expiries of lost sessions.
+ */
+#define RESUME_SWEEP_INTERVAL 1000
 
-/*-----=  General Functions  =-----*/
+/**
+ * @def MAX_REPLAY_MESSAGES 1000
+ * @brief A Macro that sets the maximal number of messages kept for a lost
+ *        session, beyond which the oldest messages are dropped.
+ */
+#define MAX_REPLAY_MESSAGES 1000
 
+/**
+ * @def DETACHED_MSG_SUFFIX " lost its connection."
+ * @brief A Macro that sets the message when a client loses its connection.
+ */
+#define DETACHED_MSG_SUFFIX " lost its connection."
 
 /**
- * @brief Gets the max socket ID currently in the server.
- * @param welcomeSocketID The welcome socket ID.
- * @return the max socket ID.
+ * @def RESUMED_MSG_SUFFIX " resumed its session."
+ * @brief A Macro that sets the message when a client resumes its session.
  */
-static int getMaxSocketID(int const welcomeSocketID)
-{
-    int maxID = welcomeSocketID;
-    for (auto i = clients.begin(); i != clients.end(); ++i)
-    {
-        maxID = std::max(maxID, *i);
-    }
-    return maxID;
-}
+#define RESUMED_MSG_SUFFIX " resumed its session."
 
 /**
- * @brief Determines if the given client name is available to use in the server.
- * @param clientName The client name to check.
- * @return true if available, false otherwise.
+ * @def EXPIRED_MSG_SUFFIX " session expired."
+ * @brief A Macro that sets the message when a lost session expires.
  */
-static bool checkAvailableName(const clientName_t clientName)
-{
-    // Check in clients names.
-    for (auto i = clients.begin(); i != clients.end(); ++i)
-    {
-        clientName_t currentName = socketsToNames[*i];
-        if ((currentName).compare(clientName) == EQUAL_COMPARISON)
-        {
-            return false;
-        }
-    }
+#define EXPIRED_MSG_SUFFIX " session expired."
 
-    // Check in groups names.
-    for (auto i = groups.begin(); i != groups.end(); ++i)
-    {
-        if ((*i).compare(clientName) == EQUAL_COMPARISON)
-        {
-            return false;
-        }
-    }
+/**
+ * @def DEDUP_WINDOW_TIMEOUT 60
+ * @brief A Macro that sets the seconds a message ID of a sender is kept, in
+ *        which a retried send with the same ID is not sent again.
+ */
+#define DEDUP_WINDOW_TIMEOUT 60
 
-    return true;
-}
+/**
+ * @def DUPLICATE_MSG_SUFFIX ": a retried message was acknowledged."
+ * @brief A Macro that sets the message when a retried send is not sent again.
+ */
+#define DUPLICATE_MSG_SUFFIX ": a retried message was acknowledged."
 
+/**
+ * @def SERVER_TRACE_COMMAND "TRACE"
+ * @brief A Macro that sets the command which writes the recorded trace, which
+ *        may be followed by the path of the trace file.
+ */
+#define SERVER_TRACE_COMMAND "TRACE"
 
-/*-----=  Client Management Functions  =-----*/
+/**
+ * @def DEFAULT_TRACE_FILE "whatsappServer.trace.json"
+ * @brief A Macro that sets the trace file when the command has no path.
+ */
+#define DEFAULT_TRACE_FILE "whatsappServer.trace.json"
 
+/**
+ * @def TRACE_WRITTEN_MSG "Trace written to "
+ * @brief A Macro that sets the message when the trace was written.
+ */
+#define TRACE_WRITTEN_MSG "Trace written to "
 
 /**
- * @brief Removes the given client from all of it's groups.
- * @param clientSocket The client to remove.
+ * @def TRACE_FAIL_MSG "ERROR: failed to write the trace."
+ * @brief A Macro that sets the error message when the trace was not written.
  */
-static void removeClientFromGroups(const int clientSocket)
-{
-    for (auto i = groups.begin(); i != groups.end(); ++i)
-    {
-        auto j = std::find(groupsToClients[*i].begin(),
-                           groupsToClients[*i].end(),
-                           clientSocket);
-        if (j != groupsToClients[*i].end())
-        {
-            groupsToClients[*i].erase(j);
-        }
-    }
-}
+#define TRACE_FAIL_MSG "ERROR: failed to write the trace."
 
 /**
- * @brief Creates a new Client in the server with the given data.
- * @param name The client name.
- * @param socket The socket of the new client.
+ * @def TRACE_SAMPLE_OPTION "--trace-sample"
+ * @brief A Macro that sets the option of the rounds per traced round.
  */
-static void createNewClient(const clientName_t name, const int socket)
-{
-    clients.push_back(socket);
-    FD_SET(socket, &readFDs);
-    socketsToNames[socket] = name;
-}
+#define TRACE_SAMPLE_OPTION "--trace-sample"
 
 /**
- * @brief Removes a client from the server.
- * @param clientSocket The client to remove.
+ * @def CAPTURE_OPTION "--capture"
+ * @brief A Macro that sets the option of the file which captures the inbound
+ *        frames of the clients.
  */
-static void removeClient(const int clientSocket)
-{
-    removeClientFromGroups(clientSocket);
-    clients.erase(std::remove(clients.begin(), clients.end(), clientSocket));
-    FD_CLR(clientSocket, &readFDs);
-    socketsToNames.erase(clientSocket);
-}
+#define CAPTURE_OPTION "--capture"
 
 /**
- * @brief Gets the client socket by the given client name.
- * @param clientName The client name to receive it's socket.
- * @return The socket ID of the given client name.
+ * @def CAPTURE_FAIL_MSG "ERROR: failed to open the capture."
+ * @brief A Macro that sets the error message when the capture was not opened.
  */
-static int getClientSocket(clientName_t const clientName)
-{
-    int clientSocket = FAILURE_STATE;
-    for (auto i = clients.begin(); i != clients.end(); ++i)
-    {
-        if (socketsToNames[*i].compare(clientName) == EQUAL_COMPARISON)
-        {
-            clientSocket = *i;
-        }
-    }
-    return clientSocket;
-}
+#define CAPTURE_FAIL_MSG "ERROR: failed to open the capture."
 
 /**
- * @brief Determine if a given client name is online.
- * @param clientName The client to check.
- * @return true if the client is connected to the server, false otherwise.
+ * @def DEFAULT_TRACE_SAMPLE 100
+ * @brief A Macro that sets the default rounds per traced round (0 disables).
  */
-static bool clientOnline(clientName_t const clientName)
-{
-    return getClientSocket(clientName) > FAILURE_STATE;
-}
+#define DEFAULT_TRACE_SAMPLE 100
 
+/**
+ * @def SIGNAL_PORT_OPTION "--signal-port"
+ * @brief A Macro that sets the option of the port of the UDP side channel.
+ */
+#define SIGNAL_PORT_OPTION "--signal-port"
 
-/*-----=  Group Management Functions  =-----*/
+/**
+ * @def NO_SIGNAL_PORT 0
+ * @brief A Macro that sets the signal port of a server without a UDP side
+ *        channel.
+ */
+#define NO_SIGNAL_PORT 0
 
+/**
+ * @def NO_SIGNAL_SOCKET -1
+ * @brief A Macro that sets the socket of a signal endpoint whose address is
+ *        not known yet.
+ */
+#define NO_SIGNAL_SOCKET -1
 
 /**
- * @brief Creates a new group in the server.
- * @param groupName The name of the new group.
+ * @def MAX_SIGNALS_PER_ROUND 64
+ * @brief A Macro that sets the maximal datagrams read from a signal socket in
+ *        a single round, so a flood of signals does not starve the clients.
  */
-static void createNewGroup(groupName_t const groupName)
-{
-    groups.push_back(groupName);
-    groupsToClients[groupName] = clientsVector();
-}
+#define MAX_SIGNALS_PER_ROUND 64
 
 /**
- * @brief Remove a group from the server.
- * @param groupName The group to remove.
+ * @def SIGNAL_RATE 20
+ * @brief A Macro that sets the signals per second a single client may send,
+ *        since a presence signal is forwarded to all the groups of its sender.
  */
-static void removeGroup(groupName_t const groupName)
-{
-    groups.erase(std::remove(groups.begin(), groups.end(), groupName));
-    groupsToClients.erase(groupName);
-}
+#define SIGNAL_RATE 20
 
 /**
- * @brief Check if a group contains a client.
- * @param groupName The group name.
- * @param client The client to check.
- * @return true if the client is in the given group, false otherwise.
+ * @def ROUND_SPAN "round"
+ * @brief A Macro that sets the span of a whole round of the server loop.
  */
-static bool groupContainsClient(groupName_t const groupName, int client)
-{
-    clientsVector groupClients = groupsToClients[groupName];
-    auto i = std::find(groupClients.begin(), groupClients.end(), client);
-    return i != groupClients.end();
-}
+#define ROUND_SPAN "round"
 
 /**
- * @brief Adds a given client to the given group.
- * @param clientName The client name to add.
- * @param groupName The group name to add into.
- * @return 0 upon success, -1 otherwise.
+ * @def READ_SPAN "read"
+ * @brief A Macro that sets the span of a read from a connection.
  */
-static int addSingleClientToGroup(clientName_t const clientName,
-                                  groupName_t const groupName)
-{
-    int clientSocket = getClientSocket(clientName);
+#define READ_SPAN "read"
 
-    if (!groupContainsClient(groupName, clientSocket))
-    {
-        groupsToClients[groupName].push_back(clientSocket);
-        return SUCCESS_STATE;
-    }
-    return FAILURE_STATE;
-}
+/**
+ * @def PARSE_SPAN "parse"
+ * @brief A Macro that sets the span of the split of a message from its input.
+ */
+#define PARSE_SPAN "parse"
 
 /**
- * @brief Check if a given group name is an open group.
- * @param groupName The group name to check.
- * @return true if the group is open in the server, false otherwise.
+ * @def HANDSHAKE_SPAN "handshake"
+ * @brief A Macro that sets the span of the handshake of a new connection.
  */
-static bool groupOpen(groupName_t const groupName)
-{
-    auto i = std::find(groups.begin(), groups.end(), groupName);
-    return i != groups.end();
-}
+#define HANDSHAKE_SPAN "handshake"
 
 /**
- * @brief Adds the given clients with the creator of the group to the group.
- * @param creator The creator of the group.
- * @param groupName The group name.
- * @param clientsNames The clients to add to the group.
- * @return 0 upon success, -1 otherwise.
+ * @def HEARTBEAT_SPAN "heartbeat"
+ * @brief A Macro that sets the span of a heartbeat of a client.
  */
-static int addClientsToGroup(clientName_t const creator,
-                             groupName_t const groupName,
-                             message_t clientsNames)
-{
-    int numberOfClients = 0;
-    // Add the creator in to the group.
-    if (addSingleClientToGroup(creator, groupName))
-    {
-        return FAILURE_STATE;
-    }
-    numberOfClients++;
+#define HEARTBEAT_SPAN "heartbeat"
 
-    std::stringstream clientsStream = std::stringstream(clientsNames);
-    clientName_t currentName;
-    while (getline(clientsStream, currentName, WHITE_SPACE_DELIM))
-    {
-        if (currentName.compare(EMPTY_MSG))
-        {
-            // Check that this client is online.
-            if (!clientOnline(currentName))
-            {
-                return FAILURE_STATE;
-            }
-            if (addSingleClientToGroup(currentName, groupName))
-            {
-                continue;
-            }
-            // If the client was added to the group.
-            numberOfClients++;
-        }
-    }
+/**
+ * @def PEER_SPAN "peer"
+ * @brief A Macro that sets the span of a frame of another node.
+ */
+#define PEER_SPAN "peer"
 
-    if (numberOfClients < MIN_GROUP_SIZE)
-    {
-        return FAILURE_STATE;
-    }
+/**
+ * @def TIMERS_SPAN "timers"
+ * @brief A Macro that sets the span of the expired timers.
+ */
+#define TIMERS_SPAN "timers"
 
-    return SUCCESS_STATE;
-}
+/**
+ * @def WRITE_SPAN "write"
+ * @brief A Macro that sets the span of a write of queued output.
+ */
+#define WRITE_SPAN "write"
 
+/**
+ * @def SIGNAL_SPAN "signal"
+ * @brief A Macro that sets the span of a datagram of the UDP side channel.
+ */
+#define SIGNAL_SPAN "signal"
 
-/*-----=  Server Initialization Functions  =-----*/
+/**
+ * @def NO_TRACE_SOCKET -1
+ * @brief A Macro that sets the socket of a span which handles no socket.
+ */
+#define NO_TRACE_SOCKET -1
 
+/**
+ * @def SERVER_METRICS_COMMAND "METRICS"
+ * @brief A Macro that sets the command which prints the connection metrics.
+ */
+#define SERVER_METRICS_COMMAND "METRICS"
 
 /**
- * @brief Reset the server data.
+ * @def METRICS_CONNECTIONS_MSG "Connections: "
+ * @brief A Macro that sets the prefix of the connection counts metrics.
  */
-static void resetServerData()
-{
-    clients = clientsVector();
-    groups = groupVector();
-    socketsToNames = socketToNameMap();
-    groupsToClients = groupToClient();
-    FD_ZERO(&readFDs);
-}
+#define METRICS_CONNECTIONS_MSG "Connections: "
 
 /**
- * @brief Checks whether the program received the desired number of arguments.
- *        In case of invalid arguments the function output an error
- *        message specifying the correct usage.
- * @param argc The number of arguments given to the program.
- * @param argv The array of given arguments.
- * @return 0 if the arguments are valid, -1 otherwise.
+ * @def METRICS_MEMORY_MSG "Connection memory: "
+ * @brief A Macro that sets the prefix of the connection memory metrics.
  */
-static int checkServerArguments(int const argc, char * const argv[])
-{
-    // Check valid number of arguments.
-    if (argc != VALID_ARGUMENTS_COUNT)
-    {
-        return FAILURE_STATE;
-    }
+#define METRICS_MEMORY_MSG "Connection memory: "
 
-    // Check valid port number.
-    if (validatePortNumber(argv[PORT_ARGUMENT_INDEX]))
-    {
-        return FAILURE_STATE;
-    }
+/**
+ * @def METRICS_REGISTRY_MSG "Registry: "
+ * @brief A Macro that sets the prefix of the registry sizes metrics.
+ */
+#define METRICS_REGISTRY_MSG "Registry: "
 
-    return SUCCESS_STATE;
-}
+/**
+ * @def IDLE_BUFFER_CAPACITY 256
+ * @brief A Macro that sets the capacity an empty buffer of a connection may
+ *        keep, beyond which its memory is released.
+ */
+#define IDLE_BUFFER_CAPACITY 256
 
 /**
- * @brief Establish connection of the server with the given port number.
- *        This function creates the welcome socket of the server.
- * @param portNumber The given port number of the server.
- * @return The socket ID of the welcome socket upon success, -1 on failure.
+ * @def LINGER_TIMEOUT 5
+ * @brief A Macro that sets the seconds a closed connection may take to receive
+ *        its last messages before its socket is closed anyway.
  */
-static int establish(const portNumber_t portNumber)
-{
-    // Hostent initialization.
-    char hostName[HOST_NAME_MAX + NULL_TERMINATOR_COUNT] = {'\0'};
-    if (gethostname(hostName, HOST_NAME_MAX))
-    {
-        systemCallError(GETHOSTNAME_NAME, errno);
-        return FAILURE_STATE;
-    }
-    hostent *pHostent = gethostbyname(hostName);
-    if (pHostent == nullptr)
+#define LINGER_TIMEOUT 5
+
+/**
+ * @def DRAIN_TIMER_KEY -1
+ * @brief A Macro that sets the timer key of the shutdown drain deadline.
+ */
+#define DRAIN_TIMER_KEY -1
+
+/**
+ * @def MAX_OUTPUT_BUFFER 4194304
+ * @brief A Macro that sets the maximal size of the queued output of a client.
+ *        A client which does not read its messages is disconnected beyond it.
+ */
+#define MAX_OUTPUT_BUFFER 4194304
+
+/**
+ * @def SLOW_CLIENT_MSG_SUFFIX " disconnected for not reading its messages."
+ * @brief A Macro that sets the message suffix when a slow client is dropped.
+ */
+#define SLOW_CLIENT_MSG_SUFFIX " disconnected for not reading its messages."
+
+/**
+ * @def BIND_OPTION "--bind"
+ * @brief A Macro that sets the option of a host to bind a TCP listener to.
+ */
+#define BIND_OPTION "--bind"
+
+/**
+ * @def ADMIN_OPTION "--admin"
+ * @brief A Macro that sets the option of the name of a client which may
+ *        broadcast to all the clients, when it connects over a Unix socket
+ *        from a process of the user of the server.
+ */
+#define ADMIN_OPTION "--admin"
+
+/**
+ * @def UNIX_OPTION "--unix"
+ * @brief A Macro that sets the option of a Unix domain socket listener path.
+ */
+#define UNIX_OPTION "--unix"
+
+/**
+ * @def MESSAGE_RATE_OPTION "--message-rate"
+ * @brief A Macro that sets the option of the messages per second per client.
+ */
+#define MESSAGE_RATE_OPTION "--message-rate"
+
+/**
+ * @def BYTE_RATE_OPTION "--byte-rate"
+ * @brief A Macro that sets the option of the bytes per second per client.
+ */
+#define BYTE_RATE_OPTION "--byte-rate"
+
+/**
+ * @def MESSAGE_BUDGET_OPTION "--message-budget"
+ * @brief A Macro that sets the option of the messages per iteration budget.
+ */
+#define MESSAGE_BUDGET_OPTION "--message-budget"
+
+/**
+ * @def HEARTBEAT_INTERVAL_OPTION "--heartbeat-interval"
+ * @brief A Macro that sets the option of the idle time before a heartbeat.
+ */
+#define HEARTBEAT_INTERVAL_OPTION "--heartbeat-interval"
+
+/**
+ * @def IDLE_TIMEOUT_OPTION "--idle-timeout"
+ * @brief A Macro that sets the option of the idle time before eviction.
+ */
+#define IDLE_TIMEOUT_OPTION "--idle-timeout"
+
+/**
+ * @def HANDSHAKE_TIMEOUT_OPTION "--handshake-timeout"
+ * @brief A Macro that sets the option of the time to send the client name.
+ */
+#define HANDSHAKE_TIMEOUT_OPTION "--handshake-timeout"
+
+/**
+ * @def DISABLED_TIMEOUT 0
+ * @brief A Macro that sets the timeout value which disables a timeout.
+ */
+#define DISABLED_TIMEOUT 0
+
+/**
+ * @def DEFAULT_HEARTBEAT_INTERVAL 30
+ * @brief A Macro that sets the default seconds of idle time before heartbeat.
+ */
+#define DEFAULT_HEARTBEAT_INTERVAL 30
+
+/**
+ * @def DEFAULT_IDLE_TIMEOUT 90
+ * @brief A Macro that sets the default seconds of idle time before eviction.
+ */
+#define DEFAULT_IDLE_TIMEOUT 90
+
+/**
+ * @def DEFAULT_HANDSHAKE_TIMEOUT 10
+ * @brief A Macro that sets the default seconds to complete a handshake.
+ */
+#define DEFAULT_HANDSHAKE_TIMEOUT 10
+
+/**
+ * @def WHEEL_SLOTS 1024
+ * @brief A Macro that sets the number of slots in the timing wheel.
+ */
+#define WHEEL_SLOTS 1024
+
+/**
+ * @def WHEEL_TICK 100
+ * @brief A Macro that sets the length of a timing wheel tick in milliseconds.
+ */
+#define WHEEL_TICK 100
+
+/**
+ * @def MILLISECONDS_PER_SECOND 1000
+ * @brief A Macro that sets the number of milliseconds in a second.
+ */
+#define MILLISECONDS_PER_SECOND 1000
+
+/**
+ * @def IDLE_EVICT_MSG_SUFFIX " disconnected due to inactivity."
+ * @brief A Macro that sets the message suffix when an idle client is evicted.
+ */
+#define IDLE_EVICT_MSG_SUFFIX " disconnected due to inactivity."
+
+/**
+ * @def UNLIMITED_RATE 0
+ * @brief A Macro that sets the rate value which disables a token bucket.
+ */
+#define UNLIMITED_RATE 0
+
+/**
+ * @def DEFAULT_MESSAGE_BUDGET 16
+ * @brief A Macro that sets the default number of messages processed for a
+ *        single client in a single iteration of the server loop.
+ */
+#define DEFAULT_MESSAGE_BUDGET 16
+
+/**
+ * @def CLIENT_READ_CHUNK 4096
+ * @brief A Macro that sets the maximal bytes read from a client at once.
+ */
+#define CLIENT_READ_CHUNK 4096
+
+/**
+ * @def MAX_INPUT_BUFFER 65536
+ * @brief A Macro that sets the maximal size of a partial client message.
+ */
+#define MAX_INPUT_BUFFER 65536
+
+/**
+ * @def MICROSECONDS_PER_SECOND 1000000
+ * @brief A Macro that sets the number of microseconds in a second.
+ */
+#define MICROSECONDS_PER_SECOND 1000000
+
+/**
+ * @def SERVER_EXIT_COMMAND "EXIT"
+ * @brief A Macro that sets the exit command when exiting the server.
+ */
+#define SERVER_EXIT_COMMAND "EXIT"
+
+/**
+ * @def SERVER_EXIT_MSG "EXIT command is typed: server is shutting down"
+ * @brief A Macro that sets the exit message when exiting the server.
+ */
+#define SERVER_EXIT_MSG "EXIT command is typed: server is shutting down"
+
+/**
+ * @def CONNECT_SUCCESS_MSG_SUFFIX " connected."
+ * @brief A Macro that sets the message suffix on connection success.
+ */
+#define CONNECT_SUCCESS_MSG_SUFFIX " connected."
+
+/**
+ * @def CONNECT_FAIL_MSG_SUFFIX " failed to connect."
+ * @brief A Macro that sets the message suffix on connection failure.
+ */
+#define CONNECT_FAIL_MSG_SUFFIX " failed to connect."
+
+/**
+ * @def MAX_PENDING_CONNECTIONS SOMAXCONN
+ * @brief A Macro that sets the maximal number of pending connections, as many
+ *        as the system allows so a burst of connections is not dropped.
+ */
+#define MAX_PENDING_CONNECTIONS SOMAXCONN
+
+/**
+ * @def MIN_GROUP_SIZE 2
+ * @brief A Macro that sets the minimal group size.
+ */
+#define MIN_GROUP_SIZE 2
+
+/**
+ * @def NODE_OPTION "--node"
+ * @brief A Macro that sets the option of the address of this server node,
+ *        which is also its ID in the hash ring of the federation.
+ */
+#define NODE_OPTION "--node"
+
+/**
+ * @def PEER_OPTION "--peer"
+ * @brief A Macro that sets the option of the address of another server node.
+ */
+#define PEER_OPTION "--peer"
+
+/**
+ * @def LOCAL_NODE 0
+ * @brief A Macro that sets the index of this server in the federation nodes.
+ */
+#define LOCAL_NODE 0
+
+/**
+ * @def NO_PEER_SOCKET -1
+ * @brief A Macro that sets the socket value of a peer link which is down.
+ */
+#define NO_PEER_SOCKET -1
+
+/**
+ * @def PEER_TIMER_KEY_BASE -1
+ * @brief A Macro that sets the base of the reconnect timer keys of the peers.
+ *        The timer key of the peer in index i is PEER_TIMER_KEY_BASE - i.
+ */
+#define PEER_TIMER_KEY_BASE -1
+
+/**
+ * @def PEER_RETRY_DELAY 1000
+ * @brief A Macro that sets the milliseconds before reconnecting a peer link.
+ */
+#define PEER_RETRY_DELAY 1000
+
+/**
+ * @def PEER_HANDSHAKE "#peer"
+ * @brief A Macro that sets the first line a server node sends on a peer link
+ *        instead of a client name (which can never start with '#').
+ */
+#define PEER_HANDSHAKE "#peer"
+
+/**
+ * @def PEER_PRESENCE_ADD "P+"
+ * @brief A Macro that sets the peer frame of clients connected to a node.
+ */
+#define PEER_PRESENCE_ADD "P+"
+
+/**
+ * @def PEER_PRESENCE_REMOVE "P-"
+ * @brief A Macro that sets the peer frame of a client that left a node.
+ */
+#define PEER_PRESENCE_REMOVE "P-"
+
+/**
+ * @def PEER_GROUP "G"
+ * @brief A Macro that sets the peer frame of a group and its members.
+ */
+#define PEER_GROUP "G"
+
+/**
+ * @def PEER_SEND "S"
+ * @brief A Macro that sets the peer frame of a message to a single client.
+ */
+#define PEER_SEND "S"
+
+/**
+ * @def PEER_GROUP_SEND "M"
+ * @brief A Macro that sets the peer frame of a message to the group members
+ *        of the receiving node.
+ */
+#define PEER_GROUP_SEND "M"
+
+/**
+ * @def PEER_GROUP_LEAVE "G-"
+ * @brief A Macro that sets the peer frame which removes members from a group.
+ */
+#define PEER_GROUP_LEAVE "G-"
+
+/**
+ * @def PEER_PUBLISH "T"
+ * @brief A Macro that sets the peer frame of a message to the subscribers of
+ *        a topic on the receiving node.
+ */
+#define PEER_PUBLISH "T"
+
+/**
+ * @def PEER_BROADCAST "B"
+ * @brief A Macro that sets the peer frame of a message to all the clients of
+ *        the receiving node.
+ */
+#define PEER_BROADCAST "B"
+
+/**
+ * @def REDIRECT_MSG_INFIX " redirected to "
+ * @brief A Macro that sets the message infix when a client is redirected.
+ */
+#define REDIRECT_MSG_INFIX " redirected to "
+
+/**
+ * @def NODE_LINKED_MSG_SUFFIX " linked."
+ * @brief A Macro that sets the message suffix when a peer node links in.
+ */
+#define NODE_LINKED_MSG_SUFFIX " linked."
+
+/**
+ * @def NODE_UNLINKED_MSG_SUFFIX " unlinked."
+ * @brief A Macro that sets the message suffix when a peer node link is lost.
+ */
+#define NODE_UNLINKED_MSG_SUFFIX " unlinked."
+
+/**
+ * @def NODE_MSG_PREFIX "Node "
+ * @brief A Macro that sets the message prefix of the peer node messages.
+ */
+#define NODE_MSG_PREFIX "Node "
+
+/**
+ * @def DESCRIPTOR_LIMIT_MSG "ERROR: too many connections, closed a new one."
+ * @brief A Macro that sets the error message when a new connection is closed
+ *        since select can not watch its descriptor.
+ */
+#define DESCRIPTOR_LIMIT_MSG "ERROR: too many connections, closed a new one."
+
+/**
+ * @def NODE_REFUSED_MSG_SUFFIX " refused."
+ * @brief A Macro that sets the message suffix when a link which did not prove
+ *        it belongs to a peer node is refused.
+ */
+#define NODE_REFUSED_MSG_SUFFIX " refused."
+
+/**
+ * @def SECRET_FILE_OPTION "--secret-file"
+ * @brief A Macro that sets the option of the file whose first line is the
+ *        secret shared by the servers which link to each other.
+ */
+#define SECRET_FILE_OPTION "--secret-file"
+
+/**
+ * @def REPLICATE_OPTION "--replicate"
+ * @brief A Macro that sets the option of the address of the primary server,
+ *        which makes this server its standby replica.
+ */
+#define REPLICATE_OPTION "--replicate"
+
+/**
+ * @def NO_REPLICATION_LINK -1
+ * @brief A Macro that sets the socket value of a replication link which is
+ *        not open.
+ */
+#define NO_REPLICATION_LINK -1
+
+/**
+ * @def REPLICA_LISTEN_OPTION "--replica-listen"
+ * @brief A Macro that sets the option of the address which this server accepts
+ *        the links of its replicas on, apart from the clients.
+ */
+#define REPLICA_LISTEN_OPTION "--replica-listen"
+
+/**
+ * @def REPLICA_HANDSHAKE "#replica"
+ * @brief A Macro that sets the first line a replica sends to its primary
+ *        instead of a client name (which can never start with '#'), followed
+ *        by the shared secret.
+ */
+#define REPLICA_HANDSHAKE "#replica"
+
+/**
+ * @def REPLICA_REFUSED_MSG "Replica refused."
+ * @brief A Macro that sets the message when a connection to the address of
+ *        the replicas did not prove it is a replica.
+ */
+#define REPLICA_REFUSED_MSG "Replica refused."
+
+/**
+ * @def REPLICA_SESSION_ADD "S+"
+ * @brief A Macro that sets the replication frame of a session and its token.
+ */
+#define REPLICA_SESSION_ADD "S+"
+
+/**
+ * @def REPLICA_SESSION_REMOVE "S-"
+ * @brief A Macro that sets the replication frame of a session that ended.
+ */
+#define REPLICA_SESSION_REMOVE "S-"
+
+/**
+ * @def REPLICA_MEMBER_ADD "M+"
+ * @brief A Macro that sets the replication frame of a member added to a group.
+ */
+#define REPLICA_MEMBER_ADD "M+"
+
+/**
+ * @def REPLICA_MEMBER_REMOVE "M-"
+ * @brief A Macro that sets the replication frame of a member that left a group.
+ */
+#define REPLICA_MEMBER_REMOVE "M-"
+
+/**
+ * @def REPLICA_RESET "R"
+ * @brief A Macro that sets the replication frame which clears everything that
+ *        was replicated, ahead of a new snapshot.
+ */
+#define REPLICA_RESET "R"
+
+/**
+ * @def MAX_REPLICA_OUTPUT 67108864
+ * @brief A Macro that sets the maximal size of the output queued to a replica
+ *        since its last snapshot (16 times that of a client), beyond which it
+ *        is sent a new snapshot.
+ */
+#define MAX_REPLICA_OUTPUT 67108864
+
+/**
+ * @def PROMOTE_TIMER_KEY (INT_MIN + 1)
+ * @brief A Macro that sets the timer key of the listen retry of a promotion.
+ */
+#define PROMOTE_TIMER_KEY (INT_MIN + 1)
+
+/**
+ * @def PROMOTE_RETRY_DELAY 100
+ * @brief A Macro that sets the milliseconds before a promoted replica tries
+ *        again to listen on a port which the old primary still holds. The
+ *        delay is doubled on every further attempt.
+ */
+#define PROMOTE_RETRY_DELAY 100
+
+/**
+ * @def MAX_PROMOTE_RETRY_DELAY 5000
+ * @brief A Macro that sets the maximal milliseconds between the attempts of a
+ *        promoted replica to listen.
+ */
+#define MAX_PROMOTE_RETRY_DELAY 5000
+
+/**
+ * @def SERVER_PROMOTE_COMMAND "PROMOTE"
+ * @brief A Macro that sets the command which promotes a replica to a primary.
+ */
+#define SERVER_PROMOTE_COMMAND "PROMOTE"
+
+/**
+ * @def PROMOTED_MSG "Replica promoted to primary."
+ * @brief A Macro that sets the message when a replica takes over.
+ */
+#define PROMOTED_MSG "Replica promoted to primary."
+
+/**
+ * @def REPLICA_FAIL_MSG "ERROR: failed to replicate the primary server."
+ * @brief A Macro that sets the error message when the primary is unreachable.
+ */
+#define REPLICA_FAIL_MSG "ERROR: failed to replicate the primary server."
+
+/**
+ * @def REPLICA_RESTART_MSG "ERROR: a replica can not restart."
+ * @brief A Macro that sets the error message of a restart of a replica.
+ */
+#define REPLICA_RESTART_MSG "ERROR: a replica can not restart."
+
+/**
+ * @def REPLICA_LINKED_MSG "Replica linked."
+ * @brief A Macro that sets the message when a replica links to this server.
+ */
+#define REPLICA_LINKED_MSG "Replica linked."
+
+/**
+ * @def REPLICA_UNLINKED_MSG "Replica unlinked."
+ * @brief A Macro that sets the message when the link of a replica is lost.
+ */
+#define REPLICA_UNLINKED_MSG "Replica unlinked."
+
+/**
+ * @def REPLICA_RESYNC_MSG "Replica fell behind, sent a new snapshot."
+ * @brief A Macro that sets the message when the frames of a slow replica are
+ *        dropped for a new snapshot.
+ */
+#define REPLICA_RESYNC_MSG "Replica fell behind, sent a new snapshot."
+
+/**
+ * @def REPLICA_SPAN "replica"
+ * @brief A Macro that sets the span name of a replication frame.
+ */
+#define REPLICA_SPAN "replica"
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief Type Definition for a vector of client sockets.
+ */
+typedef std::vector<int> clientsVector;
+
+/**
+ * @brief Type Definition for a set of client sockets.
+ */
+typedef std::unordered_set<int> clientsSet;
+
+/**
+ * @brief Type Definition for a set of client names.
+ */
+typedef std::unordered_set<clientName_t> namesSet;
+
+/**
+ * @brief Type Definition for a set of groups.
+ */
+typedef std::set<groupName_t> groupSet;
+
+/**
+ * @brief The kinds of the connections in the connection table.
+ */
+enum ConnectionKind { FREE_CONNECTION, PENDING_CONNECTION, CLIENT_CONNECTION,
+                      CLOSING_CONNECTION, PEER_CONNECTION,
+                      REPLICA_CONNECTION };
+
+/**
+ * @brief The slot of a socket in the connection table. The generation of the
+ *        slot changes whenever its socket is opened again, so a handle to a
+ *        connection that was closed never refers to a later connection. A
+ *        stamped connection gets the server timestamps of its frames.
+ */
+struct ConnectionSlot
+{
+    uint32_t generation;
+    ConnectionKind kind;
+    bool stamped;
+};
+
+/**
+ * @brief Type Definition for a handle of a connection, which is the socket
+ *        with the generation of its slot.
+ */
+typedef uint64_t connectionHandle_t;
+
+/**
+ * @brief Type Definition for the column of the connection table of the slots.
+ */
+typedef std::vector<ConnectionSlot> socketToSlotTable;
+
+/**
+ * @brief Type Definition for the column of the connection table of the client
+ *        names.
+ */
+typedef std::vector<clientName_t> socketToNameTable;
+
+/**
+ * @brief Type Definition for a map from group to the set of the sockets of its
+ *        clients. The sockets are the dense IDs of the connection table, so a
+ *        large group is kept as a compact bitmap of them.
+ */
+typedef std::map<groupName_t, MemberSet> groupToClient;
+
+/**
+ * @brief Type Definition for a map from client name to socket.
+ */
+typedef std::unordered_map<clientName_t, int> nameToSocketMap;
+
+/**
+ * @brief Type Definition for a map from client name to the groups it is a
+ *        member of.
+ */
+typedef std::unordered_map<clientName_t, groupSet> nameToGroupsMap;
+
+/**
+ * @brief Type Definition for a column of the connection table of buffers.
+ */
+typedef std::vector<message_t> socketToBufferTable;
+
+/**
+ * @brief Type Definition for a point in time of the server clock.
+ */
+typedef std::chrono::steady_clock::time_point timePoint_t;
+
+/**
+ * @brief Type Definition for a time of the server clock in microseconds.
+ */
+typedef uint64_t microseconds_t;
+
+/**
+ * @brief The token buckets which limit the rate of a single client.
+ *        A token count may drop below zero, which means the client is in debt
+ *        and will not be served until the bucket is refilled. The signals of
+ *        the client have a bucket of their own, which is always limited.
+ */
+struct TokenBucket
+{
+    double messageTokens;
+    double byteTokens;
+    double signalTokens;
+    timePoint_t lastRefill;
+};
+
+/**
+ * @brief Type Definition for the column of the connection table of the token
+ *        buckets.
+ */
+typedef std::vector<TokenBucket> socketToBucketTable;
+
+/**
+ * @brief The timer of a single connection, which is used for the handshake
+ *        deadline of a new connection and for the heartbeats and idle
+ *        eviction of a client. The activity is recorded without touching the
+ *        wheel, and the timer checks it only when it expires.
+ */
+struct ConnectionTimer
+{
+    timerID_t timer;
+    milliseconds_t lastActivity;
+    bool heartbeatSent;
+};
+
+/**
+ * @brief Type Definition for the column of the connection table of the timers.
+ */
+typedef std::vector<ConnectionTimer> socketToTimerTable;
+
+/**
+ * @brief Type Definition for the column of the connection table of the shared
+ *        memory channels.
+ */
+typedef std::vector<SharedChannel> socketToChannelTable;
+
+/**
+ * @brief Type Definition for the column of the connection table of the
+ *        handshake coroutines.
+ */
+typedef std::vector<ConnectionTask> socketToTaskTable;
+
+/**
+ * @brief Type Definition for the column of the connection table of the topic
+ *        filters a client is subscribed to.
+ */
+typedef std::vector<std::set<std::string>> socketToTopicsTable;
+
+/**
+ * @brief A server node of the federation. Every node keeps an outbound link
+ *        to every other node, which carries its own frames, and receives the
+ *        frames of the other node over the inbound link that node opened.
+ */
+struct FederationNode
+{
+    std::string id;
+    std::string host;
+    std::string port;
+    int outbound;
+    int inbound;
+    timerID_t retryTimer;
+};
+
+/**
+ * @brief Type Definition for a vector of federation nodes.
+ */
+typedef std::vector<FederationNode> nodeVector;
+
+/**
+ * @brief Type Definition for a map from a client name to its node.
+ */
+typedef std::map<clientName_t, int> nameToNodeMap;
+
+/**
+ * @brief Type Definition for a map from socket to a node.
+ */
+typedef std::map<int, int> socketToNodeMap;
+
+/**
+ * @brief Type Definition for a map from socket to a size in bytes.
+ */
+typedef std::map<int, size_t> socketToSizeMap;
+
+/**
+ * @brief Type Definition for a map from group to the names of some of its
+ *        members (those which are not connected to this server).
+ */
+typedef std::map<groupName_t, namesSet> groupToNamesMap;
+
+/**
+ * @brief The session of a client which lost its connection. The session is
+ *        kept for the grace period so the client may resume it, and the
+ *        messages sent to the client meanwhile are kept to be replayed.
+ */
+struct DetachedSession
+{
+    milliseconds_t expiry;
+    std::deque<message_t> replay;
+};
+
+/**
+ * @brief Type Definition for a map from a client name to its lost session.
+ */
+typedef std::map<clientName_t, DetachedSession> nameToSessionMap;
+
+/**
+ * @brief Type Definition for a map from a client name to its resume token.
+ */
+typedef std::map<clientName_t, std::string> nameToTokenMap;
+
+/**
+ * @brief Type Definition for a map from a client name to the IDs of its recent
+ *        messages.
+ */
+typedef std::map<clientName_t, DedupWindow> nameToDedupMap;
+
+/**
+ * @brief The endpoint of a client on the UDP side channel: the token which
+ *        authenticates its signals, and the address it last signaled from
+ *        with the signal socket which received it.
+ */
+struct SignalEndpoint
+{
+    std::string token;
+    int socket;
+    sockaddr_storage address;
+    socklen_t addressLength;
+};
+
+/**
+ * @brief Type Definition for a map from a client name to its signal endpoint.
+ */
+typedef std::unordered_map<clientName_t, SignalEndpoint> nameToSignalMap;
+
+
+/*-----=  Server Data  =-----*/
+
+
+/**
+ * @brief The vector of the connected clients.
+ */
+clientsVector clients = clientsVector();
+
+/**
+ * @brief The set of the open groups.
+ */
+groupSet groups = groupSet();
+
+/**
+ * @brief The slots of the connection table, indexed by the sockets. The table
+ *        is a set of parallel columns, so the hot columns (the slots, buckets
+ *        and timers) are scanned without touching the buffers and names.
+ */
+socketToSlotTable socketsToSlots = socketToSlotTable();
+
+/**
+ * @brief The connection table column of the connected client names.
+ */
+socketToNameTable socketsToNames = socketToNameTable();
+
+/**
+ * @brief The map from the connected client names into their sockets.
+ */
+nameToSocketMap namesToSockets = nameToSocketMap();
+
+/**
+ * @brief The map from the names of all the group members (connected to this
+ *        server or not) into their groups.
+ */
+nameToGroupsMap namesToGroups = nameToGroupsMap();
+
+/**
+ * @brief The map from the open groups to the sockets of their clients.
+ */
+groupToClient groupsToClients = groupToClient();
+
+/**
+ * @brief The connection table column of the partial input.
+ */
+socketToBufferTable socketsToBuffers = socketToBufferTable();
+
+/**
+ * @brief The connection table column of the client token buckets.
+ */
+socketToBucketTable socketsToBuckets = socketToBucketTable();
+
+/**
+ * @brief The new connections which did not send their client name yet.
+ */
+clientsVector pendingConnections = clientsVector();
+
+/**
+ * @brief The connection table column of the connection timers.
+ */
+socketToTimerTable socketsToTimers = socketToTimerTable();
+
+/**
+ * @brief The connection table column of the queued output.
+ */
+socketToBufferTable socketsToOutput = socketToBufferTable();
+
+/**
+ * @brief The connection table column of the shared memory channels of the
+ *        co-located clients (which are not open for the other connections).
+ */
+socketToChannelTable socketsToChannels = socketToChannelTable();
+
+/**
+ * @brief The connection table column of the handshake coroutines of the
+ *        pending connections (which are not started for the other
+ *        connections).
+ */
+socketToTaskTable socketsToTasks = socketToTaskTable();
+
+/**
+ * @brief The connection table column of the topic filters of the clients,
+ *        which are released with the connection.
+ */
+socketToTopicsTable socketsToTopics = socketToTopicsTable();
+
+/**
+ * @brief The trie of the topic subscriptions of the connected clients.
+ */
+TopicTrie topics = TopicTrie();
+
+/**
+ * @brief The sockets which have queued output to write.
+ */
+std::set<int> outputSockets = std::set<int>();
+
+/**
+ * @brief The closed connections which still write their last messages.
+ */
+clientsVector closingConnections = clientsVector();
+
+/**
+ * @brief Whether the server is draining its clients before exit.
+ */
+bool draining = false;
+
+/**
+ * @brief The timing wheel of all the server timers.
+ */
+TimingWheel timingWheel = TimingWheel(WHEEL_SLOTS, WHEEL_TICK, 0);
+
+/**
+ * @brief The welcome sockets (listeners) of the server.
+ */
+clientsVector listeners = clientsVector();
+
+/**
+ * @brief The hosts to bind the TCP listeners to (empty for wildcard).
+ */
+std::vector<std::string> bindHosts = std::vector<std::string>();
+
+/**
+ * @brief The paths of the Unix domain socket listeners.
+ */
+std::vector<std::string> unixPaths = std::vector<std::string>();
+
+/**
+ * @brief The names of the clients which may broadcast to all the clients.
+ */
+namesSet adminNames = namesSet();
+
+/**
+ * @brief The secret shared by the servers which link to each other, which a
+ *        link sends in its handshake. It is never printed or captured.
+ */
+std::string clusterSecret = std::string();
+
+/**
+ * @brief The FD Set for the server to read from.
+ */
+fd_set readFDs;
+
+/**
+ * @brief The index of the client which is served first in the next iteration.
+ */
+size_t nextClientIndex = 0;
+
+/**
+ * @brief The number of messages per second allowed for a client (0 unlimited).
+ */
+unsigned long messageRate = UNLIMITED_RATE;
+
+/**
+ * @brief The number of bytes per second allowed for a client (0 unlimited).
+ */
+unsigned long byteRate = UNLIMITED_RATE;
+
+/**
+ * @brief The number of messages processed for a client in a single iteration.
+ */
+unsigned long messageBudget = DEFAULT_MESSAGE_BUDGET;
+
+/**
+ * @brief The seconds of idle time before a heartbeat is sent (0 disabled).
+ */
+unsigned long heartbeatInterval = DEFAULT_HEARTBEAT_INTERVAL;
+
+/**
+ * @brief The seconds of idle time before a client is evicted (0 disabled).
+ */
+unsigned long idleTimeout = DEFAULT_IDLE_TIMEOUT;
+
+/**
+ * @brief The seconds a new connection has to send its name (0 disabled).
+ */
+unsigned long handshakeTimeout = DEFAULT_HANDSHAKE_TIMEOUT;
+
+/**
+ * @brief The seconds the server drains its clients on exit.
+ */
+unsigned long drainTimeout = DEFAULT_DRAIN_TIMEOUT;
+
+/**
+ * @brief The socket to receive the state of an old server from on restart.
+ */
+unsigned long inheritSocket = NO_INHERITED_STATE;
+
+/**
+ * @brief The arguments the server was started with, used to restart it.
+ */
+std::vector<std::string> serverArguments = std::vector<std::string>();
+
+/**
+ * @brief The nodes of the federation, where this server is the first node.
+ *        A server with no node ID is not federated.
+ */
+nodeVector nodes = nodeVector(1, FederationNode{"", "", "", NO_PEER_SOCKET,
+                                                NO_PEER_SOCKET, NO_TIMER});
+
+/**
+ * @brief The hash ring which determines the node that owns a client name.
+ */
+HashRing ring = HashRing();
+
+/**
+ * @brief The map from the clients connected to other nodes into their nodes.
+ */
+nameToNodeMap remoteClients = nameToNodeMap();
+
+/**
+ * @brief The map from the open groups to their members on other nodes.
+ */
+groupToNamesMap groupsToRemoteClients = groupToNamesMap();
+
+/**
+ * @brief The map from the inbound peer link sockets into their nodes.
+ */
+socketToNodeMap inboundPeers = socketToNodeMap();
+
+/**
+ * @brief The seconds a lost session may be resumed (0 disables resumption).
+ */
+unsigned long resumeGrace = DEFAULT_RESUME_GRACE;
+
+/**
+ * @brief The sessions of the clients which lost their connection.
+ */
+nameToSessionMap detachedSessions = nameToSessionMap();
+
+/**
+ * @brief The resume tokens of the clients, connected or not.
+ */
+nameToTokenMap sessionTokens = nameToTokenMap();
+
+/**
+ * @brief The IDs of the recent messages of the clients, connected or not.
+ */
+nameToDedupMap sendersToMessageIDs = nameToDedupMap();
+
+/**
+ * @brief The port of the UDP side channel of the signals (0 disables it).
+ */
+unsigned long signalPort = NO_SIGNAL_PORT;
+
+/**
+ * @brief The UDP sockets of the signals, bound alongside the TCP listeners.
+ */
+clientsVector signalSockets = clientsVector();
+
+/**
+ * @brief The map from the connected client names to their signal endpoints.
+ */
+nameToSignalMap namesToSignals = nameToSignalMap();
+
+/**
+ * @brief The sockets of the clients whose signal address is known, which are
+ *        the only clients a signal can be forwarded to.
+ */
+MemberSet signalingClients = MemberSet();
+
+/**
+ * @brief A map between a group to the names of its members which lost their
+ *        connection.
+ */
+groupToNamesMap groupsToDetachedClients = groupToNamesMap();
+
+/**
+ * @brief The timer of the expiry of the lost sessions.
+ */
+timerID_t resumeTimer = NO_TIMER;
+
+/**
+ * @brief The rounds of the server loop per traced round (0 disables tracing).
+ */
+unsigned long traceSample = DEFAULT_TRACE_SAMPLE;
+
+/**
+ * @brief The tracer of the stages of the server loop.
+ */
+Tracer tracer = Tracer();
+
+/**
+ * @brief The time the frame which is handled was received, which is the
+ *        start of the round of the loop that read it, or 0 outside the
+ *        handling of a frame.
+ */
+microseconds_t frameReceiveTime = 0;
+
+/**
+ * @brief The path of the capture file, empty if the frames are not captured.
+ */
+std::string capturePath = std::string();
+
+/**
+ * @brief The capture of the inbound frames of the clients.
+ */
+CaptureWriter capture = CaptureWriter();
+
+/**
+ * @brief The port of the server, which a replica listens on once promoted.
+ */
+portNumber_t serverPort = 0;
+
+/**
+ * @brief The host of the primary server this server replicates.
+ */
+std::string primaryHost = std::string();
+
+/**
+ * @brief The port of the primary server this server replicates.
+ */
+std::string primaryPort = std::string();
+
+/**
+ * @brief The link of a replica to its primary, or NO_REPLICATION_LINK.
+ */
+int replicationLink = NO_REPLICATION_LINK;
+
+/**
+ * @brief The host this server accepts the links of its replicas on, empty if
+ *        it accepts none.
+ */
+std::string replicaListenHost = std::string();
+
+/**
+ * @brief The port this server accepts the links of its replicas on.
+ */
+unsigned long replicaListenPort = 0;
+
+/**
+ * @brief The links of the replicas of this server.
+ */
+clientsVector replicas = clientsVector();
+
+/**
+ * @brief The map from the links of the replicas into the size of the output
+ *        they had right after their last snapshot was queued.
+ */
+socketToSizeMap replicaSnapshots = socketToSizeMap();
+
+/**
+ * @brief The milliseconds before the next attempt of a promoted replica to
+ *        listen on its port.
+ */
+milliseconds_t promoteRetryDelay = PROMOTE_RETRY_DELAY;
+
+
+/*-----=  General Functions  =-----*/
+
+
+/**
+ * @brief Gets the max socket ID currently in the server.
+ * @return the max socket ID.
+ */
+static int getMaxSocketID()
+{
+    int maxID = STDIN_FILENO;
+    for (auto i = listeners.begin(); i != listeners.end(); ++i)
+    {
+        maxID = std::max(maxID, *i);
+    }
+    for (auto i = pendingConnections.begin(); i != pendingConnections.end(); ++i)
+    {
+        maxID = std::max(maxID, *i);
+    }
+    for (auto i = closingConnections.begin(); i != closingConnections.end(); ++i)
+    {
+        maxID = std::max(maxID, *i);
+    }
+    for (auto i = clients.begin(); i != clients.end(); ++i)
+    {
+        maxID = std::max(maxID, *i);
+    }
+    for (auto i = inboundPeers.begin(); i != inboundPeers.end(); ++i)
+    {
+        maxID = std::max(maxID, i->first);
+    }
+    for (auto i = nodes.begin(); i != nodes.end(); ++i)
+    {
+        maxID = std::max(maxID, i->outbound);
+    }
+    for (auto i = socketsToChannels.begin(); i != socketsToChannels.end(); ++i)
+    {
+        maxID = std::max(maxID, i->doorbell());
+    }
+    for (auto i = signalSockets.begin(); i != signalSockets.end(); ++i)
+    {
+        maxID = std::max(maxID, *i);
+    }
+    for (auto i = replicas.begin(); i != replicas.end(); ++i)
+    {
+        maxID = std::max(maxID, *i);
+    }
+    return std::max(maxID, replicationLink);
+}
+
+/**
+ * @brief Checks whether a secret which was sent is the expected one. Every
+ *        byte is compared, so the time it takes does not tell how many of the
+ *        first bytes were right.
+ * @param given The secret which was sent.
+ * @param expected The expected secret.
+ * @return true if the secrets are equal, false otherwise.
+ */
+static bool secretsEqual(std::string const &given,
+                         std::string const &expected)
+{
+    if (given.length() != expected.length())
+    {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (size_t i = 0; i < given.length(); ++i)
+    {
+        difference |= given[i] ^ expected[i];
+    }
+    return difference == 0;
+}
+
+/**
+ * @brief Checks whether select can watch the given descriptor. The sets of
+ *        select only hold the descriptors below FD_SETSIZE, and setting one
+ *        above it would write past the set.
+ * @param descriptor The descriptor to check.
+ * @return true if select can watch the descriptor, false otherwise.
+ */
+static bool selectable(const int descriptor)
+{
+    return descriptor < FD_SETSIZE;
+}
+
+/**
+ * @brief Checks if the given client name is a valid name, which is not empty
+ *        and is alphanumeric.
+ * @param clientName The client name to check.
+ * @return 0 if the name is valid, -1 otherwise.
+ */
+static int validateClientName(clientName_t const &clientName)
+{
+    if (clientName.empty())
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned int i = 0; i < clientName.length(); ++i)
+    {
+        if (!isalnum(clientName[i]))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Determines if the given client name is available to use in the server.
+ * @param clientName The client name to check.
+ * @return true if available, false otherwise.
+ */
+static bool checkAvailableName(const clientName_t clientName)
+{
+    // Check in clients names.
+    if (namesToSockets.find(clientName) != namesToSockets.end())
+    {
+        return false;
+    }
+
+    // Check in groups names.
+    if (groups.find(clientName) != groups.end())
+    {
+        return false;
+    }
+
+    // Check in the names of the clients which may still resume.
+    if (detachedSessions.find(clientName) != detachedSessions.end())
+    {
+        return false;
+    }
+
+    // Check in the names of the clients of the other nodes.
+    return remoteClients.find(clientName) == remoteClients.end();
+}
+
+
+/*-----=  Timer Functions  =-----*/
+
+
+/**
+ * @brief Gets the current time of the server clock in milliseconds.
+ * @return The current time.
+ */
+static milliseconds_t currentTimeMS()
+{
+    return (milliseconds_t) std::chrono::duration_cast<std::chrono::milliseconds>
+            (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Gets a time of the server clock in microseconds.
+ * @param time The time.
+ * @return The time in microseconds.
+ */
+static microseconds_t timeUS(const timePoint_t time)
+{
+    return (microseconds_t) std::chrono::duration_cast<
+            std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+/**
+ * @brief Schedule the timer of the given connection, replacing its previous
+ *        timer if there is one.
+ * @param socket The connection socket.
+ * @param delay The delay until the timer expires in milliseconds.
+ */
+static void scheduleConnectionTimer(const int socket, const milliseconds_t delay)
+{
+    ConnectionTimer &connectionTimer = socketsToTimers[socket];
+    timingWheel.cancel(connectionTimer.timer);
+    connectionTimer.timer = timingWheel.schedule(currentTimeMS(), delay, socket);
+}
+
+/**
+ * @brief Cancel the timer of the given connection and forget its activity.
+ * @param socket The connection socket.
+ */
+static void cancelConnectionTimer(const int socket)
+{
+    ConnectionTimer &connectionTimer = socketsToTimers[socket];
+    timingWheel.cancel(connectionTimer.timer);
+    connectionTimer = ConnectionTimer();
+}
+
+/**
+ * @brief Records an activity of the given connection.
+ * @param socket The connection socket.
+ */
+static void touchConnection(const int socket)
+{
+    ConnectionTimer &connectionTimer = socketsToTimers[socket];
+    connectionTimer.lastActivity = currentTimeMS();
+    connectionTimer.heartbeatSent = false;
+}
+
+/**
+ * @brief Schedule the idle timer of the given client to the next time it
+ *        should be checked, which is either its heartbeat or its eviction.
+ * @param clientSocket The client socket.
+ * @param now The current time.
+ */
+static void scheduleIdleTimer(const int clientSocket, const milliseconds_t now)
+{
+    ConnectionTimer &connectionTimer = socketsToTimers[clientSocket];
+    milliseconds_t deadline = 0;
+    if (heartbeatInterval != DISABLED_TIMEOUT && !connectionTimer.heartbeatSent)
+    {
+        deadline = connectionTimer.lastActivity
+                   + heartbeatInterval * MILLISECONDS_PER_SECOND;
+    }
+    if (idleTimeout != DISABLED_TIMEOUT)
+    {
+        milliseconds_t eviction = connectionTimer.lastActivity
+                                  + idleTimeout * MILLISECONDS_PER_SECOND;
+        deadline = deadline ? std::min(deadline, eviction) : eviction;
+    }
+
+    if (deadline == 0)
+    {
+        // Neither heartbeats nor eviction are enabled.
+        timingWheel.cancel(connectionTimer.timer);
+        connectionTimer.timer = NO_TIMER;
+        return;
+    }
+    scheduleConnectionTimer(clientSocket, deadline > now ? deadline - now : 0);
+}
+
+
+/*-----=  Connection Table Functions  =-----*/
+
+
+/**
+ * @brief Opens the slot of a new connection socket in the connection table,
+ *        and grows the table if the socket is beyond it. The kernel gives the
+ *        lowest free descriptor to a new socket, so the table stays dense.
+ * @param socket The connection socket.
+ */
+static void openConnection(const int socket)
+{
+    if ((size_t) socket >= socketsToSlots.size())
+    {
+        size_t size = (size_t) socket + 1;
+        socketsToSlots.resize(size, ConnectionSlot{0, FREE_CONNECTION,
+                                                   false});
+        socketsToNames.resize(size);
+        socketsToBuffers.resize(size);
+        socketsToBuckets.resize(size);
+        socketsToTimers.resize(size);
+        socketsToOutput.resize(size);
+        socketsToChannels.resize(size);
+        socketsToTasks.resize(size);
+        socketsToTopics.resize(size);
+    }
+    ConnectionSlot &slot = socketsToSlots[socket];
+    // The generation is never zero, as the generations of the timing wheel.
+    slot.generation = std::max(slot.generation + 1, (uint32_t) 1);
+    slot.kind = FREE_CONNECTION;
+    slot.stamped = false;
+}
+
+/**
+ * @brief Gets the kind of the given connection.
+ * @param socket The connection socket.
+ * @return The kind of the connection, FREE_CONNECTION if it is not open.
+ */
+static ConnectionKind connectionKind(const int socket)
+{
+    if (socket < 0 || (size_t) socket >= socketsToSlots.size())
+    {
+        return FREE_CONNECTION;
+    }
+    return socketsToSlots[socket].kind;
+}
+
+/**
+ * @brief Sets the kind of the given open connection.
+ * @param socket The connection socket.
+ * @param kind The kind of the connection.
+ */
+static void setConnectionKind(const int socket, const ConnectionKind kind)
+{
+    socketsToSlots[socket].kind = kind;
+}
+
+/**
+ * @brief Gets the handle of the given open connection.
+ * @param socket The connection socket.
+ * @return The handle of the connection.
+ */
+static connectionHandle_t connectionHandle(const int socket)
+{
+    return ((connectionHandle_t) socketsToSlots[socket].generation
+            << GENERATION_SHIFT) | (uint32_t) socket;
+}
+
+/**
+ * @brief Gets the socket of the given connection handle, if the connection
+ *        is still of the given kind.
+ * @param handle The connection handle.
+ * @param kind The kind of the connection.
+ * @return The socket, or -1 if the connection was closed or has changed.
+ */
+static int handleSocket(const connectionHandle_t handle,
+                        const ConnectionKind kind)
+{
+    int socket = (int) (uint32_t) handle;
+    if (connectionKind(socket) != kind
+        || connectionHandle(socket) != handle)
+    {
+        return FAILURE_STATE;
+    }
+    return socket;
+}
+
+/**
+ * @brief Determine if the given connection has data to read in the given FD
+ *        set, over its socket or over its shared memory channel.
+ * @param socket The connection socket.
+ * @param currentFDs The FD set.
+ * @return true if the connection is readable, false otherwise.
+ */
+static bool connectionReadable(const int socket, fd_set *currentFDs)
+{
+    const SharedChannel &channel = socketsToChannels[socket];
+    return FD_ISSET(socket, currentFDs)
+           || (channel.open() && FD_ISSET(channel.doorbell(), currentFDs));
+}
+
+/**
+ * @brief Removes the given connection from the given FD set, so it is not
+ *        read in this round.
+ * @param socket The connection socket.
+ * @param currentFDs The FD set.
+ */
+static void ignoreConnection(const int socket, fd_set *currentFDs)
+{
+    FD_CLR(socket, currentFDs);
+    const SharedChannel &channel = socketsToChannels[socket];
+    if (channel.open())
+    {
+        FD_CLR(channel.doorbell(), currentFDs);
+    }
+}
+
+/**
+ * @brief Captures a frame which the given connection has sent.
+ * @param socket The connection socket.
+ * @param frame The frame, without its terminator.
+ */
+static void captureFrame(const int socket, const message_t &frame)
+{
+    if (capture.capturing())
+    {
+        capture.frame(connectionHandle(socket), frame);
+    }
+}
+
+/**
+ * @brief Captures a client which is handed off to a new server on a restart.
+ * @param clientSocket The client socket.
+ */
+static void captureHandoff(const int clientSocket)
+{
+    if (capture.capturing())
+    {
+        capture.handoff(connectionHandle(clientSocket),
+                        socketsToNames[clientSocket]);
+    }
+}
+
+/**
+ * @brief Captures a client which was taken over from an old server.
+ * @param clientSocket The client socket.
+ */
+static void captureTakeover(const int clientSocket)
+{
+    if (capture.capturing())
+    {
+        capture.takeover(connectionHandle(clientSocket),
+                         socketsToNames[clientSocket]);
+    }
+}
+
+/**
+ * @brief Closes the socket of the given connection, with its shared memory
+ *        channel if it has one, and frees its slot.
+ * @param socket The connection socket.
+ */
+static void closeConnection(const int socket)
+{
+    if (capture.capturing())
+    {
+        capture.close(connectionHandle(socket));
+    }
+    SharedChannel &channel = socketsToChannels[socket];
+    if (channel.open())
+    {
+        FD_CLR(channel.doorbell(), &readFDs);
+        channel.release();
+    }
+    setConnectionKind(socket, FREE_CONNECTION);
+    close(socket);
+}
+
+/**
+ * @brief Releases the memory of the given buffer once it is empty, unless it
+ *        is small, so an idle connection keeps only a small buffer.
+ * @param buffer The buffer.
+ */
+static void releaseBuffer(message_t &buffer)
+{
+    if (buffer.empty() && buffer.capacity() > IDLE_BUFFER_CAPACITY)
+    {
+        message_t().swap(buffer);
+    }
+}
+
+/**
+ * @brief Gets the heap memory held by the given string.
+ * @param data The string.
+ * @return The number of bytes, 0 if the string is held inline.
+ */
+static size_t heapBytes(const std::string &data)
+{
+    static const size_t inlineCapacity = std::string().capacity();
+    return data.capacity() > inlineCapacity ? data.capacity() + 1 : 0;
+}
+
+/**
+ * @brief Gets the memory held by the given connection: its row in the
+ *        connection table, its buffers and queued output, its shared memory,
+ *        and for a client also its name, its resume token and its recent
+ *        message IDs.
+ * @param socket The connection socket.
+ * @param inputBytes The bytes of the input buffer, which are added to.
+ * @param outputBytes The bytes of the queued output, which are added to.
+ * @param clientBytes The bytes of the client data, which are added to.
+ * @return The number of bytes held by the connection.
+ */
+static size_t connectionBytes(const int socket, size_t &inputBytes,
+                              size_t &outputBytes, size_t &clientBytes)
+{
+    size_t input = heapBytes(socketsToBuffers[socket]);
+    size_t output = heapBytes(socketsToOutput[socket]);
+    size_t client = heapBytes(socketsToNames[socket]);
+    if (connectionKind(socket) == CLIENT_CONNECTION)
+    {
+        const clientName_t &name = socketsToNames[socket];
+        auto token = sessionTokens.find(name);
+        if (token != sessionTokens.end())
+        {
+            client += heapBytes(token->second);
+        }
+        auto window = sendersToMessageIDs.find(name);
+        if (window != sendersToMessageIDs.end())
+        {
+            client += window->second.bytes();
+        }
+    }
+    inputBytes += input;
+    outputBytes += output;
+    clientBytes += client;
+    size_t shared = socketsToChannels[socket].open() ? sizeof(SharedRegion) : 0;
+    return sizeof(ConnectionSlot) + sizeof(clientName_t)
+           + 2 * sizeof(message_t) + sizeof(TokenBucket)
+           + sizeof(ConnectionTimer) + sizeof(SharedChannel) + input + output
+           + client + shared;
+}
+
+
+/*-----=  Output Functions  =-----*/
+
+
+/**
+ * @brief Creates a frame of the times the handled frame was received and
+ *        dispatched, which is now.
+ * @param tag The tag of the frame.
+ * @return The frame.
+ */
+static message_t timestampFrame(const MessageTag tag)
+{
+    return messageTag(tag) + std::to_string(frameReceiveTime)
+           + WHITE_SPACE_DELIM
+           + std::to_string(timeUS(std::chrono::steady_clock::now()));
+}
+
+/**
+ * @brief Queue a message to the given connection. The message is written
+ *        when the socket is writable, so a slow reader never blocks the server.
+ *        A message to a stamped connection in the handling of a frame is
+ *        preceded by the timestamps of the frame.
+ * @param socket The connection socket.
+ * @param message The message to queue.
+ */
+static void queueData(const int socket, const message_t &message)
+{
+    message_t &output = socketsToOutput[socket];
+    if (frameReceiveTime != 0 && socketsToSlots[socket].stamped)
+    {
+        output += timestampFrame(TIMESTAMP);
+        output += (char) MSG_TERMINATOR;
+    }
+    output += message;
+    output += (char) MSG_TERMINATOR;
+    outputSockets.insert(socket);
+}
+
+/**
+ * @brief Queue a single state character (with no terminator) to the given
+ *        connection, as used in the connection and logout responses.
+ * @param socket The connection socket.
+ * @param state The state to queue.
+ */
+static void queueState(const int socket, const char state)
+{
+    socketsToOutput[socket] += state;
+    outputSockets.insert(socket);
+}
+
+/**
+ * @brief Creates a replication frame.
+ * @param type The type of the frame.
+ * @param first The first field of the frame.
+ * @param second The second field of the frame, if it has one.
+ * @return The frame.
+ */
+static message_t createReplicaFrame(const char *type, std::string const &first,
+                                    std::string const &second)
+{
+    message_t frame = std::string(type) + WHITE_SPACE_DELIM + first;
+    if (!second.empty())
+    {
+        frame += WHITE_SPACE_DELIM + second;
+    }
+    return frame;
+}
+
+/**
+ * @brief Queue a replication frame to all the replicas of this server. The
+ *        frame is only built when there are replicas to send it to.
+ * @param type The type of the frame.
+ * @param first The first field of the frame.
+ * @param second The second field of the frame, if it has one.
+ */
+static void replicateFrame(const char *type, std::string const &first,
+                           std::string const &second = std::string())
+{
+    if (replicas.empty())
+    {
+        return;
+    }
+    message_t frame = createReplicaFrame(type, first, second);
+    for (int replica : replicas)
+    {
+        queueData(replica, frame);
+    }
+}
+
+/**
+ * @brief Discard the queued output of the given connection.
+ * @param socket The connection socket.
+ */
+static void discardOutput(const int socket)
+{
+    message_t().swap(socketsToOutput[socket]);
+    outputSockets.erase(socket);
+}
+
+/**
+ * @brief Write as much as possible of the queued output of the given
+ *        connection without blocking.
+ * @param socket The connection socket.
+ * @return 0 upon success (even if some output remains), -1 on failure.
+ */
+static int flushOutput(const int socket)
+{
+    message_t &output = socketsToOutput[socket];
+    SharedChannel &channel = socketsToChannels[socket];
+    if (channel.open())
+    {
+        // A full ring is written again once the client frees some space.
+        ssize_t written = channel.write(output.data(), output.length());
+        if (written < 0)
+        {
+            // The client corrupted the indices of the ring.
+            return FAILURE_STATE;
+        }
+        output.erase(MSG_BEGIN_INDEX, written);
+        if (output.empty())
+        {
+            discardOutput(socket);
+        }
+        return SUCCESS_STATE;
+    }
+
+    size_t written = INITIAL_WRITE_COUNT;
+    while (written < output.length())
+    {
+        ssize_t currentCount = write(socket, output.data() + written,
+                                     output.length() - written);
+        if (currentCount < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (wouldBlock())
+            {
+                break;
+            }
+            output.erase(MSG_BEGIN_INDEX, written);
+            return FAILURE_STATE;
+        }
+        written += currentCount;
+    }
+
+    output.erase(MSG_BEGIN_INDEX, written);
+    if (output.empty())
+    {
+        discardOutput(socket);
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Determine if the given connection has queued output.
+ * @param socket The connection socket.
+ * @return true if there is output to write, false otherwise.
+ */
+static bool hasOutput(const int socket)
+{
+    return outputSockets.find(socket) != outputSockets.end();
+}
+
+/**
+ * @brief Closes the given connection immediately, with its queued output.
+ * @param socket The connection socket.
+ */
+static void finishConnection(const int socket)
+{
+    closingConnections.erase(std::remove(closingConnections.begin(),
+                                         closingConnections.end(), socket),
+                             closingConnections.end());
+    cancelConnectionTimer(socket);
+    discardOutput(socket);
+    closeConnection(socket);
+}
+
+/**
+ * @brief Closes the given connection (which is no longer a client or a
+ *        pending connection) once its queued output is written, or when the
+ *        linger timeout expires.
+ * @param socket The connection socket.
+ */
+static void lingerConnection(const int socket)
+{
+    if (!hasOutput(socket))
+    {
+        closeConnection(socket);
+        return;
+    }
+    closingConnections.push_back(socket);
+    setConnectionKind(socket, CLOSING_CONNECTION);
+    // A closing channel is no longer read, and is flushed on every round.
+    if (socketsToChannels[socket].open())
+    {
+        FD_CLR(socketsToChannels[socket].doorbell(), &readFDs);
+    }
+    if (!draining)
+    {
+        scheduleConnectionTimer(socket, LINGER_TIMEOUT * MILLISECONDS_PER_SECOND);
+    }
+}
+
+/**
+ * @brief Determine if the given socket is a closing connection.
+ * @param socket The socket to check.
+ * @return true if the socket is closing, false otherwise.
+ */
+static bool connectionClosing(const int socket)
+{
+    return connectionKind(socket) == CLOSING_CONNECTION;
+}
+
+
+/*-----=  Group Membership Functions  =-----*/
+
+
+/**
+ * @brief Check if a given group name is an open group.
+ * @param groupName The group name to check.
+ * @return true if the group is open in the server, false otherwise.
+ */
+static bool groupOpen(groupName_t const groupName)
+{
+    return groups.find(groupName) != groups.end();
+}
+
+/**
+ * @brief Check if a group contains a client, whether the client is connected
+ *        to this server, to another node or lost its connection.
+ * @param groupName The group name.
+ * @param clientName The client to check.
+ * @return true if the client is in the given group, false otherwise.
+ */
+static bool groupContainsClient(groupName_t const groupName,
+                                clientName_t const clientName)
+{
+    auto i = namesToGroups.find(clientName);
+    return i != namesToGroups.end() && i->second.find(groupName)
+                                       != i->second.end();
+}
+
+/**
+ * @brief Creates a new group in the server.
+ * @param groupName The name of the new group.
+ */
+static void createNewGroup(groupName_t const groupName)
+{
+    groups.insert(groupName);
+    groupsToClients[groupName] = MemberSet();
+    groupsToRemoteClients[groupName] = namesSet();
+    groupsToDetachedClients[groupName] = namesSet();
+}
+
+/**
+ * @brief Removes a group from the groups of a member.
+ * @param clientName The member name.
+ * @param groupName The group name.
+ */
+static void forgetMembership(clientName_t const clientName,
+                             groupName_t const groupName)
+{
+    auto i = namesToGroups.find(clientName);
+    if (i == namesToGroups.end())
+    {
+        return;
+    }
+    replicateFrame(REPLICA_MEMBER_REMOVE, groupName, clientName);
+    i->second.erase(groupName);
+    if (i->second.empty())
+    {
+        namesToGroups.erase(i);
+    }
+}
+
+/**
+ * @brief Remove a group from the server.
+ * @param groupName The group to remove.
+ */
+static void removeGroup(groupName_t const groupName)
+{
+    for (int member : groupsToClients[groupName])
+    {
+        forgetMembership(socketsToNames[member], groupName);
+    }
+    for (const clientName_t &member : groupsToRemoteClients[groupName])
+    {
+        forgetMembership(member, groupName);
+    }
+    for (const clientName_t &member : groupsToDetachedClients[groupName])
+    {
+        forgetMembership(member, groupName);
+    }
+    groups.erase(groupName);
+    groupsToClients.erase(groupName);
+    groupsToRemoteClients.erase(groupName);
+    groupsToDetachedClients.erase(groupName);
+}
+
+/**
+ * @brief Removes a member from a group. A group which is left without members
+ *        is removed, so its name is available again.
+ * @param clientName The member name.
+ * @param groupName The group name.
+ */
+static void removeClientFromGroup(clientName_t const clientName,
+                                  groupName_t const groupName)
+{
+    forgetMembership(clientName, groupName);
+    MemberSet &members = groupsToClients[groupName];
+    auto clientSocket = namesToSockets.find(clientName);
+    if (clientSocket != namesToSockets.end())
+    {
+        members.erase(clientSocket->second);
+    }
+    namesSet &remoteMembers = groupsToRemoteClients[groupName];
+    namesSet &detachedMembers = groupsToDetachedClients[groupName];
+    remoteMembers.erase(clientName);
+    detachedMembers.erase(clientName);
+    if (members.empty() && remoteMembers.empty() && detachedMembers.empty())
+    {
+        removeGroup(groupName);
+    }
+}
+
+/**
+ * @brief Removes the given client from all of it's groups.
+ * @param clientName The client to remove.
+ */
+static void removeClientFromGroups(clientName_t const clientName)
+{
+    auto i = namesToGroups.find(clientName);
+    if (i == namesToGroups.end())
+    {
+        return;
+    }
+    // Take a copy since the groups of the client are removed while handled.
+    groupSet memberGroups = i->second;
+    for (const groupName_t &groupName : memberGroups)
+    {
+        removeClientFromGroup(clientName, groupName);
+    }
+}
+
+
+/*-----=  Federation Functions  =-----*/
+
+
+/**
+ * @brief Determine if this server is a node of a federation.
+ * @return true if the server has a node ID, false otherwise.
+ */
+static bool federated()
+{
+    return !nodes[LOCAL_NODE].id.empty();
+}
+
+/**
+ * @brief Gets the node which owns the given client name.
+ * @param clientName The client name.
+ * @return The index of the owner node (this server if it is not federated).
+ */
+static int getOwnerNode(clientName_t const clientName)
+{
+    int owner = ring.ownerOf(clientName);
+    return owner == NO_NODE ? LOCAL_NODE : owner;
+}
+
+/**
+ * @brief Gets the index of the node with the given ID.
+ * @param nodeID The node ID.
+ * @return The index of the node, or NO_NODE if there is no such node.
+ */
+static int findNode(std::string const nodeID)
+{
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].id.compare(nodeID) == EQUAL_COMPARISON)
+        {
+            return (int) i;
+        }
+    }
+    return NO_NODE;
+}
+
+/**
+ * @brief Gets the node whose outbound link is the given socket.
+ * @param socket The socket to check.
+ * @return The index of the node, or NO_NODE if it is not an outbound link.
+ */
+static int getOutboundPeerNode(const int socket)
+{
+    for (size_t i = LOCAL_NODE + 1; i < nodes.size(); ++i)
+    {
+        if (nodes[i].outbound == socket)
+        {
+            return (int) i;
+        }
+    }
+    return NO_NODE;
+}
+
+/**
+ * @brief Determine if a given client name is connected to another node.
+ * @param clientName The client to check.
+ * @return true if the client is connected to another node, false otherwise.
+ */
+static bool remoteClientOnline(clientName_t const clientName)
+{
+    return remoteClients.find(clientName) != remoteClients.end();
+}
+
+/**
+ * @brief Removes a client of another node, and removes it from its groups.
+ * @param clientName The client to remove.
+ */
+static void removeRemoteClient(clientName_t const clientName)
+{
+    remoteClients.erase(clientName);
+    removeClientFromGroups(clientName);
+}
+
+/**
+ * @brief Queue a frame to the outbound link of the given node. The frames of
+ *        a link are written together once per iteration of the server loop,
+ *        so many messages to a node share a single write.
+ * @param node The node to send to.
+ * @param frame The frame to queue.
+ * @return 0 upon success, -1 if the link to the node is down.
+ */
+static int queuePeerFrame(const int node, const message_t &frame)
+{
+    if (nodes[node].outbound == NO_PEER_SOCKET)
+    {
+        return FAILURE_STATE;
+    }
+    queueData(nodes[node].outbound, frame);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Queue a frame to the outbound links of all the other nodes.
+ * @param frame The frame to queue.
+ * @return The number of nodes the frame was queued to.
+ */
+static size_t broadcastPeerFrame(const message_t &frame)
+{
+    size_t queued = 0;
+    for (size_t i = LOCAL_NODE + 1; i < nodes.size(); ++i)
+    {
+        if (!queuePeerFrame((int) i, frame))
+        {
+            queued++;
+        }
+    }
+    return queued;
+}
+
+/**
+ * @brief Creates the peer frame of the given group with all of its members.
+ * @param groupName The group name.
+ * @return The group frame.
+ */
+static message_t createGroupFrame(groupName_t const groupName)
+{
+    message_t frame = std::string(PEER_GROUP) + WHITE_SPACE_DELIM + groupName;
+    MemberSet &members = groupsToClients[groupName];
+    for (auto i = members.begin(); i != members.end(); ++i)
+    {
+        frame += WHITE_SPACE_DELIM + socketsToNames[*i];
+    }
+    namesSet &remoteMembers = groupsToRemoteClients[groupName];
+    for (auto i = remoteMembers.begin(); i != remoteMembers.end(); ++i)
+    {
+        frame += WHITE_SPACE_DELIM + *i;
+    }
+    namesSet &detachedMembers = groupsToDetachedClients[groupName];
+    for (auto i = detachedMembers.begin(); i != detachedMembers.end(); ++i)
+    {
+        frame += WHITE_SPACE_DELIM + *i;
+    }
+    return frame;
+}
+
+/**
+ * @brief Forward a message to a client connected to another node.
+ * @param senderName The sender client name.
+ * @param receiverName The receiver client name.
+ * @param message The message to send.
+ * @return 0 upon success, -1 if the link to the node of the client is down.
+ */
+static int forwardMessageToClient(clientName_t const senderName,
+                                  clientName_t const receiverName,
+                                  message_t const &message)
+{
+    message_t frame = std::string(PEER_SEND) + WHITE_SPACE_DELIM + senderName
+                      + WHITE_SPACE_DELIM + receiverName + WHITE_SPACE_DELIM
+                      + message;
+    return queuePeerFrame(remoteClients[receiverName], frame);
+}
+
+/**
+ * @brief Forward a group message to the members of the group on the other
+ *        nodes. Every node with members is sent a single frame, and delivers
+ *        the message to its own members.
+ * @param senderName The sender client name.
+ * @param groupName The group name.
+ * @param message The message to send.
+ */
+static void forwardMessageToGroup(clientName_t const senderName,
+                                  groupName_t const groupName,
+                                  message_t const &message)
+{
+    std::set<int> memberNodes;
+    namesSet &remoteMembers = groupsToRemoteClients[groupName];
+    for (auto i = remoteMembers.begin(); i != remoteMembers.end(); ++i)
+    {
+        auto j = remoteClients.find(*i);
+        if (j != remoteClients.end())
+        {
+            memberNodes.insert(j->second);
+        }
+    }
+
+    message_t frame = std::string(PEER_GROUP_SEND) + WHITE_SPACE_DELIM
+                      + senderName + WHITE_SPACE_DELIM + groupName
+                      + WHITE_SPACE_DELIM + message;
+    for (int node : memberNodes)
+    {
+        queuePeerFrame(node, frame);
+    }
+}
+
+/**
+ * @brief Queue the first frames of a new outbound link to the given node: the
+ *        ID of this node, the clients connected to it and all of its groups.
+ * @param node The node of the link.
+ */
+static void syncPeer(const int node)
+{
+    queuePeerFrame(node, std::string(PEER_HANDSHAKE) + WHITE_SPACE_DELIM
+                         + nodes[LOCAL_NODE].id + WHITE_SPACE_DELIM
+                         + clusterSecret);
+    if (!clients.empty() || !detachedSessions.empty())
+    {
+        message_t presence = PEER_PRESENCE_ADD;
+        for (auto i = clients.begin(); i != clients.end(); ++i)
+        {
+            presence += WHITE_SPACE_DELIM + socketsToNames[*i];
+        }
+        for (auto i = detachedSessions.begin(); i != detachedSessions.end();
+             ++i)
+        {
+            presence += WHITE_SPACE_DELIM + i->first;
+        }
+        queuePeerFrame(node, presence);
+    }
+    for (auto i = groups.begin(); i != groups.end(); ++i)
+    {
+        queuePeerFrame(node, createGroupFrame(*i));
+    }
+}
+
+/**
+ * @brief Opens the outbound link to the given node. The connection completes
+ *        in the background, and the queued frames are written once it does.
+ * @param node The node to connect to.
+ * @return 0 upon success, -1 on failure.
+ */
+static int connectPeer(const int node)
+{
+    FederationNode &peer = nodes[node];
+    peer.retryTimer = NO_TIMER;
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    int error = getaddrinfo(peer.host.c_str(), peer.port.c_str(), &hints,
+                            &addresses);
+    if (error)
+    {
+        addressInfoError(error);
+        return FAILURE_STATE;
+    }
+
+    int socketID = socket(addresses->ai_family, SOCK_STREAM, 0);
+    if (socketID < SOCKET_ID_BOUND)
+    {
+        systemCallError(SOCKET_NAME, errno);
+        freeaddrinfo(addresses);
+        return FAILURE_STATE;
+    }
+    if (!selectable(socketID))
+    {
+        // The link is retried once enough connections are closed.
+        std::cerr << DESCRIPTOR_LIMIT_MSG << std::endl;
+        close(socketID);
+        freeaddrinfo(addresses);
+        return FAILURE_STATE;
+    }
+    setNoDelay(socketID);
+    if (setNonBlocking(socketID)
+        || (connect(socketID, addresses->ai_addr, addresses->ai_addrlen)
+            && errno != EINPROGRESS))
+    {
+        close(socketID);
+        freeaddrinfo(addresses);
+        return FAILURE_STATE;
+    }
+    freeaddrinfo(addresses);
+
+    // The link is read only to notice when the other node closes it.
+    openConnection(socketID);
+    setConnectionKind(socketID, PEER_CONNECTION);
+    peer.outbound = socketID;
+    FD_SET(socketID, &readFDs);
+    syncPeer(node);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Schedule a new attempt to open the outbound link to the given node.
+ * @param node The node to reconnect.
+ */
+static void schedulePeerRetry(const int node)
+{
+    nodes[node].retryTimer = timingWheel.schedule(currentTimeMS(),
+                                                  PEER_RETRY_DELAY,
+                                                  PEER_TIMER_KEY_BASE - node);
+}
+
+/**
+ * @brief Opens the outbound links to all the other nodes.
+ */
+static void connectPeers()
+{
+    for (size_t i = LOCAL_NODE + 1; i < nodes.size(); ++i)
+    {
+        if (connectPeer((int) i))
+        {
+            schedulePeerRetry((int) i);
+        }
+    }
+}
+
+/**
+ * @brief Closes the outbound link to the given node, which has failed, and
+ *        schedules its reconnection. The frames that were not written yet are
+ *        lost, and the new link starts with the entire state of this node.
+ * @param node The node of the link.
+ */
+static void closeOutboundPeer(const int node)
+{
+    int socket = nodes[node].outbound;
+    FD_CLR(socket, &readFDs);
+    discardOutput(socket);
+    closeConnection(socket);
+    nodes[node].outbound = NO_PEER_SOCKET;
+    schedulePeerRetry(node);
+}
+
+
+/*-----=  Client Management Functions  =-----*/
+
+
+/**
+ * @brief Creates a new Client in the server with the given data.
+ * @param name The client name.
+ * @param socket The socket of the new client.
+ */
+static void createNewClient(const clientName_t name, const int socket)
+{
+    clients.push_back(socket);
+    FD_SET(socket, &readFDs);
+    // Any input the client has sent right after its name is kept.
+    setConnectionKind(socket, CLIENT_CONNECTION);
+    socketsToNames[socket] = name;
+    namesToSockets[name] = socket;
+
+    // A new client starts with full buckets.
+    TokenBucket bucket;
+    bucket.messageTokens = messageRate;
+    bucket.byteTokens = byteRate;
+    bucket.signalTokens = SIGNAL_RATE;
+    bucket.lastRefill = std::chrono::steady_clock::now();
+    socketsToBuckets[socket] = bucket;
+
+    touchConnection(socket);
+    scheduleIdleTimer(socket, currentTimeMS());
+}
+
+/**
+ * @brief Releases the connection of a client from the server data, while its
+ *        group memberships are kept and its topic subscriptions are dropped.
+ * @param clientSocket The client to release.
+ */
+static void releaseClient(const int clientSocket)
+{
+    clients.erase(std::remove(clients.begin(), clients.end(), clientSocket));
+    FD_CLR(clientSocket, &readFDs);
+    namesToSockets.erase(socketsToNames[clientSocket]);
+    namesToSignals.erase(socketsToNames[clientSocket]);
+    signalingClients.erase((memberID_t) clientSocket);
+    setConnectionKind(clientSocket, FREE_CONNECTION);
+    clientName_t().swap(socketsToNames[clientSocket]);
+    message_t().swap(socketsToBuffers[clientSocket]);
+    cancelConnectionTimer(clientSocket);
+
+    // The subscriptions belong to the connection, and a resumed session
+    // subscribes again.
+    std::set<std::string> &filters = socketsToTopics[clientSocket];
+    for (auto i = filters.begin(); i != filters.end(); ++i)
+    {
+        topics.unsubscribe(*i, (memberID_t) clientSocket);
+    }
+    std::set<std::string>().swap(filters);
+}
+
+/**
+ * @brief Removes a client from the server.
+ * @param clientSocket The client to remove.
+ */
+static void removeClient(const int clientSocket)
+{
+    broadcastPeerFrame(std::string(PEER_PRESENCE_REMOVE) + WHITE_SPACE_DELIM
+                       + socketsToNames[clientSocket]);
+    replicateFrame(REPLICA_SESSION_REMOVE, socketsToNames[clientSocket]);
+    sessionTokens.erase(socketsToNames[clientSocket]);
+    sendersToMessageIDs.erase(socketsToNames[clientSocket]);
+    removeClientFromGroups(socketsToNames[clientSocket]);
+    releaseClient(clientSocket);
+}
+
+/**
+ * @brief Determine if the given socket belongs to a connected client.
+ * @param clientSocket The socket to check.
+ * @return true if the socket is of a connected client, false otherwise.
+ */
+static bool clientConnected(const int clientSocket)
+{
+    return connectionKind(clientSocket) == CLIENT_CONNECTION;
+}
+
+/**
+ * @brief Gets the client socket by the given client name.
+ * @param clientName The client name to receive it's socket.
+ * @return The socket ID of the given client name.
+ */
+static int getClientSocket(clientName_t const clientName)
+{
+    auto i = namesToSockets.find(clientName);
+    return i != namesToSockets.end() ? i->second : FAILURE_STATE;
+}
+
+/**
+ * @brief Determine if a given client name is online.
+ * @param clientName The client to check.
+ * @return true if the client is connected to the server, false otherwise.
+ */
+static bool clientOnline(clientName_t const clientName)
+{
+    return getClientSocket(clientName) > FAILURE_STATE;
+}
+
+
+/*-----=  Session Resumption Functions  =-----*/
+
+
+/**
+ * @brief Determine if a given client name belongs to a lost session which may
+ *        still be resumed.
+ * @param clientName The client to check.
+ * @return true if the session of the client is detached, false otherwise.
+ */
+static bool sessionDetached(clientName_t const clientName)
+{
+    return detachedSessions.find(clientName) != detachedSessions.end();
+}
+
+/**
+ * @brief Generates a new token from the random bytes of the kernel, so a token
+ *        can not be predicted from the tokens which were issued before it. All
+ *        the tokens have the same number of digits.
+ * @return The token, or an empty string if no random bytes were read.
+ */
+static std::string generateToken()
+{
+    unsigned char bytes[TOKEN_BYTES];
+    if (getrandom(bytes, TOKEN_BYTES, 0) != TOKEN_BYTES)
+    {
+        systemCallError(GETRANDOM_NAME, errno);
+        return std::string();
+    }
+    std::stringstream token;
+    token << std::hex << std::setfill('0');
+    for (int i = 0; i < TOKEN_BYTES; ++i)
+    {
+        token << std::setw(TOKEN_BYTE_DIGITS) << (int) bytes[i];
+    }
+    return token.str();
+}
+
+/**
+ * @brief Issues a new resume token to the given client. A client resumes its
+ *        session by sending the token after its name when it reconnects.
+ * @param clientSocket The client socket.
+ */
+static void issueResumeToken(const int clientSocket)
+{
+    if (resumeGrace == DISABLED_TIMEOUT)
+    {
+        return;
+    }
+    std::string token = generateToken();
+    if (token.empty())
+    {
+        // The client keeps on without a token, and can not resume.
+        return;
+    }
+    sessionTokens[socketsToNames[clientSocket]] = token;
+    replicateFrame(REPLICA_SESSION_ADD, socketsToNames[clientSocket], token);
+    queueData(clientSocket, std::to_string(RESUME_TOKEN) + token);
+}
+
+/**
+ * @brief Issues a new signal token to the given client, with the port of the
+ *        UDP side channel. The client authenticates its signals by the token,
+ *        and its address is known once it signals for the first time.
+ * @param clientSocket The client socket.
+ */
+static void issueSignalToken(const int clientSocket)
+{
+    if (signalSockets.empty())
+    {
+        return;
+    }
+    std::string token = generateToken();
+    if (token.empty())
+    {
+        // The client keeps on without signals.
+        return;
+    }
+    SignalEndpoint endpoint = {token, NO_SIGNAL_SOCKET, sockaddr_storage(), 0};
+    namesToSignals[socketsToNames[clientSocket]] = endpoint;
+    signalingClients.erase((memberID_t) clientSocket);
+    queueData(clientSocket, messageTag(SIGNAL_TOKEN)
+                            + std::to_string(signalPort) + WHITE_SPACE_DELIM
+                            + endpoint.token);
+}
+
+/**
+ * @brief Schedule the expiry of the lost sessions, unless it is scheduled.
+ */
+static void scheduleResumeTimer()
+{
+    if (resumeTimer == NO_TIMER)
+    {
+        resumeTimer = timingWheel.schedule(currentTimeMS(),
+                                           RESUME_SWEEP_INTERVAL,
+                                           RESUME_TIMER_KEY);
+    }
+}
+
+/**
+ * @brief Detaches a client which lost its connection. The client keeps its
+ *        name and its groups for the grace period, and the messages sent to
+ *        it meanwhile are kept for it.
+ * @param clientSocket The client socket.
+ */
+static void detachClient(const int clientSocket)
+{
+    clientName_t clientName = socketsToNames[clientSocket];
+    auto memberGroups = namesToGroups.find(clientName);
+    if (memberGroups != namesToGroups.end())
+    {
+        for (const groupName_t &groupName : memberGroups->second)
+        {
+            groupsToClients[groupName].erase(clientSocket);
+            groupsToDetachedClients[groupName].insert(clientName);
+        }
+    }
+    releaseClient(clientSocket);
+
+    DetachedSession &session = detachedSessions[clientName];
+    session.expiry = currentTimeMS() + resumeGrace * MILLISECONDS_PER_SECOND;
+    session.replay.clear();
+    scheduleResumeTimer();
+    std::cout << clientName << DETACHED_MSG_SUFFIX << std::endl;
+}
+
+/**
+ * @brief Keeps a message sent to a lost session, to replay it on resumption.
+ * @param clientName The client name.
+ * @param message The message.
+ */
+static void keepReplayMessage(clientName_t const clientName,
+                              message_t const &message)
+{
+    std::deque<message_t> &replay = detachedSessions[clientName].replay;
+    replay.push_back(message);
+    if (replay.size() > MAX_REPLAY_MESSAGES)
+    {
+        replay.pop_front();
+    }
+}
+
+/**
+ * @brief Handle the expiry timer of the lost sessions. A session whose grace
+ *        period has passed is removed along with its name.
+ */
+static void handleResumeTimer()
+{
+    resumeTimer = NO_TIMER;
+    milliseconds_t now = currentTimeMS();
+    for (auto i = detachedSessions.begin(); i != detachedSessions.end();)
+    {
+        if (i->second.expiry > now)
+        {
+            ++i;
+            continue;
+        }
+        clientName_t clientName = i->first;
+        i = detachedSessions.erase(i);
+        replicateFrame(REPLICA_SESSION_REMOVE, clientName);
+        sessionTokens.erase(clientName);
+        sendersToMessageIDs.erase(clientName);
+        removeClientFromGroups(clientName);
+        broadcastPeerFrame(std::string(PEER_PRESENCE_REMOVE) + WHITE_SPACE_DELIM
+                           + clientName);
+        std::cout << clientName << EXPIRED_MSG_SUFFIX << std::endl;
+    }
+    if (!detachedSessions.empty())
+    {
+        scheduleResumeTimer();
+    }
+}
+
+
+/*-----=  Rate Limiting Functions  =-----*/
+
+
+/**
+ * @brief Refill the given token buckets according to the time passed since
+ *        the last refill. A bucket holds at most a single second of tokens.
+ * @param bucket The buckets to refill.
+ * @param now The current time.
+ */
+static void refillBucket(TokenBucket &bucket, const timePoint_t now)
+{
+    double elapsed = std::chrono::duration<double>(now - bucket.lastRefill)
+                     .count();
+    bucket.lastRefill = now;
+    if (messageRate != UNLIMITED_RATE)
+    {
+        bucket.messageTokens = std::min((double) messageRate,
+                                        bucket.messageTokens
+                                        + elapsed * messageRate);
+    }
+    if (byteRate != UNLIMITED_RATE)
+    {
+        bucket.byteTokens = std::min((double) byteRate,
+                                     bucket.byteTokens + elapsed * byteRate);
+    }
+    bucket.signalTokens = std::min((double) SIGNAL_RATE,
+                                   bucket.signalTokens + elapsed * SIGNAL_RATE);
+}
+
+/**
+ * @brief Gets the time until the given buckets allows another message.
+ * @param bucket The buckets to check (should be refilled by the caller).
+ * @return The delay in seconds, 0 if a message is allowed right now.
+ */
+static double bucketDelay(const TokenBucket &bucket)
+{
+    double delay = 0;
+    if (messageRate != UNLIMITED_RATE && bucket.messageTokens < 1)
+    {
+        delay = (1 - bucket.messageTokens) / messageRate;
+    }
+    if (byteRate != UNLIMITED_RATE && bucket.byteTokens <= 0)
+    {
+        // Wait until the debt is paid and a single byte is available.
+        delay = std::max(delay, (1 - bucket.byteTokens) / byteRate);
+    }
+    return delay;
+}
+
+/**
+ * @brief Consume the tokens of a single message from the given buckets.
+ *        A message larger than the byte bucket is still allowed, and the
+ *        remaining size is taken as debt from the following refills.
+ * @param bucket The buckets to consume from.
+ * @param messageSize The size in bytes of the message.
+ */
+static void consumeBucket(TokenBucket &bucket, const size_t messageSize)
+{
+    if (messageRate != UNLIMITED_RATE)
+    {
+        bucket.messageTokens--;
+    }
+    if (byteRate != UNLIMITED_RATE)
+    {
+        bucket.byteTokens -= messageSize;
+    }
+}
+
+
+/*-----=  Group Management Functions  =-----*/
+
+
+/**
+ * @brief Determine if a given client name belongs to a client of any of the
+ *        nodes, including a client which lost its connection.
+ * @param clientName The client to check.
+ * @return true if the client exists, false otherwise.
+ */
+static bool clientExists(clientName_t const clientName)
+{
+    return clientOnline(clientName) || remoteClientOnline(clientName)
+           || sessionDetached(clientName);
+}
+
+/**
+ * @brief Adds a given client to the given group. A client which is not
+ *        connected to this server is added by its name if another node owns it
+ *        or if it lost its connection and may still resume.
+ * @param clientName The client name to add.
+ * @param groupName The group name to add into.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int addSingleClientToGroup(clientName_t const clientName,
+                                  groupName_t const groupName)
+{
+    if (groupContainsClient(groupName, clientName))
+    {
+        return FAILURE_STATE;
+    }
+
+    int clientSocket = getClientSocket(clientName);
+    if (clientSocket != FAILURE_STATE)
+    {
+        groupsToClients[groupName].insert(clientSocket);
+    }
+    else if (sessionDetached(clientName))
+    {
+        groupsToDetachedClients[groupName].insert(clientName);
+    }
+    else if (getOwnerNode(clientName) != LOCAL_NODE)
+    {
+        groupsToRemoteClients[groupName].insert(clientName);
+    }
+    else
+    {
+        return FAILURE_STATE;
+    }
+    namesToGroups[clientName].insert(groupName);
+    replicateFrame(REPLICA_MEMBER_ADD, groupName, clientName);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Adds the given clients with the creator of the group to the group.
+ * @param creator The creator of the group.
+ * @param groupName The group name.
+ * @param clientsNames The clients to add to the group.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int addClientsToGroup(clientName_t const creator,
+                             groupName_t const groupName,
+                             message_t clientsNames)
+{
+    int numberOfClients = 0;
+    // Add the creator in to the group.
+    if (addSingleClientToGroup(creator, groupName))
+    {
+        return FAILURE_STATE;
+    }
+    numberOfClients++;
+
+    std::stringstream clientsStream = std::stringstream(clientsNames);
+    clientName_t currentName;
+    while (getline(clientsStream, currentName, WHITE_SPACE_DELIM))
+    {
+        if (currentName.compare(EMPTY_MSG))
+        {
+            // Check that this client is online in any of the nodes.
+            if (!clientExists(currentName))
+            {
+                return FAILURE_STATE;
+            }
+            if (addSingleClientToGroup(currentName, groupName))
+            {
+                continue;
+            }
+            // If the client was added to the group.
+            numberOfClients++;
+        }
+    }
+
+    if (numberOfClients < MIN_GROUP_SIZE)
+    {
+        return FAILURE_STATE;
+    }
+
+    return SUCCESS_STATE;
+}
+
+
+/*-----=  Server Initialization Functions  =-----*/
+
+
+/**
+ * @brief Reset the server data.
+ */
+static void resetServerData()
+{
+    clients = clientsVector();
+    groups = groupSet();
+    socketsToSlots = socketToSlotTable();
+    socketsToNames = socketToNameTable();
+    groupsToClients = groupToClient();
+    namesToSockets = nameToSocketMap();
+    namesToGroups = nameToGroupsMap();
+    socketsToBuffers = socketToBufferTable();
+    socketsToBuckets = socketToBucketTable();
+    pendingConnections = clientsVector();
+    socketsToTimers = socketToTimerTable();
+    socketsToOutput = socketToBufferTable();
+    socketsToChannels = socketToChannelTable();
+    outputSockets = std::set<int>();
+    closingConnections = clientsVector();
+    draining = false;
+    timingWheel = TimingWheel(WHEEL_SLOTS, WHEEL_TICK, currentTimeMS());
+    FD_ZERO(&readFDs);
+    nextClientIndex = 0;
+    remoteClients = nameToNodeMap();
+    groupsToRemoteClients = groupToNamesMap();
+    inboundPeers = socketToNodeMap();
+    detachedSessions = nameToSessionMap();
+    sessionTokens = nameToTokenMap();
+    groupsToDetachedClients = groupToNamesMap();
+    resumeTimer = NO_TIMER;
+    sendersToMessageIDs = nameToDedupMap();
+    signalSockets = clientsVector();
+    namesToSignals = nameToSignalMap();
+    signalingClients.clear();
+    socketsToTopics = socketToTopicsTable();
+    topics = TopicTrie();
+}
+
+/**
+ * @brief Parse a numeric value of a server option.
+ * @param value The option value to parse.
+ * @param result The variable to store the parsed value in.
+ * @return 0 if the value is a valid number, -1 otherwise.
+ */
+static int parseNumericOption(std::string const value, unsigned long &result)
+{
+    if (value.empty() || validatePortNumber(value))
+    {
+        return FAILURE_STATE;
+    }
+    try
+    {
+        result = std::stoul(value);
+    }
+    catch (const std::exception &e)
+    {
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Reads the secret shared by the linked servers from the first line of
+ *        a file, which keeps it out of the arguments any local user can list.
+ * @param path The path of the file.
+ * @return 0 if the secret was read, -1 if the file cannot be read or its first
+ *         line is empty or has a white space (which would split the frame).
+ */
+static int readSecret(std::string const &path)
+{
+    std::ifstream secretFile(path);
+    if (!std::getline(secretFile, clusterSecret) || clusterSecret.empty()
+        || clusterSecret.find_first_of(" \t\r") != std::string::npos)
+    {
+        clusterSecret.clear();
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Parse the optional arguments of the server which follow the port.
+ * @param argc The number of arguments given to the program.
+ * @param argv The array of given arguments.
+ * @return 0 if the options are valid, -1 otherwise.
+ */
+static int parseServerOptions(int const argc, char * const argv[])
+{
+    for (int i = VALID_ARGUMENTS_COUNT; i < argc; i += OPTION_ARGUMENTS_COUNT)
+    {
+        if (i + 1 >= argc)
+        {
+            return FAILURE_STATE;
+        }
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        unsigned long *target = nullptr;
+
+        if (option.compare(BIND_OPTION) == EQUAL_COMPARISON)
+        {
+            bindHosts.push_back(value);
+            continue;
+        }
+        else if (option.compare(NODE_OPTION) == EQUAL_COMPARISON)
+        {
+            FederationNode &node = nodes[LOCAL_NODE];
+            if (splitNodeAddress(value, node.host, node.port))
+            {
+                return FAILURE_STATE;
+            }
+            node.id = value;
+            continue;
+        }
+        else if (option.compare(PEER_OPTION) == EQUAL_COMPARISON)
+        {
+            FederationNode node = {value, "", "", NO_PEER_SOCKET,
+                                   NO_PEER_SOCKET, NO_TIMER};
+            if (splitNodeAddress(value, node.host, node.port)
+                || findNode(value) != NO_NODE)
+            {
+                return FAILURE_STATE;
+            }
+            nodes.push_back(node);
+            continue;
+        }
+        else if (option.compare(ADMIN_OPTION) == EQUAL_COMPARISON)
+        {
+            adminNames.insert(value);
+            continue;
+        }
+        else if (option.compare(CAPTURE_OPTION) == EQUAL_COMPARISON)
+        {
+            capturePath = value;
+            continue;
+        }
+        else if (option.compare(SECRET_FILE_OPTION) == EQUAL_COMPARISON)
+        {
+            if (readSecret(value))
+            {
+                return FAILURE_STATE;
+            }
+            continue;
+        }
+        else if (option.compare(REPLICATE_OPTION) == EQUAL_COMPARISON)
+        {
+            if (splitNodeAddress(value, primaryHost, primaryPort))
+            {
+                return FAILURE_STATE;
+            }
+            continue;
+        }
+        else if (option.compare(REPLICA_LISTEN_OPTION) == EQUAL_COMPARISON)
+        {
+            std::string port;
+            if (splitNodeAddress(value, replicaListenHost, port)
+                || parseNumericOption(port, replicaListenPort))
+            {
+                return FAILURE_STATE;
+            }
+            continue;
+        }
+        else if (option.compare(UNIX_OPTION) == EQUAL_COMPARISON)
+        {
+            if (!isUnixSocketPath(value))
+            {
+                return FAILURE_STATE;
+            }
+            unixPaths.push_back(value);
+            continue;
+        }
+        else if (option.compare(MESSAGE_RATE_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &messageRate;
+        }
+        else if (option.compare(BYTE_RATE_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &byteRate;
+        }
+        else if (option.compare(MESSAGE_BUDGET_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &messageBudget;
+        }
+        else if (option.compare(HEARTBEAT_INTERVAL_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &heartbeatInterval;
+        }
+        else if (option.compare(IDLE_TIMEOUT_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &idleTimeout;
+        }
+        else if (option.compare(HANDSHAKE_TIMEOUT_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &handshakeTimeout;
+        }
+        else if (option.compare(DRAIN_TIMEOUT_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &drainTimeout;
+        }
+        else if (option.compare(RESUME_GRACE_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &resumeGrace;
+        }
+        else if (option.compare(TRACE_SAMPLE_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &traceSample;
+        }
+        else if (option.compare(SIGNAL_PORT_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &signalPort;
+        }
+        else if (option.compare(INHERIT_OPTION) == EQUAL_COMPARISON)
+        {
+            target = &inheritSocket;
+        }
+        else
+        {
+            return FAILURE_STATE;
+        }
+
+        if (parseNumericOption(value, *target))
+        {
+            return FAILURE_STATE;
+        }
+    }
+
+    // A zero budget would never serve any client.
+    if (messageBudget == 0 || signalPort > USHRT_MAX)
+    {
+        return FAILURE_STATE;
+    }
+    // Peers can only link to a server which is a node itself.
+    if (nodes.size() > LOCAL_NODE + 1 && !federated())
+    {
+        return FAILURE_STATE;
+    }
+    // The links of the nodes and the replicas cannot be authenticated
+    // without a secret.
+    if ((federated() || !primaryHost.empty() || !replicaListenHost.empty())
+        && clusterSecret.empty())
+    {
+        return FAILURE_STATE;
+    }
+    // The replicas are told apart from the clients by the port they link to.
+    if (!replicaListenHost.empty()
+        && (replicaListenPort > USHRT_MAX
+            || replicaListenPort == std::stoul(argv[PORT_ARGUMENT_INDEX])))
+    {
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Checks whether the program received the desired number of arguments.
+ *        In case of invalid arguments the function output an error
+ *        message specifying the correct usage.
+ * @param argc The number of arguments given to the program.
+ * @param argv The array of given arguments.
+ * @return 0 if the arguments are valid, -1 otherwise.
+ */
+static int checkServerArguments(int const argc, char * const argv[])
+{
+    // Check valid number of arguments.
+    if (argc < VALID_ARGUMENTS_COUNT)
+    {
+        return FAILURE_STATE;
+    }
+
+    // Check valid port number.
+    if (validatePortNumber(argv[PORT_ARGUMENT_INDEX]))
+    {
+        return FAILURE_STATE;
+    }
+
+    // Check the optional arguments.
+    if (parseServerOptions(argc, argv))
+    {
+        return FAILURE_STATE;
+    }
+
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Creates a listening socket bound to the given address. A datagram
+ *        socket does not listen, and is read without blocking instead.
+ * @param family The address family of the socket.
+ * @param type The type of the socket (SOCK_STREAM or SOCK_DGRAM).
+ * @param address The address to bind to.
+ * @param addressLength The length of the given address.
+ * @return The socket ID of the listening socket upon success, -1 on failure.
+ */
+static int createListenSocket(const int family, const int type,
+                              const sockaddr *address,
+                              const socklen_t addressLength)
+{
+    // Create Socket.
+    int socketID = socket(family, type, 0);
+    if (socketID < SOCKET_ID_BOUND)
+    {
+        systemCallError(SOCKET_NAME, errno);
+        return FAILURE_STATE;
+    }
+
+    int enable = 1;
+    if (family != AF_UNIX
+        && setsockopt(socketID, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)))
+    {
+        systemCallError(SETSOCKOPT_NAME, errno);
+    }
+    // The IPv6 socket should not take the IPv4 addresses of the IPv4 socket.
+    if (family == AF_INET6
+        && setsockopt(socketID, IPPROTO_IPV6, IPV6_V6ONLY, &enable, sizeof(int)))
+    {
+        systemCallError(SETSOCKOPT_NAME, errno);
+    }
+
+    if (bind(socketID, address, addressLength))
+    {
+        systemCallError(BIND_NAME, errno);
+        if (close(socketID))
+        {
+            systemCallError(CLOSE_NAME, errno);
+        }
+        return FAILURE_STATE;
+    }
+
+    if (type == SOCK_DGRAM)
+    {
+        if (setNonBlocking(socketID))
+        {
+            close(socketID);
+            return FAILURE_STATE;
+        }
+        return socketID;
+    }
+
+    // Listen.
+    if (listen(socketID, MAX_PENDING_CONNECTIONS))
+    {
+        systemCallError(LISTEN_NAME, errno);
+        close(socketID);
+        return FAILURE_STATE;
+    }
+
+    return socketID;
+}
+
+/**
+ * @brief Creates the TCP listeners (or the UDP sockets) of the given host and
+ *        port number. Every address of the host is bound, so a wildcard host
+ *        listens on both the IPv4 and the IPv6 wildcard addresses.
+ * @param host The host to bind, nullptr for the wildcard addresses.
+ * @param portNumber The given port number of the server.
+ * @param type The type of the sockets (SOCK_STREAM or SOCK_DGRAM).
+ * @param sockets The vector to add the sockets into.
+ * @return The number of sockets created, -1 on failure.
+ */
+static int establishInet(const char *host, const portNumber_t portNumber,
+                         const int type, clientsVector &sockets)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo *addresses = nullptr;
+    std::string port = std::to_string(portNumber);
+    int error = getaddrinfo(host, port.c_str(), &hints, &addresses);
+    if (error)
+    {
+        addressInfoError(error);
+        return FAILURE_STATE;
+    }
+
+    int count = 0;
+    for (addrinfo *i = addresses; i != nullptr; i = i->ai_next)
+    {
+        int socketID = createListenSocket(i->ai_family, type, i->ai_addr,
+                                          i->ai_addrlen);
+        if (socketID >= SOCKET_ID_BOUND)
+        {
+            sockets.push_back(socketID);
+            count++;
+        }
+    }
+    freeaddrinfo(addresses);
+
+    return count ? count : FAILURE_STATE;
+}
+
+/**
+ * @brief Removes the socket file in the given path, if there is one. Any other
+ *        file in the path is kept, since the path may be mistyped.
+ * @param path The path of the socket.
+ * @return 0 if the path is free, -1 (with errno set) if another file is in it
+ *         or the path can not be checked.
+ */
+static int removeSocketFile(std::string const path)
+{
+    struct stat status;
+    if (lstat(path.c_str(), &status))
+    {
+        return errno == ENOENT ? SUCCESS_STATE : FAILURE_STATE;
+    }
+    if (!S_ISSOCK(status.st_mode))
+    {
+        errno = EEXIST;
+        return FAILURE_STATE;
+    }
+    return unlink(path.c_str()) ? FAILURE_STATE : SUCCESS_STATE;
+}
+
+/**
+ * @brief Creates a Unix domain socket listener in the given path. A stale
+ *        socket file left in the path is removed, but the listener fails if
+ *        any other file is in the path.
+ * @param path The path of the socket.
+ * @return 0 upon success, -1 on failure.
+ */
+static int establishUnix(std::string const path)
+{
+    sockaddr_un sa;
+    if (setUnixSocketAddress(path, sa))
+    {
+        systemCallError(BIND_NAME, ENAMETOOLONG);
+        return FAILURE_STATE;
+    }
+    if (removeSocketFile(path))
+    {
+        systemCallError(BIND_NAME, errno);
+        return FAILURE_STATE;
+    }
+
+    int socketID = createListenSocket(AF_UNIX, SOCK_STREAM, (sockaddr *) &sa,
+                                      sizeof(sockaddr_un));
+    if (socketID < SOCKET_ID_BOUND)
+    {
+        return FAILURE_STATE;
+    }
+    listeners.push_back(socketID);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Establish connection of the server with the given port number.
+ *        This function creates the welcome sockets of the server, a TCP
+ *        listener for each bind host (or the wildcard addresses if no host
+ *        was given) and a listener for each Unix socket path. With a signal
+ *        port, a UDP socket of the signals is bound alongside every TCP
+ *        listener, and with a replica address the replicas get a listener of
+ *        their own.
+ * @param portNumber The given port number of the server.
+ * @return 0 upon success, -1 on failure.
+ */
+static int establish(const portNumber_t portNumber)
+{
+    std::vector<const char *> hosts;
+    for (auto i = bindHosts.begin(); i != bindHosts.end(); ++i)
+    {
+        hosts.push_back((*i).c_str());
+    }
+    if (hosts.empty())
+    {
+        hosts.push_back(nullptr);
+    }
+    for (const char *host : hosts)
+    {
+        if (establishInet(host, portNumber, SOCK_STREAM, listeners) < 0
+            || (signalPort != NO_SIGNAL_PORT
+                && establishInet(host, (portNumber_t) signalPort, SOCK_DGRAM,
+                                 signalSockets) < 0))
+        {
+            return FAILURE_STATE;
+        }
+    }
+
+    for (auto i = unixPaths.begin(); i != unixPaths.end(); ++i)
+    {
+        if (establishUnix(*i))
+        {
+            return FAILURE_STATE;
+        }
+    }
+
+    // The listener of the replicas is one more welcome socket.
+    if (!replicaListenHost.empty()
+        && establishInet(replicaListenHost.c_str(),
+                         (portNumber_t) replicaListenPort, SOCK_STREAM,
+                         listeners) < 0)
+    {
+        return FAILURE_STATE;
+    }
+
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Closes all the listeners and the signal sockets of the server, and
+ *        removes the socket files of the Unix listeners.
+ * @return 0 upon success, -1 on failure.
+ */
+static int closeListeners()
+{
+    int state = SUCCESS_STATE;
+    for (auto i = listeners.begin(); i != listeners.end(); ++i)
+    {
+        FD_CLR(*i, &readFDs);
+        if (close(*i))
+        {
+            systemCallError(CLOSE_NAME, errno);
+            state = FAILURE_STATE;
+        }
+    }
+    listeners.clear();
+
+    for (auto i = signalSockets.begin(); i != signalSockets.end(); ++i)
+    {
+        FD_CLR(*i, &readFDs);
+        if (close(*i))
+        {
+            systemCallError(CLOSE_NAME, errno);
+            state = FAILURE_STATE;
+        }
+    }
+    signalSockets.clear();
+    namesToSignals.clear();
+    signalingClients.clear();
+
+    for (auto i = unixPaths.begin(); i != unixPaths.end(); ++i)
+    {
+        removeSocketFile(*i);
+    }
+    return state;
+}
+
+
+/*-----=  Replication Functions  =-----*/
+
+
+/**
+ * @brief Determine if this server is the replica of a primary server.
+ * @return true if the link to the primary is open, false otherwise.
+ */
+static bool replicating()
+{
+    return replicationLink != NO_REPLICATION_LINK;
+}
+
+/**
+ * @brief Determine if a connection was accepted by the listener of the
+ *        replicas, which is the only listener on their port.
+ * @param connectionSocket The connection socket.
+ * @return true if the connection is to the port of the replicas, false
+ *         otherwise.
+ */
+static bool replicaListenerConnection(const int connectionSocket)
+{
+    sockaddr_storage address;
+    socklen_t addressLength = sizeof(sockaddr_storage);
+    if (replicaListenHost.empty()
+        || getsockname(connectionSocket, (sockaddr *) &address, &addressLength))
+    {
+        return false;
+    }
+    in_port_t port = 0;
+    if (address.ss_family == AF_INET)
+    {
+        port = ((sockaddr_in *) &address)->sin_port;
+    }
+    else if (address.ss_family == AF_INET6)
+    {
+        port = ((sockaddr_in6 *) &address)->sin6_port;
+    }
+    return ntohs(port) == replicaListenPort;
+}
+
+/**
+ * @brief Queue a snapshot of the sessions and the groups to a replica. The
+ *        output of the replica is kept, so a snapshot larger than the limit
+ *        of the replica output is not sent again right away.
+ * @param socket The link socket.
+ */
+static void queueReplicaSnapshot(const int socket)
+{
+    for (auto i = sessionTokens.begin(); i != sessionTokens.end(); ++i)
+    {
+        queueData(socket, createReplicaFrame(REPLICA_SESSION_ADD, i->first,
+                                             i->second));
+    }
+    for (auto i = namesToGroups.begin(); i != namesToGroups.end(); ++i)
+    {
+        for (const groupName_t &groupName : i->second)
+        {
+            queueData(socket, createReplicaFrame(REPLICA_MEMBER_ADD, groupName,
+                                                 i->first));
+        }
+    }
+    replicaSnapshots[socket] = socketsToOutput[socket].length();
+}
+
+/**
+ * @brief Adds the link of a new replica of this server. The replica starts
+ *        from a snapshot of the sessions and the groups, and is sent a frame
+ *        of every change of them from then on. The link is read only to
+ *        notice when the replica closes it.
+ * @param connectionSocket The link socket.
+ */
+static void addReplica(const int connectionSocket)
+{
+    setConnectionKind(connectionSocket, REPLICA_CONNECTION);
+    replicas.push_back(connectionSocket);
+    FD_SET(connectionSocket, &readFDs);
+    queueReplicaSnapshot(connectionSocket);
+    std::cout << REPLICA_LINKED_MSG << std::endl;
+}
+
+/**
+ * @brief Resynchronizes a replica which fell too far behind. Its queued frames
+ *        are dropped, but for the one it has started to read, and it is sent
+ *        a reset and a new snapshot over the same link. Closing the link
+ *        instead would make the replica take over as the primary.
+ * @param socket The link socket.
+ */
+static void resyncReplica(const int socket)
+{
+    message_t &output = socketsToOutput[socket];
+    output.erase(output.find(MSG_TERMINATOR) + 1);
+    queueData(socket, REPLICA_RESET);
+    queueReplicaSnapshot(socket);
+    std::cout << REPLICA_RESYNC_MSG << std::endl;
+}
+
+/**
+ * @brief Removes the link of a replica of this server.
+ * @param socket The link socket.
+ */
+static void removeReplica(const int socket)
+{
+    replicas.erase(std::remove(replicas.begin(), replicas.end(), socket),
+                   replicas.end());
+    replicaSnapshots.erase(socket);
+    FD_CLR(socket, &readFDs);
+    discardOutput(socket);
+    message_t().swap(socketsToBuffers[socket]);
+    closeConnection(socket);
+    std::cout << REPLICA_UNLINKED_MSG << std::endl;
+}
+
+/**
+ * @brief Opens the link of this replica to its primary server. The link is
+ *        connected before the server starts, so a replica never starts
+ *        without its primary.
+ * @return 0 upon success, -1 on failure.
+ */
+static int connectPrimary()
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    int error = getaddrinfo(primaryHost.c_str(), primaryPort.c_str(), &hints,
+                            &addresses);
+    if (error)
+    {
+        addressInfoError(error);
+        return FAILURE_STATE;
+    }
+
+    int socketID = FAILURE_STATE;
+    for (addrinfo *i = addresses; i != nullptr; i = i->ai_next)
+    {
+        socketID = socket(i->ai_family, SOCK_STREAM, 0);
+        if (socketID < SOCKET_ID_BOUND)
+        {
+            error = errno;
+            continue;
+        }
+        if (!connect(socketID, i->ai_addr, i->ai_addrlen))
+        {
+            break;
+        }
+        error = errno;
+        close(socketID);
+        socketID = FAILURE_STATE;
+    }
+    freeaddrinfo(addresses);
+    if (socketID < SOCKET_ID_BOUND)
+    {
+        systemCallError(CONNECT_NAME, error);
+        return FAILURE_STATE;
+    }
+    if (!selectable(socketID))
+    {
+        std::cerr << DESCRIPTOR_LIMIT_MSG << std::endl;
+        close(socketID);
+        return FAILURE_STATE;
+    }
+    setNoDelay(socketID);
+    if (setNonBlocking(socketID))
+    {
+        close(socketID);
+        return FAILURE_STATE;
+    }
+
+    openConnection(socketID);
+    setConnectionKind(socketID, REPLICA_CONNECTION);
+    replicationLink = socketID;
+    FD_SET(socketID, &readFDs);
+    queueData(socketID, std::string(REPLICA_HANDSHAKE) + WHITE_SPACE_DELIM
+                        + clusterSecret);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Starts listening on the port of a promoted replica. The old primary
+ *        may still hold the port for a moment after its link is lost (or for
+ *        as long as it runs, if it shares the host and the replica was
+ *        promoted by hand), so a failed attempt is retried with a backoff.
+ */
+static void listenPromoted()
+{
+    if (establish(serverPort))
+    {
+        closeListeners();
+        timingWheel.schedule(currentTimeMS(), promoteRetryDelay,
+                             PROMOTE_TIMER_KEY);
+        promoteRetryDelay = std::min(promoteRetryDelay * 2,
+                                     (milliseconds_t) MAX_PROMOTE_RETRY_DELAY);
+        return;
+    }
+    for (auto i = listeners.begin(); i != listeners.end(); ++i)
+    {
+        FD_SET(*i, &readFDs);
+    }
+    for (auto i = signalSockets.begin(); i != signalSockets.end(); ++i)
+    {
+        FD_SET(*i, &readFDs);
+    }
+    connectPeers();
+    std::cout << PROMOTED_MSG << std::endl;
+}
+
+/**
+ * @brief Promotes this replica to a primary server. The link to the old
+ *        primary is closed, and the server starts listening on its port. Every
+ *        replicated session is detached and may be resumed for the entire
+ *        grace period, so the clients of the old primary reconnect to this
+ *        server with their tokens and get back their groups.
+ */
+static void promoteServer()
+{
+    int link = replicationLink;
+    replicationLink = NO_REPLICATION_LINK;
+    FD_CLR(link, &readFDs);
+    discardOutput(link);
+    message_t().swap(socketsToBuffers[link]);
+    closeConnection(link);
+
+    // A member without a session (such as a client of another node) can not
+    // resume on this server.
+    nameToGroupsMap memberships = namesToGroups;
+    for (auto i = memberships.begin(); i != memberships.end(); ++i)
+    {
+        if (!sessionDetached(i->first))
+        {
+            removeClientFromGroups(i->first);
+        }
+    }
+    milliseconds_t expiry = currentTimeMS()
+                            + resumeGrace * MILLISECONDS_PER_SECOND;
+    for (auto i = detachedSessions.begin(); i != detachedSessions.end(); ++i)
+    {
+        i->second.expiry = expiry;
+    }
+    if (!detachedSessions.empty())
+    {
+        scheduleResumeTimer();
+    }
+    listenPromoted();
+}
+
+/**
+ * @brief Closes a replication link which failed. A replica whose link to its
+ *        primary is lost takes over as the primary.
+ * @param socket The link socket.
+ */
+static void closeReplicaConnection(const int socket)
+{
+    if (socket == replicationLink)
+    {
+        promoteServer();
+        return;
+    }
+    removeReplica(socket);
+}
+
+
+/*-----=  Handle Connection Functions  =-----*/
+
+
+/**
+ * @brief Get a new connection with the given socketID (will be welcome socket).
+ *        A connection which select can not watch is closed right away.
+ * @param socketID The socket to connect with.
+ * @return The new socket that the welcome socket returned from the connection.
+ */
+static int getConnection(const int socketID)
+{
+    int newSocket = accept(socketID, NULL, NULL);
+    if (newSocket < SOCKET_ID_BOUND)
+    {
+        systemCallError(ACCEPT_NAME, errno);
+        return FAILURE_STATE;
+    }
+    if (!selectable(newSocket))
+    {
+        std::cerr << DESCRIPTOR_LIMIT_MSG << std::endl;
+        close(newSocket);
+        return FAILURE_STATE;
+    }
+    return newSocket;
+}
+
+/**
+ * @brief Adds a new connection that should send its client name.
+ * @param connectionSocket The connection socket.
+ */
+static void addPendingConnection(const int connectionSocket)
+{
+    openConnection(connectionSocket);
+    setConnectionKind(connectionSocket, PENDING_CONNECTION);
+    pendingConnections.push_back(connectionSocket);
+    FD_SET(connectionSocket, &readFDs);
+
+    touchConnection(connectionSocket);
+    if (handshakeTimeout != DISABLED_TIMEOUT)
+    {
+        scheduleConnectionTimer(connectionSocket,
+                                handshakeTimeout * MILLISECONDS_PER_SECOND);
+    }
+}
+
+/**
+ * @brief Handles the server procedure on a new connection request. The new
+ *        connection waits for its client name like any other message, so a
+ *        slow connection does not hold the server.
+ * @param welcomeSocket The welcome socket (listener) of the connection.
+ */
+static void handleNewConnection(const int welcomeSocket)
+{
+    int connectionSocket = getConnection(welcomeSocket);
+    if (connectionSocket < SOCKET_ID_BOUND)
+    {
+        return;
+    }
+    setNoDelay(connectionSocket);
+    if (setNonBlocking(connectionSocket))
+    {
+        close(connectionSocket);
+        return;
+    }
+    addPendingConnection(connectionSocket);
+}
+
+/**
+ * @brief Removes a new connection from the pending connections.
+ * @param connectionSocket The connection socket.
+ */
+static void removePendingConnection(const int connectionSocket)
+{
+    pendingConnections.erase(std::remove(pendingConnections.begin(),
+                                         pendingConnections.end(),
+                                         connectionSocket),
+                             pendingConnections.end());
+    FD_CLR(connectionSocket, &readFDs);
+    setConnectionKind(connectionSocket, FREE_CONNECTION);
+    message_t().swap(socketsToBuffers[connectionSocket]);
+    cancelConnectionTimer(connectionSocket);
+}
+
+/**
+ * @brief Determine if the given socket is a pending connection.
+ * @param connectionSocket The socket to check.
+ * @return true if the socket did not complete its handshake, false otherwise.
+ */
+static bool connectionPending(const int connectionSocket)
+{
+    return connectionKind(connectionSocket) == PENDING_CONNECTION;
+}
+
+/**
+ * @brief Closes a new connection that failed before sending its name.
+ * @param connectionSocket The connection socket.
+ */
+static void closePendingConnection(const int connectionSocket)
+{
+    removePendingConnection(connectionSocket);
+    closeConnection(connectionSocket);
+}
+
+/**
+ * @brief Opens a shared memory channel for a co-located client which asked
+ *        for it over a Unix socket, and passes the channel to the client with
+ *        its descriptors. The connection stays pending until its name arrives
+ *        over the channel, and its socket is kept only to notice when the
+ *        client closes it.
+ * @param connectionSocket The connection socket.
+ * @return 0 on success, -1 on failure.
+ */
+static int openSharedChannel(const int connectionSocket)
+{
+    SharedChannel &channel = socketsToChannels[connectionSocket];
+    sockaddr_storage address;
+    socklen_t addressLength = sizeof(sockaddr_storage);
+    if (channel.open()
+        || getsockname(connectionSocket, (sockaddr *) &address, &addressLength)
+        || address.ss_family != AF_UNIX || channel.create())
+    {
+        return FAILURE_STATE;
+    }
+    if (!selectable(channel.doorbell()))
+    {
+        channel.release();
+        return FAILURE_STATE;
+    }
+
+    std::vector<int> descriptors;
+    channel.clientDescriptors(descriptors);
+    if (sendDescriptors(connectionSocket, descriptors))
+    {
+        return FAILURE_STATE;
+    }
+    FD_SET(channel.doorbell(), &readFDs);
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Adds the inbound link of another node, whose frames are read and
+ *        processed in every iteration. A new link of a node replaces its
+ *        previous one, which is only closed when the other node closes it.
+ *        A link of a node which is not one of the peers is refused.
+ * @param connectionSocket The link socket.
+ * @param nodeID The ID of the node.
+ * @param remainingInput The frames which were sent right after the ID.
+ */
+static void addInboundPeer(const int connectionSocket,
+                           std::string const nodeID,
+                           message_t const &remainingInput)
+{
+    int node = findNode(nodeID);
+    if (node == NO_NODE || node == LOCAL_NODE)
+    {
+        std::cout << NODE_MSG_PREFIX << nodeID << NODE_REFUSED_MSG_SUFFIX
+                  << std::endl;
+        closeConnection(connectionSocket);
+        return;
+    }
+    setConnectionKind(connectionSocket, PEER_CONNECTION);
+    nodes[node].inbound = connectionSocket;
+    inboundPeers[connectionSocket] = node;
+    FD_SET(connectionSocket, &readFDs);
+    socketsToBuffers[connectionSocket] = remainingInput;
+    std::cout << NODE_MSG_PREFIX << nodeID << NODE_LINKED_MSG_SUFFIX
+              << std::endl;
+}
+
+/**
+ * @brief Resumes the session of a client which reconnected with its resume
+ *        token. The client gets back its groups and the messages it missed.
+ *        A connection of the client which is still open is considered lost,
+ *        since the token proves the new connection belongs to the client.
+ * @param connectionSocket The connection socket.
+ * @param clientName The client name.
+ * @param token The resume token sent by the client.
+ * @param remainingInput The input which was sent right after the name.
+ * @return 0 if the session was resumed, -1 if the token is not valid (or the
+ *         session has expired) and the client starts a new session instead.
+ */
+static int resumeSession(const int connectionSocket,
+                         clientName_t const clientName,
+                         std::string const &token,
+                         message_t const &remainingInput)
+{
+    auto i = sessionTokens.find(clientName);
+    if (i == sessionTokens.end() || !secretsEqual(token, i->second))
+    {
+        return FAILURE_STATE;
+    }
+    int oldSocket = getClientSocket(clientName);
+    if (oldSocket != FAILURE_STATE)
+    {
+        detachClient(oldSocket);
+        discardOutput(oldSocket);
+        closeConnection(oldSocket);
+    }
+    std::deque<message_t> replay = detachedSessions[clientName].replay;
+    detachedSessions.erase(clientName);
+
+    queueState(connectionSocket, CONNECTION_RESUMED_STATE);
+    socketsToBuffers[connectionSocket] = remainingInput;
+    createNewClient(clientName, connectionSocket);
+    auto memberGroups = namesToGroups.find(clientName);
+    if (memberGroups != namesToGroups.end())
+    {
+        for (const groupName_t &groupName : memberGroups->second)
+        {
+            groupsToDetachedClients[groupName].erase(clientName);
+            groupsToClients[groupName].insert(connectionSocket);
+        }
+    }
+    issueResumeToken(connectionSocket);
+    issueSignalToken(connectionSocket);
+    for (auto j = replay.begin(); j != replay.end(); ++j)
+    {
+        queueData(connectionSocket, *j);
+    }
+    std::cout << clientName << RESUMED_MSG_SUFFIX << std::endl;
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Completes the handshake of a pending connection which has sent its
+ *        client name, and creates the client if the name is available. A name
+ *        owned by another node is redirected to that node.
+ * @param connectionSocket The connection socket.
+ * @param clientName The client name which the connection sent.
+ */
+static void completeHandshake(const int connectionSocket,
+                              clientName_t clientName)
+{
+    std::string peerPrefix = std::string(PEER_HANDSHAKE) + WHITE_SPACE_DELIM;
+    std::string replicaHandshake = std::string(REPLICA_HANDSHAKE)
+                                   + WHITE_SPACE_DELIM;
+    message_t remainingInput = socketsToBuffers[connectionSocket];
+    removePendingConnection(connectionSocket);
+
+    if (replicaListenerConnection(connectionSocket))
+    {
+        // Only a replica which sent the secret links to this port.
+        if (clientName.compare(MSG_BEGIN_INDEX, replicaHandshake.length(),
+                               replicaHandshake) != EQUAL_COMPARISON
+            || !secretsEqual(clientName.substr(replicaHandshake.length()),
+                             clusterSecret))
+        {
+            std::cout << REPLICA_REFUSED_MSG << std::endl;
+            closeConnection(connectionSocket);
+            return;
+        }
+        addReplica(connectionSocket);
+        return;
+    }
+
+    if (clientName.compare(MSG_BEGIN_INDEX, peerPrefix.length(), peerPrefix)
+        == EQUAL_COMPARISON)
+    {
+        // This is the inbound link of another node, if it sent the secret.
+        std::string handshake = clientName.substr(peerPrefix.length());
+        size_t secretStart = handshake.find(WHITE_SPACE_DELIM);
+        std::string nodeID = handshake.substr(MSG_BEGIN_INDEX, secretStart);
+        if (secretStart == std::string::npos
+            || !secretsEqual(handshake.substr(secretStart + 1), clusterSecret))
+        {
+            std::cout << NODE_MSG_PREFIX << nodeID << NODE_REFUSED_MSG_SUFFIX
+                      << std::endl;
+            closeConnection(connectionSocket);
+            return;
+        }
+        addInboundPeer(connectionSocket, nodeID, remainingInput);
+        return;
+    }
+    captureFrame(connectionSocket, clientName);
+
+    // A client which resumes its session sends its resume token after its name.
+    std::string token;
+    auto tokenStart = clientName.find(WHITE_SPACE_DELIM);
+    if (tokenStart != std::string::npos)
+    {
+        token = clientName.substr(tokenStart + 1);
+        clientName.erase(tokenStart);
+    }
+    if (validateClientName(clientName))
+    {
+        // Only a link of a server may send a line which starts with '#'.
+        queueState(connectionSocket, CONNECTION_FAIL_STATE);
+        std::cout << clientName << CONNECT_FAIL_MSG_SUFFIX << std::endl;
+        lingerConnection(connectionSocket);
+        return;
+    }
+
+    int owner = getOwnerNode(clientName);
+    if (owner != LOCAL_NODE)
+    {
+        // Send the client to the node which owns its name.
+        queueState(connectionSocket, CONNECTION_REDIRECT_STATE);
+        queueData(connectionSocket, nodes[owner].id);
+        std::cout << clientName << REDIRECT_MSG_INFIX << nodes[owner].id
+                  << std::endl;
+        lingerConnection(connectionSocket);
+        return;
+    }
+
+    if (!token.empty() && resumeSession(connectionSocket, clientName, token,
+                                        remainingInput) == SUCCESS_STATE)
+    {
+        return;
+    }
+
+    if (!checkAvailableName(clientName))
+    {
+        // Send to this client that the client name is in use.
+        queueState(connectionSocket, CONNECTION_IN_USE_STATE);
+        std::cout << clientName << CONNECT_FAIL_MSG_SUFFIX << std::endl;
+        // Close the socket stream once the state is written.
+        lingerConnection(connectionSocket);
+        return;
+    }
+
+    // Send to this client that the connection is successful.
+    queueState(connectionSocket, CONNECTION_SUCCESS_STATE);
+    socketsToBuffers[connectionSocket] = remainingInput;
+    createNewClient(clientName, connectionSocket);
+    issueResumeToken(connectionSocket);
+    issueSignalToken(connectionSocket);
+    broadcastPeerFrame(std::string(PEER_PRESENCE_ADD) + WHITE_SPACE_DELIM
+                       + clientName);
+    std::cout << clientName << CONNECT_SUCCESS_MSG_SUFFIX << std::endl;
+}
+
+/**
+ * @brief Runs the handshake of a pending connection. In our protocol, right
+ *        after the connection request there should be a message with the
+ *        client name, and a co-located client may first ask for a shared
+ *        memory channel, over which its name follows.
+ * @param connectionSocket The connection socket.
+ * @return The task of the handshake.
+ */
+static ConnectionTask runHandshake(const int connectionSocket)
+{
+    clientName_t clientName;
+    if (!co_await FrameAwaiter(socketsToBuffers, connectionSocket, clientName))
+    {
+        closePendingConnection(connectionSocket);
+        co_return;
+    }
+
+    if (clientName.compare(SHARED_MEMORY_REQUEST) == EQUAL_COMPARISON)
+    {
+        if (openSharedChannel(connectionSocket)
+            || !co_await FrameAwaiter(socketsToBuffers, connectionSocket,
+                                      clientName))
+        {
+            closePendingConnection(connectionSocket);
+            co_return;
+        }
+    }
+
+    completeHandshake(connectionSocket, clientName);
+}
+
+/**
+ * @brief Resumes the handshake of a pending connection which has new input,
+ *        and starts it on the first input of the connection. The frame of a
+ *        handshake which ended is released right away, since the coroutine
+ *        can not release it while it runs.
+ * @param connectionSocket The connection socket.
+ */
+static void resumeHandshake(const int connectionSocket)
+{
+    TraceSpan span(tracer, HANDSHAKE_SPAN, connectionSocket);
+    if (!socketsToTasks[connectionSocket].started())
+    {
+        socketsToTasks[connectionSocket] = runHandshake(connectionSocket);
+    }
+    else
+    {
+        socketsToTasks[connectionSocket].resume();
+    }
+    if (socketsToTasks[connectionSocket].done())
+    {
+        socketsToTasks[connectionSocket] = ConnectionTask();
+    }
+}
+
+/**
+ * @brief Cancels the handshake of a pending connection, which closes the
+ *        connection. The input of the connection is dropped, so the handshake
+ *        is resumed without a frame.
+ * @param connectionSocket The connection socket.
+ */
+static void cancelHandshake(const int connectionSocket)
+{
+    if (!socketsToTasks[connectionSocket].started())
+    {
+        closePendingConnection(connectionSocket);
+        return;
+    }
+    message_t().swap(socketsToBuffers[connectionSocket]);
+    resumeHandshake(connectionSocket);
+}
+
+
+/*-----=  Handle Clients Functions  =-----*/
+
+
+/**
+ * @brief Handles the client exit command.
+ * @param clientSocket The client who send the command.
+ */
+static void handleClientExitCommand(int const clientSocket)
+{
+    clientName_t clientName = socketsToNames[clientSocket];
+
+    // Remove the client from the server data.
+    removeClient(clientSocket);
+
+    // Send the client response about the log out and print a message.
+    queueState(clientSocket, LOGOUT_SUCCESS_STATE);
+    std::cout << clientName << ": " << LOGOUT_SUCCESS_MSG << std::endl;
+    lingerConnection(clientSocket);
+}
+
+/**
+ * @brief Set the server's who response according to the current state.
+ * @return The who response message.
+ */
+static message_t setWhoResponse()
+{
+    // Set the message tag.
+    message_t whoResponse = std::to_string(WHO);
+
+    // Set a new container of all the client names.
+    std::vector<clientName_t> currentClients;
+
+    // Add all the names of all clients in the server.
+    for (auto i = clients.begin(); i != clients.end(); ++i)
+    {
+        currentClients.push_back(socketsToNames[*i]);
+    }
+    for (auto i = remoteClients.begin(); i != remoteClients.end(); ++i)
+    {
+        currentClients.push_back(i->first);
+    }
+    for (auto i = detachedSessions.begin(); i != detachedSessions.end(); ++i)
+    {
+        currentClients.push_back(i->first);
+    }
+
+    // Sort and create the who response message.
+    std::sort(currentClients.begin(), currentClients.end());
+    for (auto i = currentClients.begin(); i != currentClients.end(); ++i)
+    {
+        whoResponse += *i;
+        whoResponse += (i == (--currentClients.end()) ? MSG_SUFFIX : GROUP_SEP);
+    }
+
+    return whoResponse;
+}
+
+/**
+ * @brief Handles the client who command.
+ * @param clientSocket The client who send the command.
+ */
+static void handleClientWhoCommand(int const clientSocket)
+{
+    clientName_t clientName = socketsToNames[clientSocket];
+
+    // Print an informative message to the server.
+    std::cout << clientName << ": " << WHO_REQUEST_MSG << std::endl;
+
+    // Set a response for the client.
+    message_t whoResponse = setWhoResponse();
+
+    queueData(clientSocket, whoResponse);
+}
+
+/**
+ * @brief Handles the client ping command, which is answered with the times
+ *        the ping was received and answered. The ping is not printed, so the
+ *        probe does not slow the server down.
+ * @param clientSocket The client who send the command.
+ */
+static void handleClientPingCommand(int const clientSocket)
+{
+    queueData(clientSocket, timestampFrame(PING));
+}
+
+/**
+ * @brief Handles the client create group command.
+ * @param clientSocket The client who send the command.
+ */
+static void handleClientGroupCommand(int const clientSocket,
+                                     const message_t &message)
+{
+    bool successState = false;
+    clientName_t clientName = socketsToNames[clientSocket];
+    message_t modifiedMessage = message.substr(1);  // Trim the message tag.
+
+    auto trimIndex = modifiedMessage.find(WHITE_SPACE_DELIM);
+    groupName_t groupName = modifiedMessage.substr(0, trimIndex);
+
+    // Prepare the message for clients reading by removing the group name.
+    modifiedMessage = modifiedMessage.substr(trimIndex + 1);
+
+    // Check the group name is available.
+    if (checkAvailableName(groupName))
+    {
+        // If group name is valid.
+        createNewGroup(groupName);
+        // Add each client to the group.
+        if (addClientsToGroup(clientName, groupName, modifiedMessage)
+            == SUCCESS_STATE)
+        {
+            successState = true;
+            broadcastPeerFrame(createGroupFrame(groupName));
+        }
+        else
+        {
+            // Remove the newly created group.
+            removeGroup(groupName);
+        }
+    }
+
+    message_t groupResponse = std::to_string(CREATE_GROUP);
+    if (successState)
+    {
+        // Set a response for the client.
+        groupResponse += "Group \"" + groupName + "\" was created successfully.";
+        // Print an informative message to the server.
+        std::cout << clientName << ": " << "Group \""
+                  << groupName << "\" was created successfully."
+                  << std::endl;
+    }
+    else
+    {
+        // Set a response for the client.
+        groupResponse += "ERROR: failed to create group \"" + groupName + "\".";
+        // Print an informative message to the server.
+        std::cout << clientName << ": " << "ERROR: failed to create group \""
+                  << groupName << "\"." << std::endl;
+    }
+
+    queueData(clientSocket, groupResponse);
+}
+
+/**
+ * @brief Splits the member names of a group command, which are separated by
+ *        white spaces.
+ * @param clientsNames The member names.
+ * @return The member names.
+ */
+static std::vector<clientName_t> splitClientsNames(message_t const
+                                                   &clientsNames)
+{
+    std::vector<clientName_t> names;
+    std::stringstream clientsStream = std::stringstream(clientsNames);
+    clientName_t currentName;
+    while (getline(clientsStream, currentName, WHITE_SPACE_DELIM))
+    {
+        if (currentName.compare(EMPTY_MSG))
+        {
+            names.push_back(currentName);
+        }
+    }
+    return names;
+}
+
+/**
+ * @brief Queue the response to a group membership command (or a topic
+ *        subscription), and print it.
+ * @param clientSocket The client who send the command.
+ * @param tag The tag of the command.
+ * @param response The response, which is followed by the group name.
+ * @param groupName The group name (or the topic filter).
+ */
+static void respondGroupCommand(int const clientSocket, MessageTag const tag,
+                                const char *response,
+                                groupName_t const groupName)
+{
+    message_t groupResponse = response + std::string(QUATS) + groupName
+                              + QUATS MSG_SUFFIX;
+    queueData(clientSocket, messageTag(tag) + groupResponse);
+    std::cout << socketsToNames[clientSocket] << ": " << groupResponse
+              << std::endl;
+}
+
+/**
+ * @brief Takes the group name of a group membership command.
+ * @param message The message, which is left with the member names.
+ * @return The group name.
+ */
+static groupName_t takeGroupName(message_t &message)
+{
+    message = message.substr(1);  // Trim the message tag.
+    auto trimIndex = message.find(WHITE_SPACE_DELIM);
+    groupName_t groupName = message.substr(MSG_BEGIN_INDEX, trimIndex);
+    message = (trimIndex == std::string::npos) ? EMPTY_MSG
+                                               : message.substr(trimIndex + 1);
+    return groupName;
+}
+
+/**
+ * @brief Handles the client add to group command. Only a member of a group
+ *        may add clients to it, and every added client is a single O(1)
+ *        insertion, so a large group is never rebuilt.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientAddCommand(int const clientSocket, message_t message)
+{
+    groupName_t groupName = takeGroupName(message);
+    std::vector<clientName_t> names = splitClientsNames(message);
+    bool successState = !names.empty()
+                        && groupContainsClient(groupName,
+                                               socketsToNames[clientSocket]);
+    for (auto i = names.begin(); i != names.end() && successState; ++i)
+    {
+        successState = clientExists(*i);
+    }
+
+    if (!successState)
+    {
+        respondGroupCommand(clientSocket, ADD_TO_GROUP, ADD_TO_GROUP_FAIL_MSG,
+                            groupName);
+        return;
+    }
+    message_t frame = std::string(PEER_GROUP) + WHITE_SPACE_DELIM + groupName;
+    for (auto i = names.begin(); i != names.end(); ++i)
+    {
+        // A client which is already a member is left as is.
+        if (addSingleClientToGroup(*i, groupName) == SUCCESS_STATE)
+        {
+            frame += WHITE_SPACE_DELIM + *i;
+        }
+    }
+    broadcastPeerFrame(frame);
+    respondGroupCommand(clientSocket, ADD_TO_GROUP, ADD_TO_GROUP_SUCCESS_MSG,
+                        groupName);
+}
+
+/**
+ * @brief Removes the given members from a group and tells the other nodes.
+ * @param groupName The group name.
+ * @param names The names of the members.
+ */
+static void removeClientsFromGroup(groupName_t const groupName,
+                                   std::vector<clientName_t> const &names)
+{
+    message_t frame = std::string(PEER_GROUP_LEAVE) + WHITE_SPACE_DELIM
+                      + groupName;
+    for (auto i = names.begin(); i != names.end(); ++i)
+    {
+        // The group is removed along with its last member.
+        if (groupContainsClient(groupName, *i))
+        {
+            removeClientFromGroup(*i, groupName);
+            frame += WHITE_SPACE_DELIM + *i;
+        }
+    }
+    broadcastPeerFrame(frame);
+}
+
+/**
+ * @brief Handles the client remove from group command. Only a member of a
+ *        group may remove members from it (including itself), and all the
+ *        given clients must be members.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientRemoveCommand(int const clientSocket,
+                                      message_t message)
+{
+    groupName_t groupName = takeGroupName(message);
+    std::vector<clientName_t> names = splitClientsNames(message);
+    bool successState = !names.empty()
+                        && groupContainsClient(groupName,
+                                               socketsToNames[clientSocket]);
+    for (auto i = names.begin(); i != names.end() && successState; ++i)
+    {
+        successState = groupContainsClient(groupName, *i);
+    }
+
+    if (!successState)
+    {
+        respondGroupCommand(clientSocket, REMOVE_FROM_GROUP,
+                            REMOVE_FROM_GROUP_FAIL_MSG, groupName);
+        return;
+    }
+    removeClientsFromGroup(groupName, names);
+    respondGroupCommand(clientSocket, REMOVE_FROM_GROUP,
+                        REMOVE_FROM_GROUP_SUCCESS_MSG, groupName);
+}
+
+/**
+ * @brief Handles the client leave group command.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientLeaveCommand(int const clientSocket, message_t message)
+{
+    groupName_t groupName = takeGroupName(message);
+    clientName_t clientName = socketsToNames[clientSocket];
+    if (!message.empty() || !groupContainsClient(groupName, clientName))
+    {
+        respondGroupCommand(clientSocket, LEAVE_GROUP, LEAVE_GROUP_FAIL_MSG,
+                            groupName);
+        return;
+    }
+    removeClientsFromGroup(groupName, std::vector<clientName_t>(1, clientName));
+    respondGroupCommand(clientSocket, LEAVE_GROUP, LEAVE_GROUP_SUCCESS_MSG,
+                        groupName);
+}
+
+/**
+ * @brief Creates the message a client receives from the given sender.
+ * @param senderName The sender client name.
+ * @param message The message.
+ * @return The message to deliver.
+ */
+static message_t createClientMessage(clientName_t const senderName,
+                                     message_t const &message)
+{
+    return senderName + ": " + message;
+}
+
+/**
+ * @brief Deliver a message which is already created to the receiver. A
+ *        message to a client which lost its connection is kept until it
+ *        resumes.
+ * @param receiverName The receiver client name.
+ * @param toSend The message to deliver.
+ */
+static void deliverMessage(clientName_t const receiverName,
+                           message_t const &toSend)
+{
+    int receiverSocket = getClientSocket(receiverName);
+    if (receiverSocket == FAILURE_STATE)
+    {
+        keepReplayMessage(receiverName, toSend);
+        return;
+    }
+    queueData(receiverSocket, toSend);
+}
+
+/**
+ * @brief Send a message from the sender to receiver.
+ * @param senderName The sender client name.
+ * @param receiverName The receiver client name.
+ * @param message tHe message to send.
+ */
+static void sendMessageToClient(clientName_t const senderName,
+                                clientName_t const receiverName,
+                                message_t const &message)
+{
+    deliverMessage(receiverName, createClientMessage(senderName, message));
+}
+
+/**
+ * @brief Send a message from the sender to the group members of this server.
+ * @param senderName The sender client name.
+ * @param groupName The group name.
+ * @param message tHe message to send.
+ */
+static void sendMessageToLocalMembers(clientName_t const senderName,
+                                      groupName_t const groupName,
+                                      message_t const &message)
+{
+    MemberSet &groupClients = groupsToClients[groupName];
+    // The message is created once for all the members.
+    message_t toSend = createClientMessage(senderName, message);
+
+    for (auto i = groupClients.begin(); i != groupClients.end(); ++i)
+    {
+        if (socketsToNames[*i].compare(senderName) != EQUAL_COMPARISON)
+        {
+            queueData(*i, toSend);
+        }
+    }
+
+    namesSet &detachedMembers = groupsToDetachedClients[groupName];
+    for (auto i = detachedMembers.begin(); i != detachedMembers.end(); ++i)
+    {
+        if (i->compare(senderName) != EQUAL_COMPARISON)
+        {
+            keepReplayMessage(*i, toSend);
+        }
+    }
+}
+
+/**
+ * @brief Send a message from the sender to group.
+ * @param senderName The sender client name.
+ * @param groupName The group name.
+ * @param message tHe message to send.
+ */
+static void sendMessageToGroup(clientName_t const senderName,
+                               groupName_t const groupName,
+                               message_t const &message)
+{
+    sendMessageToLocalMembers(senderName, groupName, message);
+    forwardMessageToGroup(senderName, groupName, message);
+}
+
+/**
+ * @brief Send a message from the sender to the clients of this server which
+ *        are subscribed to a filter that matches the topic. The subscribers
+ *        are matched in the topic trie, and the message is created once for
+ *        all of them.
+ * @param senderName The sender client name.
+ * @param topic The topic.
+ * @param message The message to send.
+ * @return The number of the subscribers the message was sent to.
+ */
+static size_t publishToLocalSubscribers(clientName_t const senderName,
+                                        std::string const topic,
+                                        message_t const &message)
+{
+    MemberSet recipients;
+    topics.match(topic, recipients);
+    message_t toSend = createClientMessage(senderName + TOPIC_SENDER_DELIM
+                                           + topic, message);
+
+    size_t sent = 0;
+    for (auto i = recipients.begin(); i != recipients.end(); ++i)
+    {
+        if (socketsToNames[*i].compare(senderName) != EQUAL_COMPARISON)
+        {
+            queueData(*i, toSend);
+            sent++;
+        }
+    }
+    return sent;
+}
+
+/**
+ * @brief Send a broadcast message from the sender to all the clients of this
+ *        server, including the clients which lost their connection. The
+ *        message is created once for all of them.
+ * @param senderName The sender client name.
+ * @param message The message to send.
+ * @return The number of the clients the message was sent to.
+ */
+static size_t broadcastToLocalClients(clientName_t const senderName,
+                                      message_t const &message)
+{
+    message_t toSend = createClientMessage(senderName, message);
+    size_t sent = 0;
+    for (int receiverSocket : clients)
+    {
+        if (socketsToNames[receiverSocket].compare(senderName)
+            != EQUAL_COMPARISON)
+        {
+            queueData(receiverSocket, toSend);
+            sent++;
+        }
+    }
+    for (auto i = detachedSessions.begin(); i != detachedSessions.end(); ++i)
+    {
+        keepReplayMessage(i->first, toSend);
+        sent++;
+    }
+    return sent;
+}
+
+/**
+ * @brief Takes the optional ID of a send request, and checks if a message with
+ *        the same ID was already sent by the sender within the window.
+ * @param senderName The sender client name.
+ * @param request The request without its tag, which is left without the ID.
+ * @param idHash The hash of the ID, which is 0 if the request has no ID.
+ * @return true if the request is a duplicate of a sent message, false
+ *         otherwise.
+ */
+static bool takeMessageID(clientName_t const senderName, message_t &request,
+                          uint64_t &idHash)
+{
+    idHash = 0;
+    if (request.empty() || request.front() != MESSAGE_ID_PREFIX)
+    {
+        return false;
+    }
+    auto idEnd = request.find(WHITE_SPACE_DELIM);
+    idHash = HashRing::hash(request.substr(MSG_BEGIN_INDEX, idEnd));
+    request = (idEnd == std::string::npos) ? EMPTY_MSG
+                                           : request.substr(idEnd + 1);
+    auto window = sendersToMessageIDs.find(senderName);
+    return window != sendersToMessageIDs.end()
+           && window->second.contains(idHash, currentTimeMS(),
+                                      DEDUP_WINDOW_TIMEOUT
+                                      * MILLISECONDS_PER_SECOND);
+}
+
+/**
+ * @brief Handle a send command received from the client.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientSendCommand(int const clientSocket,
+                                    const message_t &message)
+{
+    bool successState = false;
+    clientName_t senderName = socketsToNames[clientSocket];
+    message_t modifiedMessage = message.substr(1);  // Trim the message tag.
+
+    // A retried send is acknowledged again, but it is not sent twice.
+    uint64_t idHash;
+    if (takeMessageID(senderName, modifiedMessage, idHash))
+    {
+        queueData(clientSocket, std::to_string(SEND)
+                                + CLIENT_SEND_SUCCESS_MSG);
+        std::cout << senderName << DUPLICATE_MSG_SUFFIX << std::endl;
+        return;
+    }
+
+    auto trimIndex = modifiedMessage.find(WHITE_SPACE_DELIM);
+    clientName_t sendTo = modifiedMessage.substr(0, trimIndex);
+
+    // Prepare the message for clients reading by removing the group name.
+    modifiedMessage = modifiedMessage.substr(trimIndex + 1);
+
+    // Check the group name is available.
+    if (clientOnline(sendTo) || sessionDetached(sendTo))
+    {
+        // If client name to send is valid.
+        sendMessageToClient(senderName, sendTo, modifiedMessage);
+        successState = true;
+
+    }
+    else if (remoteClientOnline(sendTo))
+    {
+        // If the client is connected to another node.
+        successState = !forwardMessageToClient(senderName, sendTo,
+                                               modifiedMessage);
+    }
+    else if (groupOpen(sendTo))
+    {
+        // If the send request is for a valid group.
+        if (groupContainsClient(sendTo, senderName))
+        {
+            sendMessageToGroup(senderName, sendTo, modifiedMessage);
+            successState = true;
+        }
+    }
+
+    message_t sendResponse = std::to_string(SEND);
+    if (successState)
+    {
+        if (idHash != 0)
+        {
+            sendersToMessageIDs[senderName].insert(idHash, currentTimeMS());
+        }
+        // Set a response for the client.
+        sendResponse += CLIENT_SEND_SUCCESS_MSG;
+        // Print an informative message to the server.
+        std::cout << senderName << ": \"" << modifiedMessage
+                  << "\" was sent successfully to " << sendTo
+                  << "." << std::endl;
+    }
+    else
+    {
+        // Set a response for the client.
+        sendResponse += CLIENT_SEND_FAIL_MSG;
+        // Print an informative message to the server.
+        std::cout << senderName << ": ERROR: failed to send \""
+                  << modifiedMessage << "\" to " << sendTo << "." << std::endl;
+    }
+
+    queueData(clientSocket, sendResponse);
+}
+
+/**
+ * @brief Handle a multi send command received from the client, which sends a
+ *        single message to several clients. The receivers are resolved once,
+ *        the message is created once for all of them, and the client gets a
+ *        single response with the receivers the message failed to reach.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientMultiSendCommand(int const clientSocket,
+                                         const message_t &message)
+{
+    clientName_t senderName = socketsToNames[clientSocket];
+    message_t modifiedMessage = message.substr(1);  // Trim the message tag.
+
+    // A retried send is acknowledged again, but it is not sent twice.
+    uint64_t idHash;
+    if (takeMessageID(senderName, modifiedMessage, idHash))
+    {
+        queueData(clientSocket, messageTag(MULTI_SEND)
+                                + CLIENT_SEND_SUCCESS_MSG);
+        std::cout << senderName << DUPLICATE_MSG_SUFFIX << std::endl;
+        return;
+    }
+
+    auto trimIndex = modifiedMessage.find(WHITE_SPACE_DELIM);
+    message_t receivers = modifiedMessage.substr(MSG_BEGIN_INDEX, trimIndex);
+    modifiedMessage = (trimIndex == std::string::npos) ?
+                      EMPTY_MSG : modifiedMessage.substr(trimIndex + 1);
+    message_t toSend = createClientMessage(senderName, modifiedMessage);
+
+    namesSet resolved;
+    std::vector<clientName_t> failed;
+    size_t sent = 0;
+    std::stringstream receiversStream = std::stringstream(receivers);
+    clientName_t receiverName;
+    while (getline(receiversStream, receiverName, GROUP_CLIENTS_DELIM))
+    {
+        if (receiverName.empty() || !resolved.insert(receiverName).second)
+        {
+            continue;
+        }
+        if (receiverName.compare(senderName) != EQUAL_COMPARISON
+            && (clientOnline(receiverName) || sessionDetached(receiverName)))
+        {
+            deliverMessage(receiverName, toSend);
+            sent++;
+        }
+        else if (remoteClientOnline(receiverName)
+                 && !forwardMessageToClient(senderName, receiverName,
+                                            modifiedMessage))
+        {
+            sent++;
+        }
+        else
+        {
+            failed.push_back(receiverName);
+        }
+    }
+
+    if (sent > 0 && idHash != 0)
+    {
+        sendersToMessageIDs[senderName].insert(idHash, currentTimeMS());
+    }
+    if (failed.empty() && sent > 0)
+    {
+        queueData(clientSocket, messageTag(MULTI_SEND)
+                                + CLIENT_SEND_SUCCESS_MSG);
+        std::cout << senderName << ": \"" << modifiedMessage
+                  << "\" was sent successfully to " << sent << " clients."
+                  << std::endl;
+        return;
+    }
+
+    if (failed.empty())
+    {
+        // There were no receivers at all.
+        queueData(clientSocket, messageTag(MULTI_SEND) + CLIENT_SEND_FAIL_MSG);
+        return;
+    }
+    message_t failedNames = failed.front();
+    for (auto i = failed.begin() + 1; i != failed.end(); ++i)
+    {
+        failedNames += GROUP_CLIENTS_DELIM + *i;
+    }
+    queueData(clientSocket, messageTag(MULTI_SEND) + MULTI_SEND_FAIL_MSG
+                            + failedNames + MSG_SUFFIX);
+    std::cout << senderName << ": ERROR: failed to send \"" << modifiedMessage
+              << "\" to " << failedNames << " (sent to " << sent
+              << " clients)." << std::endl;
+}
+
+/**
+ * @brief Determine if a client is an admin. The name of a client is only what
+ *        it claimed in its handshake, so an admin must also be connected over
+ *        a Unix socket from a process of the user the server runs as.
+ * @param clientSocket The client socket.
+ * @return true if the client is an admin, false otherwise.
+ */
+static bool adminClient(int const clientSocket)
+{
+    if (adminNames.find(socketsToNames[clientSocket]) == adminNames.end())
+    {
+        return false;
+    }
+    sockaddr_storage address;
+    socklen_t addressLength = sizeof(sockaddr_storage);
+    ucred credentials;
+    socklen_t credentialsLength = sizeof(ucred);
+    return !getsockname(clientSocket, (sockaddr *) &address, &addressLength)
+           && address.ss_family == AF_UNIX
+           && !getsockopt(clientSocket, SOL_SOCKET, SO_PEERCRED, &credentials,
+                          &credentialsLength)
+           && credentials.uid == geteuid();
+}
+
+/**
+ * @brief Handle a broadcast command received from an admin client, which
+ *        sends a single message to all the clients of all the nodes, including
+ *        the clients which lost their connection. The message is created once
+ *        for all the clients of this server, and sent once to every other
+ *        node, which sends it to its own clients, so only the clients of this
+ *        server are counted.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientBroadcastCommand(int const clientSocket,
+                                         const message_t &message)
+{
+    clientName_t senderName = socketsToNames[clientSocket];
+    message_t modifiedMessage = message.substr(1);  // Trim the message tag.
+
+    uint64_t idHash;
+    bool duplicate = takeMessageID(senderName, modifiedMessage, idHash);
+    // A client which is not an admin never learns if its ID was sent before.
+    if (!adminClient(clientSocket))
+    {
+        queueData(clientSocket, messageTag(BROADCAST) + BROADCAST_FAIL_MSG);
+        std::cout << senderName << ": ERROR: failed to broadcast \""
+                  << modifiedMessage << "\"." << std::endl;
+        return;
+    }
+
+    if (duplicate)
+    {
+        queueData(clientSocket, messageTag(BROADCAST)
+                                + CLIENT_SEND_SUCCESS_MSG);
+        std::cout << senderName << DUPLICATE_MSG_SUFFIX << std::endl;
+        return;
+    }
+
+    size_t sent = broadcastToLocalClients(senderName, modifiedMessage);
+    size_t forwarded = broadcastPeerFrame(std::string(PEER_BROADCAST)
+                                          + WHITE_SPACE_DELIM + senderName
+                                          + WHITE_SPACE_DELIM
+                                          + modifiedMessage);
+
+    if (idHash != 0)
+    {
+        sendersToMessageIDs[senderName].insert(idHash, currentTimeMS());
+    }
+    queueData(clientSocket, messageTag(BROADCAST) + CLIENT_SEND_SUCCESS_MSG);
+    std::cout << senderName << ": \"" << modifiedMessage
+              << "\" was broadcast to " << sent
+              << " clients and forwarded to " << forwarded << " nodes."
+              << std::endl;
+}
+
+/**
+ * @brief Handle a subscribe command received from the client, which
+ *        subscribes the client to a topic filter, or unsubscribes it from one
+ *        it is subscribed to, by the mark of the filter. A subscription which
+ *        the client already has is left as is.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientSubscribeCommand(int const clientSocket,
+                                         const message_t &message)
+{
+    // Trim the message tag and the mark.
+    std::string filter = message.length() > 1 ? message.substr(2) : EMPTY_MSG;
+    std::set<std::string> &filters = socketsToTopics[clientSocket];
+    if (message.length() > 1 && message[1] == SUBSCRIBE_MARK)
+    {
+        if (validateTopic(filter, true))
+        {
+            respondGroupCommand(clientSocket, SUBSCRIBE, SUBSCRIBE_FAIL_MSG,
+                                filter);
+            return;
+        }
+        if (filters.insert(filter).second)
+        {
+            topics.subscribe(filter, (memberID_t) clientSocket);
+        }
+        respondGroupCommand(clientSocket, SUBSCRIBE, SUBSCRIBE_SUCCESS_MSG,
+                            filter);
+        return;
+    }
+
+    if (message.length() <= 1 || message[1] != UNSUBSCRIBE_MARK
+        || filters.erase(filter) == 0)
+    {
+        respondGroupCommand(clientSocket, SUBSCRIBE, UNSUBSCRIBE_FAIL_MSG,
+                            filter);
+        return;
+    }
+    topics.unsubscribe(filter, (memberID_t) clientSocket);
+    respondGroupCommand(clientSocket, SUBSCRIBE, UNSUBSCRIBE_SUCCESS_MSG,
+                        filter);
+}
+
+/**
+ * @brief Handle a publish command received from the client, which sends a
+ *        single message to the subscribers of a topic on all the nodes. The
+ *        publisher needs no subscription, and a topic without subscribers is
+ *        not a failure.
+ * @param clientSocket The client who send the command.
+ * @param message The message contains the command data.
+ */
+static void handleClientPublishCommand(int const clientSocket,
+                                       const message_t &message)
+{
+    clientName_t senderName = socketsToNames[clientSocket];
+    message_t modifiedMessage = message.substr(1);  // Trim the message tag.
+
+    uint64_t idHash;
+    bool duplicate = takeMessageID(senderName, modifiedMessage, idHash);
+    auto topicEnd = modifiedMessage.find(WHITE_SPACE_DELIM);
+    std::string topic = modifiedMessage.substr(MSG_BEGIN_INDEX, topicEnd);
+    std::string quotedTopic = QUATS + topic + QUATS;
+    if (duplicate)
+    {
+        queueData(clientSocket, messageTag(PUBLISH) + PUBLISH_SUCCESS_MSG
+                                + quotedTopic + MSG_SUFFIX);
+        std::cout << senderName << DUPLICATE_MSG_SUFFIX << std::endl;
+        return;
+    }
+
+    if (topicEnd == std::string::npos || validateTopic(topic, false))
+    {
+        queueData(clientSocket, messageTag(PUBLISH) + PUBLISH_FAIL_MSG
+                                + quotedTopic + MSG_SUFFIX);
+        std::cout << senderName << ": " << PUBLISH_FAIL_MSG << quotedTopic
+                  << MSG_SUFFIX << std::endl;
+        return;
+    }
+    modifiedMessage = modifiedMessage.substr(topicEnd + 1);
+
+    size_t sent = publishToLocalSubscribers(senderName, topic,
+                                            modifiedMessage);
+    // Every node matches the topic against its own subscriptions.
+    broadcastPeerFrame(std::string(PEER_PUBLISH) + WHITE_SPACE_DELIM
+                       + senderName + WHITE_SPACE_DELIM + topic
+                       + WHITE_SPACE_DELIM + modifiedMessage);
+
+    if (idHash != 0)
+    {
+        sendersToMessageIDs[senderName].insert(idHash, currentTimeMS());
+    }
+    queueData(clientSocket, messageTag(PUBLISH) + PUBLISH_SUCCESS_MSG
+                            + quotedTopic + MSG_SUFFIX);
+    std::cout << senderName << ": \"" << modifiedMessage
+              << "\" was published to topic " << quotedTopic << " for "
+              << sent << " local subscribers." << std::endl;
+}
+
+/**
+ * @brief Gets the name of the trace span of the handler of the given message.
+ * @param message The message.
+ * @return The name of the span.
+ */
+static const char *handlerSpanName(const message_t &message)
+{
+    switch (message.front() - TAG_CHAR_BASE)
+    {
+        case CREATE_GROUP:
+            return CREATE_GROUP_COMMAND;
+
+        case SEND:
+            return SEND_COMMAND;
+
+        case MULTI_SEND:
+            return MULTI_SEND_COMMAND;
+
+        case BROADCAST:
+            return BROADCAST_COMMAND;
+
+        case WHO:
+            return WHO_COMMAND;
+
+        case ADD_TO_GROUP:
+            return ADD_TO_GROUP_COMMAND;
+
+        case REMOVE_FROM_GROUP:
+            return REMOVE_FROM_GROUP_COMMAND;
+
+        case LEAVE_GROUP:
+            return LEAVE_GROUP_COMMAND;
+
+        case CLIENT_EXIT:
+            return EXIT_COMMAND;
+
+        case PING:
+            return PING_COMMAND;
+
+        case SUBSCRIBE:
+            return SUBSCRIBE_COMMAND;
+
+        case PUBLISH:
+            return PUBLISH_COMMAND;
+
+        default:
+            return HEARTBEAT_SPAN;
+    }
+}
+
+/**
+ * @brief Process a message received in the given client socket.
+ * @param clientSocket The current client socket.
+ * @param message The message to process.
+ */
+static void processMessage(int const clientSocket, const message_t &message)
+{
+    TraceSpan span(tracer, handlerSpanName(message), clientSocket);
+    int tagChar = message.front() - TAG_CHAR_BASE;
+
+    switch (tagChar)
+    {
+        case CREATE_GROUP:
+            handleClientGroupCommand(clientSocket, message);
+            return;
+
+        case SEND:
+            handleClientSendCommand(clientSocket, message);
+            return;
+
+        case MULTI_SEND:
+            handleClientMultiSendCommand(clientSocket, message);
+            return;
+
+        case BROADCAST:
+            handleClientBroadcastCommand(clientSocket, message);
+            return;
+
+        case WHO:
+            handleClientWhoCommand(clientSocket);
+            return;
+
+        case ADD_TO_GROUP:
+            handleClientAddCommand(clientSocket, message);
+            return;
+
+        case REMOVE_FROM_GROUP:
+            handleClientRemoveCommand(clientSocket, message);
+            return;
+
+        case LEAVE_GROUP:
+            handleClientLeaveCommand(clientSocket, message);
+            return;
+
+        case CLIENT_EXIT:
+            handleClientExitCommand(clientSocket);
+            return;
+
+        case PING:
+            handleClientPingCommand(clientSocket);
+            return;
+
+        case TIMESTAMP:
+            socketsToSlots[clientSocket].stamped = true;
+            return;
+
+        case SUBSCRIBE:
+            handleClientSubscribeCommand(clientSocket, message);
+            return;
+
+        case PUBLISH:
+            handleClientPublishCommand(clientSocket, message);
+            return;
+
+        case HEARTBEAT:
+            // The activity of the client was already recorded.
+            return;
+
+        default:
+            assert(false);
+            return;
+    }
+}
+
+/**
+ * @brief Disconnects a client which closed its connection or failed. The
+ *        session of the client is kept for the grace period, unless the
+ *        server is shutting down.
+ * @param clientSocket The client socket.
+ */
+static void disconnectClient(int const clientSocket)
+{
+    if (resumeGrace != DISABLED_TIMEOUT && !draining)
+    {
+        detachClient(clientSocket);
+    }
+    else
+    {
+        removeClient(clientSocket);
+    }
+    discardOutput(clientSocket);
+    closeConnection(clientSocket);
+}
+
+/**
+ * @brief Reads the data the client has written to its shared memory channel
+ *        into the client input buffer, a chunk at a time like a socket, so a
+ *        client that keeps writing can not hold the server or grow its buffer
+ *        past the limit before it is checked. A wakeup without data is of the
+ *        socket of the client, which is never written over the channel, so the
+ *        client has closed it.
+ * @param clientSocket The client socket.
+ * @return The number of bytes read, or -1 if the client closed the connection
+ *         or corrupted the channel.
+ */
+static int receiveChannelData(int const clientSocket)
+{
+    SharedChannel &channel = socketsToChannels[clientSocket];
+    // Checked first, so the data the client wrote before it closed is read.
+    bool closed = channel.closed();
+    ssize_t count = channel.read(socketsToBuffers[clientSocket],
+                                 CLIENT_READ_CHUNK);
+    if (count < 0)
+    {
+        return FAILURE_STATE;
+    }
+    if (count > 0)
+    {
+        touchConnection(clientSocket);
+        return (int) count;
+    }
+
+    char discarded;
+    ssize_t result = read(clientSocket, &discarded, sizeof(char));
+    if (closed || result == 0 || (result < 0 && !wouldBlock()))
+    {
+        return FAILURE_STATE;
+    }
+    return INITIAL_READ_COUNT;
+}
+
+/**
+ * @brief Reads the data currently available in the given client socket into
+ *        the client input buffer. Performs a single read so a client that
+ *        keeps sending can not hold the server.
+ * @param clientSocket The client socket to read from.
+ * @return The number of bytes read (0 if there is nothing to read right now),
+ *         or -1 if the client closed the connection or in case of failure.
+ */
+static int receiveClientData(int const clientSocket)
+{
+    TraceSpan span(tracer, READ_SPAN, clientSocket);
+    if (socketsToChannels[clientSocket].open())
+    {
+        return receiveChannelData(clientSocket);
+    }
+    char currentChunk[CLIENT_READ_CHUNK];
+    ssize_t currentCount = read(clientSocket, currentChunk, CLIENT_READ_CHUNK);
+    if (currentCount < 0)
+    {
+        if (wouldBlock())
+        {
+            return INITIAL_READ_COUNT;
+        }
+        systemCallError(READ_NAME, errno);
+        return FAILURE_STATE;
+    }
+    if (currentCount == 0)
+    {
+        // The client closed the connection.
+        return FAILURE_STATE;
+    }
+    socketsToBuffers[clientSocket].append(currentChunk, (size_t) currentCount);
+    touchConnection(clientSocket);
+    return (int) currentCount;
+}
+
+/**
+ * @brief Determine if the given client has a complete message to process.
+ * @param clientSocket The client socket.
+ * @return true if a complete message is buffered, false otherwise.
+ */
+static bool clientHasMessage(int const clientSocket)
+{
+    message_t &buffer = socketsToBuffers[clientSocket];
+    return buffer.find(MSG_TERMINATOR) != std::string::npos;
+}
+
+/**
+ * @brief Process the complete messages buffered for the given client, up to
+ *        the messages budget of a single iteration and the client buckets.
+ * @param clientSocket The current client socket.
+ * @param now The current time.
+ */
+static void processClientMessages(int const clientSocket, const timePoint_t now)
+{
+    TokenBucket &bucket = socketsToBuckets[clientSocket];
+    refillBucket(bucket, now);
+
+    for (unsigned long i = 0; i < messageBudget; ++i)
+    {
+        message_t &buffer = socketsToBuffers[clientSocket];
+        auto messageEnd = buffer.find(MSG_TERMINATOR);
+        if (messageEnd == std::string::npos || bucketDelay(bucket) > 0)
+        {
+            return;
+        }
+
+        message_t message;
+        {
+            TraceSpan span(tracer, PARSE_SPAN, clientSocket);
+            message = buffer.substr(MSG_BEGIN_INDEX, messageEnd);
+            buffer.erase(MSG_BEGIN_INDEX, messageEnd + 1);
+            releaseBuffer(buffer);
+            consumeBucket(bucket, messageEnd + 1);
+        }
+
+        if (!message.empty())
+        {
+            captureFrame(clientSocket, message);
+            frameReceiveTime = timeUS(now);
+            processMessage(clientSocket, message);
+            frameReceiveTime = 0;
+        }
+        if (!clientConnected(clientSocket))
+        {
+            // The client has exited during this message.
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Handle Client requests. The clients are served in a round robin
+ *        order, starting each iteration from the next client, and each
+ *        client is limited to its budget so no client can starve the others.
+ * @param currentFDs The current FD set.
+ */
+static void handleClients(fd_set *currentFDs)
+{
+    if (clients.empty())
+    {
+        return;
+    }
+
+    // Take a rotated copy of the handles since clients may be removed (and
+    // their sockets may be reused) while handled.
+    std::vector<connectionHandle_t> order;
+    order.reserve(clients.size());
+    nextClientIndex %= clients.size();
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        size_t index = (nextClientIndex + i) % clients.size();
+        order.push_back(connectionHandle(clients[index]));
+    }
+    nextClientIndex++;
+
+    timePoint_t now = std::chrono::steady_clock::now();
+    for (connectionHandle_t handle : order)
+    {
+        int clientSocket = handleSocket(handle, CLIENT_CONNECTION);
+        if (clientSocket == FAILURE_STATE)
+        {
+            continue;
+        }
+
+        if (connectionReadable(clientSocket, currentFDs))
+        {
+            if (receiveClientData(clientSocket) < 0)
+            {
+                disconnectClient(clientSocket);
+                continue;
+            }
+            if (!clientHasMessage(clientSocket)
+                && socketsToBuffers[clientSocket].size() > MAX_INPUT_BUFFER)
+            {
+                // A message that exceeds the limit is a protocol violation.
+                disconnectClient(clientSocket);
+                continue;
+            }
+        }
+
+        processClientMessages(clientSocket, now);
+    }
+}
+
+/**
+ * @brief Handle the pending connections which sent data, and complete the
+ *        handshake of those which have sent their client name.
+ * @param currentFDs The current FD set.
+ */
+static void handlePendingConnections(fd_set *currentFDs)
+{
+    // Take a copy since connections are removed while handled.
+    clientsVector pending = pendingConnections;
+    for (int connectionSocket : pending)
+    {
+        if (!connectionReadable(connectionSocket, currentFDs))
+        {
+            continue;
+        }
+        // The data was read, a new client should not be read in this round.
+        ignoreConnection(connectionSocket, currentFDs);
+        if (receiveClientData(connectionSocket) < 0)
+        {
+            cancelHandshake(connectionSocket);
+        }
+        else if (clientHasMessage(connectionSocket))
+        {
+            resumeHandshake(connectionSocket);
+        }
+        else if (socketsToBuffers[connectionSocket].size() > MAX_INPUT_BUFFER)
+        {
+            cancelHandshake(connectionSocket);
+        }
+    }
+}
+
+
+/*-----=  Handle Peers Functions  =-----*/
+
+
+/**
+ * @brief Takes the first field of the given peer frame.
+ * @param frame The frame, which is left with the rest of its fields.
+ * @return The first field.
+ */
+static std::string takeFrameField(message_t &frame)
+{
+    auto fieldEnd = frame.find(WHITE_SPACE_DELIM);
+    std::string field = frame.substr(MSG_BEGIN_INDEX, fieldEnd);
+    frame = (fieldEnd == std::string::npos) ? EMPTY_MSG
+                                            : frame.substr(fieldEnd + 1);
+    return field;
+}
+
+/**
+ * @brief Closes an inbound link of another node. If this is the current link
+ *        of the node, the clients of the node are removed from this server.
+ * @param socket The link socket.
+ */
+static void closeInboundPeer(const int socket)
+{
+    int node = inboundPeers[socket];
+    inboundPeers.erase(socket);
+    FD_CLR(socket, &readFDs);
+    message_t().swap(socketsToBuffers[socket]);
+    cancelConnectionTimer(socket);
+    closeConnection(socket);
+
+    if (nodes[node].inbound != socket)
+    {
+        // The link was already replaced by a newer one.
+        return;
+    }
+    nodes[node].inbound = NO_PEER_SOCKET;
+    nameToNodeMap names = remoteClients;
+    for (auto i = names.begin(); i != names.end(); ++i)
+    {
+        if (i->second == node)
+        {
+            removeRemoteClient(i->first);
+        }
+    }
+    std::cout << NODE_MSG_PREFIX << nodes[node].id << NODE_UNLINKED_MSG_SUFFIX
+              << std::endl;
+}
+
+/**
+ * @brief Handles a group frame of another node, which creates the group or
+ *        adds the given members to it.
+ * @param frame The frame fields, starting with the group name.
+ */
+static void handleGroupFrame(message_t frame)
+{
+    groupName_t groupName = takeFrameField(frame);
+    if (!groupOpen(groupName))
+    {
+        if (clientOnline(groupName) || remoteClientOnline(groupName))
+        {
+            return;
+        }
+        createNewGroup(groupName);
+    }
+    while (!frame.empty())
+    {
+        clientName_t member = takeFrameField(frame);
+        if (!member.empty())
+        {
+            addSingleClientToGroup(member, groupName);
+        }
+    }
+}
+
+/**
+ * @brief Handles a group leave frame of another node, which removes the given
+ *        members from the group.
+ * @param frame The frame fields, starting with the group name.
+ */
+static void handleGroupLeaveFrame(message_t frame)
+{
+    groupName_t groupName = takeFrameField(frame);
+    while (!frame.empty())
+    {
+        clientName_t member = takeFrameField(frame);
+        if (groupContainsClient(groupName, member))
+        {
+            removeClientFromGroup(member, groupName);
+        }
+    }
+}
+
+/**
+ * @brief Handles a single frame received from another node.
+ * @param node The node which sent the frame.
+ * @param frame The frame to handle.
+ */
+static void handlePeerFrame(const int node, message_t frame)
+{
+    std::string type = takeFrameField(frame);
+
+    if (type.compare(PEER_PRESENCE_ADD) == EQUAL_COMPARISON)
+    {
+        while (!frame.empty())
+        {
+            clientName_t name = takeFrameField(frame);
+            if (!name.empty())
+            {
+                remoteClients[name] = node;
+            }
+        }
+    }
+    else if (type.compare(PEER_PRESENCE_REMOVE) == EQUAL_COMPARISON)
+    {
+        auto i = remoteClients.find(frame);
+        if (i != remoteClients.end() && i->second == node)
+        {
+            removeRemoteClient(frame);
+        }
+    }
+    else if (type.compare(PEER_GROUP) == EQUAL_COMPARISON)
+    {
+        handleGroupFrame(frame);
+    }
+    else if (type.compare(PEER_GROUP_LEAVE) == EQUAL_COMPARISON)
+    {
+        handleGroupLeaveFrame(frame);
+    }
+    else if (type.compare(PEER_SEND) == EQUAL_COMPARISON)
+    {
+        clientName_t senderName = takeFrameField(frame);
+        clientName_t receiverName = takeFrameField(frame);
+        if (clientOnline(receiverName) || sessionDetached(receiverName))
+        {
+            sendMessageToClient(senderName, receiverName, frame);
+        }
+    }
+    else if (type.compare(PEER_GROUP_SEND) == EQUAL_COMPARISON)
+    {
+        clientName_t senderName = takeFrameField(frame);
+        groupName_t groupName = takeFrameField(frame);
+        if (groupOpen(groupName))
+        {
+            sendMessageToLocalMembers(senderName, groupName, frame);
+        }
+    }
+    else if (type.compare(PEER_PUBLISH) == EQUAL_COMPARISON)
+    {
+        clientName_t senderName = takeFrameField(frame);
+        std::string topic = takeFrameField(frame);
+        publishToLocalSubscribers(senderName, topic, frame);
+    }
+    else if (type.compare(PEER_BROADCAST) == EQUAL_COMPARISON)
+    {
+        clientName_t senderName = takeFrameField(frame);
+        broadcastToLocalClients(senderName, frame);
+    }
+}
+
+/**
+ * @brief Handle the links of the other nodes. The inbound links are read and
+ *        all of their frames are processed, and an outbound link which became
+ *        readable has failed or was closed by the other node.
+ * @param currentFDs The current FD set.
+ */
+static void handlePeers(fd_set *currentFDs)
+{
+    for (size_t i = LOCAL_NODE + 1; i < nodes.size(); ++i)
+    {
+        int socket = nodes[i].outbound;
+        if (socket == NO_PEER_SOCKET || !FD_ISSET(socket, currentFDs))
+        {
+            continue;
+        }
+        char discarded[CLIENT_READ_CHUNK];
+        ssize_t currentCount = read(socket, discarded, CLIENT_READ_CHUNK);
+        if (currentCount == 0 || (currentCount < 0 && !wouldBlock()))
+        {
+            closeOutboundPeer((int) i);
+        }
+    }
+
+    // Take a copy since links are removed while handled.
+    socketToNodeMap inbound = inboundPeers;
+    timePoint_t now = std::chrono::steady_clock::now();
+    for (auto i = inbound.begin(); i != inbound.end(); ++i)
+    {
+        int socket = i->first;
+        if (FD_ISSET(socket, currentFDs) && receiveClientData(socket) < 0)
+        {
+            closeInboundPeer(socket);
+            continue;
+        }
+
+        message_t &buffer = socketsToBuffers[socket];
+        auto frameEnd = buffer.find(MSG_TERMINATOR);
+        while (frameEnd != std::string::npos)
+        {
+            message_t frame = buffer.substr(MSG_BEGIN_INDEX, frameEnd);
+            buffer.erase(MSG_BEGIN_INDEX, frameEnd + 1);
+            TraceSpan span(tracer, PEER_SPAN, socket);
+            // The clients of this node are stamped with the time of this hop.
+            frameReceiveTime = timeUS(now);
+            handlePeerFrame(i->second, frame);
+            frameReceiveTime = 0;
+            frameEnd = buffer.find(MSG_TERMINATOR);
+        }
+    }
+}
+
+
+/*-----=  Handle Signals Functions  =-----*/
+
+
+/**
+ * @brief Forwards a signal to the given clients, except for its sender. The
+ *        clients should have signaled from a known address (the recipients
+ *        are intersected with the signaling clients by the caller). A datagram
+ *        which is not sent is dropped, since the signals are never
+ *        retransmitted.
+ * @param signal The signal to forward.
+ * @param recipients The sockets of the clients.
+ * @param senderSocket The socket of the sender.
+ */
+static void forwardSignal(const message_t &signal, const MemberSet &recipients,
+                          const int senderSocket)
+{
+    for (int clientSocket : recipients)
+    {
+        auto endpoint = namesToSignals.find(socketsToNames[clientSocket]);
+        if (clientSocket == senderSocket || endpoint == namesToSignals.end())
+        {
+            continue;
+        }
+        const SignalEndpoint &address = endpoint->second;
+        sendto(address.socket, signal.data(), signal.length(), MSG_DONTWAIT,
+               (const sockaddr *) &address.address, address.addressLength);
+    }
+}
+
+/**
+ * @brief Process a datagram of the UDP side channel, which is in the form
+ *        "<tag>name token [group]". A signal which is not authenticated by
+ *        the signal token of a connected client is ignored, and so is a signal
+ *        of a client which is not online or has used up its signal bucket
+ *        (every signal is also charged to the buckets of its messages), since
+ *        a single signal may be forwarded to many clients. A typing signal
+ *        is forwarded to the members of its group, and a presence signal to
+ *        the members of all the groups of its sender, as "<tag>name [group]".
+ * @param signalSocket The signal socket which received the datagram.
+ * @param datagram The datagram.
+ * @param address The address the datagram was sent from.
+ * @param addressLength The length of the address.
+ */
+static void processSignal(const int signalSocket, const message_t &datagram,
+                          const sockaddr_storage &address,
+                          const socklen_t addressLength)
+{
+    TraceSpan span(tracer, SIGNAL_SPAN, signalSocket);
+    clientName_t clientName;
+    std::string token;
+    groupName_t groupName;
+    std::istringstream fields(datagram.substr(1));
+    fields >> clientName >> token >> groupName;
+
+    auto endpoint = namesToSignals.find(clientName);
+    int clientSocket = getClientSocket(clientName);
+    if (endpoint == namesToSignals.end()
+        || !secretsEqual(token, endpoint->second.token)
+        || clientSocket == FAILURE_STATE)
+    {
+        return;
+    }
+    TokenBucket &bucket = socketsToBuckets[clientSocket];
+    refillBucket(bucket, std::chrono::steady_clock::now());
+    if (bucket.signalTokens < 1 || bucketDelay(bucket) > 0)
+    {
+        return;
+    }
+    bucket.signalTokens--;
+    consumeBucket(bucket, datagram.length());
+    // Every authentic signal refreshes the address of its sender.
+    endpoint->second.socket = signalSocket;
+    endpoint->second.address = address;
+    endpoint->second.addressLength = addressLength;
+    signalingClients.insert((memberID_t) clientSocket);
+
+    message_t signal = datagram.substr(0, 1) + clientName;
+    int tag = datagram.front() - TAG_CHAR_BASE;
+    if (tag == TYPING_SIGNAL && groupContainsClient(groupName, clientName))
+    {
+        signal += WHITE_SPACE_DELIM + groupName;
+        forwardSignal(signal, groupsToClients[groupName].intersection(
+                signalingClients), clientSocket);
+    }
+    else if (tag == PRESENCE_SIGNAL)
+    {
+        // A member of several groups of the sender is signaled once, and
+        // only the members which can be signaled are collected.
+        MemberSet recipients;
+        auto memberGroups = namesToGroups.find(clientName);
+        if (memberGroups == namesToGroups.end())
+        {
+            return;
+        }
+        for (const groupName_t &memberGroup : memberGroups->second)
+        {
+            recipients.unite(groupsToClients[memberGroup].intersection(
+                    signalingClients));
+        }
+        forwardSignal(signal, recipients, clientSocket);
+    }
+}
+
+/**
+ * @brief Handle the signal sockets which are ready, and read a bounded number
+ *        of datagrams from each of them without blocking.
+ * @param currentFDs The FD set of the ready sockets.
+ */
+static void handleSignals(fd_set *currentFDs)
+{
+    char datagram[MAX_SIGNAL_SIZE];
+    for (int signalSocket : signalSockets)
+    {
+        if (!FD_ISSET(signalSocket, currentFDs))
+        {
+            continue;
+        }
+        for (int i = 0; i < MAX_SIGNALS_PER_ROUND; ++i)
+        {
+            sockaddr_storage address;
+            socklen_t addressLength = sizeof(sockaddr_storage);
+            ssize_t length = recvfrom(signalSocket, datagram, MAX_SIGNAL_SIZE,
+                                      0, (sockaddr *) &address,
+                                      &addressLength);
+            if (length < 0)
+            {
+                if (errno != EINTR && !wouldBlock())
+                {
+                    systemCallError(RECVFROM_NAME, errno);
+                }
+                break;
+            }
+            if (length > 0)
+            {
+                processSignal(signalSocket, message_t(datagram, length),
+                              address, addressLength);
+            }
+        }
+    }
+}
+
+
+/*-----=  Handle Replication Functions  =-----*/
+
+
+/**
+ * @brief Handles a frame of the primary server, which applies a change of its
+ *        sessions or groups to this replica. The members are kept as detached
+ *        until the replica is promoted. A reset clears all of them, and the
+ *        primary sends a new snapshot right after it.
+ * @param frame The frame.
+ */
+static void handleReplicaFrame(message_t frame)
+{
+    std::string type = takeFrameField(frame);
+    std::string name = takeFrameField(frame);
+    if (type.compare(REPLICA_RESET) == EQUAL_COMPARISON)
+    {
+        // A new snapshot follows.
+        nameToGroupsMap memberships = namesToGroups;
+        for (auto i = memberships.begin(); i != memberships.end(); ++i)
+        {
+            removeClientFromGroups(i->first);
+        }
+        detachedSessions.clear();
+        sessionTokens.clear();
+    }
+    else if (type.compare(REPLICA_SESSION_ADD) == EQUAL_COMPARISON)
+    {
+        sessionTokens[name] = frame;
+        detachedSessions.insert({name, DetachedSession()});
+    }
+    else if (type.compare(REPLICA_SESSION_REMOVE) == EQUAL_COMPARISON)
+    {
+        detachedSessions.erase(name);
+        sessionTokens.erase(name);
+        removeClientFromGroups(name);
+    }
+    else if (type.compare(REPLICA_MEMBER_ADD) == EQUAL_COMPARISON)
+    {
+        if (!groupOpen(name))
+        {
+            createNewGroup(name);
+        }
+        groupsToDetachedClients[name].insert(frame);
+        namesToGroups[frame].insert(name);
+    }
+    else if (type.compare(REPLICA_MEMBER_REMOVE) == EQUAL_COMPARISON)
+    {
+        if (groupContainsClient(name, frame))
+        {
+            removeClientFromGroup(frame, name);
+        }
+    }
+}
+
+/**
+ * @brief Handle the replication links. The links of the replicas of this
+ *        server are read only to notice when they close, and the link of this
+ *        replica to its primary is read and all of its frames are applied.
+ *        A replica whose primary closed the link is promoted.
+ * @param currentFDs The current FD set.
+ */
+static void handleReplication(fd_set *currentFDs)
+{
+    // Take a copy since links are removed while handled.
+    clientsVector links = replicas;
+    for (int socket : links)
+    {
+        if (!FD_ISSET(socket, currentFDs))
+        {
+            continue;
+        }
+        char discarded[CLIENT_READ_CHUNK];
+        ssize_t currentCount = read(socket, discarded, CLIENT_READ_CHUNK);
+        if (currentCount == 0 || (currentCount < 0 && !wouldBlock()))
+        {
+            removeReplica(socket);
+        }
+    }
+
+    int link = replicationLink;
+    if (!replicating() || !FD_ISSET(link, currentFDs))
+    {
+        return;
+    }
+    if (receiveClientData(link) < 0)
+    {
+        promoteServer();
+        return;
+    }
+    message_t &buffer = socketsToBuffers[link];
+    auto frameEnd = buffer.find(MSG_TERMINATOR);
+    while (frameEnd != std::string::npos)
+    {
+        message_t frame = buffer.substr(MSG_BEGIN_INDEX, frameEnd);
+        buffer.erase(MSG_BEGIN_INDEX, frameEnd + 1);
+        TraceSpan span(tracer, REPLICA_SPAN, link);
+        handleReplicaFrame(frame);
+        frameEnd = buffer.find(MSG_TERMINATOR);
+    }
+    releaseBuffer(buffer);
+}
+
+
+/*-----=  Handle Output Functions  =-----*/
+
+
+/**
+ * @brief Write the queued output of all the connections which have any, as
+ *        much as their sockets accept without blocking. A client which fails
+ *        or keeps too much unread output is disconnected, and a closing
+ *        connection is closed once all of its output is written.
+ */
+static void handleOutput()
+{
+    // Take a copy since connections are removed while handled.
+    std::vector<int> sockets(outputSockets.begin(), outputSockets.end());
+    for (int socket : sockets)
+    {
+        int state;
+        {
+            TraceSpan span(tracer, WRITE_SPAN, socket);
+            state = flushOutput(socket);
+        }
+        bool closing = connectionClosing(socket);
+
+        if (connectionKind(socket) == REPLICA_CONNECTION)
+        {
+            // A slow replica is not dropped, since it would take over while
+            // this server still serves the clients, but it starts over.
+            if (state)
+            {
+                closeReplicaConnection(socket);
+            }
+            else if (socket != replicationLink
+                     && socketsToOutput[socket].length()
+                        > replicaSnapshots[socket] + MAX_REPLICA_OUTPUT)
+            {
+                resyncReplica(socket);
+            }
+            continue;
+        }
+
+        int node = getOutboundPeerNode(socket);
+        if (node != NO_NODE)
+        {
+            // A link which fails or can not keep up is opened again.
+            if (state || (hasOutput(socket) && socketsToOutput[socket].length()
+                                               > MAX_OUTPUT_BUFFER))
+            {
+                closeOutboundPeer(node);
+            }
+            continue;
+        }
+
+        if (closing && (state || !hasOutput(socket)))
+        {
+            finishConnection(socket);
+        }
+        else if (!closing && clientConnected(socket))
+        {
+            if (state)
+            {
+                disconnectClient(socket);
+            }
+            else if (socketsToOutput[socket].length() > MAX_OUTPUT_BUFFER)
+            {
+                std::cout << socketsToNames[socket] << SLOW_CLIENT_MSG_SUFFIX
+                          << std::endl;
+                disconnectClient(socket);
+            }
+        }
+    }
+}
+
+
+/*-----=  Hot Restart Functions  =-----*/
+
+
+/**
+ * @brief Appends a field to the serialized state of the server. A field is
+ *        written as its length followed by its data, so it may hold any data.
+ * @param state The serialized state.
+ * @param field The field to append.
+ */
+static void encodeField(message_t &state, const std::string &field)
+{
+    state += std::to_string(field.length());
+    state += FIELD_LENGTH_DELIM;
+    state += field;
+    state += FIELD_END;
+}
+
+/**
+ * @brief Reads the next field of the serialized state of the server.
+ * @param state The serialized state.
+ * @param position The position of the field, advanced past it.
+ * @param field The string to read the field into.
+ * @return 0 upon success, -1 if the state is malformed.
+ */
+static int decodeField(const message_t &state, size_t &position,
+                       std::string &field)
+{
+    size_t lengthEnd = state.find(FIELD_LENGTH_DELIM, position);
+    if (lengthEnd == std::string::npos || lengthEnd == position)
+    {
+        return FAILURE_STATE;
+    }
+    size_t length = 0;
+    for (size_t i = position; i < lengthEnd; ++i)
+    {
+        if (!isdigit(state[i]))
+        {
+            return FAILURE_STATE;
+        }
+        length = length * 10 + (state[i] - TAG_CHAR_BASE);
+    }
+    size_t fieldEnd = lengthEnd + 1 + length;
+    if (fieldEnd >= state.length() || state[fieldEnd] != FIELD_END)
+    {
+        return FAILURE_STATE;
+    }
+    field = state.substr(lengthEnd + 1, length);
+    position = fieldEnd + 1;
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Reads the next field of the serialized state as a count.
+ * @param state The serialized state.
+ * @param position The position of the field, advanced past it.
+ * @param count The variable to read the count into.
+ * @return 0 upon success, -1 if the state is malformed.
+ */
+static int decodeCount(const message_t &state, size_t &position,
+                       unsigned long &count)
+{
+    std::string field;
+    if (decodeField(state, position, field))
+    {
+        return FAILURE_STATE;
+    }
+    return parseNumericOption(field, count);
+}
+
+/**
+ * @brief Serializes the registry of the server (its connections, clients,
+ *        groups, the clients of the other nodes, the lost sessions, the
+ *        recent message IDs, the inbound links of the other nodes, the shared
+ *        memory channels, the signal endpoints, the links of the replicas and
+ *        the buffers of its connections), and collects the descriptors to
+ *        pass in the same order they appear in the state.
+ * @param state The string to serialize into.
+ * @param descriptors The vector to collect the descriptors into.
+ */
+static void serializeServer(message_t &state, std::vector<int> &descriptors)
+{
+    encodeField(state, std::to_string(listeners.size()));
+    for (int socket : listeners)
+    {
+        descriptors.push_back(socket);
+    }
+
+    encodeField(state, std::to_string(signalSockets.size()));
+    for (int socket : signalSockets)
+    {
+        descriptors.push_back(socket);
+    }
+
+    encodeField(state, std::to_string(pendingConnections.size()));
+    for (int socket : pendingConnections)
+    {
+        descriptors.push_back(socket);
+        encodeField(state, socketsToBuffers[socket]);
+    }
+
+    encodeField(state, std::to_string(clients.size()));
+    for (int socket : clients)
+    {
+        descriptors.push_back(socket);
+        encodeField(state, socketsToNames[socket]);
+        auto token = sessionTokens.find(socketsToNames[socket]);
+        encodeField(state, token != sessionTokens.end() ? token->second
+                                                        : std::string());
+        encodeField(state, socketsToBuffers[socket]);
+        encodeField(state, hasOutput(socket) ? socketsToOutput[socket]
+                                             : message_t());
+        encodeField(state, std::to_string(socketsToSlots[socket].stamped));
+        std::set<std::string> &filters = socketsToTopics[socket];
+        encodeField(state, std::to_string(filters.size()));
+        for (auto i = filters.begin(); i != filters.end(); ++i)
+        {
+            encodeField(state, *i);
+        }
+    }
+
+    encodeField(state, std::to_string(closingConnections.size()));
+    for (int socket : closingConnections)
+    {
+        descriptors.push_back(socket);
+        encodeField(state, socketsToOutput[socket]);
+    }
+
+    encodeField(state, std::to_string(groups.size()));
+    for (auto i = groups.begin(); i != groups.end(); ++i)
+    {
+        encodeField(state, *i);
+        MemberSet &members = groupsToClients[*i];
+        encodeField(state, std::to_string(members.size()));
+        for (int member : members)
+        {
+            encodeField(state, socketsToNames[member]);
+        }
+        namesSet &remoteMembers = groupsToRemoteClients[*i];
+        encodeField(state, std::to_string(remoteMembers.size()));
+        for (auto j = remoteMembers.begin(); j != remoteMembers.end(); ++j)
+        {
+            encodeField(state, *j);
+        }
+        namesSet &detachedMembers = groupsToDetachedClients[*i];
+        encodeField(state, std::to_string(detachedMembers.size()));
+        for (auto j = detachedMembers.begin(); j != detachedMembers.end(); ++j)
+        {
+            encodeField(state, *j);
+        }
+    }
+
+    encodeField(state, std::to_string(remoteClients.size()));
+    for (auto i = remoteClients.begin(); i != remoteClients.end(); ++i)
+    {
+        encodeField(state, i->first);
+        encodeField(state, nodes[i->second].id);
+    }
+
+    encodeField(state, std::to_string(detachedSessions.size()));
+    for (auto i = detachedSessions.begin(); i != detachedSessions.end(); ++i)
+    {
+        encodeField(state, i->first);
+        encodeField(state, sessionTokens[i->first]);
+        encodeField(state, std::to_string(i->second.expiry));
+        encodeField(state, std::to_string(i->second.replay.size()));
+        for (auto j = i->second.replay.begin(); j != i->second.replay.end();
+             ++j)
+        {
+            encodeField(state, *j);
+        }
+    }
+
+    encodeField(state, std::to_string(sendersToMessageIDs.size()));
+    for (auto i = sendersToMessageIDs.begin(); i != sendersToMessageIDs.end();
+         ++i)
+    {
+        encodeField(state, i->first);
+        encodeField(state, std::to_string(i->second.size()));
+        for (size_t j = 0; j < i->second.size(); ++j)
+        {
+            uint64_t idHash;
+            uint64_t time;
+            i->second.at(j, idHash, time);
+            encodeField(state, std::to_string(idHash));
+            encodeField(state, std::to_string(time));
+        }
+    }
+
+    encodeField(state, std::to_string(inboundPeers.size()));
+    for (auto i = inboundPeers.begin(); i != inboundPeers.end(); ++i)
+    {
+        descriptors.push_back(i->first);
+        encodeField(state, nodes[i->second].id);
+        encodeField(state, socketsToBuffers[i->first]);
+    }
+
+    // The channels follow every socket, and refer to the index of theirs.
+    std::vector<int> channelSockets;
+    for (size_t socket = 0; socket < socketsToChannels.size(); ++socket)
+    {
+        if (socketsToChannels[socket].open())
+        {
+            channelSockets.push_back((int) socket);
+        }
+    }
+    encodeField(state, std::to_string(channelSockets.size()));
+    for (int socket : channelSockets)
+    {
+        auto index = std::find(descriptors.begin(), descriptors.end(), socket);
+        encodeField(state, std::to_string(index - descriptors.begin()));
+        socketsToChannels[socket].serverDescriptors(descriptors);
+    }
+
+    // An endpoint refers to the index of its signal socket, and its address is
+    // empty until the client signals.
+    encodeField(state, std::to_string(namesToSignals.size()));
+    for (auto i = namesToSignals.begin(); i != namesToSignals.end(); ++i)
+    {
+        const SignalEndpoint &endpoint = i->second;
+        auto index = std::find(signalSockets.begin(), signalSockets.end(),
+                               endpoint.socket);
+        encodeField(state, i->first);
+        encodeField(state, endpoint.token);
+        encodeField(state, std::to_string(index - signalSockets.begin()));
+        encodeField(state, std::string((const char *) &endpoint.address,
+                                       endpoint.addressLength));
+    }
+
+    encodeField(state, std::to_string(replicas.size()));
+    for (int socket : replicas)
+    {
+        descriptors.push_back(socket);
+        encodeField(state, hasOutput(socket) ? socketsToOutput[socket]
+                                             : message_t());
+    }
+}
+
+/**
+ * @brief Takes the next descriptor passed by an old server. The counts of the
+ *        descriptors come from its state, so a truncated state or a short
+ *        batch of descriptors fails the takeover instead of aborting it.
+ * @param descriptors The passed descriptors.
+ * @param descriptor The index of the next descriptor, which is advanced.
+ * @param socket The descriptor to set.
+ * @return 0 upon success, -1 if there are no more descriptors.
+ */
+static int takeDescriptor(const std::vector<int> &descriptors,
+                          size_t &descriptor, int &socket)
+{
+    if (descriptor >= descriptors.size())
+    {
+        return FAILURE_STATE;
+    }
+    socket = descriptors[descriptor++];
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Restores the registry serialized by an old server, with the
+ *        descriptors it has passed.
+ * @param state The serialized state.
+ * @param descriptors The passed descriptors.
+ * @return 0 upon success, -1 if the state is malformed.
+ */
+static int restoreRegistry(const message_t &state,
+                           const std::vector<int> &descriptors)
+{
+    size_t position = MSG_BEGIN_INDEX;
+    size_t descriptor = 0;
+    unsigned long count = 0;
+    std::string field;
+
+    if (decodeCount(state, position, count))
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        int socket = NO_DESCRIPTOR;
+        if (takeDescriptor(descriptors, descriptor, socket))
+        {
+            return FAILURE_STATE;
+        }
+        listeners.push_back(socket);
+        FD_SET(socket, &readFDs);
+    }
+
+    if (decodeCount(state, position, count))
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        int socket = NO_DESCRIPTOR;
+        if (takeDescriptor(descriptors, descriptor, socket))
+        {
+            return FAILURE_STATE;
+        }
+        signalSockets.push_back(socket);
+        FD_SET(socket, &readFDs);
+    }
+
+    if (decodeCount(state, position, count))
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        int socket = NO_DESCRIPTOR;
+        if (takeDescriptor(descriptors, descriptor, socket))
+        {
+            return FAILURE_STATE;
+        }
+        if (decodeField(state, position, field))
+        {
+            return FAILURE_STATE;
+        }
+        addPendingConnection(socket);
+        socketsToBuffers[socket] = field;
+    }
+
+    if (decodeCount(state, position, count))
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        int socket = NO_DESCRIPTOR;
+        if (takeDescriptor(descriptors, descriptor, socket))
+        {
+            return FAILURE_STATE;
+        }
+        clientName_t name;
+        std::string token;
+        std::string stamped;
+        unsigned long filtersCount = 0;
+        openConnection(socket);
+        if (decodeField(state, position, name)
+            || decodeField(state, position, token)
+            || decodeField(state, position, socketsToBuffers[socket])
+            || decodeField(state, position, field)
+            || decodeField(state, position, stamped)
+            || decodeCount(state, position, filtersCount))
+        {
+            return FAILURE_STATE;
+        }
+        createNewClient(name, socket);
+        socketsToSlots[socket].stamped = stamped.compare(std::to_string(true))
+                                         == EQUAL_COMPARISON;
+        for (unsigned long j = 0; j < filtersCount; ++j)
+        {
+            std::string filter;
+            if (decodeField(state, position, filter))
+            {
+                return FAILURE_STATE;
+            }
+            socketsToTopics[socket].insert(filter);
+            topics.subscribe(filter, (memberID_t) socket);
+        }
+        if (!token.empty())
+        {
+            sessionTokens[name] = token;
+        }
+        if (!field.empty())
+        {
+            socketsToOutput[socket] = field;
+            outputSockets.insert(socket);
+        }
+    }
+
+    if (decodeCount(state, position, count))
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        int socket = NO_DESCRIPTOR;
+        if (takeDescriptor(descriptors, descriptor, socket))
+        {
+            return FAILURE_STATE;
+        }
+        if (decodeField(state, position, field))
+        {
+            return FAILURE_STATE;
+        }
+        openConnection(socket);
+        socketsToOutput[socket] = field;
+        outputSockets.insert(socket);
+        lingerConnection(socket);
+    }
+
+    if (decodeCount(state, position, count))
     {
-        systemCallError(GETHOSTBYNAME_NAME, errno);
         return FAILURE_STATE;
     }
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        groupName_t groupName;
+        unsigned long membersCount = 0;
+        if (decodeField(state, position, groupName)
+            || decodeCount(state, position, membersCount))
+        {
+            return FAILURE_STATE;
+        }
+        createNewGroup(groupName);
+        for (unsigned long j = 0; j < membersCount; ++j)
+        {
+            if (decodeField(state, position, field))
+            {
+                return FAILURE_STATE;
+            }
+            groupsToClients[groupName].insert(getClientSocket(field));
+            namesToGroups[field].insert(groupName);
+        }
+        if (decodeCount(state, position, membersCount))
+        {
+            return FAILURE_STATE;
+        }
+        for (unsigned long j = 0; j < membersCount; ++j)
+        {
+            if (decodeField(state, position, field))
+            {
+                return FAILURE_STATE;
+            }
+            groupsToRemoteClients[groupName].insert(field);
+            namesToGroups[field].insert(groupName);
+        }
+        if (decodeCount(state, position, membersCount))
+        {
+            return FAILURE_STATE;
+        }
+        for (unsigned long j = 0; j < membersCount; ++j)
+        {
+            if (decodeField(state, position, field))
+            {
+                return FAILURE_STATE;
+            }
+            groupsToDetachedClients[groupName].insert(field);
+            namesToGroups[field].insert(groupName);
+        }
+    }
 
-    // Socket Address initialization.
-    sockaddr_in sa;
-    memset(&sa, 0, sizeof(sockaddr_in));
-    sa.sin_family = (sa_family_t) pHostent->h_addrtype;
-    memcpy(&sa.sin_addr, pHostent->h_addr, (size_t) pHostent->h_length);
-    sa.sin_port = htons(portNumber);
-
-//    std::cout << inet_ntoa(*((in_addr *)pHostent->h_addr)) << std::endl;
-
-    // Create Socket.
-    int socketID = socket(AF_INET, SOCK_STREAM, 0);
-    if (socketID < SOCKET_ID_BOUND)
+    if (decodeCount(state, position, count))
     {
-        systemCallError(SOCKET_NAME, errno);
         return FAILURE_STATE;
     }
-    if (bind(socketID, (sockaddr *) &sa, sizeof(sockaddr_in)))
+    for (unsigned long i = 0; i < count; ++i)
     {
-        if (close(socketID))
+        clientName_t name;
+        if (decodeField(state, position, name)
+            || decodeField(state, position, field))
         {
-            systemCallError(CLOSE_NAME, errno);
             return FAILURE_STATE;
         }
-        systemCallError(BIND_NAME, errno);
-        return FAILURE_STATE;
+        int node = findNode(field);
+        if (node != NO_NODE)
+        {
+            remoteClients[name] = node;
+        }
     }
 
-    // Listen.
-    if (listen(socketID, MAX_PENDING_CONNECTIONS))
+    if (decodeCount(state, position, count))
     {
-        systemCallError(LISTEN_NAME, errno);
         return FAILURE_STATE;
     }
-
-    return socketID;
-}
-
-
-/*-----=  Handle Input Functions  =-----*/
-
-
-/**
- * @brief Perform the actions required when terminating the server.
- */
-static void terminateServer(const int welcomeSocket)
-{
-    for (auto i = clients.begin(); i != clients.end(); ++i)
+    for (unsigned long i = 0; i < count; ++i)
     {
-        // Write to each client that the server is terminating.
-        message_t serverExit = std::to_string(SERVER_EXIT);
-        writeData(*i, serverExit);
+        clientName_t name;
+        unsigned long expiry = 0;
+        unsigned long replayCount = 0;
+        if (decodeField(state, position, name)
+            || decodeField(state, position, sessionTokens[name])
+            || decodeCount(state, position, expiry)
+            || decodeCount(state, position, replayCount))
+        {
+            return FAILURE_STATE;
+        }
+        // The expiry is kept as is, since the server clock is monotonic.
+        DetachedSession &session = detachedSessions[name];
+        session.expiry = expiry;
+        for (unsigned long j = 0; j < replayCount; ++j)
+        {
+            if (decodeField(state, position, field))
+            {
+                return FAILURE_STATE;
+            }
+            session.replay.push_back(field);
+        }
+        scheduleResumeTimer();
     }
 
-    // Terminate the server.
-    if (close(welcomeSocket))
+    if (decodeCount(state, position, count))
     {
-        systemCallError(CLOSE_NAME, errno);
-        exit(EXIT_FAILURE);
+        return FAILURE_STATE;
     }
-    std::cout << SERVER_EXIT_MSG;
-    exit(EXIT_SUCCESS);
-}
-
-/**
- * @brief Handles the server procedure in case of receiving input from the user.
- */
-static void handleServerInput(const int welcomeSocket)
-{
-    message_t currentInput;
-    std::getline(std::cin, currentInput);
-
-    if (currentInput.compare(SERVER_EXIT_COMMAND) == EQUAL_COMPARISON)
+    for (unsigned long i = 0; i < count; ++i)
     {
-        // If the server received the EXIT command, it should terminate.
-        terminateServer(welcomeSocket);
+        clientName_t name;
+        unsigned long idsCount = 0;
+        if (decodeField(state, position, name)
+            || decodeCount(state, position, idsCount))
+        {
+            return FAILURE_STATE;
+        }
+        DedupWindow &window = sendersToMessageIDs[name];
+        for (unsigned long j = 0; j < idsCount; ++j)
+        {
+            unsigned long idHash = 0;
+            unsigned long time = 0;
+            if (decodeCount(state, position, idHash)
+                || decodeCount(state, position, time))
+            {
+                return FAILURE_STATE;
+            }
+            window.insert(idHash, time);
+        }
     }
-}
-
-
-/*-----=  Handle Connection Functions  =-----*/
-
 
-/**
- * @brief Get a new connection with the given socketID (will be welcome socket).
- * @param socketID The socket to connect with.
- * @return The new socket that the welcome socket returned from the connection.
- */
-static int getConnection(const int socketID)
-{
-    int newSocket = accept(socketID, NULL, NULL);
-    if (newSocket < SOCKET_ID_BOUND)
+    if (decodeCount(state, position, count))
     {
-        systemCallError(ACCEPT_NAME, errno);
         return FAILURE_STATE;
     }
-    return newSocket;
-}
-
-/**
- * @brief Handles the server procedure on a new connection request.
- * @param welcomeSocket The welcome socket of the server.
- */
-static void handleNewConnection(const int welcomeSocket)
-{
-    // Declare indicator variables for this new connection process.
-    int connectionState = SUCCESS_STATE;
-    bool availableName = true;
-    bool receivedName = false;
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        int socket = NO_DESCRIPTOR;
+        if (takeDescriptor(descriptors, descriptor, socket))
+        {
+            return FAILURE_STATE;
+        }
+        std::string nodeID;
+        if (decodeField(state, position, nodeID)
+            || decodeField(state, position, field))
+        {
+            return FAILURE_STATE;
+        }
+        openConnection(socket);
+        addInboundPeer(socket, nodeID, field);
+    }
 
-    clientName_t clientName;
+    if (decodeCount(state, position, count))
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        unsigned long index = 0;
+        if (decodeCount(state, position, index))
+        {
+            return FAILURE_STATE;
+        }
+        int memory = NO_DESCRIPTOR;
+        int doorbell = NO_DESCRIPTOR;
+        int peerDoorbell = NO_DESCRIPTOR;
+        if (index >= descriptors.size()
+            || takeDescriptor(descriptors, descriptor, memory)
+            || takeDescriptor(descriptors, descriptor, doorbell)
+            || takeDescriptor(descriptors, descriptor, peerDoorbell))
+        {
+            return FAILURE_STATE;
+        }
+        int socket = descriptors[index];
+        // The connection of the channel may have been closed while restored.
+        if (connectionKind(socket) == FREE_CONNECTION)
+        {
+            close(memory);
+            close(doorbell);
+            close(peerDoorbell);
+        }
+        else if (!socketsToChannels[socket].attach(memory, doorbell,
+                                                   peerDoorbell, true))
+        {
+            FD_SET(doorbell, &readFDs);
+        }
+    }
 
-    int connectionSocket = getConnection(welcomeSocket);
-    if (connectionSocket < SOCKET_ID_BOUND)
+    if (decodeCount(state, position, count))
     {
-        connectionState = FAILURE_STATE;
+        return FAILURE_STATE;
     }
-    else
+    for (unsigned long i = 0; i < count; ++i)
     {
-        // In our protocol, right after connection request there should be a
-        // message with the client name. We first check that this client
-        // name is available.
-        if (readData(connectionSocket, clientName) < 0)
+        clientName_t name;
+        SignalEndpoint endpoint = {"", NO_SIGNAL_SOCKET, sockaddr_storage(), 0};
+        unsigned long index = 0;
+        if (decodeField(state, position, name)
+            || decodeField(state, position, endpoint.token)
+            || decodeCount(state, position, index)
+            || decodeField(state, position, field)
+            || field.length() > sizeof(sockaddr_storage))
         {
-            connectionState = FAILURE_STATE;
+            return FAILURE_STATE;
         }
-        else
+        int clientSocket = getClientSocket(name);
+        if (!field.empty() && index < signalSockets.size())
         {
-            // Here we have successfully read the client name.
-            // Check if the name is available.
-            receivedName = true;
-            if (checkAvailableName(clientName))
-            {
-                createNewClient(clientName, connectionSocket);
-            }
-            else
+            endpoint.socket = signalSockets[index];
+            endpoint.addressLength = (socklen_t) field.length();
+            memcpy(&endpoint.address, field.data(), field.length());
+            if (clientSocket != FAILURE_STATE)
             {
-                availableName = false;
-                connectionState = FAILURE_STATE;
+                signalingClients.insert((memberID_t) clientSocket);
             }
         }
+        namesToSignals[name] = endpoint;
     }
 
-    if (connectionState)
+    if (decodeCount(state, position, count))
+    {
+        return FAILURE_STATE;
+    }
+    for (unsigned long i = 0; i < count; ++i)
     {
-        // If the new connection failed.
-        char state = (char) NULL;
-        if (!availableName)
+        int socket = NO_DESCRIPTOR;
+        if (takeDescriptor(descriptors, descriptor, socket))
         {
-            // If the failure reason is due to client name in use.
-            state = CONNECTION_IN_USE_STATE;
+            return FAILURE_STATE;
         }
-        else
+        if (decodeField(state, position, field))
         {
-            // If the failure is for any other reason.
-            state = CONNECTION_FAIL_STATE;
+            return FAILURE_STATE;
         }
-
-        // Send to this client that the connection is failed.
-        if (write(connectionSocket, &state, sizeof(char)) < 0)
+        openConnection(socket);
+        setConnectionKind(socket, REPLICA_CONNECTION);
+        replicas.push_back(socket);
+        FD_SET(socket, &readFDs);
+        if (!field.empty())
         {
-            systemCallError(WRITE_NAME, errno);
-            return;
+            socketsToOutput[socket] = field;
+            outputSockets.insert(socket);
         }
-        // There might be a failure before we even received the client name.
-        if (receivedName)
+    }
+
+    return position == state.length() ? SUCCESS_STATE : FAILURE_STATE;
+}
+
+/**
+ * @brief Writes the entire given buffer into the given blocking socket.
+ * @param socket The socket to write into.
+ * @param buffer The buffer to write.
+ * @param length The length of the buffer.
+ * @return 0 upon success, -1 on failure.
+ */
+static int writeFully(const int socket, const char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t currentCount = write(socket, buffer, length);
+        if (currentCount < 0)
         {
-            std::cout << clientName << CONNECT_FAIL_MSG_SUFFIX << std::endl;
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            systemCallError(WRITE_NAME, errno);
+            return FAILURE_STATE;
         }
-        // Close the socket stream.
-        close(connectionSocket);
+        buffer += currentCount;
+        length -= currentCount;
     }
-    else
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Reads exactly the given length from the given blocking socket.
+ * @param socket The socket to read from.
+ * @param buffer The buffer to read into.
+ * @param length The length to read.
+ * @return 0 upon success, -1 on failure.
+ */
+static int readFully(const int socket, char *buffer, size_t length)
+{
+    while (length > 0)
     {
-        assert(availableName);
-        // Send to this client that the connection is successful.
-        char state = CONNECTION_SUCCESS_STATE;
-        if (write(connectionSocket, &state, sizeof(char)) < 0)
+        ssize_t currentCount = read(socket, buffer, length);
+        if (currentCount < 0 && errno == EINTR)
         {
-            systemCallError(WRITE_NAME, errno);
-            return;
+            continue;
+        }
+        if (currentCount <= 0)
+        {
+            systemCallError(READ_NAME, currentCount < 0 ? errno : EPROTO);
+            return FAILURE_STATE;
         }
-        std::cout << clientName << CONNECT_SUCCESS_MSG_SUFFIX << std::endl;
+        buffer += currentCount;
+        length -= currentCount;
     }
+    return SUCCESS_STATE;
 }
 
+/**
+ * @brief Takes over the state of an old server which restarts into this one,
+ *        through the given Unix socket. The old server sends the length of
+ *        its state and the number of its descriptors, then the state and
+ *        then the descriptors, and this server acknowledges once it took over.
+ * @param socket The Unix socket shared with the old server.
+ * @return 0 upon success, -1 on failure.
+ */
+static int inheritServer(const int socket)
+{
+    // The server was executed through its link in /proc, which would name it.
+    const std::string &path = serverArguments.front();
+    std::string name = path.substr(path.rfind(UNIX_PATH_SEPARATOR) + 1);
+    prctl(PR_SET_NAME, name.c_str());
 
-/*-----=  Handle Clients Functions  =-----*/
+    uint64_t header[2];
+    if (readFully(socket, (char *) header, sizeof(header)))
+    {
+        return FAILURE_STATE;
+    }
+    message_t state(header[0], '\0');
+    std::vector<int> descriptors;
+    if (readFully(socket, &state[0], state.length())
+        || receiveDescriptors(socket, header[1], descriptors))
+    {
+        return FAILURE_STATE;
+    }
 
+    if (descriptors.size() != header[1] || restoreRegistry(state, descriptors))
+    {
+        std::cerr << RESTART_FAIL_MSG << std::endl;
+        return FAILURE_STATE;
+    }
+    for (int clientSocket : clients)
+    {
+        captureTakeover(clientSocket);
+    }
+
+    char acknowledge = RESTART_ACK;
+    if (writeFully(socket, &acknowledge, sizeof(char)))
+    {
+        return FAILURE_STATE;
+    }
+    close(socket);
+    return SUCCESS_STATE;
+}
 
 /**
- * @brief Handles the client exit command.
- * @param clientSocket The client who send the command.
+ * @brief Starts the new server process of a hot restart. Runs in the forked
+ *        child, where every descriptor but the standard ones and the given
+ *        socket is closed, since the descriptors are passed explicitly.
+ * @param socket The Unix socket shared with the old server.
  */
-static void handleClientExitCommand(int const clientSocket)
+static void execNewServer(const int socket)
 {
-    clientName_t clientName = socketsToNames[clientSocket];
+    for (int i = STDERR_FILENO + 1; i <= getMaxSocketID(); ++i)
+    {
+        if (i != socket)
+        {
+            close(i);
+        }
+    }
 
-    // Remove the client from the server data.
-    removeClient(clientSocket);
+    // Start the new server with the same arguments, but a new inherit socket.
+    std::vector<std::string> arguments;
+    for (size_t i = 0; i < serverArguments.size(); ++i)
+    {
+        if (serverArguments[i].compare(INHERIT_OPTION) == EQUAL_COMPARISON)
+        {
+            i++;
+            continue;
+        }
+        arguments.push_back(serverArguments[i]);
+    }
+    arguments.push_back(INHERIT_OPTION);
+    arguments.push_back(std::to_string(socket));
 
-    // Send the client response about the log out and print a message.
-    char state = LOGOUT_SUCCESS_STATE;
-    if (write(clientSocket, &state, sizeof(char)) < 0)
+    std::vector<char *> argv;
+    for (auto i = arguments.begin(); i != arguments.end(); ++i)
     {
-        systemCallError(WRITE_NAME, errno);
-        return;
+        argv.push_back(&(*i)[0]);
     }
-    std::cout << clientName << ": " << LOGOUT_SUCCESS_MSG << std::endl;
+    argv.push_back(nullptr);
+
+    // The name the server was started with is kept only as its name.
+    execv(SELF_EXECUTABLE, argv.data());
+    systemCallError(EXECV_NAME, errno);
+    _exit(EXIT_FAILURE);
 }
 
 /**
- * @brief Set the server's who response according to the current state.
- * @return The who response message.
+ * @brief Hot restarts the server. A new server process is executed from the
+ *        server binary, and this server passes it its listeners, all of its
+ *        connections and its serialized registry, so the clients are kept
+ *        connected. If the new server fails to take over, this server keeps
+ *        on running.
  */
-static message_t setWhoResponse()
+static void restartServer()
 {
-    // Set the message tag.
-    message_t whoResponse = std::to_string(WHO);
-
-    // Set a new container of all the client names.
-    std::vector<clientName_t> currentClients;
+    if (replicating())
+    {
+        // The new server could not take over the link to the primary.
+        std::cerr << REPLICA_RESTART_MSG << std::endl;
+        return;
+    }
 
-    // Add all the names of all clients in the server.
-    for (auto i = clients.begin(); i != clients.end(); ++i)
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair))
     {
-        currentClients.push_back(socketsToNames[*i]);
+        systemCallError(SOCKETPAIR_NAME, errno);
+        return;
     }
 
-    // Sort and create the who response message.
-    std::sort(currentClients.begin(), currentClients.end());
-    for (auto i = currentClients.begin(); i != currentClients.end(); ++i)
+    std::cout.flush();
+    for (int clientSocket : clients)
     {
-        whoResponse += *i;
-        whoResponse += (i == (--currentClients.end()) ? MSG_SUFFIX : GROUP_SEP);
+        captureHandoff(clientSocket);
+    }
+    // The new server appends to the capture after the records of this one.
+    capture.flush();
+    pid_t child = fork();
+    if (child < 0)
+    {
+        systemCallError(FORK_NAME, errno);
+        close(pair[0]);
+        close(pair[1]);
+        return;
+    }
+    if (child == 0)
+    {
+        close(pair[0]);
+        execNewServer(pair[1]);
+    }
+    close(pair[1]);
+
+    message_t state;
+    std::vector<int> descriptors;
+    serializeServer(state, descriptors);
+    uint64_t header[2] = {state.length(), descriptors.size()};
+
+    char acknowledge = (char) NULL;
+    pollfd response = {pair[0], POLLIN, 0};
+    if (!writeFully(pair[0], (char *) header, sizeof(header))
+        && !writeFully(pair[0], state.data(), state.length())
+        && !sendDescriptors(pair[0], descriptors)
+        && poll(&response, 1, RESTART_TIMEOUT) > 0
+        && read(pair[0], &acknowledge, sizeof(char)) == sizeof(char)
+        && acknowledge == RESTART_ACK)
+    {
+        // The new server took over, leave without touching the clients.
+        std::cout << SERVER_RESTART_MSG << std::endl;
+        exit(EXIT_SUCCESS);
     }
 
-    return whoResponse;
+    std::cerr << RESTART_FAIL_MSG << std::endl;
+    close(pair[0]);
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
 }
 
+
+/*-----=  Handle Input Functions  =-----*/
+
+
 /**
- * @brief Handles the client who command.
- * @param clientSocket The client who send the command.
+ * @brief Terminates the server once the drain is over.
  */
-static void handleClientWhoCommand(int const clientSocket)
+static void terminateServer()
 {
-    clientName_t clientName = socketsToNames[clientSocket];
-
-    // Print an informative message to the server.
-    std::cout << clientName << ": " << WHO_REQUEST_MSG << std::endl;
-
-    // Set a response for the client.
-    message_t whoResponse = setWhoResponse();
+    // Close the connections which did not receive all of their output.
+    clientsVector closing = closingConnections;
+    for (int socket : closing)
+    {
+        finishConnection(socket);
+    }
 
-    writeData(clientSocket, whoResponse);
+    std::cout << SERVER_EXIT_MSG;
+    exit(EXIT_SUCCESS);
 }
 
 /**
- * @brief Handles the client create group command.
- * @param clientSocket The client who send the command.
+ * @brief Starts the drain of the server when it is shutting down. The server
+ *        stops accepting connections and reading requests, and every client
+ *        is sent its queued output followed by the exit message. All the
+ *        clients are written concurrently without blocking, and the server
+ *        terminates when they are all written or when the drain timeout
+ *        expires, so a stuck client can not hold the shutdown.
  */
-static void handleClientGroupCommand(int const clientSocket,
-                                     const message_t &message)
+static void startDrain()
 {
-    bool successState = false;
-    clientName_t clientName = socketsToNames[clientSocket];
-    message_t modifiedMessage = message.substr(1);  // Trim the message tag.
-
-    auto trimIndex = modifiedMessage.find(WHITE_SPACE_DELIM);
-    groupName_t groupName = modifiedMessage.substr(0, trimIndex);
+    draining = true;
 
-    // Prepare the message for clients reading by removing the group name.
-    modifiedMessage = modifiedMessage.substr(trimIndex + 1);
-
-    // Check the group name is available.
-    if (checkAvailableName(groupName))
+    // Stop accepting new connections.
+    if (closeListeners())
     {
-        // If group name is valid.
-        createNewGroup(groupName);
-        // Add each client to the group.
-        if (addClientsToGroup(clientName, groupName, modifiedMessage)
-            == SUCCESS_STATE)
-        {
-            successState = true;
-        }
-        else
-        {
-            // Remove the newly created group.
-            removeGroup(groupName);
-        }
+        exit(EXIT_FAILURE);
     }
-
-    message_t groupResponse = std::to_string(CREATE_GROUP);
-    if (successState)
+    clientsVector pending = pendingConnections;
+    for (int connectionSocket : pending)
     {
-        // Set a response for the client.
-        groupResponse += "Group \"" + groupName + "\" was created successfully.";
-        // Print an informative message to the server.
-        std::cout << clientName << ": " << "Group \""
-                  << groupName << "\" was created successfully."
-                  << std::endl;
+        cancelHandshake(connectionSocket);
     }
-    else
+
+    // Write to each client that the server is terminating.
+    message_t serverExit = std::to_string(SERVER_EXIT);
+    clientsVector drained = clients;
+    for (int clientSocket : drained)
     {
-        // Set a response for the client.
-        groupResponse += "ERROR: failed to create group \"" + groupName + "\".";
-        // Print an informative message to the server.
-        std::cout << clientName << ": " << "ERROR: failed to create group \""
-                  << groupName << "\"." << std::endl;
+        queueData(clientSocket, serverExit);
+        removeClient(clientSocket);
+        lingerConnection(clientSocket);
     }
 
-    writeData(clientSocket, groupResponse);
+    if (closingConnections.empty())
+    {
+        terminateServer();
+    }
+    timingWheel.schedule(currentTimeMS(),
+                         drainTimeout * MILLISECONDS_PER_SECOND,
+                         DRAIN_TIMER_KEY);
 }
 
 /**
- * @brief Send a message from the sender to receiver.
- * @param senderName The sender client name.
- * @param receiverName The receiver client name.
- * @param message tHe message to send.
+ * @brief Prints the metrics of the connections of the server: their number by
+ *        kind, and the memory they hold in total, on average and at most, by
+ *        input, queued output and client data, and the sizes of the
+ *        registry of the clients and the groups.
  */
-static void sendMessageToClient(clientName_t const senderName,
-                                clientName_t const receiverName,
-                                message_t const &message)
+static void printMetrics()
 {
-    int receiverSocket = getClientSocket(receiverName);
-    message_t toSend = senderName + ": " + message;
-    writeData(receiverSocket, toSend);
+    size_t counts[REPLICA_CONNECTION + 1] = {0};
+    size_t totalBytes = 0;
+    size_t maxBytes = 0;
+    size_t inputBytes = 0;
+    size_t outputBytes = 0;
+    size_t clientBytes = 0;
+    for (size_t socket = 0; socket < socketsToSlots.size(); ++socket)
+    {
+        ConnectionKind kind = socketsToSlots[socket].kind;
+        if (kind == FREE_CONNECTION)
+        {
+            continue;
+        }
+        counts[kind]++;
+        size_t bytes = connectionBytes((int) socket, inputBytes, outputBytes,
+                                       clientBytes);
+        totalBytes += bytes;
+        maxBytes = std::max(maxBytes, bytes);
+    }
+
+    size_t open = counts[PENDING_CONNECTION] + counts[CLIENT_CONNECTION]
+                  + counts[CLOSING_CONNECTION] + counts[PEER_CONNECTION]
+                  + counts[REPLICA_CONNECTION];
+    std::cout << METRICS_CONNECTIONS_MSG << open << " ("
+              << counts[CLIENT_CONNECTION] << " clients, "
+              << counts[PENDING_CONNECTION] << " pending, "
+              << counts[CLOSING_CONNECTION] << " closing, "
+              << counts[PEER_CONNECTION] << " peers, "
+              << counts[REPLICA_CONNECTION] << " replicas)." << std::endl;
+    std::cout << METRICS_MEMORY_MSG << totalBytes << " bytes ("
+              << (open ? totalBytes / open : 0) << " per connection, "
+              << maxBytes << " at most), " << inputBytes << " of input, "
+              << outputBytes << " of output, " << clientBytes
+              << " of client data, " << socketsToSlots.size()
+              << " table slots." << std::endl;
+
+    // The sizes of the registry go back to the same level whenever the same
+    // clients are connected, so a growth between samples is a leak.
+    size_t members = 0;
+    for (auto i = groupsToClients.begin(); i != groupsToClients.end(); ++i)
+    {
+        members += i->second.size();
+    }
+    std::cout << METRICS_REGISTRY_MSG << namesToSockets.size() << " clients, "
+              << groups.size() << " groups, " << members << " members, "
+              << namesToGroups.size() << " memberships, "
+              << detachedSessions.size() << " detached, "
+              << sessionTokens.size() << " tokens, "
+              << sendersToMessageIDs.size() << " windows, "
+              << namesToSignals.size() << " endpoints, "
+              << remoteClients.size() << " remote, "
+              << topics.size() << " subscriptions, "
+              << timingWheel.size() << " timers." << std::endl;
 }
 
 /**
- * @brief Send a message from the sender to group.
- * @param senderName The sender client name.
- * @param groupName The group name.
- * @param message tHe message to send.
+ * @brief Writes the spans recorded by the tracer into a trace file, which may
+ *        be opened in a Chrome trace viewer.
+ * @param path The path of the trace file.
  */
-static void sendMessageToGroup(clientName_t const senderName,
-                               groupName_t const groupName,
-                               message_t const &message)
+static void writeTrace(std::string const path)
 {
-    clientsVector groupClients = groupsToClients[groupName];
-
-    for (auto i = groupClients.begin(); i != groupClients.end(); ++i)
+    std::ofstream traceFile(path);
+    tracer.dump(traceFile, (long) getpid());
+    traceFile.close();
+    if (!traceFile)
     {
-        clientName_t currentName = socketsToNames[*i];
-        if (currentName.compare(senderName) == EQUAL_COMPARISON)
-        {
-            continue;
-        }
-        sendMessageToClient(senderName, currentName, message);
+        std::cerr << TRACE_FAIL_MSG << std::endl;
+        return;
     }
+    std::cout << TRACE_WRITTEN_MSG << path << "." << std::endl;
 }
 
 /**
- * @brief Handle a send command received from the client.
- * @param clientSocket The client who send the command.
- * @param message The message contains the command data.
+ * @brief Handles the server procedure in case of receiving input from the user.
  */
-static void handleClientSendCommand(int const clientSocket,
-                                    const message_t &message)
+static void handleServerInput()
 {
-    bool successState = false;
-    clientName_t senderName = socketsToNames[clientSocket];
-    message_t modifiedMessage = message.substr(1);  // Trim the message tag.
-
-    auto trimIndex = modifiedMessage.find(WHITE_SPACE_DELIM);
-    clientName_t sendTo = modifiedMessage.substr(0, trimIndex);
-
-    // Prepare the message for clients reading by removing the group name.
-    modifiedMessage = modifiedMessage.substr(trimIndex + 1);
+    message_t currentInput;
+    if (!std::getline(std::cin, currentInput))
+    {
+        // The input was closed, the server keeps running without it.
+        FD_CLR(STDIN_FILENO, &readFDs);
+        return;
+    }
 
-    // Check the group name is available.
-    if (clientOnline(sendTo))
+    if (draining)
     {
-        // If client name to send is valid.
-        sendMessageToClient(senderName, sendTo, modifiedMessage);
-        successState = true;
+        return;
+    }
 
+    if (currentInput.compare(SERVER_EXIT_COMMAND) == EQUAL_COMPARISON)
+    {
+        // If the server received the EXIT command, it should terminate.
+        startDrain();
     }
-    else if (groupOpen(sendTo))
+    else if (currentInput.compare(SERVER_RESTART_COMMAND) == EQUAL_COMPARISON)
     {
-        // If the send request is for a valid group.
-        if (groupContainsClient(sendTo, clientSocket))
-        {
-            sendMessageToGroup(senderName, sendTo, modifiedMessage);
-            successState = true;
-        }
+        // Hand the server over to a new process of the server binary.
+        restartServer();
     }
-
-    message_t sendResponse = std::to_string(SEND);
-    if (successState)
+    else if (currentInput.compare(SERVER_METRICS_COMMAND) == EQUAL_COMPARISON)
     {
-        // Set a response for the client.
-        sendResponse += CLIENT_SEND_SUCCESS_MSG;
-        // Print an informative message to the server.
-        std::cout << senderName << ": \"" << modifiedMessage
-                  << "\" was sent successfully to " << sendTo
-                  << "." << std::endl;
+        printMetrics();
+    }
+    else if (currentInput.compare(SERVER_PROMOTE_COMMAND) == EQUAL_COMPARISON)
+    {
+        // Take over from the primary, which may still be running.
+        if (replicating())
+        {
+            promoteServer();
+        }
     }
     else
     {
-        // Set a response for the client.
-        sendResponse += CLIENT_SEND_FAIL_MSG;
-        // Print an informative message to the server.
-        std::cout << senderName << ": ERROR: failed to send \""
-                  << modifiedMessage << "\" to " << sendTo << "." << std::endl;
+        std::istringstream words(currentInput);
+        std::string command, path = DEFAULT_TRACE_FILE;
+        words >> command >> path;
+        if (command.compare(SERVER_TRACE_COMMAND) == EQUAL_COMPARISON)
+        {
+            // Write the recent spans of the server loop.
+            writeTrace(path);
+        }
     }
-
-    writeData(clientSocket, sendResponse);
 }
 
+
+/*-----=  Handle Timers Functions  =-----*/
+
+
 /**
- * @brief Process a message received in the given client socket.
- * @param clientSocket The current client socket.
- * @param message The message to process.
+ * @brief Handle the expired timer of a client. A client which was idle for
+ *        the heartbeat interval is sent a heartbeat it should answer, and a
+ *        client which was idle for the idle timeout is evicted.
+ * @param clientSocket The client socket.
+ * @param now The current time.
  */
-static void processMessage(int const clientSocket, const message_t &message)
+static void handleIdleTimer(const int clientSocket, const milliseconds_t now)
 {
-    int tagChar = message.front() - TAG_CHAR_BASE;
+    ConnectionTimer &connectionTimer = socketsToTimers[clientSocket];
+    connectionTimer.timer = NO_TIMER;
+    milliseconds_t idle = now - connectionTimer.lastActivity;
 
-    switch (tagChar)
+    if (idleTimeout != DISABLED_TIMEOUT
+        && idle >= idleTimeout * MILLISECONDS_PER_SECOND)
     {
-        case CREATE_GROUP:
-            handleClientGroupCommand(clientSocket, message);
-            return;
-
-        case SEND:
-            handleClientSendCommand(clientSocket, message);
-            return;
-
-        case WHO:
-            handleClientWhoCommand(clientSocket);
-            return;
-
-        case CLIENT_EXIT:
-            handleClientExitCommand(clientSocket);
-            return;
+        std::cout << socketsToNames[clientSocket] << IDLE_EVICT_MSG_SUFFIX
+                  << std::endl;
+        disconnectClient(clientSocket);
+        return;
+    }
 
-        default:
-            assert(false);
-            return;
+    if (heartbeatInterval != DISABLED_TIMEOUT && !connectionTimer.heartbeatSent
+        && idle >= heartbeatInterval * MILLISECONDS_PER_SECOND)
+    {
+        message_t heartbeat = std::to_string(HEARTBEAT);
+        queueData(clientSocket, heartbeat);
+        connectionTimer.heartbeatSent = true;
     }
+    scheduleIdleTimer(clientSocket, now);
 }
 
 /**
- * @brief Parse messages read from the recent read operation from the socket.
- * @param clientSocket The current client socket.
- * @param messages The read data which contain a message or several.
+ * @brief Advance the timing wheel and handle the timers that expired.
  */
-static void parseMessages(int const clientSocket, const message_t &messages)
+static void handleTimers()
 {
-    message_t currentMessage;
-    std::stringstream messageStream = std::stringstream(messages);
-    while (std::getline(messageStream, currentMessage))
+    TraceSpan span(tracer, TIMERS_SPAN, NO_TRACE_SOCKET);
+    milliseconds_t now = currentTimeMS();
+    std::vector<int> expired;
+    timingWheel.advance(now, expired);
+
+    for (int socket : expired)
     {
-        processMessage(clientSocket, currentMessage);
+        if (socket == RESUME_TIMER_KEY)
+        {
+            handleResumeTimer();
+        }
+        else if (socket == PROMOTE_TIMER_KEY)
+        {
+            listenPromoted();
+        }
+        else if (socket == DRAIN_TIMER_KEY)
+        {
+            // The drain is over even if some clients did not read all.
+            terminateServer();
+        }
+        else if (socket < DRAIN_TIMER_KEY)
+        {
+            // Reconnect the outbound link of a node.
+            int node = PEER_TIMER_KEY_BASE - socket;
+            if (connectPeer(node))
+            {
+                schedulePeerRetry(node);
+            }
+        }
+        else if (connectionClosing(socket))
+        {
+            // The connection did not read its last messages in time.
+            finishConnection(socket);
+        }
+        else if (connectionPending(socket))
+        {
+            // The connection did not send its name before the deadline.
+            cancelHandshake(socket);
+        }
+        else if (clientConnected(socket))
+        {
+            handleIdleTimer(socket, now);
+        }
     }
 }
 
+
+/*-----=  Select Functions  =-----*/
+
+
 /**
- * @brief Handle Client requests.
- * @param currentFDs The current FD set.
+ * @brief Prepare the FD sets and the timeout of the next select. Clients with
+ *        buffered messages or empty buckets are not read from, so their
+ *        pending data stays in the kernel until they are served again.
+ *        Connections with queued output are waited on for writing.
+ * @param currentFDs The FD set to prepare.
+ * @param writeFDs The write FD set to fill.
+ * @param timeout The timeout to fill.
+ * @return The timeout to select with, or nullptr to wait with no timeout.
  */
-static void handleClients(fd_set *currentFDs)
+static timeval *prepareSelect(fd_set *currentFDs, fd_set *writeFDs,
+                              timeval *timeout)
 {
+    FD_ZERO(writeFDs);
+    for (int socket : outputSockets)
+    {
+        // A shared memory channel is flushed again once its client frees
+        // space in the ring and rings the doorbell.
+        if (!socketsToChannels[socket].open())
+        {
+            FD_SET(socket, writeFDs);
+        }
+    }
+
+    timePoint_t now = std::chrono::steady_clock::now();
+    double wait = -1;
+
     for (int clientSocket : clients)
     {
-        if (FD_ISSET(clientSocket, currentFDs))
+        TokenBucket &bucket = socketsToBuckets[clientSocket];
+        refillBucket(bucket, now);
+        double delay = bucketDelay(bucket);
+
+        if (delay > 0)
         {
-            message_t clientMessage;
-            if (readData(clientSocket, clientMessage) < 0)
-            {
-                return;
-            }
-            parseMessages(clientSocket, clientMessage);
+            ignoreConnection(clientSocket, currentFDs);
         }
+        else if (clientHasMessage(clientSocket))
+        {
+            ignoreConnection(clientSocket, currentFDs);
+        }
+        else
+        {
+            continue;
+        }
+        wait = (wait < 0) ? delay : std::min(wait, delay);
+    }
+
+    // Wake up for the next tick of the timing wheel.
+    long wheelWait = timingWheel.nextTimeout(currentTimeMS());
+    if (wheelWait >= 0)
+    {
+        double delay = (double) wheelWait / MILLISECONDS_PER_SECOND;
+        wait = (wait < 0) ? delay : std::min(wait, delay);
+    }
+
+    if (wait < 0)
+    {
+        return nullptr;
     }
+    long microseconds = (long) (wait * MICROSECONDS_PER_SECOND) + 1;
+    timeout->tv_sec = microseconds / MICROSECONDS_PER_SECOND;
+    timeout->tv_usec = microseconds % MICROSECONDS_PER_SECOND;
+    return timeout;
 }
 
 
@@ -915,6 +7215,8 @@ static void handleClients(fd_set *currentFDs)
 int main(int argc, char *argv[])
 {
     resetServerData();
+    // A client that closed its connection should not terminate the server.
+    signal(SIGPIPE, SIG_IGN);
 
     // Check the server arguments.
     if (checkServerArguments(argc, argv))
@@ -923,44 +7225,107 @@ int main(int argc, char *argv[])
         return FAILURE_STATE;
     }
 
-    // Set the port number and create a welcome socket with that port.
-    portNumber_t portNum = (portNumber_t) std::stoi(argv[PORT_ARGUMENT_INDEX]);
-    int welcomeSocket = establish(portNum);
-    if (welcomeSocket < SOCKET_ID_BOUND)
+    serverArguments = std::vector<std::string>(argv, argv + argc);
+    serverPort = (portNumber_t) std::stoi(argv[PORT_ARGUMENT_INDEX]);
+    if (!capturePath.empty() && capture.open(capturePath))
     {
+        std::cerr << CAPTURE_FAIL_MSG << std::endl;
         return FAILURE_STATE;
     }
-
-    // Update the readFDs set.
     FD_SET(STDIN_FILENO, &readFDs);
-    FD_SET(welcomeSocket, &readFDs);
+
+    // All the nodes build the same ring from the same node IDs.
+    for (size_t i = LOCAL_NODE; federated() && i < nodes.size(); ++i)
+    {
+        ring.addNode(nodes[i].id, (int) i);
+    }
+
+    if (inheritSocket != NO_INHERITED_STATE)
+    {
+        // Take over the listeners and clients of the old server.
+        if (inheritServer((int) inheritSocket))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    else if (!primaryHost.empty())
+    {
+        // A replica only listens once it is promoted.
+        if (connectPrimary())
+        {
+            std::cerr << REPLICA_FAIL_MSG << std::endl;
+            return FAILURE_STATE;
+        }
+    }
+    else
+    {
+        // Create the welcome sockets with the port number.
+        if (establish(serverPort))
+        {
+            closeListeners();
+            return FAILURE_STATE;
+        }
+
+        // Update the readFDs set.
+        for (auto i = listeners.begin(); i != listeners.end(); ++i)
+        {
+            FD_SET(*i, &readFDs);
+        }
+        for (auto i = signalSockets.begin(); i != signalSockets.end(); ++i)
+        {
+            FD_SET(*i, &readFDs);
+        }
+    }
+    if (!replicating())
+    {
+        connectPeers();
+    }
+    tracer.setPeriod(traceSample);
 
     while (true)
     {
         // Create a temporary FD Set for this iteration.
         fd_set currentFDs = readFDs;
+        fd_set writeFDs;
+        timeval timeout;
+        timeval *pTimeout = prepareSelect(&currentFDs, &writeFDs, &timeout);
         // Get the max socket ID for the select function.
-        int maxSocketID = getMaxSocketID(welcomeSocket);
+        int maxSocketID = getMaxSocketID();
         // Select.
-        int readyFD = select(maxSocketID + 1, &currentFDs, NULL, NULL, NULL);
+        int readyFD = select(maxSocketID + 1, &currentFDs, &writeFDs, NULL,
+                             pTimeout);
 
         if (readyFD < 0)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             systemCallError(SELECT_NAME, errno);
             return FAILURE_STATE;
         }
+        tracer.beginRound();
+        TraceSpan round(tracer, ROUND_SPAN, NO_TRACE_SOCKET);
 
         if (FD_ISSET(STDIN_FILENO, &currentFDs))
         {
-            handleServerInput(welcomeSocket);
-        }
-        else if (FD_ISSET(welcomeSocket, &currentFDs))
-        {
-            handleNewConnection(welcomeSocket);
+            handleServerInput();
         }
-        else
+        for (auto i = listeners.begin(); i != listeners.end(); ++i)
         {
-            handleClients(&currentFDs);
+            if (FD_ISSET(*i, &currentFDs))
+            {
+                handleNewConnection(*i);
+            }
         }
+        handlePendingConnections(&currentFDs);
+        handlePeers(&currentFDs);
+        handleClients(&currentFDs);
+        handleSignals(&currentFDs);
+        handleReplication(&currentFDs);
+        handleTimers();
+        handleOutput();
+        // The frames captured in this round are written together.
+        capture.flush();
     }
 }
\ No newline at end of file
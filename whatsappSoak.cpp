@@ -0,0 +1,1086 @@
+/**
+ * @file whatsappSoak.cpp
+ * @author Itai Tagar <itagar>
+ *
+ * @brief A Soak of the WhatsApp Server, which churns clients and groups for a
+ *        long time and tracks the resources of the server.
+ */
+
+
+/*-----=  Includes  =-----*/
+
+
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <csignal>
+#include <dirent.h>
+#include <sys/wait.h>
+#include "WhatsAppSession.h"
+
+
+/*-----=  Definitions  =-----*/
+
+
+/**
+ * @def MIN_ARGUMENTS_COUNT 5
+ * @brief A Macro that sets the minimal number for valid arguments count.
+ */
+#define MIN_ARGUMENTS_COUNT 5
+
+/**
+ * @def DURATION_ARGUMENT_INDEX 1
+ * @brief A Macro that sets the index of the duration to this program.
+ */
+#define DURATION_ARGUMENT_INDEX 1
+
+/**
+ * @def GROWTH_ARGUMENT_INDEX 2
+ * @brief A Macro that sets the index of the allowed growth to this program.
+ */
+#define GROWTH_ARGUMENT_INDEX 2
+
+/**
+ * @def SERVER_ARGUMENT_INDEX 3
+ * @brief A Macro that sets the index of the server program to this program.
+ */
+#define SERVER_ARGUMENT_INDEX 3
+
+/**
+ * @def PORT_ARGUMENT_INDEX 4
+ * @brief A Macro that sets the index of the server port to this program.
+ */
+#define PORT_ARGUMENT_INDEX 4
+
+/**
+ * @def USAGE_MSG "Usage: whatsappSoak seconds growthPercent serverProgram"
+ * @brief A Macro that sets the error message when the usage is invalid.
+ */
+#define USAGE_MSG "Usage: whatsappSoak seconds growthPercent serverProgram " \
+                  "portNum [serverOption]...\n"
+
+/**
+ * @def SOAK_HOST "localhost"
+ * @brief A Macro that sets the host of the server which is soaked.
+ */
+#define SOAK_HOST "localhost"
+
+/**
+ * @def ROUND_SESSIONS 32
+ * @brief A Macro that sets the number of sessions of every round.
+ */
+#define ROUND_SESSIONS 32
+
+/**
+ * @def SESSION_PREFIX "s"
+ * @brief A Macro that sets the prefix of the client names of the sessions.
+ */
+#define SESSION_PREFIX "s"
+
+/**
+ * @def GROUP_PREFIX "g"
+ * @brief A Macro that sets the prefix of the group names of the sessions.
+ */
+#define GROUP_PREFIX "g"
+
+/**
+ * @def TOPIC_PREFIX "t"
+ * @brief A Macro that sets the prefix of the topics of the sessions.
+ */
+#define TOPIC_PREFIX "t"
+
+/**
+ * @def NAME_ROUND_DELIM "x"
+ * @brief A Macro that sets the delimiter of the round and the session index
+ *        in a name.
+ */
+#define NAME_ROUND_DELIM "x"
+
+/**
+ * @def SOAK_MSG "soak"
+ * @brief A Macro that sets the message which the sessions send.
+ */
+#define SOAK_MSG "soak"
+
+/**
+ * @def SAMPLE_INTERVAL 10
+ * @brief A Macro that sets the seconds between the samples of the server.
+ */
+#define SAMPLE_INTERVAL 10
+
+/**
+ * @def WARMUP_FRACTION 4
+ * @brief A Macro that sets the fraction of the duration which warms up the
+ *        server before its baseline is sampled.
+ */
+#define WARMUP_FRACTION 4
+
+/**
+ * @def MILLISECONDS_PER_SECOND 1000
+ * @brief A Macro that sets the number of milliseconds in a second.
+ */
+#define MILLISECONDS_PER_SECOND 1000
+
+/**
+ * @def PHASE_TIMEOUT 10000
+ * @brief A Macro that sets the milliseconds a phase of a round may take.
+ */
+#define PHASE_TIMEOUT 10000
+
+/**
+ * @def SETTLE_TIMEOUT 5000
+ * @brief A Macro that sets the milliseconds the server may take to close the
+ *        connections of a round before it is sampled.
+ */
+#define SETTLE_TIMEOUT 5000
+
+/**
+ * @def SETTLE_POLL_INTERVAL 50
+ * @brief A Macro that sets the milliseconds between the polls of a server
+ *        which did not close the connections of a round yet.
+ */
+#define SETTLE_POLL_INTERVAL 50
+
+/**
+ * @def MAX_EPOLL_EVENTS 256
+ * @brief A Macro that sets the maximal number of events of a single wait.
+ */
+#define MAX_EPOLL_EVENTS 256
+
+/**
+ * @def SERVER_OUTPUT_KEY UINT64_MAX
+ * @brief A Macro that sets the epoll key of the output of the server.
+ */
+#define SERVER_OUTPUT_KEY UINT64_MAX
+
+/**
+ * @def FULL_PERCENTAGE 100
+ * @brief A Macro that sets the percentage of the whole of a value.
+ */
+#define FULL_PERCENTAGE 100
+
+/**
+ * @def SERVER_METRICS_COMMAND "METRICS\n"
+ * @brief A Macro that sets the command which prints the server metrics.
+ */
+#define SERVER_METRICS_COMMAND "METRICS\n"
+
+/**
+ * @def SERVER_EXIT_COMMAND "EXIT\n"
+ * @brief A Macro that sets the command which exits the server.
+ */
+#define SERVER_EXIT_COMMAND "EXIT\n"
+
+/**
+ * @def METRICS_CONNECTIONS_MSG "Connections: "
+ * @brief A Macro that sets the prefix of the connection counts metrics.
+ */
+#define METRICS_CONNECTIONS_MSG "Connections: "
+
+/**
+ * @def METRICS_REGISTRY_MSG "Registry: "
+ * @brief A Macro that sets the prefix of the registry sizes metrics.
+ */
+#define METRICS_REGISTRY_MSG "Registry: "
+
+/**
+ * @def RESIDENT_SIZE_FIELD "VmRSS:"
+ * @brief A Macro that sets the field of the resident size of a process.
+ */
+#define RESIDENT_SIZE_FIELD "VmRSS:"
+
+/**
+ * @def PROC_PATH "/proc/"
+ * @brief A Macro that sets the path of the process information.
+ */
+#define PROC_PATH "/proc/"
+
+/**
+ * @def PROC_STATUS_FILE "/status"
+ * @brief A Macro that sets the file of the status of a process.
+ */
+#define PROC_STATUS_FILE "/status"
+
+/**
+ * @def PROC_DESCRIPTORS_DIR "/fd"
+ * @brief A Macro that sets the directory of the descriptors of a process.
+ */
+#define PROC_DESCRIPTORS_DIR "/fd"
+
+/**
+ * @def PIPE_NAME "pipe2"
+ * @brief A Macro that sets function name for pipe2.
+ */
+#define PIPE_NAME "pipe2"
+
+/**
+ * @def FORK_NAME "fork"
+ * @brief A Macro that sets function name for fork.
+ */
+#define FORK_NAME "fork"
+
+/**
+ * @def EXECV_NAME "execv"
+ * @brief A Macro that sets function name for execv.
+ */
+#define EXECV_NAME "execv"
+
+/**
+ * @def SERVER_FAIL_MSG "ERROR: the server did not answer."
+ * @brief A Macro that sets the error message when the server does not answer.
+ */
+#define SERVER_FAIL_MSG "ERROR: the server did not answer."
+
+/**
+ * @def ROUND_FAIL_MSG "ERROR: a round did not complete, in phase "
+ * @brief A Macro that sets the error message when a round fails.
+ */
+#define ROUND_FAIL_MSG "ERROR: a round did not complete, in phase "
+
+/**
+ * @def SETTLE_FAIL_MSG "ERROR: the server did not close the connections."
+ * @brief A Macro that sets the error message when the connections of a round
+ *        are left open.
+ */
+#define SETTLE_FAIL_MSG "ERROR: the server did not close the connections."
+
+/**
+ * @def GROWTH_FAIL_MSG "ERROR: the server grew beyond the baseline: "
+ * @brief A Macro that sets the error message when a resource leaks.
+ */
+#define GROWTH_FAIL_MSG "ERROR: the server grew beyond the baseline: "
+
+
+/*-----=  Type Definitions  =-----*/
+
+
+/**
+ * @brief Type Definition for a pointer to a session.
+ */
+typedef std::unique_ptr<WhatsAppSession> sessionPointer;
+
+/**
+ * @brief Type Definition for the sizes of the registry of the server, by
+ *        their names.
+ */
+typedef std::vector<std::pair<std::string, size_t>> registrySizes;
+
+/**
+ * @brief A sample of the resources of the server.
+ */
+struct ServerSample
+{
+    size_t residentSize;
+    size_t descriptors;
+    size_t connections;
+    registrySizes registry;
+};
+
+
+/*-----=  Soak Data  =-----*/
+
+
+/**
+ * @brief The sessions of the current round.
+ */
+std::vector<sessionPointer> sessions;
+
+/**
+ * @brief The epoll instance of the soak.
+ */
+int epollFD = FAILURE_STATE;
+
+/**
+ * @brief The process of the server.
+ */
+pid_t serverPID = FAILURE_STATE;
+
+/**
+ * @brief The descriptor of the input of the server.
+ */
+int serverInput = FAILURE_STATE;
+
+/**
+ * @brief The descriptor of the output of the server.
+ */
+int serverOutput = FAILURE_STATE;
+
+/**
+ * @brief The partial line of the output of the server.
+ */
+message_t serverLine = EMPTY_MSG;
+
+/**
+ * @brief Whether the server closed its output.
+ */
+bool serverExited = false;
+
+/**
+ * @brief The sample which is filled from the metrics of the server.
+ */
+ServerSample currentSample;
+
+/**
+ * @brief Whether the metrics of the current sample were printed.
+ */
+bool sampleReady = false;
+
+/**
+ * @brief The number of events of the current phase of a round (handshakes,
+ *        responses or closed sessions).
+ */
+size_t phaseEvents = 0;
+
+/**
+ * @brief The number of handshakes of the current round which failed.
+ */
+size_t failedHandshakes = 0;
+
+/**
+ * @brief The number of messages the sessions received.
+ */
+size_t receivedMessages = 0;
+
+
+/*-----=  Server Functions  =-----*/
+
+
+/**
+ * @brief Gets the current time.
+ * @return The current time in milliseconds of the monotonic clock.
+ */
+static uint64_t now()
+{
+    auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint64_t) std::chrono::duration_cast<
+            std::chrono::milliseconds>(elapsed).count();
+}
+
+/**
+ * @brief Parses a non negative number argument.
+ * @param argument The argument.
+ * @param number The number to fill.
+ * @return 0 if the argument is valid, -1 otherwise.
+ */
+static int parseNumber(std::string const argument, unsigned long &number)
+{
+    std::istringstream value(argument);
+    value >> number;
+    if (argument.empty() || !isdigit(argument.front()) || !value
+        || !value.eof())
+    {
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Starts the server, with its input and output on pipes of the soak.
+ * @param argv The program of the server and its arguments.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int startServer(char *argv[])
+{
+    int inputPipe[2];
+    int outputPipe[2];
+    if (pipe2(inputPipe, O_CLOEXEC) || pipe2(outputPipe, O_CLOEXEC))
+    {
+        systemCallError(PIPE_NAME, errno);
+        return FAILURE_STATE;
+    }
+    serverPID = fork();
+    if (serverPID < 0)
+    {
+        systemCallError(FORK_NAME, errno);
+        return FAILURE_STATE;
+    }
+    if (serverPID == 0)
+    {
+        dup2(inputPipe[0], STDIN_FILENO);
+        dup2(outputPipe[1], STDOUT_FILENO);
+        execv(argv[0], argv);
+        systemCallError(EXECV_NAME, errno);
+        _exit(EXIT_FAILURE);
+    }
+    close(inputPipe[0]);
+    close(outputPipe[1]);
+    serverInput = inputPipe[1];
+    serverOutput = outputPipe[0];
+    if (setNonBlocking(serverOutput))
+    {
+        return FAILURE_STATE;
+    }
+
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN;
+    event.data.u64 = SERVER_OUTPUT_KEY;
+    if (epoll_ctl(epollFD, EPOLL_CTL_ADD, serverOutput, &event))
+    {
+        systemCallError(EPOLL_CTL_NAME, errno);
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Parses the sizes of the registry of the server, as in
+ *        "3 clients, 1 groups, 2 members.".
+ * @param sizes The sizes.
+ * @return The sizes by their names.
+ */
+static registrySizes parseRegistry(const message_t &sizes)
+{
+    registrySizes registry;
+    std::istringstream fields(sizes);
+    size_t size;
+    std::string name;
+    while (fields >> size >> name)
+    {
+        name.pop_back();
+        registry.emplace_back(name, size);
+    }
+    return registry;
+}
+
+/**
+ * @brief Handles a line of the output of the server. Only the metrics are
+ *        kept, and the sizes of the registry end them.
+ * @param line The line.
+ */
+static void handleServerLine(const message_t &line)
+{
+    if (!line.compare(MSG_BEGIN_INDEX, strlen(METRICS_CONNECTIONS_MSG),
+                      METRICS_CONNECTIONS_MSG))
+    {
+        std::istringstream count(line.substr(strlen(METRICS_CONNECTIONS_MSG)));
+        count >> currentSample.connections;
+    }
+    else if (!line.compare(MSG_BEGIN_INDEX, strlen(METRICS_REGISTRY_MSG),
+                           METRICS_REGISTRY_MSG))
+    {
+        currentSample.registry = parseRegistry(
+                line.substr(strlen(METRICS_REGISTRY_MSG)));
+        sampleReady = true;
+    }
+}
+
+/**
+ * @brief Reads the output of the server, which must be read all the time
+ *        since the server blocks on a full pipe.
+ */
+static void readServerOutput()
+{
+    char chunk[READ_CHUNK];
+    ssize_t count;
+    while ((count = read(serverOutput, chunk, READ_CHUNK)) > 0)
+    {
+        serverLine.append(chunk, (size_t) count);
+    }
+    if (count == 0 || (count < 0 && !wouldBlock()))
+    {
+        serverExited = true;
+        epoll_ctl(epollFD, EPOLL_CTL_DEL, serverOutput, nullptr);
+    }
+
+    size_t position = MSG_BEGIN_INDEX;
+    auto lineEnd = serverLine.find(MSG_TERMINATOR);
+    while (lineEnd != std::string::npos)
+    {
+        handleServerLine(serverLine.substr(position, lineEnd - position));
+        position = lineEnd + 1;
+        lineEnd = serverLine.find(MSG_TERMINATOR, position);
+    }
+    serverLine.erase(MSG_BEGIN_INDEX, position);
+}
+
+/**
+ * @brief Writes a command to the input of the server.
+ * @param command The command, with its terminator.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int commandServer(const char *command)
+{
+    size_t length = strlen(command);
+    if (write(serverInput, command, length) != (ssize_t) length)
+    {
+        systemCallError(WRITE_NAME, errno);
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+
+/*-----=  Event Loop Functions  =-----*/
+
+
+/**
+ * @brief Watch the descriptor of a session in the epoll set. The session
+ *        index is the key of its events.
+ * @param index The index of the session.
+ * @param socketID The descriptor of the session.
+ * @param writing Whether the session waits to write.
+ */
+static void watchSession(const size_t index, const int socketID,
+                         const bool writing)
+{
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+    event.data.u64 = index;
+    if (epoll_ctl(epollFD, EPOLL_CTL_MOD, socketID, &event)
+        && (errno != ENOENT
+            || epoll_ctl(epollFD, EPOLL_CTL_ADD, socketID, &event)))
+    {
+        systemCallError(EPOLL_CTL_NAME, errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Waits for the events of the sessions and of the server once, and
+ *        handles them.
+ * @param timeout The maximal time to wait in milliseconds.
+ */
+static void handleEvents(const int timeout)
+{
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int readyCount = epoll_wait(epollFD, events, MAX_EPOLL_EVENTS, timeout);
+    if (readyCount < 0 && errno != EINTR)
+    {
+        systemCallError(EPOLL_WAIT_NAME, errno);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < readyCount; ++i)
+    {
+        uint64_t key = events[i].data.u64;
+        if (key == SERVER_OUTPUT_KEY)
+        {
+            readServerOutput();
+            continue;
+        }
+        uint32_t ready = events[i].events;
+        if (key < sessions.size() && sessions[key])
+        {
+            sessions[key]->handleEvents(ready & (EPOLLIN | EPOLLHUP | EPOLLERR),
+                                        ready & EPOLLOUT);
+        }
+    }
+}
+
+/**
+ * @brief Runs the event loop until the given number of events of the current
+ *        phase have happened.
+ * @param expected The number of events.
+ * @param timeout The maximal time to wait in milliseconds.
+ * @return 0 upon success, -1 if the time passed or the server exited.
+ */
+static int waitForEvents(const size_t expected, const uint64_t timeout)
+{
+    uint64_t deadline = now() + timeout;
+    while (phaseEvents < expected)
+    {
+        uint64_t current = now();
+        if (current >= deadline || serverExited)
+        {
+            return FAILURE_STATE;
+        }
+        handleEvents((int) (deadline - current));
+    }
+    phaseEvents = 0;
+    return SUCCESS_STATE;
+}
+
+
+/*-----=  Sample Functions  =-----*/
+
+
+/**
+ * @brief Gets the resident size of the server.
+ * @return The resident size in kB, 0 if it is not known.
+ */
+static size_t residentSize()
+{
+    std::ifstream status(PROC_PATH + std::to_string(serverPID)
+                         + PROC_STATUS_FILE);
+    std::string field;
+    while (status >> field)
+    {
+        if (field.compare(RESIDENT_SIZE_FIELD) == EQUAL_COMPARISON)
+        {
+            size_t size = 0;
+            status >> size;
+            return size;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Gets the number of the open descriptors of the server.
+ * @return The number of descriptors.
+ */
+static size_t openDescriptors()
+{
+    std::string path = PROC_PATH + std::to_string(serverPID)
+                       + PROC_DESCRIPTORS_DIR;
+    DIR *directory = opendir(path.c_str());
+    if (directory == nullptr)
+    {
+        return 0;
+    }
+    size_t count = 0;
+    dirent *entry;
+    while ((entry = readdir(directory)) != nullptr)
+    {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(directory);
+    return count;
+}
+
+/**
+ * @brief Samples the server once it closed all the connections of the last
+ *        round, so every sample is taken in the same state.
+ * @param sample The sample to fill.
+ * @return 0 upon success, -1 if the server did not answer or did not close
+ *         the connections.
+ */
+static int sampleServer(ServerSample &sample)
+{
+    uint64_t deadline = now() + SETTLE_TIMEOUT;
+    while (true)
+    {
+        sampleReady = false;
+        if (commandServer(SERVER_METRICS_COMMAND))
+        {
+            return FAILURE_STATE;
+        }
+        while (!sampleReady)
+        {
+            uint64_t current = now();
+            if (current >= deadline || serverExited)
+            {
+                std::cout << SERVER_FAIL_MSG << std::endl;
+                return FAILURE_STATE;
+            }
+            handleEvents((int) (deadline - current));
+        }
+        if (currentSample.connections == 0)
+        {
+            break;
+        }
+        if (now() >= deadline)
+        {
+            std::cout << SETTLE_FAIL_MSG << std::endl;
+            return FAILURE_STATE;
+        }
+        handleEvents(SETTLE_POLL_INTERVAL);
+    }
+    sample = currentSample;
+    sample.residentSize = residentSize();
+    sample.descriptors = openDescriptors();
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Prints a sample.
+ * @param elapsed The seconds since the soak started.
+ * @param rounds The number of the rounds so far.
+ * @param sample The sample.
+ */
+static void printSample(const uint64_t elapsed, const size_t rounds,
+                        const ServerSample &sample)
+{
+    std::cout << "[" << elapsed << "s] " << rounds << " rounds: "
+              << sample.residentSize << " kB resident, " << sample.descriptors
+              << " descriptors";
+    for (auto i = sample.registry.begin(); i != sample.registry.end(); ++i)
+    {
+        std::cout << ", " << i->second << " " << i->first;
+    }
+    std::cout << "." << std::endl;
+}
+
+/**
+ * @brief Checks a resource of a sample against its baseline.
+ * @param name The name of the resource.
+ * @param value The value of the sample.
+ * @param limit The limit of the value.
+ * @return 0 if the value is in the limit, -1 otherwise.
+ */
+static int checkGrowth(const std::string &name, const size_t value,
+                       const size_t limit)
+{
+    if (value <= limit)
+    {
+        return SUCCESS_STATE;
+    }
+    std::cout << GROWTH_FAIL_MSG << name << " is " << value << ", above "
+              << limit << "." << std::endl;
+    return FAILURE_STATE;
+}
+
+/**
+ * @brief Checks a sample against the baseline. The resident size and the
+ *        sizes of the registry may grow by the given percentage, and the
+ *        registry by one round of sessions, whose detached sessions may have
+ *        expired or not by the time of a sample. The descriptors may not grow
+ *        at all, since every sample is taken once the connections are closed.
+ * @param sample The sample.
+ * @param baseline The baseline.
+ * @param growth The allowed growth in percents.
+ * @return 0 if the sample is in the limits, -1 otherwise.
+ */
+static int checkSample(const ServerSample &sample,
+                       const ServerSample &baseline, const unsigned long growth)
+{
+    int result = checkGrowth("resident size", sample.residentSize,
+                             baseline.residentSize * (FULL_PERCENTAGE + growth)
+                             / FULL_PERCENTAGE);
+    result |= checkGrowth("descriptors", sample.descriptors,
+                          baseline.descriptors);
+    for (size_t i = 0; i < sample.registry.size()
+                       && i < baseline.registry.size(); ++i)
+    {
+        size_t base = baseline.registry[i].second;
+        result |= checkGrowth(sample.registry[i].first,
+                              sample.registry[i].second,
+                              base * (FULL_PERCENTAGE + growth)
+                              / FULL_PERCENTAGE + ROUND_SESSIONS);
+    }
+    return result;
+}
+
+
+/*-----=  Round Functions  =-----*/
+
+
+/**
+ * @brief Gets a name of a round.
+ * @param prefix The prefix of the name.
+ * @param round The round.
+ * @param index The index of the session.
+ * @return The name.
+ */
+static std::string roundName(const char *prefix, const size_t round,
+                             const size_t index)
+{
+    return prefix + std::to_string(round) + NAME_ROUND_DELIM
+           + std::to_string(index % ROUND_SESSIONS);
+}
+
+/**
+ * @brief Counts an event of the current phase.
+ */
+static void countEvent()
+{
+    phaseEvents++;
+}
+
+/**
+ * @brief Opens the sessions of a round, under names which were never used
+ *        before, so a name which the server did not forget is never reused.
+ * @param round The round.
+ * @param portNumber The port number of the server.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int openSessions(const size_t round, const portNumber_t portNumber)
+{
+    failedHandshakes = 0;
+    for (size_t i = 0; i < ROUND_SESSIONS; ++i)
+    {
+        sessions.emplace_back(new WhatsAppSession(
+                roundName(SESSION_PREFIX, round, i)));
+        WhatsAppSession *newSession = sessions.back().get();
+        newSession->subscribe([](const message_t &)
+        {
+            receivedMessages++;
+        });
+        newSession->onInterest([i](const int socketID, const bool writing)
+        {
+            watchSession(i, socketID, writing);
+        });
+        if (newSession->connect(SOAK_HOST, portNumber,
+                                [](const char connectionState)
+        {
+            failedHandshakes += connectionState != CONNECTION_SUCCESS_STATE;
+            countEvent();
+        }))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    if (waitForEvents(ROUND_SESSIONS, PHASE_TIMEOUT) || failedHandshakes)
+    {
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Creates a group for every session of a round, with the next session
+ *        of the round, and subscribes every session to all the subtopics of
+ *        its own topic. Every session then sends a message to its group and
+ *        to the next session, and publishes one to the topic of the next
+ *        session.
+ * @param round The round.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int sendMessages(const size_t round)
+{
+    for (size_t i = 0; i < ROUND_SESSIONS; ++i)
+    {
+        auto onResponse = [](const message_t &)
+        {
+            countEvent();
+        };
+        if (sessions[i]->createGroup(roundName(GROUP_PREFIX, round, i),
+                                     {roundName(SESSION_PREFIX, round, i + 1)},
+                                     onResponse)
+            || sessions[i]->subscribeTopic(roundName(TOPIC_PREFIX, round, i)
+                                           + TOPIC_SEP + TOPIC_MULTI_WILDCARD,
+                                           onResponse))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    if (waitForEvents(2 * ROUND_SESSIONS, PHASE_TIMEOUT))
+    {
+        return FAILURE_STATE;
+    }
+
+    for (size_t i = 0; i < ROUND_SESSIONS; ++i)
+    {
+        auto onResponse = [](const message_t &)
+        {
+            countEvent();
+        };
+        if (sessions[i]->send(roundName(GROUP_PREFIX, round, i), SOAK_MSG,
+                              onResponse)
+            || sessions[i]->send(roundName(SESSION_PREFIX, round, i + 1),
+                                 SOAK_MSG, onResponse)
+            || sessions[i]->publish(roundName(TOPIC_PREFIX, round, i + 1)
+                                    + TOPIC_SEP + SOAK_MSG, SOAK_MSG,
+                                    onResponse))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    return waitForEvents(3 * ROUND_SESSIONS, PHASE_TIMEOUT);
+}
+
+/**
+ * @brief Closes the sessions of a round. Every odd session leaves its own
+ *        group and unsubscribes from its topic, so half of the groups are
+ *        removed by a leave and the rest with their last member, and half of
+ *        the subscriptions are dropped with their connection. Every even
+ *        session then logs out, and every odd session drops its connection,
+ *        which the server keeps for the resume grace period.
+ * @param round The round.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int closeSessions(const size_t round)
+{
+    for (size_t i = 1; i < ROUND_SESSIONS; i += 2)
+    {
+        auto onResponse = [](const message_t &)
+        {
+            countEvent();
+        };
+        if (sessions[i]->leaveGroup(roundName(GROUP_PREFIX, round, i),
+                                    onResponse)
+            || sessions[i]->unsubscribeTopic(roundName(TOPIC_PREFIX, round, i)
+                                             + TOPIC_SEP
+                                             + TOPIC_MULTI_WILDCARD,
+                                             onResponse))
+        {
+            return FAILURE_STATE;
+        }
+    }
+    if (waitForEvents(ROUND_SESSIONS, PHASE_TIMEOUT))
+    {
+        return FAILURE_STATE;
+    }
+
+    for (size_t i = 0; i < ROUND_SESSIONS; i += 2)
+    {
+        sessions[i]->onClose([](const CloseReason)
+        {
+            countEvent();
+        });
+        if (sessions[i]->logout())
+        {
+            return FAILURE_STATE;
+        }
+        sessions[i + 1].reset();
+    }
+    if (waitForEvents(ROUND_SESSIONS / 2, PHASE_TIMEOUT))
+    {
+        return FAILURE_STATE;
+    }
+    sessions.clear();
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief Runs a single round of the soak.
+ * @param round The round.
+ * @param portNumber The port number of the server.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int runRound(const size_t round, const portNumber_t portNumber)
+{
+    const char *phase = nullptr;
+    if (openSessions(round, portNumber))
+    {
+        phase = "connect";
+    }
+    else if (sendMessages(round))
+    {
+        phase = "send";
+    }
+    else if (closeSessions(round))
+    {
+        phase = "close";
+    }
+    if (phase != nullptr)
+    {
+        std::cout << ROUND_FAIL_MSG << phase << "." << std::endl;
+        return FAILURE_STATE;
+    }
+    return SUCCESS_STATE;
+}
+
+
+/*-----=  Main  =-----*/
+
+
+/**
+ * @brief Runs the soak after the server started, until the duration passed
+ *        or the server leaked. The baseline is the first sample after a
+ *        warmup of a fraction of the duration (one sample interval at least),
+ *        once the allocator, the tables and the maps of the server have grown
+ *        to the size of the load, and the sessions which were detached at the
+ *        start have expired. The warmup should thus be longer than the resume
+ *        grace period of the server.
+ * @param duration The duration of the soak in seconds.
+ * @param growth The allowed growth in percents.
+ * @param portNumber The port number of the server.
+ * @return 0 upon success, -1 otherwise.
+ */
+static int runSoak(const unsigned long duration, const unsigned long growth,
+                   const portNumber_t portNumber)
+{
+    ServerSample baseline;
+    ServerSample sample;
+    if (sampleServer(sample))
+    {
+        return FAILURE_STATE;
+    }
+    printSample(0, 0, sample);
+
+    uint64_t start = now();
+    uint64_t end = start + duration * MILLISECONDS_PER_SECOND;
+    uint64_t nextSample = start + SAMPLE_INTERVAL * MILLISECONDS_PER_SECOND;
+    uint64_t warmupEnd = start + std::max(duration / WARMUP_FRACTION,
+                                          (unsigned long) SAMPLE_INTERVAL)
+                                 * MILLISECONDS_PER_SECOND;
+    bool sampled = false;
+    size_t round = 0;
+    while (true)
+    {
+        if (runRound(round++, portNumber))
+        {
+            return FAILURE_STATE;
+        }
+        uint64_t current = now();
+        if (current < nextSample && current < end)
+        {
+            continue;
+        }
+        if (sampleServer(sample))
+        {
+            return FAILURE_STATE;
+        }
+        printSample((current - start) / MILLISECONDS_PER_SECOND, round,
+                    sample);
+        if (!sampled && current >= warmupEnd)
+        {
+            baseline = sample;
+            sampled = true;
+        }
+        else if (sampled && checkSample(sample, baseline, growth))
+        {
+            return FAILURE_STATE;
+        }
+        if (current >= end)
+        {
+            break;
+        }
+        nextSample = current + SAMPLE_INTERVAL * MILLISECONDS_PER_SECOND;
+    }
+    std::cout << "Soaked " << round << " rounds of " << ROUND_SESSIONS
+              << " sessions, " << receivedMessages << " messages received."
+              << std::endl;
+    return SUCCESS_STATE;
+}
+
+/**
+ * @brief The main function that runs the soak. The server is started by the
+ *        soak with the given arguments, and every round connects a new set of
+ *        sessions, creates groups, sends messages, and removes them all again.
+ *        The resident size and the descriptors of the server are sampled from
+ *        /proc, and the sizes of its registry from its metrics. The soak fails
+ *        if any of them grows beyond the baseline by more than the allowed
+ *        growth, and the server exits at the end.
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @return 0 upon success, -1 otherwise.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned long duration = 0;
+    unsigned long growth = 0;
+    if (argc < MIN_ARGUMENTS_COUNT
+        || parseNumber(argv[DURATION_ARGUMENT_INDEX], duration)
+        || parseNumber(argv[GROWTH_ARGUMENT_INDEX], growth)
+        || validatePortNumber(argv[PORT_ARGUMENT_INDEX]))
+    {
+        std::cout << USAGE_MSG;
+        return FAILURE_STATE;
+    }
+    portNumber_t portNumber = (portNumber_t) std::stoi(
+            argv[PORT_ARGUMENT_INDEX]);
+
+    signal(SIGPIPE, SIG_IGN);
+    epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFD < SOCKET_ID_BOUND)
+    {
+        systemCallError(EPOLL_CREATE_NAME, errno);
+        return FAILURE_STATE;
+    }
+    if (startServer(&argv[SERVER_ARGUMENT_INDEX]))
+    {
+        return FAILURE_STATE;
+    }
+
+    int result = runSoak(duration, growth, portNumber);
+    sessions.clear();
+    commandServer(SERVER_EXIT_COMMAND);
+    close(serverInput);
+    uint64_t deadline = now() + SETTLE_TIMEOUT;
+    while (!serverExited && now() < deadline)
+    {
+        handleEvents(SETTLE_POLL_INTERVAL);
+    }
+    if (!serverExited)
+    {
+        kill(serverPID, SIGKILL);
+    }
+    int status;
+    waitpid(serverPID, &status, 0);
+    close(serverOutput);
+    close(epollFD);
+    return result;
+}